@@ -1199,3 +1199,124 @@ CREATE AGGREGATE count_distinct(anyelement) (
 CREATE FUNCTION gamma_vec_bool_expr_and(VARIADIC vbool[]) RETURNS vbool AS '$libdir/gammadb' LANGUAGE C IMMUTABLE STRICT;
 CREATE FUNCTION gamma_vec_bool_expr_or(VARIADIC vbool[]) RETURNS vbool AS '$libdir/gammadb' LANGUAGE C IMMUTABLE STRICT;
 CREATE FUNCTION gamma_vec_bool_expr_not(vbool) RETURNS vbool AS '$libdir/gammadb' LANGUAGE C IMMUTABLE STRICT;
+
+-- Load column vectors of a gamma table into gamma buffer
+CREATE FUNCTION gamma_prewarm(rel regclass, columns text[] DEFAULT NULL)
+RETURNS bigint
+AS '$libdir/gammadb'
+LANGUAGE C;
+
+-- Dump the list of column vectors in gamma buffer for autoprewarm
+CREATE FUNCTION gamma_prewarm_dump_now()
+RETURNS bigint
+AS '$libdir/gammadb'
+LANGUAGE C STRICT;
+
+REVOKE EXECUTE ON FUNCTION gamma_prewarm_dump_now() FROM PUBLIC;
+
+-- Observability of gamma buffer
+CREATE FUNCTION gamma_buffer_contents(
+	OUT dbid oid, OUT relid oid, OUT rgid oid, OUT attno int2,
+	OUT dim int8, OUT values_bytes int8, OUT nulls_bytes int8, OUT bytes int8,
+	OUT compressed bool)
+RETURNS SETOF record
+AS '$libdir/gammadb'
+LANGUAGE C;
+
+CREATE FUNCTION gamma_buffer_stats(
+	OUT dbid oid, OUT relid oid, OUT attno int2,
+	OUT hits int8, OUT misses int8, OUT inserts int8, OUT evictions int8,
+	OUT insert_bytes int8, OUT evict_bytes int8)
+RETURNS SETOF record
+AS '$libdir/gammadb'
+LANGUAGE C;
+
+CREATE FUNCTION gamma_buffer_stats_reset()
+RETURNS void
+AS '$libdir/gammadb'
+LANGUAGE C;
+
+CREATE VIEW pg_stat_gammadb_buffer AS
+	SELECT s.relid,
+		   n.nspname AS schemaname,
+		   c.relname,
+		   s.attno,
+		   a.attname,
+		   s.hits,
+		   s.misses,
+		   s.inserts,
+		   s.evictions,
+		   s.insert_bytes,
+		   s.evict_bytes,
+		   coalesce(b.cached_cvs, 0) AS cached_cvs,
+		   coalesce(b.cached_bytes, 0) AS cached_bytes,
+		   coalesce(b.compressed_bytes, 0) AS compressed_bytes
+	FROM gamma_buffer_stats() s
+		LEFT JOIN pg_class c ON c.oid = s.relid
+		LEFT JOIN pg_namespace n ON n.oid = c.relnamespace
+		LEFT JOIN pg_attribute a ON a.attrelid = s.relid AND a.attnum = s.attno
+		LEFT JOIN (SELECT relid, attno, count(*) AS cached_cvs,
+						  sum(bytes) AS cached_bytes,
+						  sum(bytes) FILTER (WHERE compressed) AS compressed_bytes
+				   FROM gamma_buffer_contents()
+				   WHERE dbid = (SELECT oid FROM pg_database
+								 WHERE datname = current_database())
+				   GROUP BY relid, attno) b
+			ON b.relid = s.relid AND b.attno = s.attno
+	WHERE s.dbid = (SELECT oid FROM pg_database
+					WHERE datname = current_database());
+
+REVOKE ALL ON FUNCTION gamma_buffer_contents() FROM PUBLIC;
+REVOKE ALL ON FUNCTION gamma_buffer_stats() FROM PUBLIC;
+REVOKE ALL ON FUNCTION gamma_buffer_stats_reset() FROM PUBLIC;
+REVOKE ALL ON pg_stat_gammadb_buffer FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION gamma_buffer_contents() TO pg_monitor;
+GRANT EXECUTE ON FUNCTION gamma_buffer_stats() TO pg_monitor;
+GRANT SELECT ON pg_stat_gammadb_buffer TO pg_monitor;
+
+-- Observability of the background merge of delta tables
+CREATE FUNCTION gamma_merge_status(
+	OUT dbid oid, OUT relid oid, OUT live_rows int8, OUT ins_rows int8,
+	OUT merged_ins_rows int8, OUT rowgroups int8, OUT merges int8, OUT throttled int8, OUT skipped int8,
+	OUT last_check timestamptz, OUT last_merge timestamptz)
+RETURNS SETOF record
+AS '$libdir/gammadb'
+LANGUAGE C STRICT;
+
+CREATE VIEW pg_stat_gammadb_merge AS
+	SELECT s.relid,
+		   n.nspname AS schemaname,
+		   c.relname,
+		   s.live_rows AS delta_rows,
+		   greatest(s.ins_rows - s.merged_ins_rows, 0) AS pending_rows,
+		   s.rowgroups AS merged_rowgroups,
+		   s.merges,
+		   s.throttled,
+		   s.skipped,
+		   s.last_check,
+		   s.last_merge
+	FROM gamma_merge_status() s
+		LEFT JOIN pg_class c ON c.oid = s.relid
+		LEFT JOIN pg_namespace n ON n.oid = c.relnamespace
+	WHERE s.dbid = (SELECT oid FROM pg_database
+					WHERE datname = current_database());
+
+REVOKE ALL ON FUNCTION gamma_merge_status() FROM PUBLIC;
+REVOKE ALL ON pg_stat_gammadb_merge FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION gamma_merge_status() TO pg_monitor;
+GRANT SELECT ON pg_stat_gammadb_merge TO pg_monitor;
+
+-- Merge the delta table of a gamma table in the current transaction
+CREATE FUNCTION gamma_merge_delta(rel regclass, max_rowgroups int4 DEFAULT 0)
+RETURNS int4
+AS '$libdir/gammadb'
+LANGUAGE C STRICT;
+
+-- Column statistics merged from the row groups of a gamma table
+CREATE FUNCTION gamma_column_stats(rel regclass,
+	OUT attnum int2, OUT rowgroups int8, OUT complete bool,
+	OUT rows int8, OUT nulls int8, OUT n_distinct float8,
+	OUT min text, OUT max text)
+RETURNS SETOF record
+AS '$libdir/gammadb'
+LANGUAGE C STRICT;
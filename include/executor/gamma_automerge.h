@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2024 Gamma Data, Inc. <jackey@gammadb.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GAMMA_AUTOMERGE_H
+#define GAMMA_AUTOMERGE_H
+
+#include "postgres.h"
+
+extern bool gammadb_automerge;
+extern int gammadb_automerge_naptime;
+extern int gammadb_automerge_min_rows;
+extern int gammadb_automerge_max_rowgroups;
+extern int gammadb_automerge_busy_backends;
+extern int gammadb_automerge_delay;
+
+extern void gamma_automerge_register_worker(void);
+extern bool gamma_automerge_running(void);
+
+extern PGDLLEXPORT void gamma_automerge_main(Datum main_arg);
+extern PGDLLEXPORT void gamma_automerge_worker_main(Datum main_arg);
+
+#endif /* GAMMA_AUTOMERGE_H */
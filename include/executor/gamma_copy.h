@@ -22,25 +22,54 @@
 #include "storage/gamma_cv.h"
 
 extern bool gammadb_copy_to_cvtable;
+extern int gammadb_copy_parallel_workers;
+extern int gammadb_insert_rowgroup_threshold;
+
+/* the max #workers of parallel COPY */
+#define GAMMA_COPY_MAX_WORKERS		8
+
+/* the rows of a row group being collected */
+typedef struct CopyRowGroup
+{
+	uint32 rgid;
+	int32 rows;
+	MemoryContext context;		/* keeps the copied tuples */
+	HeapTupleData *pin_tuples;	/* GAMMA_COLUMN_VECTOR_SIZE */
+} CopyRowGroup;
+
+struct GammaCopyPool;
 
 typedef struct CopyCollectorState
 {
 	Relation rel;
-	int32 rows;
 	MemoryContext context;
 	CommandId cid;
 	int options;
-	uint32 rgid;
 
 	/* to be a mark for one COPY command */
 	BulkInsertStateData *bi;
-	HeapTupleData pin_tuples[GAMMA_COLUMN_VECTOR_SIZE];
+	SubTransactionId subid;
+	bool enabled;				/* see gamma_copy_bulk_enabled */
+
+	/*
+	 * The full row groups are handed to the worker pool of parallel COPY,
+	 * which is started at the first full one, the leader keeps collecting
+	 * the next one meanwhile.
+	 */
+	int nworkers;
+	struct GammaCopyPool *pool;
+	CopyRowGroup rg;
 }
 CopyCollectorState;
 
 extern void gamma_copy_finish_collect(Relation rel, int options);
-extern void gamma_copy_collect_and_merge(Relation rel, TupleTableSlot ** slots,
+extern bool gamma_copy_collect_and_merge(Relation rel, TupleTableSlot ** slots,
 		int ntuples, CommandId cid, int options,
 		struct BulkInsertStateData * bistate);
+extern bool gamma_copy_insert_collect(Relation rel, TupleTableSlot *slot,
+									  CommandId cid, int options);
+extern void gamma_copy_note_rewrite(Relation rel);
+extern void gamma_copy_init(void);
+extern PGDLLEXPORT void gamma_copy_worker_main(Datum main_arg);
 
 #endif /* GAMMA_COPY_H */
@@ -24,4 +24,6 @@ extern const CustomPathMethods* gamma_indexscan_methods(void);
 extern void gamma_indexscan_init(void);
 extern bool gamma_is_indexscan_customscan(CustomScan *cscan);
 
+extern int gammadb_index_fetch_sort_tids;
+
 #endif   /* GAMMA_INDEXSCAN_H */
@@ -16,8 +16,9 @@
 #ifndef GAMMA_MERGE_H
 #define GAMMA_MERGE_H
 
+extern bool gammadb_delta_table_merge_all;
 
-extern void gamma_merge(Relation rel);
+extern int gamma_merge(Relation rel, int max_rowgroups, bool merge_tail);
 extern void gamma_merge_one_rowgroup(Relation rel, HeapTupleData *pin_tuples,
 						uint32 rgid, bool *delbitmap, int rowcount);
 
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2024 Gamma Data, Inc. <jackey@gammadb.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GAMMA_VEC_BITMAPSCAN_H
+#define GAMMA_VEC_BITMAPSCAN_H
+
+#include "access/relscan.h"
+#include "nodes/execnodes.h"
+#include "nodes/extensible.h"
+#include "nodes/plannodes.h"
+
+/*
+ * The state of vectorized bitmap heap scan. It is tagged as
+ * BitmapHeapScanState, EXPLAIN shows it as the original plan node.
+ */
+typedef struct VecBitmapHeapScanState
+{
+	BitmapHeapScanState bhss;	/* bitmapqualorig is vectorized */
+	bool inited;				/* the tids have been collected */
+	bool recheck;				/* some index asked for recheck */
+
+	/* the sorted tids of the bitmap quals */
+	MemoryContext tid_context;
+	ItemPointerData *tids;
+	int64 ntids;
+	int64 pos;
+
+	bool rg_loaded;				/* the row group of cvscan is loaded */
+	uint32 lossy_offset;		/* the next row of a lossy row group */
+
+	/* fetch the rows of delta table */
+	IndexFetchTableData *heap_fetch;
+	TupleTableSlot *heap_slot;
+} VecBitmapHeapScanState;
+
+extern const CustomPathMethods* gamma_vec_bitmapscan_path_methods(void);
+extern void gamma_vec_bitmapscan_init(void);
+
+#endif   /* GAMMA_VEC_BITMAPSCAN_H */
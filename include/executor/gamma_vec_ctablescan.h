@@ -18,9 +18,12 @@
 
 #include "nodes/execnodes.h"
 #include "nodes/plannodes.h"
+#include "utils/relcache.h"
 
 
 extern TupleTableSlot * vec_ctablescan_access_seqnext(ScanState *node);
 extern bool vec_ctablescan_access_recheck(ScanState *node, TupleTableSlot *slot);
+extern List *vec_ctablescan_build_keys(ScanState *node, Relation rel,
+									   List *quals);
 
 #endif   /* GAMMA_VEC_TABLESCAN_H */
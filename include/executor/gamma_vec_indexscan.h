@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2024 Gamma Data, Inc. <jackey@gammadb.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GAMMA_VEC_INDEXSCAN_H
+#define GAMMA_VEC_INDEXSCAN_H
+
+#include "nodes/execnodes.h"
+#include "nodes/extensible.h"
+#include "nodes/plannodes.h"
+
+#include "storage/ctable_am.h"
+
+/*
+ * The state of vectorized index scan. It is tagged as IndexScanState,
+ * EXPLAIN shows it as the original plan node.
+ */
+typedef struct VecIndexScanState
+{
+	IndexScanState iss;			/* indexqualorig is vectorized */
+
+	/* the tids fetched from index, sorted by row group */
+	CIndexFetchSortItem *items;
+	int maxitems;
+	int nitems;
+	int pos;
+
+	TupleTableSlot *row_slot;	/* a row fetched by the tid */
+	Bitmapset *bms_proj;		/* the columns fetched by the tid */
+	int *proj_attnos;			/* the columns copied into the batch */
+	int nproj;
+	MemoryContext batch_context;	/* the by-reference values of a batch */
+} VecIndexScanState;
+
+extern const CustomPathMethods* gamma_vec_indexscan_path_methods(void);
+extern void gamma_vec_indexscan_init(void);
+
+#endif   /* GAMMA_VEC_INDEXSCAN_H */
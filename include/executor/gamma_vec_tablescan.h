@@ -16,6 +16,7 @@
 #ifndef GAMMA_VEC_TABLESCAN_H
 #define GAMMA_VEC_TABLESCAN_H
 
+#include "access/skey.h"
 #include "nodes/execnodes.h"
 #include "nodes/extensible.h"
 #include "nodes/plannodes.h"
@@ -24,6 +25,21 @@ typedef struct VecSeqScanState
 {
 	SeqScanState sss;
 	bool scan_over;
+
+	/* TABLESAMPLE of columnar tables, NULL for plain seqscan */
+	TableSampleClause *tablesample;
+	List *sample_args;				/* ExprState list of arguments */
+	ExprState *sample_repeatable;
+	bool sample_inited;
+
+	/* TID range scan of columnar tables, NIL for plain seqscan */
+	List *tidrange_opnos;			/* operators, the ctid is on the left */
+	List *tidrange_args;			/* ExprState list of the tid arguments */
+	bool tidrange_inited;
+
+	/* the quals done by the cv scan, see vec_ctablescan_build_keys */
+	ScanKey scankeys;
+	int nscankeys;
 }VecSeqScanState;
 
 extern const CustomPathMethods* gamma_vec_tablescan_path_methods(void);
@@ -26,5 +26,6 @@ extern void VecExecConditionalAssignProjectionInfo(PlanState *planstate,
 									Index varno);
 extern TupleTableSlot* vec_tablescan_execscan(ScanState *node,
 		 ExecScanAccessMtd accessMtd, ExecScanRecheckMtd recheckMtd);
+extern bool vec_exec_qual(ExprState *qual, ExprContext *econtext);
 
 #endif /* VEC_EXEC_SCAN_H */
@@ -49,6 +49,9 @@ typedef struct VectorTupleSlot
 	 * function for batch execution.
 	 */
 	short *row_indexarr;
+
+	/* the copies of the rows which are not in the pages, reset per batch */
+	MemoryContext	batch_context;
 } VectorTupleSlot;
 
 #define VSlotSetNonSkip(vslot) ((vslot)->flags |= GAMMA_VSLOT_FLAGS_NON_SKIP)
@@ -76,7 +79,8 @@ extern uint32 tts_slot_from_rg(TupleTableSlot *slot, RowGroup *rg,
 								Bitmapset *bms_proj, uint32 offset);
 extern bool tts_vector_slot_fill_tuple(TableScanDesc scandesc,
 									   ScanDirection direction,
-									   TupleTableSlot *slot);
+									   TupleTableSlot *slot,
+									   ItemPointer tids);
 extern void tts_vector_slot_copy_one_row(TupleTableSlot *slot,
 									TupleTableSlot *src_slot, int row);
 extern void tts_vector_slot_fill_vector(TupleTableSlot *slot,
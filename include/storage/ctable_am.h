@@ -21,12 +21,34 @@
 
 #define GAMMA_COLTABLE_AM_NAME  "gamma"
 
+/* a tid of index scan, see gamma_indexscan_access_sortnext */
+typedef struct CIndexFetchSortItem
+{
+	ItemPointerData tid;
+	bool recheck;
+} CIndexFetchSortItem;
+
 typedef struct CIndexFetchCTableData
 {
 	IndexFetchHeapData base;
 	TupleTableSlot *heapslot; /* for heap fetch slot */
 	Bitmapset *bms_proj;
 	bool indexonlyscan;
+
+	/* the cv scan and the row group are kept across the fetches */
+	struct CVScanDescData *cvscan;
+	uint32 rgid;
+	bool rg_loaded;				/* the projected columns of rgid */
+	uint64 rg_generation;		/* gamma_rg_cache_generation when loaded */
+	bool rg_missing;			/* rgid is not visible */
+	bool delbitmap_loaded;		/* the delete bitmap of rgid */
+	Bitmapset *rg_clean;		/* rgids without deleted rows in the snapshot */
+
+	/* the tids fetched from index, sorted by row group */
+	CIndexFetchSortItem *sort_items;
+	int sort_size;
+	int sort_nitems;
+	int sort_pos;
 } CIndexFetchCTableData;
 
 const TableAmRoutine * ctable_tableam_routine(void);
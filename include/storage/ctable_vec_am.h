@@ -16,6 +16,8 @@
 #ifndef CTABLE_VEC_AM_H
 #define CTABLE_VEC_AM_H
 
+#include "utils/sampling.h"
+
 #include "storage/gamma_rg.h"
 #include "storage/gamma_cvtable_am.h"
 
@@ -26,6 +28,33 @@ typedef struct CTableScanDescData {
 	TupleTableSlot *buf_slot;
 	bool heap;					/* cv table first */
 	bool scan_over;
+	BlockNumber sample_block;	/* next row group block of TABLESAMPLE */
+
+	/* TID range scan, see vec_ctable_set_tidrange */
+	bool tidrange;
+	ItemPointerData tidrange_min;
+	ItemPointerData tidrange_max;
+
+	/* ANALYZE, see ctable_scan_analyze_next_block */
+	bool analyze_inited;
+	bool analyze_rg;			/* sampling rows of row groups */
+	bool analyze_heap;			/* a block of delta table is read */
+	BlockSamplerData analyze_bs;	/* row groups to sample */
+	double analyze_rg_liverows;	/* reported when the row groups begin */
+	double analyze_rg_keep;		/* probability to keep a row group row */
+	double analyze_heap_keep;	/* probability to keep a delta table row */
+	bool analyze_use_samples;	/* read the samples kept by the writer */
+	double analyze_sample_keep;	/* probability to keep a sample row */
+	MemoryContext analyze_context;	/* the samples of one row group */
+	struct GammaColumnStats **analyze_samples;
+	uint16 *analyze_sample_rowids;
+	uint32 analyze_sample_rgid;
+	int32 analyze_nsample;
+	int32 analyze_pos;
+#if PG_VERSION_NUM < 170000
+	BlockNumber analyze_blockno;	/* the first block, after row groups */
+	BufferAccessStrategy analyze_bstrategy;
+#endif
 } CTableScanDescData;
 
 typedef struct CTableScanDescData *CTableScanDesc;
@@ -41,5 +70,9 @@ extern void vec_ctable_end_scan(TableScanDesc scan);
 extern void vec_ctable_rescan(TableScanDesc scan, struct ScanKeyData * key,
 		bool set_params, bool allow_strat, bool allow_sync,
 		bool allow_pagemode);
+extern void vec_ctable_set_tidrange(TableScanDesc scan, ItemPointer mintid,
+		ItemPointer maxtid);
+extern void vec_ctable_tidrange_rows(CTableScanDesc cscan, RowGroup *rg,
+		uint32 offset, bool *skip, uint32 count);
 
 #endif /* CTABLE_VEC_AM_H */
@@ -16,13 +16,39 @@
 #ifndef GAMMA_BUFFER_H
 #define GAMMA_BUFFER_H
 
+#include "storage/gamma_cv.h"
 #include "storage/gamma_toc.h"
 
+extern int gammadb_buffer_decoded_percent;
+
 extern void gamma_buffer_startup(void);
-extern bool gamma_buffer_add_cv(Oid relid, Oid rgid, int attno, uint32 dim,
-		char *data, Size values_nbytes, bool *nulls, Size isnull_nbytes);
-extern bool gamma_buffer_get_cv(Oid relid, Oid rgid, int16 attno, uint32 *dim,
+extern gamma_toc_entry *gamma_buffer_reserve_cv(Oid relid, Oid rgid, int16 attno,
+		uint32 dim, Size values_nbytes, Size isnull_nbytes,
+		char **data, bool **nulls, bool evict);
+extern void gamma_buffer_publish_cv(gamma_toc_entry *entry);
+extern void gamma_buffer_cancel_cv(gamma_toc_entry *entry);
+extern bool gamma_buffer_add_compressed_cv(Oid relid, Oid rgid, int16 attno,
+		uint32 dim, char *data, Size values_nbytes, char *nulls, Size isnull_nbytes);
+extern bool gamma_buffer_get_compressed_cv(Oid relid, Oid rgid, int16 attno,
+		uint32 *dim, char **data, Size *values_nbytes, char **nulls,
+		Size *isnull_nbytes);
+extern bool gamma_buffer_contains_cv(Oid relid, Oid rgid, int16 attno);
+extern gamma_toc_entry *gamma_buffer_get_cv(Oid relid, Oid rgid, int16 attno,
+			uint32 *dim, char **data, Size *values_nbytes, bool **nulls,
+			Size *isnull_nbytes);
+extern void gamma_buffer_unpin_cv(gamma_toc_entry *entry);
+extern void gamma_buffer_pin_ref(ColumnVector *cv, gamma_toc_entry *entry);
+extern void gamma_buffer_release_cv(ColumnVector *cv);
+extern bool gamma_buffer_find_cv(Oid relid, Oid rgid, int16 attno, uint32 *dim,
 			char **data, Size *values_nbytes, bool **nulls, Size *isnull_nbytes);
-extern void gamma_buffer_invalid_rel(Oid relid);
+extern void gamma_buffer_invalid_rel(Oid dbid, Oid relid);
+extern uint64 gamma_buffer_delbitmap_gen(void);
+extern bool gamma_buffer_get_delbitmap(Oid relid, Oid rgid, char *version,
+		Size version_nbytes, bool *delbitmap, Size *count);
+extern void gamma_buffer_add_delbitmap(Oid relid, Oid rgid, uint64 gen,
+		char *version, Size version_nbytes, bool *delbitmap, Size count);
+extern void gamma_buffer_invalid_delbitmap(Oid relid, Oid rgid);
+extern bool gamma_buffer_delbitmap_bypass(void);
+extern gamma_toc_key *gamma_buffer_cv_keys(uint32 *nkeys);
 
 #endif
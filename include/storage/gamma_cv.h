@@ -42,6 +42,14 @@ typedef struct ColumnVector {
 	/* cache or ref */
 	bool *isnull;//[GAMMA_COLUMN_VECTOR_SIZE];
 	Datum *values;//[GAMMA_COLUMN_VECTOR_SIZE];
+
+	/* the entry of backend-local buffer referenced by values/isnull */
+	void *local_entry;
+	uint32 local_gen;
+
+	/* the pinned entry of gamma buffer referenced by values/isnull */
+	void *shared_entry;
+	uint32 shared_gen;
 } ColumnVector;
 
 #define CVIsRef(cv) (cv->flags & GAMMA_CV_FLAGS_REF)
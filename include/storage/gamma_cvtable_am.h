@@ -40,6 +40,15 @@ typedef struct VecParallelTableScanDescData
 
 typedef struct VecParallelTableScanDescData *VecParallelTableScanDesc;
 
+/* TABLESAMPLE methods of the vectorized scan */
+#define GAMMA_SAMPLE_NONE			(0)
+#define GAMMA_SAMPLE_SYSTEM			(1)		/* whole row groups (or blocks) */
+#define GAMMA_SAMPLE_BERNOULLI		(2)		/* single rows */
+
+/* hash salts of TABLESAMPLE, see cvtable_sample_keep */
+#define GAMMA_SAMPLE_SALT_RG		(0x52477270)
+#define GAMMA_SAMPLE_SALT_DELTA		(0x444c5461)
+
 typedef struct CVScanDescData {
 	IndexScanDesc scan;
 	Relation cv_rel;
@@ -59,11 +68,33 @@ typedef struct CVScanDescData {
 	/* projection info*/
 	Bitmapset *bms_proj;
 
+	/* the last row group prefetched */
+	uint32 prefetch_rgid;
+
+	/* TABLESAMPLE, see cvtable_set_sample */
+	int sample_method;
+	uint64 sample_cutoff;
+	uint32 sample_seed;
+
+	/*
+	 * The quals "column op const" pushed down by the vectorized scan, see
+	 * cvtable_set_keys. sk_func is the btree comparison proc of the column
+	 * and the const, sk_strategy is the btree strategy of the operator.
+	 */
+	int nkeys;
+	ScanKey keys;
+	MemoryContext keys_context;		/* for the min/max of row groups */
+	AttrNumber *key_attnos;			/* the sorted columns of the keys */
+	int key_natts;
+	uint64 rg_pruned;				/* row groups skipped by the keys */
+
 	bool inited;
 } CVScanDescData;
 
 typedef struct CVScanDescData *CVScanDesc;
 
+extern int gammadb_cv_prefetch_rowgroups;
+
 
 extern CVScanDesc cvtable_beginscan(Relation rel, Snapshot snapshot, int nkeys,
 		struct ScanKeyData * key,
@@ -72,7 +103,10 @@ extern CVScanDesc cvtable_beginscan(Relation rel, Snapshot snapshot, int nkeys,
 extern bool cvtable_getnextslot(CVScanDesc cvscan, ScanDirection direction,
 		TupleTableSlot * slot);
 extern bool cvtable_loadnext_rg(CVScanDesc cvscan, ScanDirection direction);
+extern bool cvtable_rg_visible(CVScanDesc cvscan, uint32 rgid);
 extern bool cvtable_load_rg(CVScanDesc cvscan, uint32 rgid);
+extern bool cvtable_prewarm_cv(CVScanDesc cvscan, uint32 rgid, int16 attno,
+								bool *full);
 extern bool cvtable_load_rowslot(CVScanDesc cvscan, uint32 rgid,
 									int32 rowid, TupleTableSlot *slot);
 extern void cvtable_rescan(CVScanDesc scan, struct ScanKeyData * key,
@@ -80,6 +114,17 @@ extern void cvtable_rescan(CVScanDesc scan, struct ScanKeyData * key,
 		bool allow_pagemode);
 extern void cvtable_endscan(CVScanDesc cvscan);
 
+extern void cvtable_set_sample(CVScanDesc cvscan, int method, double percent,
+								uint32 seed);
+extern void cvtable_set_rgid_range(CVScanDesc cvscan, uint32 min_rgid,
+								   uint32 max_rgid);
+extern void cvtable_set_keys(CVScanDesc cvscan, int nkeys, ScanKey keys);
+extern void cvtable_keys_filter(CVScanDesc cvscan, TupleTableSlot *slot);
+extern bool cvtable_sample_keep(CVScanDesc cvscan, uint32 key1, uint32 key2,
+								bool delta);
+extern void cvtable_sample_rows(CVScanDesc cvscan, uint32 offset,
+								bool *skip, uint32 count);
+
 extern TM_Result cvtable_delete_tuple(Relation relation, ItemPointer tid,
 			CommandId cid, Snapshot snapshot, Snapshot crosscheck, bool wait,
 			TM_FailureData *tmfd, bool changingPart);
@@ -88,7 +133,8 @@ extern HeapTuple cvtable_get_delbitmap_tuple(Relation cvrel, Oid indexoid,
 extern void cvtable_load_delbitmap(CVScanDesc cvscan, uint32 rgid);
 
 extern uint64 cvtable_get_rows(Relation cvrel);
-extern void cvtable_update_delete_bitmap(Relation relation, Snapshot snapshot,
-								uint32 rgid, bool *vacuum_delbitmap, int count);
+extern void cvtable_update_delete_bitmap(Relation relation, Oid base_relid,
+								Snapshot snapshot, uint32 rgid,
+								bool *vacuum_delbitmap, int count);
 
 #endif /* GAMMA_CVTABLE_AM_H */
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2024 Gamma Data, Inc. <jackey@gammadb.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GAMMA_LOCAL_BUFFER_H
+#define GAMMA_LOCAL_BUFFER_H
+
+#include "postgres.h"
+
+#include "storage/gamma_cv.h"
+
+extern int gammadb_local_buffers;
+
+extern bool gamma_local_buffer_get_cv(Oid relid, Oid rgid, int16 attno,
+				ColumnVector *cv);
+extern bool gamma_local_buffer_add_cv(Oid relid, Oid rgid, int16 attno,
+				ColumnVector *cv, char *data, Size values_nbytes,
+				bool *nulls, uint32 rows);
+extern void gamma_local_buffer_release_cv(ColumnVector *cv);
+extern bool gamma_local_buffer_get_rg_xmin(Oid relid, Oid rgid,
+				TransactionId *xmin);
+extern void gamma_local_buffer_set_rg_xmin(Oid relid, Oid rgid,
+				TransactionId xmin);
+extern void gamma_local_buffer_invalid_rel(Oid relid);
+
+#endif /* GAMMA_LOCAL_BUFFER_H */
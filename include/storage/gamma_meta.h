@@ -49,13 +49,22 @@ extern Oid gamma_meta_get_cv_table_rel(Relation baserel);
 extern Oid gamma_meta_get_cv_table_oid(Oid base_rel_oid);
 extern uint32 gamma_meta_next_rgid(Relation rel);
 extern uint32 gamma_meta_max_rgid(Relation rel);
+#if PG_VERSION_NUM < 170000
+extern void gamma_meta_keep_delta_block(Relation rel);
+#endif
 extern Oid gamma_meta_rgid_sequence_oid(Relation rel);
 
 extern void gamma_meta_insert_rowgroup(Relation rel, RowGroup *rg);
+extern List *gamma_meta_form_rowgroup(Relation rel, Relation cv_rel,
+									  RowGroup *rg);
 extern void gamma_meta_insert_delbitmap(Relation cvrel, uint32 rgid, 
 											bool *delbitmap, int32 count);
-extern void gamma_meta_insert_cv(Relation cvrel,
-					 uint32 rgid, int32 attno, ColumnVector *cv);
+extern void gamma_meta_insert_cv(Relation cvrel, uint32 rgid, int32 attno,
+					 ColumnVector *cv, Form_pg_attribute attr,
+					 struct GammaColumnStats *stats);
+extern HeapTuple gamma_meta_form_cv(Relation cvrel, uint32 rgid, int32 attno,
+					 ColumnVector *cv, Form_pg_attribute attr,
+					 struct GammaColumnStats *stats, bool compress);
 
 extern ItemPointerData gamma_meta_cv_convert_tid(uint32 rgid, uint16 rowid);
 extern uint32 gamma_meta_tid_get_rgid(ItemPointerData tid);
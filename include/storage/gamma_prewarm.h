@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2024 Gamma Data, Inc. <jackey@gammadb.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GAMMA_PREWARM_H
+#define GAMMA_PREWARM_H
+
+#include "postgres.h"
+
+extern bool gammadb_autoprewarm;
+extern int gammadb_autoprewarm_interval;
+extern int gammadb_autoprewarm_workers;
+
+extern void gamma_prewarm_register_worker(void);
+
+extern PGDLLEXPORT void gamma_prewarm_main(Datum main_arg);
+extern PGDLLEXPORT void gamma_prewarm_worker_main(Datum main_arg);
+
+#endif /* GAMMA_PREWARM_H */
@@ -28,12 +28,14 @@ typedef struct RowGroup {
 	Oid rgid;
 	int dim;
 	int flags;
+	int natts;
 	bool *delbitmap;
 	ColumnVector cvs[FLEXIBLE_ARRAY_MEMBER];
 } RowGroup;
 
 #define RGSetDelBitmap(rg) (rg->flags |= GAMMA_ROWGROUP_HAS_DELBITMAP);
 #define RGHasDelBitmap(rg) (rg->flags & GAMMA_ROWGROUP_HAS_DELBITMAP)
+#define RGClearDelBitmap(rg) (rg->flags &= ~GAMMA_ROWGROUP_HAS_DELBITMAP)
 
 #define SizeOfRowGroup(cnt) \
 				add_size(offsetof(RowGroup, cvs), \
@@ -44,6 +46,8 @@ extern RowGroup* gamma_rg_build_desc(TupleDesc tupdesc);
 extern void gamma_rg_free(RowGroup *rg);
 
 extern ColumnVector *gamma_rg_get_cv(RowGroup *rg, int idx);
+extern void gamma_rg_reset_cv(RowGroup *rg, int idx);
+extern uint64 gamma_rg_cache_generation(void);
 extern bool gamma_rg_fetch_slot(Relation rel, Snapshot snapshot,
 								ItemPointer tid, TupleTableSlot *slot,
 								Bitmapset *bms_proj);
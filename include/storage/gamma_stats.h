@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2024 Gamma Data, Inc. <jackey@gammadb.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GAMMA_STATS_H
+#define GAMMA_STATS_H
+
+#include "access/tupdesc.h"
+#include "lib/hyperloglog.h"
+#include "lib/stringinfo.h"
+#include "utils/relcache.h"
+#include "utils/snapshot.h"
+
+#include "storage/gamma_cv.h"
+
+/* 1024 registers, about 3% error of ndistinct */
+#define GAMMA_STATS_HLL_BWIDTH			(10)
+
+/* the expected sample rows of a full row group */
+#define GAMMA_STATS_SAMPLE_ROWS			(300)
+#define GAMMA_STATS_SAMPLE_RATE \
+		((double) GAMMA_STATS_SAMPLE_ROWS / GAMMA_COLUMN_VECTOR_SIZE)
+
+/* the wider values are not kept in the sample */
+#define GAMMA_STATS_SAMPLE_WIDTH		(1024)
+
+/*
+ * The statistics of a column vector, built when the row group is written.
+ * They are mergeable: the statistics of a column are the merge of the
+ * statistics of its row groups.
+ */
+typedef struct GammaColumnStats
+{
+	int64 nrows;				/* rows, including nulls */
+	int64 nnulls;
+
+	bool has_minmax;
+	Datum min;
+	Datum max;
+
+	bool has_hll;				/* HyperLogLog for ndistinct */
+	hyperLogLogState hll;
+
+	/* the row sample, the same rowids for all columns of a row group */
+	int32 nsample;
+	uint16 *sample_rowids;
+	Datum *sample_values;
+	bool *sample_isnull;
+} GammaColumnStats;
+
+extern uint16 *gamma_stats_sample_rowids(int32 rowcount, int32 *nsample);
+extern GammaColumnStats *gamma_stats_build(Form_pg_attribute attr,
+										   ColumnVector *cv, bool *delbitmap,
+										   uint16 *rowids, int32 nsample);
+extern void gamma_stats_serialize(Form_pg_attribute attr,
+								  GammaColumnStats *stats, StringInfo option,
+								  StringInfo min, StringInfo max);
+extern GammaColumnStats *gamma_stats_deserialize(Form_pg_attribute attr,
+												 char *option, Size option_len,
+												 char *min, char *max,
+												 bool sample);
+extern void gamma_stats_merge(Form_pg_attribute attr, GammaColumnStats *dst,
+							  GammaColumnStats *src);
+extern double gamma_stats_ndistinct(GammaColumnStats *stats);
+
+extern GammaColumnStats *gamma_stats_fetch(Relation cvrel, Oid indexoid,
+										   Snapshot snapshot, uint32 rgid,
+										   Form_pg_attribute attr);
+extern void gamma_stats_fetch_minmax(Relation cvrel, Oid indexoid,
+									 Snapshot snapshot, uint32 rgid,
+									 AttrNumber *attnos, int natts,
+									 GammaColumnStats **stats);
+extern bool gamma_stats_rel_column(Relation rel, AttrNumber attnum,
+								   double *stadistinct, double *nullfrac);
+
+#endif /*GAMMA_STATS_H*/
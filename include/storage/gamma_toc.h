@@ -22,20 +22,58 @@
 
 typedef struct gamma_toc_entry
 {
+	Oid dbid;
 	Oid relid;
 	Oid rgid;
 	int16 attno;
-	int16 flags;			/* for memory align, nouse now */
+	int16 flags;			/* TOC_ENTRY_xxx in gamma_toc.c */
 	Size nbytes;			/* toc memory size */
 	Size values_offset;		/* Offset, in bytes, from TOC start */
 	Size values_nbytes;		/* values array size (not aligned) */
 	Size isnull_nbytes;		/* nulls array size (not aligned) */
 	Size dim;
-	pg_atomic_uint32 state;
+	pg_atomic_uint32 usage;	/* hotness for clock sweep, bumped by lookup */
+	pg_atomic_uint32 refcount;	/* scans referencing the decoded data */
 } gamma_toc_entry;
 
 typedef struct gamma_toc gamma_toc;
 
+/* counters of gamma buffer, kept per (dbid, relid, attno) */
+typedef enum gamma_toc_counter
+{
+	GAMMA_TOC_HITS = 0,
+	GAMMA_TOC_MISSES,
+	GAMMA_TOC_INSERTS,
+	GAMMA_TOC_EVICTIONS,
+	GAMMA_TOC_INSERT_BYTES,
+	GAMMA_TOC_EVICT_BYTES,
+	GAMMA_TOC_NCOUNTERS
+} gamma_toc_counter;
+
+typedef struct gamma_toc_stat
+{
+	pg_atomic_uint32 state;
+	Oid dbid;
+	Oid relid;
+	int16 attno;
+	pg_atomic_uint64 counters[GAMMA_TOC_NCOUNTERS];
+} gamma_toc_stat;
+
+/*
+ * number of stat slots, the columns which find no slot are counted in one
+ * more slot of dbid 0 and relid 0
+ */
+#define GAMMA_TOC_NSTATS (4096)
+
+/* identity of a cached column vector, used to dump/reload the buffer */
+typedef struct gamma_toc_key
+{
+	Oid dbid;
+	Oid relid;
+	Oid rgid;
+	int16 attno;
+} gamma_toc_key;
+
 #define GAMMA_TOC_MAGIC (20101030)
 
 extern gamma_toc *gamma_toc_create(uint64 magic, void *address, Size nbytes);
@@ -46,10 +84,52 @@ extern bool gamma_toc_insert(gamma_toc *toc, Oid relid, Oid rgid, int16 attno,
 extern bool gamma_toc_lookup(gamma_toc *toc, Oid relid, Oid rgid, int16 attno,
 				uint32 *dim, char **data, Size *values_nbytes,
 				bool **nulls, Size *isnull_nbytes);
+extern gamma_toc_entry *gamma_toc_lookup_pin(gamma_toc *toc, Oid relid,
+				Oid rgid, int16 attno, uint32 *dim, char **data,
+				Size *values_nbytes, bool **nulls, Size *isnull_nbytes);
+extern void gamma_toc_pin(gamma_toc_entry *entry);
+extern void gamma_toc_unpin(gamma_toc_entry *entry);
+extern bool gamma_toc_lookup_compressed(gamma_toc *toc, Oid relid, Oid rgid,
+				int16 attno, uint32 *dim, char **data, Size *values_nbytes,
+				bool **nulls, Size *isnull_nbytes);
+extern gamma_toc_entry *gamma_toc_reserve(gamma_toc *toc, Oid relid, Oid rgid,
+				int16 attno, uint32 dim, Size values_nbytes, Size isnull_nbytes,
+				bool compressed);
+extern void gamma_toc_publish(gamma_toc *toc, gamma_toc_entry *entry, bool valid);
+extern void gamma_toc_drop_compressed(gamma_toc *toc, Oid relid, Oid rgid,
+				int16 attno);
+extern bool gamma_toc_reclaim_compressed(gamma_toc *toc, Size nbytes,
+				Size limit);
+extern bool gamma_toc_reclaim_decoded(gamma_toc *toc, Size nbytes,
+				Size limit);
+
+extern void gamma_toc_invalid_rel(gamma_toc *toc, Oid dbid, Oid relid);
+extern void gamma_toc_invalid_rg(gamma_toc *toc, Oid dbid, Oid relid,
+				uint32 rgid);
+extern void gamma_toc_invalid_cv(gamma_toc *toc, Oid dbid, Oid relid,
+				uint32 rgid, int16 attno);
+
+extern uint32 gamma_toc_nentry(gamma_toc *toc);
+extern Size gamma_toc_total_bytes(gamma_toc *toc);
+extern Size gamma_toc_decoded_bytes(gamma_toc *toc);
+extern Size gamma_toc_compressed_bytes(gamma_toc *toc);
+extern bool gamma_toc_entry_compressed(gamma_toc_entry *entry);
+extern uint64 gamma_toc_delbitmap_gen(gamma_toc *toc);
+extern void gamma_toc_bump_delbitmap_gen(gamma_toc *toc);
+extern uint32 gamma_toc_delbitmap_committing(gamma_toc *toc);
+extern void gamma_toc_begin_delbitmap_commit(gamma_toc *toc);
+extern void gamma_toc_end_delbitmap_commit(gamma_toc *toc);
+extern uint32 gamma_toc_collect_keys(gamma_toc *toc, gamma_toc_key *keys,
+				uint32 maxkeys);
+
+extern uint32 gamma_toc_collect_entries(gamma_toc *toc, gamma_toc_entry *entries,
+				uint32 maxentries);
 
-extern void gamma_toc_invalid_rel(gamma_toc *toc, Oid relid);
-extern void gamma_toc_invalid_rg(gamma_toc *toc, Oid relid, uint32 rgid);
-extern void gamma_toc_invalid_cv(gamma_toc *toc, Oid relid, uint32 rgid, int16 attno);
+extern void gamma_toc_count(gamma_toc *toc, Oid dbid, Oid relid, int16 attno,
+				gamma_toc_counter counter, uint64 n);
+extern uint32 gamma_toc_collect_stats(gamma_toc *toc, gamma_toc_stat *stats,
+				uint32 maxstats);
+extern void gamma_toc_reset_stats(gamma_toc *toc);
 
 extern void gamma_toc_lock_acquire_x(gamma_toc *toc);
 extern void gamma_toc_lock_acquire_s(gamma_toc *toc);
@@ -0,0 +1,675 @@
+/*
+ * Copyright (c) 2024 Gamma Data, Inc. <jackey@gammadb.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "postgres.h"
+
+#include "access/heapam.h"
+#include "access/relation.h"
+#include "access/table.h"
+#include "access/tableam.h"
+#include "access/xact.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_database.h"
+#include "commands/defrem.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/interrupt.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lmgr.h"
+#include "storage/lwlock.h"
+#include "storage/procarray.h"
+#include "storage/shmem.h"
+#include "tcop/tcopprot.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+
+#include "executor/gamma_automerge.h"
+#include "executor/gamma_merge.h"
+#include "storage/ctable_am.h"
+#include "storage/gamma_cv.h"
+
+#define GAMMA_AUTOMERGE_NAME "gammadb automerge"
+
+/* the gamma tables tracked by gamma_merge_status() */
+#define GAMMA_AUTOMERGE_MAX_TABLES 1024
+#define GAMMA_AUTOMERGE_STATUS_COLS 11
+
+/* the nap after a cycle which merged row groups, the ingest may go on */
+#define GAMMA_AUTOMERGE_SHORT_NAPTIME 1000
+
+bool gammadb_automerge = true;
+int gammadb_automerge_naptime = 10;
+int gammadb_automerge_min_rows = GAMMA_COLUMN_VECTOR_SIZE;
+int gammadb_automerge_max_rowgroups = 8;
+int gammadb_automerge_busy_backends = 8;
+int gammadb_automerge_delay = 100;
+
+typedef struct GammaMergeTable
+{
+	Oid dbid;
+	Oid relid;
+	int64 live_rows;			/* n_live_tup at the last check */
+	int64 ins_rows;				/* n_ins_since_vacuum at the last check */
+	int64 merged_ins_rows;		/* n_ins_since_vacuum after the last merge */
+	int64 rowgroups;			/* #row groups merged */
+	int64 merges;				/* #transactions merged row groups */
+	int64 throttled;			/* #merges cut to one row group by the load */
+	int64 skipped;				/* #checks the table was locked by VACUUM or DDL */
+	TimestampTz last_check;
+	TimestampTz last_merge;
+} GammaMergeTable;
+
+typedef struct GammaMergeShared
+{
+	LWLock *lock;
+	int64 cycle_rowgroups;		/* #row groups merged in the current cycle */
+	int ntables;
+	GammaMergeTable tables[GAMMA_AUTOMERGE_MAX_TABLES];
+} GammaMergeShared;
+
+static GammaMergeShared *merge_shared = NULL;
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+PG_FUNCTION_INFO_V1(gamma_merge_status);
+
+static void
+gamma_automerge_shmem_request(void)
+{
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+
+	RequestAddinShmemSpace(MAXALIGN(sizeof(GammaMergeShared)));
+	RequestNamedLWLockTranche(GAMMA_AUTOMERGE_NAME, 1);
+}
+
+static void
+gamma_automerge_shmem_startup(void)
+{
+	bool found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	merge_shared = ShmemInitStruct(GAMMA_AUTOMERGE_NAME,
+								   sizeof(GammaMergeShared), &found);
+	if (!found)
+	{
+		memset(merge_shared, 0, sizeof(GammaMergeShared));
+		merge_shared->lock = &(GetNamedLWLockTranche(GAMMA_AUTOMERGE_NAME))->lock;
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * Find the entry of the table, or take a free one. When all entries are
+ * used, the one checked least recently is reused. Caller holds the lock
+ * exclusively.
+ */
+static GammaMergeTable *
+gamma_automerge_entry(Oid dbid, Oid relid)
+{
+	GammaMergeTable *victim = NULL;
+	int i;
+
+	for (i = 0; i < merge_shared->ntables; i++)
+	{
+		GammaMergeTable *entry = &merge_shared->tables[i];
+
+		if (entry->dbid == dbid && entry->relid == relid)
+			return entry;
+
+		if (victim == NULL || entry->last_check < victim->last_check)
+			victim = entry;
+	}
+
+	if (merge_shared->ntables < GAMMA_AUTOMERGE_MAX_TABLES)
+		victim = &merge_shared->tables[merge_shared->ntables++];
+
+	memset(victim, 0, sizeof(GammaMergeTable));
+	victim->dbid = dbid;
+	victim->relid = relid;
+
+	return victim;
+}
+
+/*
+ * Remove the entries of dropped objects. If dbid is valid, oids are the
+ * gamma tables still in that database, otherwise they are the databases.
+ */
+static void
+gamma_automerge_forget(Oid dbid, List *oids)
+{
+	int i = 0;
+
+	LWLockAcquire(merge_shared->lock, LW_EXCLUSIVE);
+
+	while (i < merge_shared->ntables)
+	{
+		GammaMergeTable *entry = &merge_shared->tables[i];
+		bool dropped;
+
+		if (OidIsValid(dbid))
+			dropped = (entry->dbid == dbid &&
+					   !list_member_oid(oids, entry->relid));
+		else
+			dropped = !list_member_oid(oids, entry->dbid);
+
+		if (!dropped)
+		{
+			i++;
+			continue;
+		}
+
+		/* move the last entry here */
+		merge_shared->ntables--;
+		if (i < merge_shared->ntables)
+			memcpy(entry, &merge_shared->tables[merge_shared->ntables],
+				   sizeof(GammaMergeTable));
+	}
+
+	LWLockRelease(merge_shared->lock);
+}
+
+/*
+ * Return the databases which accept connections, allocated in context.
+ */
+static List *
+gamma_automerge_list_databases(MemoryContext context)
+{
+	Relation rel;
+	TableScanDesc scan;
+	HeapTuple tuple;
+	List *dbids = NIL;
+
+	StartTransactionCommand();
+	(void) GetTransactionSnapshot();
+
+	rel = table_open(DatabaseRelationId, AccessShareLock);
+	scan = table_beginscan_catalog(rel, 0, NULL);
+
+	while (HeapTupleIsValid(tuple = heap_getnext(scan, ForwardScanDirection)))
+	{
+		Form_pg_database dbform = (Form_pg_database) GETSTRUCT(tuple);
+		MemoryContext old_context;
+
+		if (!dbform->datallowconn || dbform->datistemplate)
+			continue;
+
+		old_context = MemoryContextSwitchTo(context);
+		dbids = lappend_oid(dbids, dbform->oid);
+		MemoryContextSwitchTo(old_context);
+	}
+
+	table_endscan(scan);
+	table_close(rel, AccessShareLock);
+
+	CommitTransactionCommand();
+
+	return dbids;
+}
+
+/*
+ * Return the permanent gamma tables of current database, allocated in
+ * context. Caller is in a transaction.
+ */
+static List *
+gamma_automerge_list_tables(Oid amoid, MemoryContext context)
+{
+	Relation rel;
+	TableScanDesc scan;
+	HeapTuple tuple;
+	List *relids = NIL;
+
+	rel = table_open(RelationRelationId, AccessShareLock);
+	scan = table_beginscan_catalog(rel, 0, NULL);
+
+	while (HeapTupleIsValid(tuple = heap_getnext(scan, ForwardScanDirection)))
+	{
+		Form_pg_class classform = (Form_pg_class) GETSTRUCT(tuple);
+		MemoryContext old_context;
+
+		if (classform->relam != amoid ||
+			classform->relpersistence == RELPERSISTENCE_TEMP ||
+			(classform->relkind != RELKIND_RELATION &&
+			 classform->relkind != RELKIND_MATVIEW))
+			continue;
+
+		old_context = MemoryContextSwitchTo(context);
+		relids = lappend_oid(relids, classform->oid);
+		MemoryContextSwitchTo(old_context);
+	}
+
+	table_endscan(scan);
+	table_close(rel, AccessShareLock);
+
+	return relids;
+}
+
+/*
+ * The rows of the table counted by pgstat. Only the rows written to the
+ * delta table are counted as inserted, the merge deletes them from it, so
+ * n_live_tup is about the live rows of the delta table until ANALYZE or
+ * VACUUM counts the row groups too.
+ */
+static void
+gamma_automerge_fetch_stats(Oid relid, int64 *live_rows, int64 *ins_rows)
+{
+	PgStat_StatTabEntry *tabentry = pgstat_fetch_stat_tabentry(relid);
+
+	*live_rows = 0;
+	*ins_rows = 0;
+
+	if (tabentry == NULL)
+		return;
+
+#if PG_VERSION_NUM >= 160000
+	*live_rows = tabentry->live_tuples;
+	*ins_rows = tabentry->ins_since_vacuum;
+#else
+	*live_rows = tabentry->n_live_tuples;
+	*ins_rows = tabentry->inserts_since_vacuum;
+#endif
+}
+
+/*
+ * Merge the delta table of one gamma table in one transaction.
+ *
+ * The table is merged when gammadb_automerge_min_rows rows were inserted
+ * into its delta table since the last merge, and it has at least one row
+ * group of live rows. The merge stops after gammadb_automerge_max_rowgroups
+ * row groups, or after one row group when gammadb_automerge_busy_backends
+ * backends are running write transactions. The rest of less than one row
+ * group is left in the delta table. Return true if there may be more full
+ * row groups in the delta table.
+ */
+static bool
+gamma_automerge_rel(Oid relid, bool *busy)
+{
+	Relation rel;
+	GammaMergeTable *entry;
+	int64 live_rows;
+	int64 ins_rows;
+	int64 merged_ins_rows;
+	int max_rowgroups;
+	int nrowgroups;
+	bool more;
+
+	*busy = false;
+
+	StartTransactionCommand();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	/* the relation may be dropped since it is listed */
+	rel = try_relation_open(relid, AccessShareLock);
+	if (rel != NULL && rel->rd_tableam != ctable_tableam_routine())
+	{
+		relation_close(rel, AccessShareLock);
+		rel = NULL;
+	}
+
+	if (rel == NULL)
+	{
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		return false;
+	}
+
+	gamma_automerge_fetch_stats(relid, &live_rows, &ins_rows);
+
+	LWLockAcquire(merge_shared->lock, LW_EXCLUSIVE);
+	entry = gamma_automerge_entry(MyDatabaseId, relid);
+	entry->live_rows = live_rows;
+	entry->ins_rows = ins_rows;
+	entry->last_check = GetCurrentTimestamp();
+
+	/* n_ins_since_vacuum is reset by vacuum */
+	if (entry->merged_ins_rows > ins_rows)
+		entry->merged_ins_rows = 0;
+
+	merged_ins_rows = entry->merged_ins_rows;
+	LWLockRelease(merge_shared->lock);
+
+	if (ins_rows - merged_ins_rows < gammadb_automerge_min_rows ||
+		live_rows < GAMMA_COLUMN_VECTOR_SIZE)
+	{
+		relation_close(rel, AccessShareLock);
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		return false;
+	}
+
+	/* don't wait for VACUUM or other merges of the table */
+	if (!ConditionalLockRelation(rel, ShareUpdateExclusiveLock))
+	{
+		LWLockAcquire(merge_shared->lock, LW_EXCLUSIVE);
+		entry = gamma_automerge_entry(MyDatabaseId, relid);
+		entry->skipped++;
+		LWLockRelease(merge_shared->lock);
+
+		relation_close(rel, AccessShareLock);
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		return false;
+	}
+
+	*busy = (gammadb_automerge_busy_backends > 0 &&
+			 MinimumActiveBackends(gammadb_automerge_busy_backends));
+	max_rowgroups = *busy ? 1 : gammadb_automerge_max_rowgroups;
+
+	/* only the full row groups, regardless of gammadb_delta_table_merge_all */
+	nrowgroups = gamma_merge(rel, max_rowgroups, false);
+	more = (nrowgroups >= max_rowgroups);
+
+	LWLockAcquire(merge_shared->lock, LW_EXCLUSIVE);
+	entry = gamma_automerge_entry(MyDatabaseId, relid);
+	entry->rowgroups += nrowgroups;
+	if (nrowgroups > 0)
+	{
+		entry->merges++;
+		entry->last_merge = GetCurrentTimestamp();
+	}
+	if (*busy && more)
+		entry->throttled++;
+
+	/* the rest of delta table is less than one row group */
+	if (!more)
+		entry->merged_ins_rows = ins_rows;
+
+	merge_shared->cycle_rowgroups += nrowgroups;
+	LWLockRelease(merge_shared->lock);
+
+	/* the merge lock is held until commit */
+	relation_close(rel, AccessShareLock);
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	/* the deletes of the merge are seen by the next check */
+	pgstat_report_stat(false);
+
+	return more;
+}
+
+/*
+ * Start the merge worker of the database and wait until it is done.
+ */
+static void
+gamma_automerge_launch(Oid dbid)
+{
+	BackgroundWorker worker;
+	BackgroundWorkerHandle *handle;
+
+	memset(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+					   BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	strcpy(worker.bgw_library_name, "gammadb");
+	strcpy(worker.bgw_function_name, "gamma_automerge_worker_main");
+	strcpy(worker.bgw_name, "gammadb automerge worker");
+	strcpy(worker.bgw_type, "gammadb automerge worker");
+	worker.bgw_main_arg = ObjectIdGetDatum(dbid);
+	worker.bgw_notify_pid = MyProcPid;
+
+	if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+	{
+		ereport(LOG,
+				(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+				 errmsg("registering gammadb automerge worker failed"),
+				 errhint("Consider increasing configuration parameter \"max_worker_processes\".")));
+		return;
+	}
+
+	(void) WaitForBackgroundWorkerShutdown(handle);
+	pfree(handle);
+}
+
+/*
+ * Main entry of the automerge launcher: start one merge worker for each
+ * database in turn, then sleep. The nap is short after a cycle which
+ * merged row groups, gammadb_automerge_naptime otherwise.
+ */
+void
+gamma_automerge_main(Datum main_arg)
+{
+	MemoryContext context;
+
+	pqsignal(SIGTERM, SignalHandlerForShutdownRequest);
+	pqsignal(SIGHUP, SignalHandlerForConfigReload);
+	BackgroundWorkerUnblockSignals();
+
+	/* only the shared catalogs are accessed */
+	BackgroundWorkerInitializeConnection(NULL, NULL, 0);
+
+	context = AllocSetContextCreate(TopMemoryContext,
+									"Gamma Automerge", ALLOCSET_DEFAULT_SIZES);
+
+	while (!ShutdownRequestPending)
+	{
+		List *dbids;
+		ListCell *lc;
+		int64 nrowgroups;
+		long delay_ms;
+
+		if (ConfigReloadPending)
+		{
+			ConfigReloadPending = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		LWLockAcquire(merge_shared->lock, LW_EXCLUSIVE);
+		merge_shared->cycle_rowgroups = 0;
+		LWLockRelease(merge_shared->lock);
+
+		dbids = gamma_automerge_list_databases(context);
+		gamma_automerge_forget(InvalidOid, dbids);
+
+		foreach (lc, dbids)
+		{
+			if (ShutdownRequestPending)
+				break;
+
+			gamma_automerge_launch(lfirst_oid(lc));
+		}
+
+		MemoryContextReset(context);
+
+		LWLockAcquire(merge_shared->lock, LW_SHARED);
+		nrowgroups = merge_shared->cycle_rowgroups;
+		LWLockRelease(merge_shared->lock);
+
+		delay_ms = gammadb_automerge_naptime * 1000L;
+		if (nrowgroups > 0)
+			delay_ms = Min(delay_ms, GAMMA_AUTOMERGE_SHORT_NAPTIME);
+
+		(void) WaitLatch(MyLatch,
+						 WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+						 delay_ms, PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+	}
+}
+
+/*
+ * Main entry of the merge worker, merge the delta tables of the gamma
+ * tables of one database. The table lock is released between merges, and
+ * the worker sleeps gammadb_automerge_delay between them when the server
+ * is busy.
+ */
+void
+gamma_automerge_worker_main(Datum main_arg)
+{
+	Oid dbid = DatumGetObjectId(main_arg);
+	MemoryContext context;
+	List *relids = NIL;
+	ListCell *lc;
+	Oid amoid;
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	BackgroundWorkerInitializeConnectionByOid(dbid, InvalidOid, 0);
+
+	context = AllocSetContextCreate(TopMemoryContext,
+									"Gamma Automerge", ALLOCSET_DEFAULT_SIZES);
+
+	StartTransactionCommand();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	/* gammadb may be not created in the database */
+	amoid = get_table_am_oid("gamma", true);
+	if (OidIsValid(amoid))
+		relids = gamma_automerge_list_tables(amoid, context);
+
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	gamma_automerge_forget(dbid, relids);
+
+	foreach (lc, relids)
+	{
+		Oid relid = lfirst_oid(lc);
+		bool busy;
+
+		CHECK_FOR_INTERRUPTS();
+
+		while (gamma_automerge_rel(relid, &busy))
+		{
+			if (busy && gammadb_automerge_delay > 0)
+			{
+				(void) WaitLatch(MyLatch,
+								 WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+								 gammadb_automerge_delay, PG_WAIT_EXTENSION);
+				ResetLatch(MyLatch);
+			}
+
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+
+	MemoryContextDelete(context);
+}
+
+/*
+ * Request the shared memory of gamma_merge_status() and register the
+ * automerge launcher, only when gammadb is loaded by
+ * shared_preload_libraries.
+ */
+void
+gamma_automerge_register_worker(void)
+{
+	BackgroundWorker worker;
+
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = gamma_automerge_shmem_request;
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = gamma_automerge_shmem_startup;
+
+	if (!gammadb_automerge)
+		return;
+
+	memset(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+					   BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = 10;
+	strcpy(worker.bgw_library_name, "gammadb");
+	strcpy(worker.bgw_function_name, "gamma_automerge_main");
+	strcpy(worker.bgw_name, "gammadb automerge launcher");
+	strcpy(worker.bgw_type, "gammadb automerge launcher");
+
+	RegisterBackgroundWorker(&worker);
+}
+
+/*
+ * Whether the automerge launcher has been registered, then the delta tables
+ * are merged by the workers and VACUUM leaves them alone.
+ */
+bool
+gamma_automerge_running(void)
+{
+	return merge_shared != NULL && gammadb_automerge;
+}
+
+/*
+ * gamma_merge_status()
+ *
+ * Return one row for each gamma table checked by the automerge workers.
+ */
+Datum
+gamma_merge_status(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	GammaMergeTable *tables;
+	int ntables;
+	int i;
+
+	InitMaterializedSRF(fcinfo, 0);
+
+	/* gammadb is not loaded by shared_preload_libraries */
+	if (merge_shared == NULL)
+		return (Datum) 0;
+
+	tables = (GammaMergeTable *) palloc(sizeof(GammaMergeTable) *
+										GAMMA_AUTOMERGE_MAX_TABLES);
+
+	LWLockAcquire(merge_shared->lock, LW_SHARED);
+	ntables = merge_shared->ntables;
+	memcpy(tables, merge_shared->tables, sizeof(GammaMergeTable) * ntables);
+	LWLockRelease(merge_shared->lock);
+
+	for (i = 0; i < ntables; i++)
+	{
+		Datum values[GAMMA_AUTOMERGE_STATUS_COLS];
+		bool nulls[GAMMA_AUTOMERGE_STATUS_COLS];
+
+		memset(nulls, false, sizeof(nulls));
+
+		values[0] = ObjectIdGetDatum(tables[i].dbid);
+		values[1] = ObjectIdGetDatum(tables[i].relid);
+		values[2] = Int64GetDatum(tables[i].live_rows);
+		values[3] = Int64GetDatum(tables[i].ins_rows);
+		values[4] = Int64GetDatum(tables[i].merged_ins_rows);
+		values[5] = Int64GetDatum(tables[i].rowgroups);
+		values[6] = Int64GetDatum(tables[i].merges);
+		values[7] = Int64GetDatum(tables[i].throttled);
+		values[8] = Int64GetDatum(tables[i].skipped);
+		values[9] = TimestampTzGetDatum(tables[i].last_check);
+		values[10] = TimestampTzGetDatum(tables[i].last_merge);
+
+		if (tables[i].last_merge == 0)
+			nulls[10] = true;
+
+		tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+	}
+
+	pfree(tables);
+
+	return (Datum) 0;
+}
@@ -14,141 +14,1267 @@
  */
 
 #include "postgres.h"
+
+#include "access/genam.h"
+#include "access/htup_details.h"
+#include "access/relation.h"
+#include "access/table.h"
+#include "access/xact.h"
+#include "catalog/indexing.h"
+#include "catalog/objectaccess.h"
+#include "catalog/pg_class.h"
+#include "commands/defrem.h"
+#include "commands/trigger.h"
+#include "executor/executor.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "storage/dsm.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "storage/shm_mq.h"
+#include "storage/shm_toc.h"
+#include "tcop/tcopprot.h"
+#include "tcop/utility.h"
+#include "utils/fmgroids.h"
 #include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/syscache.h"
 
 #include "executor/gamma_copy.h"
 #include "executor/gamma_merge.h"
+#include "storage/gamma_buffer.h"
 #include "storage/gamma_meta.h"
+#include "storage/gamma_rg.h"
+
+#define GAMMA_COPY_MAGIC			0x47434F50
+#define GAMMA_COPY_KEY_SHARED		UINT64CONST(0xA000000000000001)
+#define GAMMA_COPY_KEY_QUEUES		UINT64CONST(0xA000000000000002)
+
+#define GAMMA_COPY_QUEUE_SIZE		(1024 * 1024)
+
+/* the results of workers are received every #rows collected by the leader */
+#define GAMMA_COPY_POLL_ROWS		4096
+
+/*
+ * Parallel COPY: a pool of background workers is started at the first full
+ * row group of a COPY and lives until the COPY finishes. Each full row group
+ * is sent to an idle worker by its input queue, the worker builds, compresses
+ * and forms the cv tuples of it and sends them back by its output queue, the
+ * leader inserts them, since the workers can not write in the transaction of
+ * COPY. The rgids are taken from the sequence by the leader.
+ *
+ * The messages of input queue are a GammaCopyTask followed by the tuples of
+ * the row group. The output queue has the cv tuples, then the GammaCopyTask
+ * again to mark the end of the row group, which is shorter than any tuple.
+ *
+ * GAMMA NOTE: the leader waits for the workers on its latch, which is not
+ * seen by the deadlock detector. A worker waiting for the lock of the table
+ * behind a lock request which waits for the leader (eg. ALTER TABLE) would
+ * hang COPY, so the workers join the lock group of the leader, like the
+ * workers of parallel query.
+ */
+typedef struct GammaCopyShared
+{
+	Oid dbid;
+	Oid userid;
+	Oid relid;
+	PGPROC *leader;
+	int leader_pid;
+} GammaCopyShared;
+
+typedef struct GammaCopyTask
+{
+	uint32 rgid;
+	int32 rows;
+} GammaCopyTask;
+
+typedef struct GammaCopyPool
+{
+	dsm_segment *seg;
+	int nworkers;
+	Relation cv_rel;
+	MemoryContext context;		/* for the received tuples */
+	BackgroundWorkerHandle *handles[GAMMA_COPY_MAX_WORKERS];
+	shm_mq_handle *inqh[GAMMA_COPY_MAX_WORKERS];
+	shm_mq_handle *outqh[GAMMA_COPY_MAX_WORKERS];
+	bool busy[GAMMA_COPY_MAX_WORKERS];
+} GammaCopyPool;
 
 bool gammadb_copy_to_cvtable = true;
+int gammadb_copy_parallel_workers = 2;
 
 static CopyCollectorState cstate = {0};
 
+/* the utility statement being processed, see gamma_copy_bulk_enabled */
+static NodeTag gamma_utility_tag = T_Invalid;
+
 static void gamma_copy_slot_set_tid(TupleTableSlot *slot, uint32 rgid, uint16 row);
+static void gamma_copy_build_rowgroup(CopyCollectorState *cs, Relation rel);
+static void gamma_copy_pool_receive(GammaCopyPool *pool, bool wait, bool all);
+
+/*
+ * The rows of a row group are not visible to the uniqueness check until the
+ * row group is written, so the row groups are kept pending only for tables
+ * without unique indexes.
+ */
+static bool
+gamma_copy_has_unique_index(Relation rel)
+{
+	List *indexoids;
+	ListCell *lc;
+	bool result = false;
+
+	indexoids = RelationGetIndexList(rel);
+	foreach (lc, indexoids)
+	{
+		Relation indexrel = index_open(lfirst_oid(lc), AccessShareLock);
+		bool unique = indexrel->rd_index->indisunique ||
+					  indexrel->rd_index->indisexclusion;
+
+		index_close(indexrel, AccessShareLock);
+
+		if (unique)
+		{
+			result = true;
+			break;
+		}
+	}
 
+	list_free(indexoids);
+
+	return result;
+}
+
+/* the workers do not see the catalog changed by the transaction of COPY */
+static bool
+gamma_copy_rel_changed(Oid relid)
+{
+	HeapTuple tuple;
+	bool changed;
+
+	tuple = SearchSysCache1(RELOID, ObjectIdGetDatum(relid));
+	if (!HeapTupleIsValid(tuple))
+		elog(ERROR, "cache lookup failed for relation %u", relid);
+
+	changed = TransactionIdIsCurrentTransactionId(
+									HeapTupleHeaderGetXmin(tuple->t_data));
+	ReleaseSysCache(tuple);
+
+	return changed;
+}
+
+/*
+ * The parallel workers are not used in parallel mode and for temporary
+ * tables, neither for the tables created or altered by the transaction of
+ * COPY. Neither for the tables with unique indexes, keep the pending rows
+ * to the row group being collected.
+ */
+static int
+gamma_copy_nworkers(Relation rel)
+{
+	int nworkers = Min(gammadb_copy_parallel_workers, GAMMA_COPY_MAX_WORKERS);
+
+	if (nworkers <= 0 || IsInParallelMode() ||
+		rel->rd_rel->relpersistence == RELPERSISTENCE_TEMP)
+		return 0;
+
+	if (gamma_copy_has_unique_index(rel))
+		return 0;
+
+	if (gamma_copy_rel_changed(RelationGetRelid(rel)) ||
+		gamma_copy_rel_changed(gamma_meta_get_cv_table_rel(rel)))
+		return 0;
+
+	return nworkers;
+}
+
+/*
+ * The AFTER triggers fetch the new rows by tid or read the table, they may
+ * be fired before the row groups are written at the end of the statement,
+ * so are the tables with them not collected.
+ */
+static bool
+gamma_copy_has_after_trigger(Relation rel)
+{
+	return rel->trigdesc != NULL &&
+		   (rel->trigdesc->trig_insert_after_row ||
+			rel->trigdesc->trig_insert_after_statement);
+}
+
+/*
+ * The bulk inserts collected into row groups: COPY FROM and the target of
+ * CREATE TABLE AS. The table rewrite (ALTER TABLE) and REFRESH MATERIALIZED
+ * VIEW insert into a transient table, whose cv table is dropped after the
+ * relfilenodes are swapped, so their rows stay in the delta table.
+ */
+static bool
+gamma_copy_bulk_enabled(Relation rel)
+{
+	switch (gamma_utility_tag)
+	{
+		case T_CopyStmt:
+			break;
+		case T_CreateTableAsStmt:
+			if (rel->rd_createSubid == InvalidSubTransactionId)
+				return false;
+			break;
+		default:
+			return false;
+	}
+
+	return !gamma_copy_has_after_trigger(rel);
+}
+
+/* start to collect the next row group */
 static void
-gamma_copy_init_state(Relation rel, CommandId cid, int options,
-		struct BulkInsertStateData *bistate)
+gamma_copy_begin_rowgroup(CopyCollectorState *cs, Relation rel)
 {
-	cstate.rel = rel;
-	cstate.rows = 0;
-	cstate.cid = cid;
-	cstate.options = options;
-	cstate.bi = bistate;
-	cstate.rgid = gamma_meta_next_rgid(rel);
+	CopyRowGroup *crg = &cs->rg;
 
-	if (cstate.context != NULL)
+	if (crg->context == NULL)
 	{
-		MemoryContextReset(cstate.context);
+		crg->context = AllocSetContextCreate(cs->context,
+				"Gamma Copy Row Group",
+				ALLOCSET_DEFAULT_SIZES);
+		crg->pin_tuples = (HeapTupleData *) MemoryContextAlloc(cs->context,
+				sizeof(HeapTupleData) * GAMMA_COLUMN_VECTOR_SIZE);
 	}
 	else
 	{
-		cstate.context = AllocSetContextCreate(TopMemoryContext,
-				"Gamma Copy Collector",
-				ALLOCSET_DEFAULT_SIZES);
+		MemoryContextReset(crg->context);
 	}
 
+	crg->rows = 0;
+	crg->rgid = gamma_meta_next_rgid(rel);
+
 	return;
 }
 
 static void
-gamma_copy_reset_state(Relation rel)
+gamma_copy_init_state(CopyCollectorState *cs, Relation rel, CommandId cid,
+		int options, struct BulkInsertStateData *bistate, bool enabled,
+		int nworkers)
 {
-	cstate.rows = 0;
-	cstate.rgid = gamma_meta_next_rgid(rel);
+	cs->rel = rel;
+	cs->cid = cid;
+	cs->options = options;
+	cs->bi = bistate;
+	cs->subid = GetCurrentSubTransactionId();
+	cs->enabled = enabled;
 
-	if (cstate.context != NULL)
+	if (cs->context != NULL)
 	{
-		MemoryContextReset(cstate.context);
+		/* the contexts of row groups are deleted too */
+		MemoryContextReset(cs->context);
 	}
 	else
 	{
-		cstate.context = AllocSetContextCreate(TopMemoryContext,
+		cs->context = AllocSetContextCreate(TopMemoryContext,
 				"Gamma Copy Collector",
 				ALLOCSET_DEFAULT_SIZES);
 	}
 
+	memset(&cs->rg, 0, sizeof(cs->rg));
+	cs->nworkers = nworkers;
+	cs->pool = NULL;
+	if (enabled)
+		gamma_copy_begin_rowgroup(cs, rel);
+
 	return;
 }
 
 static void
-gamma_copy_release_state(void)
+gamma_copy_release_state(CopyCollectorState *cs)
 {
-	cstate.rel = NULL;
-	cstate.rows = 0;
-	cstate.cid = 0;
-	cstate.options = 0;
-	cstate.bi = NULL;
+	cs->rel = NULL;
+	cs->cid = 0;
+	cs->options = 0;
+	cs->bi = NULL;
+	cs->subid = InvalidSubTransactionId;
+	cs->enabled = false;
+	cs->nworkers = 0;
+	cs->pool = NULL;
 
-	if (cstate.context != NULL)
+	if (cs->context != NULL)
 	{
 		/*TODO: destroy and set NULL? */
-		MemoryContextReset(cstate.context);
+		MemoryContextReset(cs->context);
 	}
 
+	memset(&cs->rg, 0, sizeof(cs->rg));
+
 	return;
 }
 
-void
+/* collect a row into the row group being collected, build it when full */
+static void
+gamma_copy_collect_slot(CopyCollectorState *cs, Relation rel,
+						TupleTableSlot *slot)
+{
+	CopyRowGroup *crg = &cs->rg;
+	MemoryContext old_context;
+	HeapTuple tup;
+
+	old_context = MemoryContextSwitchTo(crg->context);
+	gamma_copy_slot_set_tid(slot, crg->rgid, crg->rows);
+	slot->tts_tableOid = RelationGetRelid(rel);
+	tup = ExecFetchSlotHeapTuple(slot, false, NULL);
+	tup = heap_copytuple(tup);
+	memcpy(&crg->pin_tuples[crg->rows++], tup, sizeof(HeapTupleData));
+	MemoryContextSwitchTo(old_context);
+
+	if (crg->rows >= GAMMA_COLUMN_VECTOR_SIZE)
+	{
+		gamma_copy_build_rowgroup(cs, rel);
+		gamma_copy_begin_rowgroup(cs, rel);
+	}
+	else if (cs->pool != NULL && crg->rows % GAMMA_COPY_POLL_ROWS == 0)
+	{
+		/* do not keep the workers waiting for the output queues */
+		gamma_copy_pool_receive(cs->pool, false, false);
+	}
+}
+
+/*
+ * Collect the rows of a bulk insert into row groups, false if the rows are
+ * not collected for the table, see gamma_copy_bulk_enabled.
+ */
+bool
 gamma_copy_collect_and_merge(Relation rel, TupleTableSlot ** slots, int ntuples,
 		CommandId cid, int options,
 		struct BulkInsertStateData * bistate)
 {
 	int i;
-	MemoryContext old_context;
-	HeapTuple tup;
 
 	/* check if it is first time */
 	if (cstate.bi == NULL || cstate.bi != bistate)
 	{
-		gamma_copy_init_state(rel, cid, options, bistate);
+		bool enabled = gamma_copy_bulk_enabled(rel);
+
+		gamma_copy_init_state(&cstate, rel, cid, options, bistate, enabled,
+							  enabled ? gamma_copy_nworkers(rel) : 0);
 	}
 
+	if (!cstate.enabled)
+		return false;
+
 	/* begin to collect */
 	for (i = 0; i < ntuples; i++)
+		gamma_copy_collect_slot(&cstate, rel, slots[i]);
+
+	return true;
+}
+
+static void
+gamma_copy_slot_set_tid(TupleTableSlot *slot, uint32 rgid, uint16 row)
+{
+	Assert(slot != NULL);
+	/* rowid of tid start with 1 */
+	slot->tts_tid = gamma_meta_cv_convert_tid(rgid, row + 1);
+}
+
+static void
+gamma_copy_build_serial(Relation rel, CopyRowGroup *crg)
+{
+	MemoryContext old_context;
+
+	old_context = MemoryContextSwitchTo(crg->context);
+	gamma_merge_one_rowgroup(rel, crg->pin_tuples, crg->rgid, NULL, crg->rows);
+	MemoryContextSwitchTo(old_context);
+}
+
+/* build the tuples of cv table for the row group, without inserting them */
+static List *
+gamma_copy_form_rowgroup(Relation rel, Relation cv_rel,
+						 HeapTupleData *pin_tuples, uint32 rgid, int32 rows)
+{
+	RowGroup *rg;
+	List *tuples;
+
+	rg = gamma_rg_build(rel);
+	rg->rgid = rgid;
+	gamma_fill_rowgroup(rel, pin_tuples, NULL, rg, rows);
+	tuples = gamma_meta_form_rowgroup(rel, cv_rel, rg);
+	gamma_rg_free(rg);
+
+	return tuples;
+}
+
+/*
+ * Start the worker pool of COPY, NULL if no worker can be started, then the
+ * row groups are built by the leader.
+ */
+static GammaCopyPool *
+gamma_copy_pool_start(CopyCollectorState *cs, Relation rel)
+{
+	GammaCopyPool *pool;
+	GammaCopyShared *shared;
+	shm_toc_estimator estimator;
+	shm_toc *toc;
+	dsm_segment *seg;
+	char *queues;
+	Size queues_size;
+	Size segsize;
+	int nworkers = cs->nworkers;
+	int nlaunched = 0;
+	int i;
+
+	queues_size = mul_size(GAMMA_COPY_QUEUE_SIZE, nworkers * 2);
+
+	shm_toc_initialize_estimator(&estimator);
+	shm_toc_estimate_chunk(&estimator, sizeof(GammaCopyShared));
+	shm_toc_estimate_chunk(&estimator, queues_size);
+	shm_toc_estimate_keys(&estimator, 2);
+	segsize = shm_toc_estimate(&estimator);
+
+	seg = dsm_create(segsize, DSM_CREATE_NULL_IF_MAXSEGMENTS);
+	if (seg == NULL)
+		return NULL;
+
+	toc = shm_toc_create(GAMMA_COPY_MAGIC, dsm_segment_address(seg), segsize);
+
+	shared = (GammaCopyShared *) shm_toc_allocate(toc, sizeof(GammaCopyShared));
+	shared->dbid = MyDatabaseId;
+	shared->userid = GetAuthenticatedUserId();
+	shared->relid = RelationGetRelid(rel);
+	shared->leader = MyProc;
+	shared->leader_pid = MyProcPid;
+	shm_toc_insert(toc, GAMMA_COPY_KEY_SHARED, shared);
+
+	BecomeLockGroupLeader();
+
+	queues = (char *) shm_toc_allocate(toc, queues_size);
+	shm_toc_insert(toc, GAMMA_COPY_KEY_QUEUES, queues);
+
+	pool = (GammaCopyPool *) MemoryContextAllocZero(cs->context,
+													sizeof(GammaCopyPool));
+	pool->seg = seg;
+	pool->context = AllocSetContextCreate(cs->context,
+										  "Gamma Copy Pool",
+										  ALLOCSET_DEFAULT_SIZES);
+
+	for (i = 0; i < nworkers; i++)
 	{
-		old_context = MemoryContextSwitchTo(cstate.context);
-		gamma_copy_slot_set_tid(slots[i], cstate.rgid, cstate.rows);
-		tup = ExecFetchSlotHeapTuple(slots[i], false, NULL);
-		tup = heap_copytuple(tup);
-		memcpy(&cstate.pin_tuples[cstate.rows++], tup, sizeof(HeapTupleData));
+		BackgroundWorker worker;
+		BackgroundWorkerHandle *handle;
+		MemoryContext old_context;
+		shm_mq *inq;
+		shm_mq *outq;
+
+		memset(&worker, 0, sizeof(worker));
+		worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+						   BGWORKER_BACKEND_DATABASE_CONNECTION;
+		worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+		worker.bgw_restart_time = BGW_NEVER_RESTART;
+		strcpy(worker.bgw_library_name, "gammadb");
+		strcpy(worker.bgw_function_name, "gamma_copy_worker_main");
+		snprintf(worker.bgw_name, BGW_MAXLEN, "gammadb copy worker %d", i);
+		strcpy(worker.bgw_type, "gammadb copy worker");
+		worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(seg));
+		worker.bgw_notify_pid = MyProcPid;
+		memcpy(worker.bgw_extra, &i, sizeof(i));
+
+		inq = shm_mq_create(queues + (2 * i) * GAMMA_COPY_QUEUE_SIZE,
+							GAMMA_COPY_QUEUE_SIZE);
+		outq = shm_mq_create(queues + (2 * i + 1) * GAMMA_COPY_QUEUE_SIZE,
+							 GAMMA_COPY_QUEUE_SIZE);
+		shm_mq_set_sender(inq, MyProc);
+		shm_mq_set_receiver(outq, MyProc);
+
+		old_context = MemoryContextSwitchTo(cs->context);
+
+		if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+		{
+			MemoryContextSwitchTo(old_context);
+			break;
+		}
+
+		pool->handles[i] = handle;
+		pool->inqh[i] = shm_mq_attach(inq, seg, handle);
+		pool->outqh[i] = shm_mq_attach(outq, seg, handle);
 		MemoryContextSwitchTo(old_context);
 
-		if (cstate.rows >= GAMMA_COLUMN_VECTOR_SIZE)
+		nlaunched++;
+	}
+
+	if (nlaunched == 0)
+	{
+		dsm_detach(seg);
+		MemoryContextDelete(pool->context);
+		pfree(pool);
+		return NULL;
+	}
+
+	pool->nworkers = nlaunched;
+	pool->cv_rel = table_open(gamma_meta_get_cv_table_rel(rel),
+							  RowExclusiveLock);
+
+	return pool;
+}
+
+/*
+ * Receive the results of the busy workers and insert them. Return when no
+ * result is pending if not wait; otherwise when there is an idle worker, or
+ * when all workers are idle if all.
+ */
+static void
+gamma_copy_pool_receive(GammaCopyPool *pool, bool wait, bool all)
+{
+	for (;;)
+	{
+		bool received = false;
+		int nbusy = 0;
+		int i;
+
+		for (i = 0; i < pool->nworkers; i++)
 		{
-			uint32 rgid = cstate.rgid;
-			old_context = MemoryContextSwitchTo(cstate.context);
-			gamma_merge_one_rowgroup(rel, cstate.pin_tuples, rgid, NULL, cstate.rows);
+			shm_mq_result res;
+			Size nbytes;
+			void *data;
+			HeapTuple tuple;
+			MemoryContext old_context;
+
+			if (!pool->busy[i])
+				continue;
+
+			res = shm_mq_receive(pool->outqh[i], &nbytes, &data, true);
+			if (res == SHM_MQ_WOULD_BLOCK)
+			{
+				nbusy++;
+				continue;
+			}
+
+			if (res == SHM_MQ_DETACHED)
+				ereport(ERROR,
+						(errcode(ERRCODE_INTERNAL_ERROR),
+						 errmsg("gammadb copy worker %d exited unexpectedly", i),
+						 errhint("See the server log for the error of the worker.")));
+
+			received = true;
+
+			/* the end of row group */
+			if (nbytes < SizeofHeapTupleHeader)
+			{
+				pool->busy[i] = false;
+				continue;
+			}
+
+			nbusy++;
+
+			old_context = MemoryContextSwitchTo(pool->context);
+			tuple = (HeapTuple) palloc(HEAPTUPLESIZE + nbytes);
+			tuple->t_len = nbytes;
+			ItemPointerSetInvalid(&tuple->t_self);
+			tuple->t_tableOid = InvalidOid;
+			tuple->t_data = (HeapTupleHeader) ((char *) tuple + HEAPTUPLESIZE);
+			memcpy(tuple->t_data, data, nbytes);
+			CatalogTupleInsert(pool->cv_rel, tuple);
 			MemoryContextSwitchTo(old_context);
+			MemoryContextReset(pool->context);
+		}
+
+		/* not wait: until nothing is pending */
+		if (!wait)
+		{
+			if (!received)
+				return;
+			continue;
+		}
 
-			/* reset the collector */
-			gamma_copy_reset_state(rel);
+		if (all ? nbusy == 0 : nbusy < pool->nworkers)
+			return;
+
+		if (!received)
+		{
+			(void) WaitLatch(MyLatch, WL_LATCH_SET | WL_EXIT_ON_PM_DEATH, 0,
+							 PG_WAIT_EXTENSION);
+			ResetLatch(MyLatch);
 		}
+
+		CHECK_FOR_INTERRUPTS();
 	}
+}
 
-	return;
+/* send the row group to an idle worker, wait for one if all are busy */
+static void
+gamma_copy_pool_send(GammaCopyPool *pool, CopyRowGroup *crg)
+{
+	GammaCopyTask task;
+	int idx = -1;
+	int i;
+
+	gamma_copy_pool_receive(pool, true, false);
+
+	for (i = 0; i < pool->nworkers; i++)
+	{
+		if (!pool->busy[i])
+		{
+			idx = i;
+			break;
+		}
+	}
+
+	Assert(idx >= 0);
+
+	task.rgid = crg->rgid;
+	task.rows = crg->rows;
+
+	/* the idle worker is waiting for the input, it does not block long */
+	if (shm_mq_send(pool->inqh[idx], sizeof(task), &task, false, true) !=
+			SHM_MQ_SUCCESS)
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("gammadb copy worker %d exited unexpectedly", idx)));
+
+	for (i = 0; i < crg->rows; i++)
+	{
+		HeapTuple tuple = &crg->pin_tuples[i];
+
+		if (shm_mq_send(pool->inqh[idx], tuple->t_len, tuple->t_data,
+						false, true) != SHM_MQ_SUCCESS)
+			ereport(ERROR,
+					(errcode(ERRCODE_INTERNAL_ERROR),
+					 errmsg("gammadb copy worker %d exited unexpectedly", idx)));
+	}
+
+	pool->busy[idx] = true;
+}
+
+/* wait until all row groups are inserted, then stop the workers */
+static void
+gamma_copy_pool_stop(GammaCopyPool *pool)
+{
+	int i;
+
+	gamma_copy_pool_receive(pool, true, true);
+
+	table_close(pool->cv_rel, RowExclusiveLock);
+
+	/* the workers exit when their input queues are detached */
+	dsm_detach(pool->seg);
+
+	for (i = 0; i < pool->nworkers; i++)
+		(void) WaitForBackgroundWorkerShutdown(pool->handles[i]);
+}
+
+/*
+ * Build the full row group being collected: by the worker pool if there are
+ * parallel workers, or by the leader.
+ */
+static void
+gamma_copy_build_rowgroup(CopyCollectorState *cs, Relation rel)
+{
+	if (cs->pool == NULL && cs->nworkers > 0)
+	{
+		cs->pool = gamma_copy_pool_start(cs, rel);
+		if (cs->pool == NULL)
+			cs->nworkers = 0;
+	}
+
+	if (cs->pool != NULL)
+		gamma_copy_pool_send(cs->pool, &cs->rg);
+	else
+		gamma_copy_build_serial(rel, &cs->rg);
+}
+
+/* build the rest of collected rows, and wait for the worker pool */
+static void
+gamma_copy_finish_rowgroups(CopyCollectorState *cs, Relation rel)
+{
+	if (cs->rg.rows > 0)
+		gamma_copy_build_serial(rel, &cs->rg);
+
+	if (cs->pool != NULL)
+	{
+		gamma_copy_pool_stop(cs->pool);
+		cs->pool = NULL;
+	}
 }
 
 void
 gamma_copy_finish_collect(Relation rel, int options)
 {
-	MemoryContext old_context;
+	gamma_copy_finish_rowgroups(&cstate, rel);
+	gamma_copy_release_state(&cstate);
+	return;
+}
+
+/*
+ * INSERT: the first gammadb_insert_rowgroup_threshold rows of a statement
+ * are written to the delta table, the rest are collected into row groups
+ * like COPY, and written when the statement finishes. The statement is
+ * told by the nesting level of executor, the rows inserted outside of the
+ * executor (logical replication) always go to the delta table.
+ */
+typedef struct InsertCollectorState
+{
+	Oid relid;
+	int level;					/* executor nesting level of the statement */
+	SubTransactionId subid;
+	bool enabled;				/* no unique index or AFTER ROW trigger */
+	bool collect;				/* the threshold is crossed */
+	int64 ndelta;				/* #rows written to the delta table */
+	CopyCollectorState cs;
+} InsertCollectorState;
+
+int gammadb_insert_rowgroup_threshold = GAMMA_COLUMN_VECTOR_SIZE;
+
+static List *insert_collectors = NIL;
+static int gamma_exec_level = 0;
 
-	if (cstate.rows > 0)
+static ExecutorRun_hook_type prev_ExecutorRun = NULL;
+static ExecutorFinish_hook_type prev_ExecutorFinish = NULL;
+static ProcessUtility_hook_type prev_ProcessUtility = NULL;
+static object_access_hook_type prev_object_access_hook = NULL;
+
+/*
+ * The table rewrite (ALTER TABLE) and REFRESH MATERIALIZED VIEW build a
+ * transient table, then swap the relfilenodes of it and the old table. The
+ * cv table belongs to the oid and stays with the old table, it is truncated
+ * when the old table takes the relfilenode of the transient table, all rows
+ * are in the delta table then. REFRESH CONCURRENTLY builds the transient
+ * table without swapping.
+ */
+typedef struct GammaRewriteEntry
+{
+	Oid relid;					/* the transient table */
+	Oid relfilenode;			/* of the transient table */
+	int level;					/* utility nesting level of the statement */
+} GammaRewriteEntry;
+
+static List *rewrite_entries = NIL;
+static int gamma_utility_level = 0;
+
+/*
+ * The row groups of INSERT are written by ExecutorFinish, after the AFTER
+ * triggers are fired, see gamma_copy_has_after_trigger.
+ */
+static bool
+gamma_copy_insert_enabled(Relation rel)
+{
+	if (gamma_copy_has_after_trigger(rel))
+		return false;
+
+	return !gamma_copy_has_unique_index(rel);
+}
+
+bool
+gamma_copy_insert_collect(Relation rel, TupleTableSlot *slot, CommandId cid,
+						  int options)
+{
+	InsertCollectorState *is = NULL;
+	ListCell *lc;
+
+	if (gammadb_insert_rowgroup_threshold < 0 || gamma_exec_level == 0)
+		return false;
+
+	foreach (lc, insert_collectors)
 	{
-		uint32 rgid = cstate.rgid;
-		old_context = MemoryContextSwitchTo(cstate.context);
-		gamma_merge_one_rowgroup(rel, cstate.pin_tuples, rgid, NULL, cstate.rows);
+		InsertCollectorState *cur = (InsertCollectorState *) lfirst(lc);
+
+		if (cur->relid == RelationGetRelid(rel) &&
+			cur->level == gamma_exec_level)
+		{
+			is = cur;
+			break;
+		}
+	}
+
+	if (is == NULL)
+	{
+		MemoryContext old_context = MemoryContextSwitchTo(TopMemoryContext);
+
+		is = (InsertCollectorState *) palloc0(sizeof(InsertCollectorState));
+		is->relid = RelationGetRelid(rel);
+		is->level = gamma_exec_level;
+		is->subid = GetCurrentSubTransactionId();
+		is->enabled = gamma_copy_insert_enabled(rel);
+		insert_collectors = lappend(insert_collectors, is);
+
 		MemoryContextSwitchTo(old_context);
 	}
 
-	gamma_copy_release_state();
-	return;
+	if (!is->enabled)
+		return false;
+
+	if (!is->collect)
+	{
+		if (is->ndelta < gammadb_insert_rowgroup_threshold)
+		{
+			is->ndelta++;
+			return false;
+		}
+
+		gamma_copy_init_state(&is->cs, rel, cid, options, NULL, true, 0);
+		is->collect = true;
+	}
+
+	gamma_copy_collect_slot(&is->cs, rel, slot);
+
+	return true;
 }
 
 static void
-gamma_copy_slot_set_tid(TupleTableSlot *slot, uint32 rgid, uint16 row)
+gamma_copy_insert_free(InsertCollectorState *is)
 {
-	Assert(slot != NULL);
-	slot->tts_tid = gamma_meta_cv_convert_tid(rgid, row);
+	if (is->cs.context != NULL)
+		MemoryContextDelete(is->cs.context);
+
+	pfree(is);
+}
+
+/* write the row groups of the statements at level or deeper */
+static void
+gamma_copy_insert_flush(int level)
+{
+	ListCell *lc;
+
+	foreach (lc, insert_collectors)
+	{
+		InsertCollectorState *is = (InsertCollectorState *) lfirst(lc);
+
+		if (is->level < level)
+			continue;
+
+		insert_collectors = foreach_delete_current(insert_collectors, lc);
+
+		if (is->collect)
+		{
+			Relation rel = table_open(is->relid, RowExclusiveLock);
+
+			gamma_copy_finish_rowgroups(&is->cs, rel);
+			table_close(rel, RowExclusiveLock);
+		}
+
+		gamma_copy_insert_free(is);
+	}
+}
+
+/* drop the collected rows of the aborted (sub)transaction */
+static void
+gamma_copy_insert_discard(SubTransactionId subid)
+{
+	ListCell *lc;
+
+	foreach (lc, insert_collectors)
+	{
+		InsertCollectorState *is = (InsertCollectorState *) lfirst(lc);
+
+		if (is->subid < subid)
+			continue;
+
+		insert_collectors = foreach_delete_current(insert_collectors, lc);
+		gamma_copy_insert_free(is);
+	}
+}
+
+static void
+gamma_copy_ExecutorRun(QueryDesc *queryDesc, ScanDirection direction,
+					   uint64 count, bool execute_once)
+{
+	gamma_exec_level++;
+	PG_TRY();
+	{
+		if (prev_ExecutorRun)
+			prev_ExecutorRun(queryDesc, direction, count, execute_once);
+		else
+			standard_ExecutorRun(queryDesc, direction, count, execute_once);
+	}
+	PG_FINALLY();
+	{
+		gamma_exec_level--;
+	}
+	PG_END_TRY();
+}
+
+static void
+gamma_copy_ExecutorFinish(QueryDesc *queryDesc)
+{
+	gamma_exec_level++;
+	PG_TRY();
+	{
+		if (prev_ExecutorFinish)
+			prev_ExecutorFinish(queryDesc);
+		else
+			standard_ExecutorFinish(queryDesc);
+
+		/* the data-modifying CTEs may have been run to completion above */
+		if (insert_collectors != NIL)
+			gamma_copy_insert_flush(gamma_exec_level);
+	}
+	PG_FINALLY();
+	{
+		gamma_exec_level--;
+	}
+	PG_END_TRY();
+}
+
+/*
+ * The COPY aborted before it finished, the DSM of worker pool has been
+ * detached by the resource owner.
+ */
+static void
+gamma_copy_discard(SubTransactionId subid)
+{
+	if (cstate.rel == NULL || cstate.subid < subid)
+		return;
+
+	gamma_copy_release_state(&cstate);
+}
+
+/*
+ * Called when the storage of a new gamma table is created, the tables
+ * created by ALTER TABLE and REFRESH MATERIALIZED VIEW are the transient
+ * ones.
+ */
+void
+gamma_copy_note_rewrite(Relation rel)
+{
+	GammaRewriteEntry *entry;
+	MemoryContext old_context;
+
+	if (gamma_utility_tag != T_AlterTableStmt &&
+		gamma_utility_tag != T_RefreshMatViewStmt)
+		return;
+
+	if (rel->rd_createSubid == InvalidSubTransactionId)
+		return;
+
+	old_context = MemoryContextSwitchTo(TopMemoryContext);
+	entry = (GammaRewriteEntry *) palloc(sizeof(GammaRewriteEntry));
+	entry->relid = RelationGetRelid(rel);
+	entry->relfilenode = rel->rd_rel->relfilenode;
+	entry->level = gamma_utility_level;
+	rewrite_entries = lappend(rewrite_entries, entry);
+	MemoryContextSwitchTo(old_context);
+}
+
+/* the relfilenode of the table, with the changes of the current command */
+static Oid
+gamma_copy_current_relfilenode(Oid relid)
+{
+	Relation classrel;
+	SysScanDesc scan;
+	ScanKeyData key;
+	HeapTuple tuple;
+	Oid relfilenode = InvalidOid;
+
+	classrel = table_open(RelationRelationId, AccessShareLock);
+	ScanKeyInit(&key, Anum_pg_class_oid, BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(relid));
+	scan = systable_beginscan(classrel, ClassOidIndexId, true, SnapshotSelf,
+							  1, &key);
+
+	tuple = systable_getnext(scan);
+	if (HeapTupleIsValid(tuple))
+		relfilenode = ((Form_pg_class) GETSTRUCT(tuple))->relfilenode;
+
+	systable_endscan(scan);
+	table_close(classrel, AccessShareLock);
+
+	return relfilenode;
+}
+
+/*
+ * The relfilenodes are swapped by swap_relation_files, which invokes the
+ * post alter hook of the old table. The cv table is truncated here, before
+ * the indexes of the old table are rebuilt by finish_heap_swap.
+ */
+static void
+gamma_copy_object_access(ObjectAccessType access, Oid classId, Oid objectId,
+						 int subId, void *arg)
+{
+	ListCell *lc;
+	Oid relfilenode;
+
+	if (prev_object_access_hook)
+		prev_object_access_hook(access, classId, objectId, subId, arg);
+
+	/* the buffer entries and the stat slots of a dropped gamma table */
+	if (access == OAT_DROP && classId == RelationRelationId && subId == 0)
+	{
+		HeapTuple tuple = SearchSysCache1(RELOID, ObjectIdGetDatum(objectId));
+
+		if (HeapTupleIsValid(tuple))
+		{
+			Oid amoid = ((Form_pg_class) GETSTRUCT(tuple))->relam;
+
+			ReleaseSysCache(tuple);
+			if (OidIsValid(amoid) &&
+				amoid == get_table_am_oid("gamma", true))
+				gamma_buffer_invalid_rel(MyDatabaseId, objectId);
+		}
+		return;
+	}
+
+	if (access != OAT_POST_ALTER || classId != RelationRelationId ||
+		subId != 0 || rewrite_entries == NIL)
+		return;
+
+	relfilenode = gamma_copy_current_relfilenode(objectId);
+	foreach (lc, rewrite_entries)
+	{
+		GammaRewriteEntry *entry = (GammaRewriteEntry *) lfirst(lc);
+		Oid cvrelid;
+
+		/* the table has taken the relfilenode of the transient table */
+		if (entry->relfilenode != relfilenode || entry->relid == objectId)
+			continue;
+
+		rewrite_entries = foreach_delete_current(rewrite_entries, lc);
+		pfree(entry);
+
+		cvrelid = gamma_meta_get_cv_table_oid(objectId);
+		if (OidIsValid(cvrelid))
+		{
+			gamma_meta_truncate_cvtable(cvrelid);
+			gamma_buffer_invalid_rel(MyDatabaseId, objectId);
+		}
+
+		break;
+	}
+}
+
+/* forget the transient tables of the statements at level or deeper */
+static void
+gamma_copy_forget_rewrites(int level)
+{
+	ListCell *lc;
+
+	foreach (lc, rewrite_entries)
+	{
+		GammaRewriteEntry *entry = (GammaRewriteEntry *) lfirst(lc);
+
+		if (entry->level < level)
+			continue;
+
+		rewrite_entries = foreach_delete_current(rewrite_entries, lc);
+		pfree(entry);
+	}
+}
+
+/* remember the utility statement for the bulk inserts run by it */
+static void
+gamma_copy_ProcessUtility(PlannedStmt *pstmt, const char *queryString,
+						  bool readOnlyTree, ProcessUtilityContext context,
+						  ParamListInfo params, QueryEnvironment *queryEnv,
+						  DestReceiver *dest, QueryCompletion *qc)
+{
+	NodeTag save_tag = gamma_utility_tag;
+
+	gamma_utility_level++;
+	gamma_utility_tag = nodeTag(pstmt->utilityStmt);
+	if (IsA(pstmt->utilityStmt, CopyStmt) &&
+		!((CopyStmt *) pstmt->utilityStmt)->is_from)
+		gamma_utility_tag = T_Invalid;
+
+	PG_TRY();
+	{
+		if (prev_ProcessUtility)
+			prev_ProcessUtility(pstmt, queryString, readOnlyTree, context,
+								params, queryEnv, dest, qc);
+		else
+			standard_ProcessUtility(pstmt, queryString, readOnlyTree, context,
+									params, queryEnv, dest, qc);
+	}
+	PG_FINALLY();
+	{
+		if (rewrite_entries != NIL)
+			gamma_copy_forget_rewrites(gamma_utility_level);
+
+		gamma_utility_tag = save_tag;
+		gamma_utility_level--;
+	}
+	PG_END_TRY();
+}
+
+static void
+gamma_copy_xact_callback(XactEvent event, void *arg)
+{
+	if (event == XACT_EVENT_ABORT || event == XACT_EVENT_PARALLEL_ABORT)
+	{
+		gamma_copy_discard(InvalidSubTransactionId);
+
+		list_free_deep(rewrite_entries);
+		rewrite_entries = NIL;
+	}
+
+	if (insert_collectors == NIL)
+		return;
+
+	switch (event)
+	{
+		case XACT_EVENT_PRE_COMMIT:
+		case XACT_EVENT_PRE_PREPARE:
+			/* not expected, the statements have been finished */
+			gamma_copy_insert_flush(0);
+			break;
+		case XACT_EVENT_ABORT:
+		case XACT_EVENT_PARALLEL_ABORT:
+			gamma_copy_insert_discard(InvalidSubTransactionId);
+			break;
+		default:
+			break;
+	}
+}
+
+static void
+gamma_copy_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
+							SubTransactionId parentSubid, void *arg)
+{
+	if (event != SUBXACT_EVENT_ABORT_SUB)
+		return;
+
+	gamma_copy_discard(mySubid);
+
+	if (insert_collectors != NIL)
+		gamma_copy_insert_discard(mySubid);
+}
+
+void
+gamma_copy_init(void)
+{
+	prev_ExecutorRun = ExecutorRun_hook;
+	ExecutorRun_hook = gamma_copy_ExecutorRun;
+	prev_ExecutorFinish = ExecutorFinish_hook;
+	ExecutorFinish_hook = gamma_copy_ExecutorFinish;
+	prev_ProcessUtility = ProcessUtility_hook;
+	ProcessUtility_hook = gamma_copy_ProcessUtility;
+	prev_object_access_hook = object_access_hook;
+	object_access_hook = gamma_copy_object_access;
+
+	RegisterXactCallback(gamma_copy_xact_callback, NULL);
+	RegisterSubXactCallback(gamma_copy_subxact_callback, NULL);
+}
+
+/*
+ * The entry of parallel COPY workers, see gamma_copy_pool_start. Build the
+ * row groups received until the leader detaches the input queue, each one
+ * in a transaction.
+ */
+void
+gamma_copy_worker_main(Datum main_arg)
+{
+	dsm_segment *seg;
+	shm_toc *toc;
+	GammaCopyShared *shared;
+	char *queues;
+	shm_mq *inq;
+	shm_mq *outq;
+	shm_mq_handle *inqh;
+	shm_mq_handle *outqh;
+	MemoryContext context;
+	int idx;
+
+	memcpy(&idx, MyBgworkerEntry->bgw_extra, sizeof(idx));
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	seg = dsm_attach(DatumGetUInt32(main_arg));
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not map dynamic shared memory segment")));
+
+	toc = shm_toc_attach(GAMMA_COPY_MAGIC, dsm_segment_address(seg));
+	if (toc == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("invalid magic number in dynamic shared memory segment")));
+
+	shared = (GammaCopyShared *) shm_toc_lookup(toc, GAMMA_COPY_KEY_SHARED,
+												false);
+	queues = (char *) shm_toc_lookup(toc, GAMMA_COPY_KEY_QUEUES, false);
+
+	inq = (shm_mq *) (queues + (2 * idx) * GAMMA_COPY_QUEUE_SIZE);
+	outq = (shm_mq *) (queues + (2 * idx + 1) * GAMMA_COPY_QUEUE_SIZE);
+	shm_mq_set_receiver(inq, MyProc);
+	shm_mq_set_sender(outq, MyProc);
+	inqh = shm_mq_attach(inq, seg, NULL);
+	outqh = shm_mq_attach(outq, seg, NULL);
+
+	/* before any heavyweight lock is taken, the leader may have exited */
+	if (!BecomeLockGroupMember(shared->leader, shared->leader_pid))
+		return;
+
+	BackgroundWorkerInitializeConnectionByOid(shared->dbid, shared->userid, 0);
+
+	context = AllocSetContextCreate(TopMemoryContext,
+									"Gamma Copy Worker",
+									ALLOCSET_DEFAULT_SIZES);
+
+	for (;;)
+	{
+		GammaCopyTask task;
+		HeapTupleData *pin_tuples;
+		Relation rel;
+		Relation cv_rel;
+		List *cvtuples;
+		ListCell *lc;
+		MemoryContext old_context;
+		shm_mq_result res;
+		Size nbytes;
+		void *data;
+		int32 row;
+
+		CHECK_FOR_INTERRUPTS();
+
+		res = shm_mq_receive(inqh, &nbytes, &data, false);
+		if (res == SHM_MQ_DETACHED)
+			break;
+
+		Assert(nbytes == sizeof(GammaCopyTask));
+		memcpy(&task, data, sizeof(GammaCopyTask));
+
+		old_context = MemoryContextSwitchTo(context);
+
+		pin_tuples = (HeapTupleData *) palloc0(sizeof(HeapTupleData) *
+											   task.rows);
+		for (row = 0; row < task.rows; row++)
+		{
+			if (shm_mq_receive(inqh, &nbytes, &data, false) != SHM_MQ_SUCCESS)
+				elog(ERROR, "lost connection to the leader of parallel COPY");
+
+			pin_tuples[row].t_len = nbytes;
+			pin_tuples[row].t_data = (HeapTupleHeader) palloc(nbytes);
+			memcpy(pin_tuples[row].t_data, data, nbytes);
+		}
+
+		StartTransactionCommand();
+		PushActiveSnapshot(GetTransactionSnapshot());
+		MemoryContextSwitchTo(context);
+
+		rel = table_open(shared->relid, AccessShareLock);
+		cv_rel = table_open(gamma_meta_get_cv_table_rel(rel), AccessShareLock);
+
+		cvtuples = gamma_copy_form_rowgroup(rel, cv_rel, pin_tuples,
+											task.rgid, task.rows);
+
+		foreach (lc, cvtuples)
+		{
+			HeapTuple tuple = (HeapTuple) lfirst(lc);
+
+			if (shm_mq_send(outqh, tuple->t_len, tuple->t_data, false, true) !=
+					SHM_MQ_SUCCESS)
+				elog(ERROR, "lost connection to the leader of parallel COPY");
+		}
+
+		if (shm_mq_send(outqh, sizeof(task), &task, false, true) !=
+				SHM_MQ_SUCCESS)
+			elog(ERROR, "lost connection to the leader of parallel COPY");
+
+		table_close(cv_rel, AccessShareLock);
+		table_close(rel, AccessShareLock);
+
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+
+		MemoryContextSwitchTo(old_context);
+		MemoryContextReset(context);
+	}
+
+	dsm_detach(seg);
 }
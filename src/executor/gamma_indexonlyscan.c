@@ -17,6 +17,7 @@
 
 #include "access/relscan.h"
 #include "access/heapam.h"
+#include "access/visibilitymap.h"
 #include "executor/execdebug.h"
 #include "executor/nodeSeqscan.h"
 #include "lib/hyperloglog.h"
@@ -40,6 +41,7 @@
 #include "executor/vector_tuple_slot.h"
 #include "optimizer/gamma_converter.h"
 #include "storage/ctable_am.h"
+#include "storage/gamma_meta.h"
 #include "utils/utils.h"
 #include "utils/vdatum/vdatum.h"
 
@@ -292,31 +294,42 @@ gamma_indexonlyscan_access_indexnext(IndexOnlyScanState *node)
 		CHECK_FOR_INTERRUPTS();
 
 		/*
-		 * Rats, we have to visit the heap to check visibility.
+		 * The rows of delta table are checked by the visibility map as
+		 * heap, the rows of row groups are checked by the delete bitmap
+		 * in index fetch, which skips the row groups without deletes.
 		 */
-		InstrCountTuples2(node, 1);
-		if (!index_fetch_heap(scandesc, node->ioss_TableSlot))
-			continue;		/* no visible tuple, try next index entry */
+		if (gamma_meta_tid_is_columnar(tid) ||
+			!VM_ALL_VISIBLE(scandesc->heapRelation,
+							ItemPointerGetBlockNumber(tid),
+							&node->ioss_VMBuffer))
+		{
+			/*
+			 * Rats, we have to visit the heap to check visibility.
+			 */
+			InstrCountTuples2(node, 1);
+			if (!index_fetch_heap(scandesc, node->ioss_TableSlot))
+				continue;		/* no visible tuple, try next index entry */
 
-		ExecClearTuple(node->ioss_TableSlot);
+			ExecClearTuple(node->ioss_TableSlot);
 
-		/*
-		 * Only MVCC snapshots are supported here, so there should be no
-		 * need to keep following the HOT chain once a visible entry has
-		 * been found.  If we did want to allow that, we'd need to keep
-		 * more state to remember not to call index_getnext_tid next time.
-		 */
-		if (scandesc->xs_heap_continue)
-			elog(ERROR, "non-MVCC snapshots are not supported in index-only scans");
+			/*
+			 * Only MVCC snapshots are supported here, so there should be no
+			 * need to keep following the HOT chain once a visible entry has
+			 * been found.  If we did want to allow that, we'd need to keep
+			 * more state to remember not to call index_getnext_tid next time.
+			 */
+			if (scandesc->xs_heap_continue)
+				elog(ERROR, "non-MVCC snapshots are not supported in index-only scans");
 
-		/*
-		 * Note: at this point we are holding a pin on the heap page, as
-		 * recorded in scandesc->xs_cbuf.  We could release that pin now,
-		 * but it's not clear whether it's a win to do so.  The next index
-		 * entry might require a visit to the same heap page.
-		 */
+			/*
+			 * Note: at this point we are holding a pin on the heap page, as
+			 * recorded in scandesc->xs_cbuf.  We could release that pin now,
+			 * but it's not clear whether it's a win to do so.  The next index
+			 * entry might require a visit to the same heap page.
+			 */
 
-		tuple_from_heap = true;
+			tuple_from_heap = true;
+		}
 
 		/*
 		 * Fill the scan tuple slot with data from the index.  This might be
@@ -32,6 +32,7 @@
 #include "executor/nodeIndexscan.h"
 #include "executor/nodeCustom.h"
 #include "optimizer/plancat.h"
+#include "pgstat.h"
 #include "utils/memutils.h"
 
 #include "executor/gamma_indexscan.h"
@@ -54,7 +55,9 @@ static void gamma_indexscan_end(CustomScanState *node);
 static Plan * gamma_plan_indexscan(PlannerInfo *root, RelOptInfo *rel,
 								 CustomPath *best_path, List *tlist,
 								 List *clauses, List *custom_plans);
+static IndexScanDesc gamma_indexscan_get_scandesc(IndexScanState *node);
 static TupleTableSlot * gamma_indexscan_access_indexnext(IndexScanState *node);
+static TupleTableSlot * gamma_indexscan_access_sortnext(IndexScanState *node);
 static bool gamma_indexscan_access_indexrecheck(IndexScanState *node,
 													TupleTableSlot *slot);
 
@@ -65,9 +68,13 @@ typedef struct GammaIndexScanState
 {
 	CustomScanState	css;
 	IndexScanState *indexstate;
+	bool sort_tids;				/* fetch the tids sorted by row group */
 	//ExecProcNodeMtd ori_exec_index_scan_proc;
 } GammaIndexScanState;
 
+/* #tids sorted by row group before fetching, 0 disables it */
+int gammadb_index_fetch_sort_tids = 4096;
+
 static CustomPathMethods gamma_indexscan_path_methods = {
 	"gamma_indexscan",
 	gamma_plan_indexscan,
@@ -159,6 +166,15 @@ gamma_indexscan_begin(CustomScanState *node, EState *estate, int eflags)
 	IndexScan *plan = (IndexScan *)linitial(cscan->custom_plans);
 
 	indexstate = vindexstate->indexstate = ExecInitIndexScan(plan, estate, eflags);
+
+	/*
+	 * The results are unsorted (see gamma_indexscan_paths), the tids can be
+	 * fetched in the order of row groups if the scan is not moved backward.
+	 */
+	vindexstate->sort_tids = gammadb_index_fetch_sort_tids > 0 &&
+							 plan->indexorderby == NIL &&
+							 (eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK)) == 0 &&
+							 IsMVCCSnapshot(estate->es_snapshot);
 	//vindexstate->ori_exec_index_scan_proc = indexstate->ss.ps.ExecProcNode;
 	//indexstate->ss.ps.ExecProcNode = gamma_indexscan_exec;
 
@@ -192,6 +208,11 @@ gamma_indexscan_exec(CustomScanState *node)
 	if (indexstate->iss_NumRuntimeKeys != 0 && !indexstate->iss_RuntimeKeysReady)
 		ExecReScan((PlanState *) indexstate);
 
+	if (vindexstate->sort_tids)
+		return ExecScan(&indexstate->ss,
+				(ExecScanAccessMtd) gamma_indexscan_access_sortnext,
+				(ExecScanRecheckMtd) gamma_indexscan_access_indexrecheck);
+
 	return ExecScan(&indexstate->ss,
 			(ExecScanAccessMtd) gamma_indexscan_access_indexnext,
 			(ExecScanRecheckMtd) gamma_indexscan_access_indexrecheck);
@@ -206,33 +227,16 @@ gamma_indexscan_end(CustomScanState *node)
 	return;
 }
 
-static TupleTableSlot *
-gamma_indexscan_access_indexnext(IndexScanState *node)
+/*
+ * Begin the index scan and set the projection of columnar fetch.
+ */
+static IndexScanDesc
+gamma_indexscan_get_scandesc(IndexScanState *node)
 {
-	EState	   *estate;
-	ExprContext *econtext;
-	ScanDirection direction;
-	IndexScanDesc scandesc;
-	TupleTableSlot *slot;
+	EState *estate = node->ss.ps.state;
+	IndexScanDesc scandesc = node->iss_ScanDesc;
 	CIndexFetchCTableData *vscandesc;
 
-	/*
-	 * extract necessary information from index scan node
-	 */
-	estate = node->ss.ps.state;
-	direction = estate->es_direction;
-	/* flip direction if this is an overall backward scan */
-	if (ScanDirectionIsBackward(((IndexScan *) node->ss.ps.plan)->indexorderdir))
-	{
-		if (ScanDirectionIsForward(direction))
-			direction = BackwardScanDirection;
-		else if (ScanDirectionIsBackward(direction))
-			direction = ForwardScanDirection;
-	}
-	scandesc = node->iss_ScanDesc;
-	econtext = node->ss.ps.ps_ExprContext;
-	slot = node->ss.ss_ScanTupleSlot;
-
 	if (scandesc == NULL)
 	{
 		/*
@@ -269,6 +273,36 @@ gamma_indexscan_access_indexnext(IndexScanState *node)
 		vscandesc->bms_proj = bms_proj;
 	}
 
+	return scandesc;
+}
+
+static TupleTableSlot *
+gamma_indexscan_access_indexnext(IndexScanState *node)
+{
+	EState	   *estate;
+	ExprContext *econtext;
+	ScanDirection direction;
+	IndexScanDesc scandesc;
+	TupleTableSlot *slot;
+
+	/*
+	 * extract necessary information from index scan node
+	 */
+	estate = node->ss.ps.state;
+	direction = estate->es_direction;
+	/* flip direction if this is an overall backward scan */
+	if (ScanDirectionIsBackward(((IndexScan *) node->ss.ps.plan)->indexorderdir))
+	{
+		if (ScanDirectionIsForward(direction))
+			direction = BackwardScanDirection;
+		else if (ScanDirectionIsBackward(direction))
+			direction = ForwardScanDirection;
+	}
+	econtext = node->ss.ps.ps_ExprContext;
+	slot = node->ss.ss_ScanTupleSlot;
+
+	scandesc = gamma_indexscan_get_scandesc(node);
+
 	/*
 	 * ok, now that we have what we need, fetch the next tuple.
 	 */
@@ -302,6 +336,103 @@ gamma_indexscan_access_indexnext(IndexScanState *node)
 	return ExecClearTuple(slot);
 }
 
+/*
+ * Buffer the tids returned by the index and fetch them in the order of tid,
+ * so the tids of one row group are fetched together and the row group is
+ * loaded only once (see ctable_index_fetch_columnar).
+ */
+static TupleTableSlot *
+gamma_indexscan_access_sortnext(IndexScanState *node)
+{
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+	IndexScanDesc scandesc;
+	CIndexFetchCTableData *fetch;
+
+	scandesc = gamma_indexscan_get_scandesc(node);
+	fetch = (CIndexFetchCTableData *) scandesc->xs_heapfetch;
+
+	if (fetch->sort_items == NULL)
+	{
+		fetch->sort_size = gammadb_index_fetch_sort_tids;
+		fetch->sort_items = (CIndexFetchSortItem *)
+			MemoryContextAlloc(node->ss.ps.state->es_query_cxt,
+							sizeof(CIndexFetchSortItem) * fetch->sort_size);
+	}
+
+	for (;;)
+	{
+		CIndexFetchSortItem *item;
+		bool call_again = false;
+		bool found;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (fetch->sort_pos >= fetch->sort_nitems)
+		{
+			ItemPointer tid;
+
+			/* the index must not be called again once it is exhausted */
+			if (node->iss_ReachedEnd)
+				break;
+
+			fetch->sort_nitems = 0;
+			fetch->sort_pos = 0;
+
+			while (fetch->sort_nitems < fetch->sort_size)
+			{
+				tid = index_getnext_tid(scandesc, ForwardScanDirection);
+				if (tid == NULL)
+				{
+					node->iss_ReachedEnd = true;
+					break;
+				}
+
+				item = &fetch->sort_items[fetch->sort_nitems++];
+				item->tid = *tid;
+				item->recheck = scandesc->xs_recheck;
+			}
+
+			if (fetch->sort_nitems == 0)
+				break;
+
+			qsort(fetch->sort_items, fetch->sort_nitems,
+				  sizeof(CIndexFetchSortItem),
+				  (int (*) (const void *, const void *)) ItemPointerCompare);
+		}
+
+		item = &fetch->sort_items[fetch->sort_pos++];
+
+		/*
+		 * GAMMA NOTE: index_fetch_heap is not used here, it would set
+		 * kill_prior_tuple for a tid which is not the current one of
+		 * the index scan.
+		 */
+		found = table_index_fetch_tuple(scandesc->xs_heapfetch, &item->tid,
+										scandesc->xs_snapshot, slot,
+										&call_again, NULL);
+		if (!found)
+			continue;
+
+		pgstat_count_heap_fetch(scandesc->indexRelation);
+
+		if (item->recheck)
+		{
+			econtext->ecxt_scantuple = slot;
+			if (!ExecQualAndReset(node->indexqualorig, econtext))
+			{
+				InstrCountFiltered2(node, 1);
+				continue;
+			}
+		}
+
+		return slot;
+	}
+
+	node->iss_ReachedEnd = true;
+	return ExecClearTuple(slot);
+}
+
 static bool
 gamma_indexscan_access_indexrecheck(IndexScanState *node, TupleTableSlot *slot)
 {
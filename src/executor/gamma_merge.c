@@ -19,24 +19,39 @@
 #include "access/genam.h"
 #include "access/heapam.h"
 #include "access/htup_details.h"
+#include "access/relation.h"
 #include "access/sdir.h"
 #include "access/tupmacs.h"
+#include "access/xact.h"
 #include "catalog/index.h"
 #include "catalog/indexing.h"
+#include "catalog/objectaddress.h"
+#include "catalog/pg_class.h"
+#include "fmgr.h"
+#include "miscadmin.h"
 #include "storage/bufmgr.h"
 #include "storage/lmgr.h"
 #include "storage/shmem.h"
+#include "tcop/utility.h"
+#include "utils/acl.h"
+#include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "utils/memutils.h"
 #include "utils/snapmgr.h"
 
 #include "executor/gamma_merge.h"
+#include "storage/ctable_am.h"
 #include "storage/gamma_meta.h"
 #include "storage/gamma_rg.h"
 
 bool gammadb_delta_table_merge_all = false;
-static void gamma_merge_delete_tuple(Relation rel,
-									 HeapTupleData *pin_tuples, int32 row);
+
+PG_FUNCTION_INFO_V1(gamma_merge_delta);
+
+static int32 gamma_merge_delete_tuple(Relation rel,
+									  HeapTupleData *pin_tuples, int32 row);
+static bool gamma_merge_batch(Relation rel, HeapTupleData *pin_tuples,
+							  int32 row);
 static void gamma_merge_insert_index(Relation rel, HeapTupleData *pin_tuples,
 									 uint32 rgid, int32 row);
 static void CatalogIndexInsert(CatalogIndexState indstate, HeapTuple heapTuple);
@@ -56,8 +71,18 @@ gamma_merge_one_rowgroup(Relation rel, HeapTupleData *pin_tuples, uint32 rgid,
 	return;
 }
 
-void
-gamma_merge(Relation rel)
+/*
+ * Merge the delta table into row groups, at most max_rowgroups full row
+ * groups if it is positive, and the rest of less than one row group too if
+ * merge_tail. Return the number of full row groups merged.
+ *
+ * GAMMA NOTE: the merge runs with readers and writers, it only takes
+ * ShareUpdateExclusiveLock to exclude other merges and VACUUM. The row
+ * groups and the deletes of the moved tuples become visible together at
+ * commit, so the lock is held until then.
+ */
+int
+gamma_merge(Relation rel, int max_rowgroups, bool merge_tail)
 {
 	static HeapTupleData pin_tuples[GAMMA_COLUMN_VECTOR_SIZE];
 	static Buffer pin_buffers[GAMMA_COLUMN_VECTOR_SIZE] = {0};
@@ -70,13 +95,14 @@ gamma_merge(Relation rel)
 	uint32 flags = SO_TYPE_SEQSCAN |SO_ALLOW_STRAT |
 				   SO_ALLOW_SYNC | SO_ALLOW_PAGEMODE;
 	int i = 0;
+	int nrowgroups = 0;
 	MemoryContext merge_context;
 	MemoryContext old_context;
 
 	merge_context = AllocSetContextCreate(CurrentMemoryContext,
 										"Gamma Merge", ALLOCSET_DEFAULT_SIZES);
 
-	LockRelation(rel, AccessExclusiveLock);
+	LockRelation(rel, ShareUpdateExclusiveLock);
 	slot = MakeTupleTableSlot(RelationGetDescr(rel), &TTSOpsBufferHeapTuple);
 
 	/* transaction snapshot*/
@@ -106,14 +132,10 @@ gamma_merge(Relation rel)
 
 		if (row >= GAMMA_COLUMN_VECTOR_SIZE)
 		{
-			uint32 rgid = gamma_meta_next_rgid(rel);
-			old_context = MemoryContextSwitchTo(merge_context);
-			gamma_merge_one_rowgroup(rel, pin_tuples, rgid, NULL, row);
-
-			/* delete before inserting index */
-			gamma_merge_delete_tuple(rel, pin_tuples, row);
-			gamma_merge_insert_index(rel, pin_tuples, rgid, row);
+			bool merged;
 
+			old_context = MemoryContextSwitchTo(merge_context);
+			merged = gamma_merge_batch(rel, pin_tuples, row);
 			MemoryContextSwitchTo(old_context);
 			MemoryContextReset(merge_context);
 
@@ -129,21 +151,19 @@ gamma_merge(Relation rel)
 
 			row = 0;
 
+			if (merged)
+				nrowgroups++;
+			if (max_rowgroups > 0 && nrowgroups >= max_rowgroups)
+				break;
 		}
 	}
 
 	Assert(row < GAMMA_COLUMN_VECTOR_SIZE);
 
-	if (gammadb_delta_table_merge_all && row > 0)
+	if (merge_tail && row > 0)
 	{
-		uint32 rgid = gamma_meta_next_rgid(rel);
 		old_context = MemoryContextSwitchTo(merge_context);
-		gamma_merge_one_rowgroup(rel, pin_tuples, rgid, NULL, row);
-
-		/* delete before inserting index */
-		gamma_merge_delete_tuple(rel, pin_tuples, row);
-		gamma_merge_insert_index(rel, pin_tuples, rgid, row);
-
+		(void) gamma_merge_batch(rel, pin_tuples, row);
 		MemoryContextSwitchTo(old_context);
 		MemoryContextReset(merge_context);
 	}
@@ -163,21 +183,66 @@ gamma_merge(Relation rel)
 
 	ExecDropSingleTupleTableSlot(slot);
 
-	UnlockRelation(rel, AccessExclusiveLock);
-
 	MemoryContextDelete(merge_context);
-	return;
+	return nrowgroups;
 }
 
 
-static void
+/*
+ * Move the tuples of one batch into a new row group, return false if none
+ * of them can be moved.
+ */
+static bool
+gamma_merge_batch(Relation rel, HeapTupleData *pin_tuples, int32 row)
+{
+	uint32 rgid;
+	int32 nrows;
+
+	/* delete before building the row group, it skips the locked tuples */
+	nrows = gamma_merge_delete_tuple(rel, pin_tuples, row);
+	if (nrows == 0)
+		return false;
+
+	rgid = gamma_meta_next_rgid(rel);
+	gamma_merge_one_rowgroup(rel, pin_tuples, rgid, NULL, nrows);
+	gamma_merge_insert_index(rel, pin_tuples, rgid, nrows);
+
+	return true;
+}
+
+/*
+ * Delete the tuples to be moved, return the number of them. The tuples
+ * updated, deleted or locked by concurrent transactions are kept in delta
+ * table, they are removed from pin_tuples.
+ *
+ * The tuples are deleted as moved out like a cross-partition UPDATE, so a
+ * concurrent UPDATE or DELETE waiting for them fails, instead of skipping
+ * the rows now in the row group. ctable_delete reports the failure as a
+ * serialization error of the merge, the transaction is to be retried.
+ */
+static int32
 gamma_merge_delete_tuple(Relation rel, HeapTupleData *pin_tuples, int32 row)
 {
+	CommandId cid = GetCurrentCommandId(true);
+	int32 nrows = 0;
 	int i;
+
 	for (i = 0; i < row; i++)
-		CatalogTupleDelete(rel, &pin_tuples[i].t_self);
+	{
+		TM_FailureData tmfd;
+		TM_Result result;
 
-	return;
+		result = heap_delete(rel, &pin_tuples[i].t_self, cid, InvalidSnapshot,
+							 false, &tmfd, true);
+		if (result != TM_Ok)
+			continue;
+
+		if (nrows != i)
+			memcpy(&pin_tuples[nrows], &pin_tuples[i], sizeof(HeapTupleData));
+		nrows++;
+	}
+
+	return nrows;
 }
 
 static void
@@ -191,7 +256,8 @@ gamma_merge_insert_index(Relation rel, HeapTupleData *pin_tuples,
 
 	for (i = 0; i < row; i++)
 	{
-		gamma_meta_set_tid(&pin_tuples[i], rgid, i);
+		/* rowid of tid start with 1 */
+		gamma_meta_set_tid(&pin_tuples[i], rgid, i + 1);
 		CatalogIndexInsert(indstate, &pin_tuples[i]);
 	}
 
@@ -303,3 +369,51 @@ CatalogIndexInsert(CatalogIndexState indstate, HeapTuple heapTuple)
 
 	ExecDropSingleTupleTableSlot(slot);
 }
+
+/*
+ * gamma_merge_delta(rel regclass, max_rowgroups int4)
+ *
+ * Merge the delta table of a gamma table in the current transaction, the
+ * rest of less than one row group too if gammadb_delta_table_merge_all.
+ * Return the number of full row groups merged.
+ */
+Datum
+gamma_merge_delta(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	int32		max_rowgroups = PG_GETARG_INT32(1);
+	Relation	rel;
+	int			nrowgroups;
+
+	if (max_rowgroups < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("max_rowgroups must not be negative")));
+
+	PreventCommandIfReadOnly("gamma_merge_delta()");
+
+	rel = relation_open(relid, ShareUpdateExclusiveLock);
+
+#if PG_VERSION_NUM >= 160000
+	if (!object_ownercheck(RelationRelationId, relid, GetUserId()))
+#else
+	if (!pg_class_ownercheck(relid, GetUserId()))
+#endif
+		aclcheck_error(ACLCHECK_NOT_OWNER,
+					   get_relkind_objtype(rel->rd_rel->relkind),
+					   RelationGetRelationName(rel));
+
+	if (rel->rd_tableam != ctable_tableam_routine())
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a gamma table",
+						RelationGetRelationName(rel))));
+
+	nrowgroups = gamma_merge(rel, max_rowgroups,
+							 gammadb_delta_table_merge_all);
+
+	/* the merge lock is held until commit */
+	relation_close(rel, NoLock);
+
+	PG_RETURN_INT32(nrowgroups);
+}
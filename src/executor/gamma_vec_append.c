@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2024 Gamma Data, Inc. <jackey@gammadb.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Vectorized Append of partitioned (or inherited) gamma tables.
+ *
+ * The Append node is kept under the custom scan, so the partition pruning
+ * (initial and run-time) is done by it as usual. All its subplans are
+ * vectorized scans, the VectorTupleSlot batches they return are passed
+ * through to the vectorized upper nodes.
+ */
+
+#include "postgres.h"
+
+#include "executor/executor.h"
+#include "miscadmin.h"
+#include "nodes/extensible.h"
+#include "executor/nodeCustom.h"
+#include "utils/memutils.h"
+
+#include "executor/gamma_vec_append.h"
+
+/* CustomScanMethods */
+static Node *create_vec_append_state(CustomScan *custom_plan);
+
+/* CustomScanExecMethods */
+static void vec_append_begin(CustomScanState *node,
+							 EState *estate, int eflags);
+static void vec_append_rescan(CustomScanState *node);
+static TupleTableSlot* vec_append_exec(CustomScanState *node);
+static void vec_append_end(CustomScanState *node);
+
+static Plan * vec_plan_append(PlannerInfo *root, RelOptInfo *rel,
+							  CustomPath *best_path, List *tlist,
+							  List *clauses, List *custom_plans);
+
+static CustomPathMethods vec_append_path_methods = {
+	"gamma_vec_append",			/* CustomName */
+	vec_plan_append,
+};
+
+static CustomScanMethods vec_append_scan_methods = {
+	"gamma_vec_append",			/* CustomName */
+	create_vec_append_state,	/* CreateCustomScanState */
+};
+
+static CustomExecMethods vec_append_exec_methods = {
+	"gamma_vec_append",			/* CustomName */
+	vec_append_begin,			/* BeginCustomScan */
+	vec_append_exec,			/* ExecCustomScan */
+	vec_append_end,				/* EndCustomScan */
+	vec_append_rescan,			/* ReScanCustomScan */
+	NULL,						/* MarkPosCustomScan */
+	NULL,						/* RestrPosCustomScan */
+	NULL,						/* EstimateDSMCustomScan */
+	NULL,						/* InitializeDSMCustomScan */
+	NULL,						/* InitializeWorkerCustomScan */
+	NULL,						/* ExplainCustomScan */
+};
+
+void
+gamma_vec_append_init(void)
+{
+	RegisterCustomScanMethods(&vec_append_scan_methods);
+}
+
+const CustomPathMethods*
+gamma_vec_append_path_methods(void)
+{
+	return &vec_append_path_methods;
+}
+
+static Plan *
+vec_plan_append(PlannerInfo *root,
+		RelOptInfo *rel,
+		CustomPath *best_path,
+		List *tlist,
+		List *clauses,
+		List *custom_plans)
+{
+	CustomScan *cscan = makeNode(CustomScan);
+	Plan *subplan;
+
+	Assert(list_length(custom_plans) == 1);
+
+	subplan = (Plan *) linitial(custom_plans);
+	if (tlist == NULL)
+		tlist = subplan->targetlist;
+
+	cscan->scan.plan.parallel_aware = false;
+	cscan->scan.plan.targetlist = (List *) copyObject(tlist);
+	cscan->scan.plan.qual = NIL;
+	cscan->scan.plan.lefttree = NULL;
+	cscan->scan.scanrelid = 0;
+	cscan->custom_scan_tlist = (List *) copyObject(subplan->targetlist);
+	cscan->custom_plans = custom_plans;
+	cscan->methods = &vec_append_scan_methods;
+
+	return &cscan->scan.plan;
+}
+
+static Node *
+create_vec_append_state(CustomScan *custom_plan)
+{
+	CustomScanState *css =
+		MemoryContextAllocZero(CurTransactionContext,
+								sizeof(CustomScanState));
+
+	/* Set tag and executor callbacks */
+	NodeSetTag(css, T_CustomScanState);
+	css->methods = &vec_append_exec_methods;
+
+	return (Node *) css;
+}
+
+static void
+vec_append_begin(CustomScanState *node, EState *estate, int eflags)
+{
+	CustomScan *cscan = (CustomScan *) node->ss.ps.plan;
+	PlanState *child;
+
+	/* the Append, or its only subplan if setrefs removed the Append */
+	child = ExecInitNode((Plan *) linitial(cscan->custom_plans),
+						 estate, eflags);
+
+	/* the batches are passed through, no projection is done here */
+	node->ss.ps.ps_ProjInfo = NULL;
+	node->ss.ps.ps_ResultTupleDesc = child->ps_ResultTupleDesc;
+	node->ss.ps.resultops = child->resultops;
+	node->ss.ps.resultopsset = child->resultopsset;
+	node->ss.ps.resultopsfixed = child->resultopsfixed;
+
+	/* set child planstate */
+	node->custom_ps = lappend(node->custom_ps, child);
+}
+
+static TupleTableSlot *
+vec_append_exec(CustomScanState *node)
+{
+	PlanState *child = (PlanState *) linitial(node->custom_ps);
+
+	CHECK_FOR_INTERRUPTS();
+
+	return ExecProcNode(child);
+}
+
+static void
+vec_append_rescan(CustomScanState *node)
+{
+	PlanState *child = (PlanState *) linitial(node->custom_ps);
+
+	/* the changed params may prune the partitions again */
+	if (node->ss.ps.chgParam != NULL)
+		UpdateChangedParamSet(child, node->ss.ps.chgParam);
+
+	/* the child is rescanned by ExecProcNode if its params are changed */
+	if (child->chgParam == NULL)
+		ExecReScan(child);
+}
+
+static void
+vec_append_end(CustomScanState *node)
+{
+	ExecEndNode((PlanState *) linitial(node->custom_ps));
+}
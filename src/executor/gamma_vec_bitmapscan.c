@@ -0,0 +1,970 @@
+/*
+ * Copyright (c) 2024 Gamma Data, Inc. <jackey@gammadb.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Vectorized bitmap heap scan of gamma tables.
+ *
+ * TIDBitmap can't hold the tids of row groups: the block of a columnar tid
+ * is MaxBlockNumber - rgid and the offset is the rowid (from 1 up to
+ * GAMMA_COLUMN_VECTOR_SIZE). So the bitmap quals (BitmapIndexScan, BitmapAnd
+ * and BitmapOr) are not executed by MultiExecProcNode, the tids are fetched
+ * by index_getnext_tid and kept in a sorted array instead. The tids of a row
+ * group are adjacent in the array, the row group is loaded once and the
+ * matching rows are emitted as vector batches, the other rows are skipped.
+ *
+ * As the lossy pages of TIDBitmap, if the array exceeds work_mem, the tids
+ * of each row group are replaced by one lossy tid, then all the rows of the
+ * row group are emitted and the bitmap quals are rechecked.
+ */
+
+#include "postgres.h"
+
+#include "access/genam.h"
+#include "access/relscan.h"
+#include "access/tableam.h"
+#include "catalog/pg_type.h"
+#include "executor/executor.h"
+#include "executor/instrument.h"
+#include "executor/nodeIndexscan.h"
+#include "miscadmin.h"
+#include "nodes/extensible.h"
+#include "nodes/makefuncs.h"
+#include "executor/nodeCustom.h"
+#include "optimizer/optimizer.h"
+#include "optimizer/plancat.h"
+#include "storage/bufmgr.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+#include "executor/gamma_expr.h"
+#include "executor/gamma_vec_bitmapscan.h"
+#include "executor/vec_exec_scan.h"
+#include "executor/vector_tuple_slot.h"
+#include "storage/ctable_vec_am.h"
+#include "storage/gamma_meta.h"
+#include "utils/gamma_cache.h"
+#include "utils/utils.h"
+#include "utils/vdatum/vdatum.h"
+
+/* the offset of a lossy tid, it is larger than any rowid */
+#define VEC_BITMAPSCAN_LOSSY_ROWID	PG_UINT16_MAX
+
+#define VecBitmapTidIsLossy(tid) \
+	(gamma_meta_tid_is_columnar(tid) && \
+	 ItemPointerGetOffsetNumberNoCheck(tid) == VEC_BITMAPSCAN_LOSSY_ROWID)
+
+/* CustomScanMethods */
+static Node *create_vec_bitmapscan_state(CustomScan *custom_plan);
+
+/* CustomScanExecMethods */
+static void vec_bitmapscan_begin(CustomScanState *node,
+								 EState *estate, int eflags);
+static void vec_bitmapscan_rescan(CustomScanState *node);
+static TupleTableSlot* vec_bitmapscan_exec(CustomScanState *node);
+static void vec_bitmapscan_end(CustomScanState *node);
+
+static VecBitmapHeapScanState* vec_bitmapscan_execinit(BitmapHeapScan *node,
+												EState *estate, int eflags);
+static TupleTableSlot* vec_bitmapscan_access_next(ScanState *node);
+static bool vec_bitmapscan_access_recheck(ScanState *node,
+										  TupleTableSlot *slot);
+static Plan * vec_plan_bitmapscan(PlannerInfo *root, RelOptInfo *rel,
+								  CustomPath *best_path, List *tlist,
+								  List *clauses, List *custom_plans);
+
+/*
+ * VecBitmapScanState - state object of vectorized bitmap scan on executor.
+ */
+typedef struct VecBitmapScanState
+{
+	CustomScanState	css;
+	VecBitmapHeapScanState *bitmapstate;
+	TupleTableSlot *backup_css_result_slot;
+} VecBitmapScanState;
+
+static CustomPathMethods vec_bitmapscan_path_methods = {
+	"gamma_vec_bitmapscan",			/* CustomName */
+	vec_plan_bitmapscan,
+};
+
+static CustomScanMethods vec_bitmapscan_scan_methods = {
+	"gamma_vec_bitmapscan",			/* CustomName */
+	create_vec_bitmapscan_state,	/* CreateCustomScanState */
+};
+
+static CustomExecMethods vec_bitmapscan_exec_methods = {
+	"gamma_vec_bitmapscan",		/* CustomName */
+	vec_bitmapscan_begin,		/* BeginCustomScan */
+	vec_bitmapscan_exec,		/* ExecCustomScan */
+	vec_bitmapscan_end,			/* EndCustomScan */
+	vec_bitmapscan_rescan,		/* ReScanCustomScan */
+	NULL,						/* MarkPosCustomScan */
+	NULL,						/* RestrPosCustomScan */
+	NULL,						/* EstimateDSMCustomScan */
+	NULL,						/* InitializeDSMCustomScan */
+	NULL,						/* InitializeWorkerCustomScan */
+	NULL,						/* ExplainCustomScan */
+};
+
+void
+gamma_vec_bitmapscan_init(void)
+{
+	RegisterCustomScanMethods(&vec_bitmapscan_scan_methods);
+}
+
+const CustomPathMethods*
+gamma_vec_bitmapscan_path_methods(void)
+{
+	return &vec_bitmapscan_path_methods;
+}
+
+static Plan *
+vec_plan_bitmapscan(PlannerInfo *root,
+		RelOptInfo *rel,
+		CustomPath *best_path,
+		List *tlist,
+		List *clauses,
+		List *custom_plans)
+{
+	CustomScan *cscan = makeNode(CustomScan);
+	Plan *subplan;
+	List *scan_tlist;
+
+	Assert(list_length(custom_plans) == 1);
+
+	subplan = (Plan *) linitial(custom_plans);
+	scan_tlist = subplan->targetlist;
+	if (scan_tlist == NULL)
+		scan_tlist = subplan->targetlist = build_physical_tlist(root, rel);
+
+	if (tlist == NULL)
+		tlist = scan_tlist;
+
+	cscan->scan.plan.parallel_aware = false;
+	cscan->scan.plan.targetlist = (List *) copyObject(tlist);
+	cscan->scan.plan.qual = NIL;
+	cscan->scan.plan.lefttree = NULL;
+	cscan->scan.scanrelid = 0;
+	cscan->custom_scan_tlist = (List *) copyObject(scan_tlist);
+	cscan->custom_plans = custom_plans;
+	cscan->methods = &vec_bitmapscan_scan_methods;
+
+	return &cscan->scan.plan;
+}
+
+static Node *
+create_vec_bitmapscan_state(CustomScan *custom_plan)
+{
+	VecBitmapScanState *vstate =
+		MemoryContextAllocZero(CurTransactionContext,
+								sizeof(VecBitmapScanState));
+
+	/* Set tag and executor callbacks */
+	NodeSetTag(vstate, T_CustomScanState);
+	vstate->css.methods = &vec_bitmapscan_exec_methods;
+
+	return (Node *) vstate;
+}
+
+static void
+vec_bitmapscan_begin(CustomScanState *node, EState *estate, int eflags)
+{
+	VecBitmapScanState *vstate = (VecBitmapScanState *) node;
+	CustomScan *cscan = (CustomScan *) node->ss.ps.plan;
+	BitmapHeapScan *plan = (BitmapHeapScan *) linitial(cscan->custom_plans);
+	ScanState *scanstate;
+
+	vstate->bitmapstate = vec_bitmapscan_execinit(plan, estate, eflags);
+	scanstate = &vstate->bitmapstate->bhss.ss;
+
+	/* ExecEndCustomScan need it */
+	vstate->backup_css_result_slot = vstate->css.ss.ps.ps_ResultTupleSlot;
+
+	/* the same as vec_tablescan_begin */
+	if (scanstate->ps.ps_ResultTupleSlot != NULL)
+	{
+		TupleDesc result_desc =
+			vstate->css.ss.ps.ps_ResultTupleSlot->tts_tupleDescriptor;
+		en_vec_tupledesc(result_desc);
+		vstate->css.ss.ps.ps_ResultTupleSlot = NULL;
+		VecExecConditionalAssignProjectionInfo(&vstate->css.ss.ps,
+				scanstate->ps.ps_ResultTupleSlot->tts_tupleDescriptor,
+				((Scan *) plan)->scanrelid);
+
+		if (vstate->css.ss.ps.ps_ProjInfo == NULL)
+			vstate->css.ss.ps.ps_ResultTupleSlot =
+						  scanstate->ps.ps_ResultTupleSlot;
+	}
+	else
+	{
+		scanstate->ps.ps_ResultTupleSlot = scanstate->ss_ScanTupleSlot;
+
+		if (vstate->css.ss.ps.ps_ProjInfo != NULL)
+		{
+			TupleDesc result_desc =
+				vstate->css.ss.ps.ps_ResultTupleSlot->tts_tupleDescriptor;
+			en_vec_tupledesc(result_desc);
+			vstate->css.ss.ps.ps_ResultTupleSlot = NULL;
+
+			VecExecConditionalAssignProjectionInfo(&vstate->css.ss.ps,
+					scanstate->ps.ps_ResultTupleSlot->tts_tupleDescriptor,
+					((Scan *) plan)->scanrelid);
+		}
+		else
+		{
+			node->ss.ps.scanops = scanstate->ps.scanops;
+			node->ss.ps.resultops = scanstate->ps.resultops;
+			vstate->css.ss.ps.ps_ResultTupleSlot =
+							scanstate->ps.ps_ResultTupleSlot;
+		}
+	}
+
+	/* set child planstate */
+	node->custom_ps = lappend(node->custom_ps, vstate->bitmapstate);
+}
+
+/*
+ * The quals are evaluated as one vectorized AND expression.
+ */
+static ExprState *
+vec_bitmapscan_init_qual(List *qual, PlanState *parent)
+{
+	FuncExpr *newexpr;
+
+	if (qual == NULL)
+		return NULL;
+
+	newexpr = makeNode(FuncExpr);
+	newexpr->funcid = gamma_get_boolexpr_and_oid();
+	newexpr->funcresulttype = en_vec_type(BOOLOID);
+	newexpr->funcretset = false;
+	newexpr->funcvariadic = true;
+	newexpr->funcformat = COERCE_EXPLICIT_CALL;
+	newexpr->funccollid = InvalidOid;
+	newexpr->inputcollid = InvalidOid;
+	newexpr->args = qual;
+	newexpr->location = -1;
+
+	return gamma_exec_init_expr((Expr *) newexpr, parent);
+}
+
+static VecBitmapHeapScanState *
+vec_bitmapscan_execinit(BitmapHeapScan *node, EState *estate, int eflags)
+{
+	VecBitmapHeapScanState *bstate;
+	BitmapHeapScanState *scanstate;
+	Relation rel;
+	TupleDesc vdesc;
+	int i;
+
+	bstate = (VecBitmapHeapScanState *) palloc0(sizeof(VecBitmapHeapScanState));
+	scanstate = &bstate->bhss;
+
+	/* EXPLAIN shows it as the bitmap heap scan */
+	NodeSetTag(scanstate, T_BitmapHeapScanState);
+
+	scanstate->ss.ps.plan = (Plan *) node;
+	scanstate->ss.ps.state = estate;
+	scanstate->ss.ps.ExecProcNode = (ExecProcNodeMtd) vec_bitmapscan_exec;
+
+	ExecAssignExprContext(estate, &scanstate->ss.ps);
+
+	scanstate->ss.ss_currentRelation =
+		ExecOpenScanRelation(estate, node->scan.scanrelid, eflags);
+
+	/* the bitmap quals, only their tids are used */
+	outerPlanState(scanstate) = ExecInitNode(outerPlan(node), estate, eflags);
+
+	rel = scanstate->ss.ss_currentRelation;
+	vdesc = CreateTupleDescCopyConstr(RelationGetDescr(rel));
+	for (i = 0; i < vdesc->natts; i++)
+	{
+		Form_pg_attribute	attr = &(vdesc->attrs[i]);
+		Oid					vtypid = en_vec_type(attr->atttypid);
+		if (vtypid != InvalidOid)
+			attr->atttypid = vtypid;
+		else
+			elog(ERROR, "cannot find vectorized type for type %d",
+					attr->atttypid);
+	}
+
+	ExecInitScanTupleSlot(estate, &scanstate->ss, vdesc, &TTSOpsVector);
+
+	ExecInitResultTypeTL(&scanstate->ss.ps);
+	VecExecAssignScanProjectionInfo(&scanstate->ss);
+
+	scanstate->ss.ps.qual =
+		vec_bitmapscan_init_qual(node->scan.plan.qual, (PlanState *) scanstate);
+	scanstate->bitmapqualorig =
+		vec_bitmapscan_init_qual(node->bitmapqualorig, (PlanState *) scanstate);
+
+	bstate->heap_slot = MakeSingleTupleTableSlot(RelationGetDescr(rel),
+												 &TTSOpsBufferHeapTuple);
+	bstate->tid_context = AllocSetContextCreate(CurrentMemoryContext,
+												"Gamma Bitmap Scan TIDs",
+												ALLOCSET_DEFAULT_SIZES);
+
+	return bstate;
+}
+
+/*
+ * Sort the tids and remove the duplicates.
+ */
+static int64
+vec_bitmapscan_sort_tids(ItemPointerData *tids, int64 ntids)
+{
+	int64 i;
+	int64 n = 0;
+
+	if (ntids <= 1)
+		return ntids;
+
+	qsort(tids, ntids, sizeof(ItemPointerData),
+		  (int (*) (const void *, const void *)) ItemPointerCompare);
+
+	for (i = 1; i < ntids; i++)
+	{
+		if (!ItemPointerEquals(&tids[n], &tids[i]))
+			tids[++n] = tids[i];
+	}
+
+	return n + 1;
+}
+
+/*
+ * Replace the tids of each row group with a lossy tid, the sorted tids are
+ * still sorted. The tids of delta table are kept.
+ */
+static int64
+vec_bitmapscan_lossify_tids(ItemPointerData *tids, int64 ntids)
+{
+	int64 i;
+	int64 n = 0;
+
+	for (i = 0; i < ntids; i++)
+	{
+		BlockNumber blkno = ItemPointerGetBlockNumberNoCheck(&tids[i]);
+
+		if (!gamma_meta_tid_is_columnar(&tids[i]))
+		{
+			tids[n++] = tids[i];
+			continue;
+		}
+
+		if (n > 0 && VecBitmapTidIsLossy(&tids[n - 1]) &&
+			ItemPointerGetBlockNumberNoCheck(&tids[n - 1]) == blkno)
+			continue;
+
+		ItemPointerSet(&tids[n++], blkno, VEC_BITMAPSCAN_LOSSY_ROWID);
+	}
+
+	return n;
+}
+
+/* the end of the tids in the block of tids[start] */
+static int64
+vec_bitmapscan_block_end(ItemPointerData *tids, int64 ntids, int64 start)
+{
+	BlockNumber blkno = ItemPointerGetBlockNumberNoCheck(&tids[start]);
+	int64 end = start + 1;
+
+	while (end < ntids && ItemPointerGetBlockNumberNoCheck(&tids[end]) == blkno)
+		end++;
+
+	return end;
+}
+
+/*
+ * Merge two sorted tid arrays, for BitmapAnd and BitmapOr. A lossy row group
+ * is merged as a lossy page of TIDBitmap: the union is lossy, the
+ * intersection is the tids of the other side.
+ */
+static ItemPointerData *
+vec_bitmapscan_merge_tids(ItemPointerData *a, int64 na,
+						  ItemPointerData *b, int64 nb,
+						  bool intersect, int64 *ntids)
+{
+	ItemPointerData *result;
+	int64 i = 0;
+	int64 j = 0;
+	int64 n = 0;
+
+	result = MemoryContextAllocHuge(CurrentMemoryContext,
+					sizeof(ItemPointerData) * Max(na + nb, 1));
+
+	while (i < na && j < nb)
+	{
+		int32 cmp;
+
+		if (ItemPointerGetBlockNumberNoCheck(&a[i]) ==
+			ItemPointerGetBlockNumberNoCheck(&b[j]) &&
+			(VecBitmapTidIsLossy(&a[i]) || VecBitmapTidIsLossy(&b[j])))
+		{
+			int64 a_end = vec_bitmapscan_block_end(a, na, i);
+			int64 b_end = vec_bitmapscan_block_end(b, nb, j);
+
+			if (!intersect || (VecBitmapTidIsLossy(&a[i]) &&
+							   VecBitmapTidIsLossy(&b[j])))
+				ItemPointerSet(&result[n++],
+							   ItemPointerGetBlockNumberNoCheck(&a[i]),
+							   VEC_BITMAPSCAN_LOSSY_ROWID);
+			else if (VecBitmapTidIsLossy(&a[i]))
+			{
+				for (; j < b_end; j++)
+					result[n++] = b[j];
+			}
+			else
+			{
+				for (; i < a_end; i++)
+					result[n++] = a[i];
+			}
+
+			i = a_end;
+			j = b_end;
+			continue;
+		}
+
+		cmp = ItemPointerCompare(&a[i], &b[j]);
+		if (cmp == 0)
+		{
+			result[n++] = a[i];
+			i++;
+			j++;
+		}
+		else if (cmp < 0)
+		{
+			if (!intersect)
+				result[n++] = a[i];
+			i++;
+		}
+		else
+		{
+			if (!intersect)
+				result[n++] = b[j];
+			j++;
+		}
+	}
+
+	if (!intersect)
+	{
+		for (; i < na; i++)
+			result[n++] = a[i];
+		for (; j < nb; j++)
+			result[n++] = b[j];
+	}
+
+	pfree(a);
+	pfree(b);
+
+	*ntids = n;
+	return result;
+}
+
+/*
+ * The same as MultiExecBitmapIndexScan, but the tids are fetched with
+ * amgettuple. The array is kept in work_mem by lossy row groups, if it is
+ * not halved, it grows anyway as tbm_lossify.
+ */
+static ItemPointerData *
+vec_bitmapscan_index_tids(VecBitmapHeapScanState *bstate,
+						  BitmapIndexScanState *node, int64 *ntids)
+{
+	IndexScanDesc scandesc;
+	ItemPointer itemptr;
+	ItemPointerData *tids;
+	int64 maxtids = 1024;
+	int64 limit;
+	int64 n = 0;
+	bool doscan;
+
+	if (node->ss.ps.instrument)
+		InstrStartNode(node->ss.ps.instrument);
+
+	scandesc = node->biss_ScanDesc;
+
+	if (!node->biss_RuntimeKeysReady &&
+		(node->biss_NumRuntimeKeys != 0 || node->biss_NumArrayKeys != 0))
+	{
+		ExecReScan((PlanState *) node);
+		doscan = node->biss_RuntimeKeysReady;
+	}
+	else
+		doscan = true;
+
+	limit = Max((int64) work_mem * 1024 / sizeof(ItemPointerData), maxtids);
+
+	tids = MemoryContextAllocHuge(CurrentMemoryContext,
+								  sizeof(ItemPointerData) * maxtids);
+
+	while (doscan)
+	{
+		while ((itemptr = index_getnext_tid(scandesc,
+											ForwardScanDirection)) != NULL)
+		{
+			if (n >= maxtids)
+			{
+				/* over work_mem, the row groups become lossy */
+				if (maxtids >= limit)
+				{
+					n = vec_bitmapscan_sort_tids(tids, n);
+					n = vec_bitmapscan_lossify_tids(tids, n);
+					bstate->recheck = true;
+				}
+
+				if (n >= maxtids / 2)
+				{
+					maxtids *= 2;
+					tids = repalloc_huge(tids,
+										 sizeof(ItemPointerData) * maxtids);
+				}
+			}
+
+			tids[n++] = *itemptr;
+
+			if (scandesc->xs_recheck)
+				bstate->recheck = true;
+
+			CHECK_FOR_INTERRUPTS();
+		}
+
+		doscan = ExecIndexAdvanceArrayKeys(node->biss_ArrayKeys,
+										   node->biss_NumArrayKeys);
+		if (doscan)
+			index_rescan(node->biss_ScanDesc,
+						 node->biss_ScanKeys, node->biss_NumScanKeys,
+						 NULL, 0);
+	}
+
+	if (node->ss.ps.instrument)
+		InstrStopNode(node->ss.ps.instrument, (double) n);
+
+	*ntids = vec_bitmapscan_sort_tids(tids, n);
+	return tids;
+}
+
+static ItemPointerData *
+vec_bitmapscan_collect_tids(VecBitmapHeapScanState *bstate,
+							PlanState *node, int64 *ntids)
+{
+	ItemPointerData *result = NULL;
+	PlanState **bitmapplans;
+	int nplans;
+	bool intersect;
+	int i;
+
+	check_stack_depth();
+
+	*ntids = 0;
+
+	if (node->chgParam != NULL)
+		ExecReScan(node);
+
+	switch (nodeTag(node))
+	{
+		case T_BitmapIndexScanState:
+			return vec_bitmapscan_index_tids(bstate,
+									(BitmapIndexScanState *) node, ntids);
+		case T_BitmapAndState:
+			bitmapplans = ((BitmapAndState *) node)->bitmapplans;
+			nplans = ((BitmapAndState *) node)->nplans;
+			intersect = true;
+			break;
+		case T_BitmapOrState:
+			bitmapplans = ((BitmapOrState *) node)->bitmapplans;
+			nplans = ((BitmapOrState *) node)->nplans;
+			intersect = false;
+			break;
+		default:
+			elog(ERROR, "unrecognized node type: %d", (int) nodeTag(node));
+			return NULL;
+	}
+
+	if (node->instrument)
+		InstrStartNode(node->instrument);
+
+	for (i = 0; i < nplans; i++)
+	{
+		ItemPointerData *subtids;
+		int64 nsubtids;
+
+		subtids = vec_bitmapscan_collect_tids(bstate, bitmapplans[i],
+											  &nsubtids);
+
+		if (result == NULL)
+		{
+			result = subtids;
+			*ntids = nsubtids;
+		}
+		else
+		{
+			result = vec_bitmapscan_merge_tids(result, *ntids,
+											   subtids, nsubtids,
+											   intersect, ntids);
+		}
+
+		/* the intersection is empty already */
+		if (intersect && *ntids == 0)
+			break;
+	}
+
+	if (node->instrument)
+		InstrStopNode(node->instrument, 0);
+
+	return result;
+}
+
+static void
+vec_bitmapscan_init_scan(VecBitmapHeapScanState *bstate)
+{
+	ScanState *scanstate = &bstate->bhss.ss;
+	EState *estate = scanstate->ps.state;
+	BitmapHeapScan *plan = (BitmapHeapScan *) scanstate->ps.plan;
+	CTableScanDesc cscan;
+	Bitmapset *bms_proj = NULL;
+	MemoryContext oldcontext;
+
+	if (scanstate->ss_currentScanDesc == NULL)
+	{
+		scanstate->ss_currentScanDesc =
+			vec_ctable_beginscan(scanstate->ss_currentRelation,
+								 estate->es_snapshot, 0, NULL, NULL,
+								 SO_TYPE_BITMAPSCAN | SO_ALLOW_PAGEMODE);
+
+		cscan = (CTableScanDesc) scanstate->ss_currentScanDesc;
+		pull_varattnos((Node *) plan->scan.plan.targetlist,
+						plan->scan.scanrelid, &bms_proj);
+		pull_varattnos((Node *) plan->scan.plan.qual,
+						plan->scan.scanrelid, &bms_proj);
+		pull_varattnos((Node *) plan->bitmapqualorig,
+						plan->scan.scanrelid, &bms_proj);
+		cscan->cvscan->bms_proj = bms_proj;
+	}
+
+	oldcontext = MemoryContextSwitchTo(bstate->tid_context);
+	bstate->tids = vec_bitmapscan_collect_tids(bstate,
+											   outerPlanState(&bstate->bhss),
+											   &bstate->ntids);
+	MemoryContextSwitchTo(oldcontext);
+
+	bstate->pos = 0;
+	bstate->inited = true;
+}
+
+/*
+ * Emit the rows of a row group in the window of the next tid.
+ */
+static bool
+vec_bitmapscan_next_rg_batch(VecBitmapHeapScanState *bstate,
+							 TupleTableSlot *slot)
+{
+	CTableScanDesc cscan =
+		(CTableScanDesc) bstate->bhss.ss.ss_currentScanDesc;
+	CVScanDesc cvscan = cscan->cvscan;
+	VectorTupleSlot *vslot = (VectorTupleSlot *) slot;
+	ItemPointer tid = &bstate->tids[bstate->pos];
+	BlockNumber blkno = ItemPointerGetBlockNumber(tid);
+	uint32 rgid = gamma_meta_ptid_get_rgid(tid);
+	uint32 rowid;
+	uint32 offset;
+	uint32 count;
+	bool keep[VECTOR_SIZE];
+	int i;
+
+	/* the row group is loaded once for all its tids */
+	if (!bstate->rg_loaded || cvscan->rg->rgid != rgid)
+	{
+		bstate->rg_loaded = cvtable_load_rg(cvscan, rgid);
+		if (!bstate->rg_loaded)
+		{
+			/* the row group is not visible, skip its tids */
+			while (bstate->pos < bstate->ntids &&
+				   ItemPointerGetBlockNumber(&bstate->tids[bstate->pos]) == blkno)
+				bstate->pos++;
+
+			return false;
+		}
+
+		cvtable_load_delbitmap(cvscan, rgid);
+		bstate->lossy_offset = 0;
+
+		if (VecBitmapTidIsLossy(tid))
+			bstate->bhss.lossy_pages++;
+		else
+			bstate->bhss.exact_pages++;
+	}
+
+	/* all the rows of a lossy row group, the quals are rechecked */
+	if (VecBitmapTidIsLossy(tid))
+	{
+		offset = bstate->lossy_offset;
+		if (offset >= cvscan->rg->dim)
+		{
+			bstate->pos++;
+			return false;
+		}
+
+		count = tts_vector_slot_from_rg(slot, cvscan->rg, cvscan->bms_proj,
+										offset);
+		bstate->lossy_offset = offset + count;
+		return true;
+	}
+
+	/* rowid of tid start with 1, it is the position in row group here */
+	rowid = gamma_meta_ptid_get_rowid(tid) - 1;
+	offset = rowid - rowid % VECTOR_SIZE;
+	if (offset >= cvscan->rg->dim)
+	{
+		bstate->pos++;
+		return false;
+	}
+
+	count = tts_vector_slot_from_rg(slot, cvscan->rg, cvscan->bms_proj, offset);
+
+	memset(keep, false, sizeof(bool) * count);
+	while (bstate->pos < bstate->ntids)
+	{
+		tid = &bstate->tids[bstate->pos];
+		if (ItemPointerGetBlockNumber(tid) != blkno)
+			break;
+
+		rowid = gamma_meta_ptid_get_rowid(tid) - 1;
+		if (rowid >= offset + count && rowid < cvscan->rg->dim)
+			break;
+
+		if (rowid < offset + count)
+			keep[rowid - offset] = true;
+
+		bstate->pos++;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (!keep[i])
+			vslot->skip[i] = true;
+	}
+
+	VSlotClearNonSkip(vslot);
+
+	return true;
+}
+
+/*
+ * Emit a batch of the rows of delta table. The tids are the roots of HOT
+ * chains, the heap index fetch follows the chain to the visible version.
+ */
+static bool
+vec_bitmapscan_next_heap_batch(VecBitmapHeapScanState *bstate,
+							   TupleTableSlot *slot)
+{
+	Relation rel = bstate->bhss.ss.ss_currentRelation;
+	Snapshot snapshot = bstate->bhss.ss.ps.state->es_snapshot;
+	const TableAmRoutine *heapam_routine = GetHeapamTableAmRoutine();
+	VectorTupleSlot *vslot = (VectorTupleSlot *) slot;
+	BlockNumber prev_block = InvalidBlockNumber;
+	HeapTupleData pin_tuples[VECTOR_SIZE];
+	Buffer pin_buffers[VECTOR_SIZE];
+	int row = 0;
+	int i;
+
+	if (bstate->heap_fetch == NULL)
+		bstate->heap_fetch = heapam_routine->index_fetch_begin(rel);
+
+	while (row < VECTOR_SIZE && bstate->pos < bstate->ntids)
+	{
+		ItemPointer tid = &bstate->tids[bstate->pos];
+		bool call_again = false;
+		bool all_dead = false;
+		bool shouldFree;
+		HeapTuple tuple;
+		Buffer buffer;
+
+		if (gamma_meta_tid_is_columnar(tid))
+			break;
+
+		bstate->pos++;
+
+		if (ItemPointerGetBlockNumber(tid) != prev_block)
+		{
+			prev_block = ItemPointerGetBlockNumber(tid);
+			bstate->bhss.exact_pages++;
+		}
+
+		/* only one version is visible to a MVCC snapshot */
+		if (!heapam_routine->index_fetch_tuple(bstate->heap_fetch, tid,
+											   snapshot, bstate->heap_slot,
+											   &call_again, &all_dead))
+			continue;
+
+		tuple = ExecFetchSlotHeapTuple(bstate->heap_slot, false, &shouldFree);
+		buffer = ((BufferHeapTupleTableSlot *) bstate->heap_slot)->buffer;
+
+		memcpy(&pin_tuples[row], tuple, sizeof(HeapTupleData));
+		pin_buffers[row] = buffer;
+		IncrBufferRefCount(buffer);
+
+		row++;
+	}
+
+	if (row == 0)
+		return false;
+
+	vslot->dim = row;
+	memset(vslot->skip, false, sizeof(bool) * row);
+
+	tts_vector_slot_getallattrs(slot, pin_tuples, pin_buffers);
+	ExecStoreVirtualTuple(slot);
+
+	for (i = 0; i < row; i++)
+		ReleaseBuffer(pin_buffers[i]);
+
+	return true;
+}
+
+static TupleTableSlot *
+vec_bitmapscan_access_next(ScanState *node)
+{
+	VecBitmapHeapScanState *bstate = (VecBitmapHeapScanState *) node;
+	TupleTableSlot *slot = node->ss_ScanTupleSlot;
+	ExprContext *econtext = node->ps.ps_ExprContext;
+
+	if (!bstate->inited)
+		vec_bitmapscan_init_scan(bstate);
+
+	for (;;)
+	{
+		bool found;
+
+		ExecClearTuple(slot);
+
+		if (bstate->pos >= bstate->ntids)
+			return slot;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (gamma_meta_tid_is_columnar(&bstate->tids[bstate->pos]))
+			found = vec_bitmapscan_next_rg_batch(bstate, slot);
+		else
+			found = vec_bitmapscan_next_heap_batch(bstate, slot);
+
+		if (!found)
+			continue;
+
+		/* the index quals are checked again if some index is lossy */
+		if (bstate->recheck && bstate->bhss.bitmapqualorig != NULL)
+		{
+			econtext->ecxt_scantuple = slot;
+			if (!vec_exec_qual(bstate->bhss.bitmapqualorig, econtext))
+			{
+				InstrCountFiltered2(node, tts_vector_get_dim(slot));
+				continue;
+			}
+		}
+
+		return slot;
+	}
+}
+
+static bool
+vec_bitmapscan_access_recheck(ScanState *node, TupleTableSlot *slot)
+{
+	return true;
+}
+
+static TupleTableSlot *
+vec_bitmapscan_exec(CustomScanState *node)
+{
+	VecBitmapScanState *vstate = (VecBitmapScanState *) node;
+	ProjectionInfo *projInfo = node->ss.ps.ps_ProjInfo;
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+	TupleTableSlot *slot;
+
+	ResetExprContext(econtext);
+
+	slot = vec_tablescan_execscan((ScanState *) vstate->bitmapstate,
+								  vec_bitmapscan_access_next,
+								  vec_bitmapscan_access_recheck);
+
+	if (TupIsNull(slot))
+	{
+		if (projInfo)
+			return ExecClearTuple(projInfo->pi_state.resultslot);
+		else
+			return slot;
+	}
+
+	if (projInfo)
+	{
+		TupleTableSlot *resultSlot;
+		econtext->ecxt_scantuple = slot;
+
+		resultSlot = ExecProject(projInfo);
+		memcpy(((VectorTupleSlot*)resultSlot)->skip,
+				((VectorTupleSlot*)slot)->skip, sizeof(bool) * VECTOR_SIZE);
+
+		((VectorTupleSlot *)resultSlot)->dim = ((VectorTupleSlot *)slot)->dim;
+
+		return resultSlot;
+	}
+
+	return slot;
+}
+
+static void
+vec_bitmapscan_reset(VecBitmapHeapScanState *bstate)
+{
+	MemoryContextReset(bstate->tid_context);
+	bstate->tids = NULL;
+	bstate->ntids = 0;
+	bstate->pos = 0;
+	bstate->inited = false;
+	bstate->recheck = false;
+	bstate->rg_loaded = false;
+	bstate->lossy_offset = 0;
+}
+
+static void
+vec_bitmapscan_rescan(CustomScanState *node)
+{
+	VecBitmapScanState *vstate = (VecBitmapScanState *) node;
+	VecBitmapHeapScanState *bstate = vstate->bitmapstate;
+
+	vec_bitmapscan_reset(bstate);
+	ExecScanReScan(&bstate->bhss.ss);
+
+	/* the tids are collected again */
+	ExecReScan(outerPlanState(&bstate->bhss));
+}
+
+static void
+vec_bitmapscan_end(CustomScanState *node)
+{
+	VecBitmapScanState *vstate = (VecBitmapScanState *) node;
+	VecBitmapHeapScanState *bstate = vstate->bitmapstate;
+
+	ExecEndNode(outerPlanState(&bstate->bhss));
+
+	if (bstate->heap_fetch != NULL)
+		GetHeapamTableAmRoutine()->index_fetch_end(bstate->heap_fetch);
+
+	ExecDropSingleTupleTableSlot(bstate->heap_slot);
+
+	if (bstate->bhss.ss.ss_currentScanDesc != NULL)
+		table_endscan(bstate->bhss.ss.ss_currentScanDesc);
+
+	MemoryContextDelete(bstate->tid_context);
+
+	if (vstate->backup_css_result_slot != NULL)
+		vstate->css.ss.ps.ps_ResultTupleSlot = vstate->backup_css_result_slot;
+}
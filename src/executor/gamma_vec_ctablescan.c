@@ -15,13 +15,23 @@
 
 #include "postgres.h"
 
+#include <math.h>
+
 #include "access/relscan.h"
 #include "access/heapam.h"
+#include "access/nbtree.h"
+#include "catalog/pg_operator.h"
+#include "common/pg_prng.h"
 #include "executor/execdebug.h"
+#include "executor/executor.h"
 #include "executor/nodeSeqscan.h"
 #include "optimizer/optimizer.h"
 #include "storage/bufmgr.h"
+#include "utils/builtins.h"
+#include "utils/fmgroids.h"
+#include "utils/lsyscache.h"
 #include "utils/rel.h"
+#include "utils/typcache.h"
 
 #include "nodes/extensible.h"
 #include "executor/nodeCustom.h"
@@ -37,6 +47,258 @@
 #include "utils/vdatum/vdatum.h"
 
 
+/*
+ * Evaluate the arguments of TABLESAMPLE, the same checks as the builtin
+ * SYSTEM and BERNOULLI methods.
+ */
+static void
+vec_ctablescan_init_sample(VecSeqScanState *vstate, CVScanDesc cvscan)
+{
+	TableSampleClause *tsc = vstate->tablesample;
+	ExprContext *econtext = vstate->sss.ss.ps.ps_ExprContext;
+	ExprState *argstate = (ExprState *) linitial(vstate->sample_args);
+	Datum datum;
+	bool isnull;
+	float4 percent;
+	uint32 seed;
+	int method;
+
+	datum = ExecEvalExprSwitchContext(argstate, econtext, &isnull);
+	if (isnull)
+		ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+				 errmsg("TABLESAMPLE parameter cannot be null")));
+
+	percent = DatumGetFloat4(datum);
+	if (percent < 0 || percent > 100 || isnan(percent))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_TABLESAMPLE_ARGUMENT),
+				 errmsg("sample percentage must be between 0 and 100")));
+
+	if (vstate->sample_repeatable != NULL)
+	{
+		datum = ExecEvalExprSwitchContext(vstate->sample_repeatable,
+										  econtext, &isnull);
+		if (isnull)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_TABLESAMPLE_REPEAT),
+					 errmsg("TABLESAMPLE REPEATABLE parameter cannot be null")));
+
+		seed = DatumGetUInt32(DirectFunctionCall1(hashfloat8, datum));
+	}
+	else
+	{
+		seed = pg_prng_uint32(&pg_global_prng_state);
+	}
+
+	if (tsc->tsmhandler == F_SYSTEM)
+		method = GAMMA_SAMPLE_SYSTEM;
+	else
+		method = GAMMA_SAMPLE_BERNOULLI;
+
+	cvtable_set_sample(cvscan, method, percent, seed);
+	vstate->sample_inited = true;
+}
+
+/*
+ * Evaluate the bounds of TID range scan, the same way as TidRangeEval. An
+ * empty range (or a NULL bound) makes the scan return nothing.
+ */
+static void
+vec_ctablescan_init_tidrange(VecSeqScanState *vstate, TableScanDesc scandesc)
+{
+	ExprContext *econtext = vstate->sss.ss.ps.ps_ExprContext;
+	ItemPointerData lower;
+	ItemPointerData upper;
+	ListCell *lc1;
+	ListCell *lc2;
+	bool empty = false;
+
+	ItemPointerSet(&lower, 0, 0);
+	ItemPointerSet(&upper, InvalidBlockNumber, PG_UINT16_MAX);
+
+	forboth(lc1, vstate->tidrange_opnos, lc2, vstate->tidrange_args)
+	{
+		Oid opno = lfirst_oid(lc1);
+		ExprState *argstate = (ExprState *) lfirst(lc2);
+		ItemPointerData bound;
+		BlockNumber block;
+		OffsetNumber offset;
+		Datum datum;
+		bool isnull;
+
+		datum = ExecEvalExprSwitchContext(argstate, econtext, &isnull);
+		if (isnull)
+		{
+			empty = true;
+			break;
+		}
+
+		ItemPointerCopy((ItemPointer) DatumGetPointer(datum), &bound);
+		block = ItemPointerGetBlockNumberNoCheck(&bound);
+		offset = ItemPointerGetOffsetNumberNoCheck(&bound);
+
+		if (opno == TIDLessOperator)
+		{
+			/* the upper bound is exclusive */
+			if (offset == 0)
+			{
+				if (block == 0)
+				{
+					empty = true;
+					break;
+				}
+
+				ItemPointerSet(&bound, block - 1, PG_UINT16_MAX);
+			}
+			else
+				ItemPointerSetOffsetNumber(&bound, offset - 1);
+		}
+		else if (opno == TIDGreaterOperator)
+		{
+			/* the lower bound is exclusive */
+			if (offset == PG_UINT16_MAX)
+			{
+				if (block == InvalidBlockNumber)
+				{
+					empty = true;
+					break;
+				}
+
+				ItemPointerSet(&bound, block + 1, 0);
+			}
+			else
+				ItemPointerSetOffsetNumber(&bound, offset + 1);
+		}
+
+		if (opno == TIDLessOperator || opno == TIDLessEqOperator)
+		{
+			if (ItemPointerCompare(&bound, &upper) < 0)
+				ItemPointerCopy(&bound, &upper);
+		}
+		else if (ItemPointerCompare(&bound, &lower) > 0)
+			ItemPointerCopy(&bound, &lower);
+	}
+
+	if (empty)
+	{
+		/* the lower bound is above the upper one */
+		ItemPointerSet(&lower, InvalidBlockNumber, PG_UINT16_MAX);
+		ItemPointerSet(&upper, 0, 0);
+	}
+
+	vec_ctable_set_tidrange(scandesc, &lower, &upper);
+	vstate->scan_over = false;
+	vstate->tidrange_inited = true;
+}
+
+/*
+ * Make the scan key of a qual "column op const" (or "const op column"), the
+ * operator must be in the btree opfamily of the column type, see
+ * cvtable_set_keys. The qual is vectorized already, the operator and the
+ * const are not changed by the converter.
+ */
+static bool
+vec_ctablescan_make_key(Relation rel, Expr *clause, ScanKey key)
+{
+	OpExpr *opexpr = (OpExpr *) clause;
+	Node *left;
+	Node *right;
+	Var *var;
+	Const *con;
+	Oid opno;
+	Form_pg_attribute attr;
+	TypeCacheEntry *typentry;
+	int strategy;
+	Oid lefttype;
+	Oid righttype;
+	Oid cmpproc;
+
+	if (!IsA(opexpr, OpExpr) || list_length(opexpr->args) != 2)
+		return false;
+
+	left = (Node *) linitial(opexpr->args);
+	right = (Node *) lsecond(opexpr->args);
+	opno = opexpr->opno;
+
+	if (IsA(left, Const) && IsA(right, Var))
+	{
+		Node *tmp = left;
+
+		left = right;
+		right = tmp;
+		opno = get_commutator(opno);
+	}
+
+	if (!IsA(left, Var) || !IsA(right, Const) || !OidIsValid(opno))
+		return false;
+
+	var = (Var *) left;
+	con = (Const *) right;
+	if (var->varattno <= 0 || con->constisnull)
+		return false;
+
+	/* the min/max of row groups are sorted by the collation of column */
+	attr = TupleDescAttr(RelationGetDescr(rel), var->varattno - 1);
+	if (OidIsValid(attr->attcollation) &&
+		opexpr->inputcollid != attr->attcollation)
+		return false;
+
+	typentry = lookup_type_cache(attr->atttypid, TYPECACHE_BTREE_OPFAMILY);
+	if (!OidIsValid(typentry->btree_opf) ||
+		!op_in_opfamily(opno, typentry->btree_opf))
+		return false;
+
+	get_op_opfamily_properties(opno, typentry->btree_opf, false,
+							   &strategy, &lefttype, &righttype);
+	if (lefttype != attr->atttypid)
+		return false;
+
+	cmpproc = get_opfamily_proc(typentry->btree_opf, lefttype, righttype,
+								BTORDER_PROC);
+	if (!OidIsValid(cmpproc))
+		return false;
+
+	ScanKeyEntryInitialize(key, 0, var->varattno, strategy, righttype,
+						   opexpr->inputcollid, cmpproc, con->constvalue);
+
+	return true;
+}
+
+/*
+ * Take the quals "column op const" as the scan keys of the cv scan, so the
+ * row groups are skipped by min/max and the rows are filtered before the
+ * upper nodes. The other quals are returned, they are evaluated by the
+ * vectorized quals.
+ */
+List *
+vec_ctablescan_build_keys(ScanState *node, Relation rel, List *quals)
+{
+	VecSeqScanState *vstate = (VecSeqScanState *) node;
+	List *rest = NIL;
+	ListCell *lc;
+
+	vstate->nscankeys = 0;
+	if (quals == NIL)
+		return NIL;
+
+	vstate->scankeys = (ScanKey) palloc0(sizeof(ScanKeyData) *
+										 list_length(quals));
+
+	foreach (lc, quals)
+	{
+		Expr *clause = (Expr *) lfirst(lc);
+
+		if (vec_ctablescan_make_key(rel, clause,
+									&vstate->scankeys[vstate->nscankeys]))
+			vstate->nscankeys++;
+		else
+			rest = lappend(rest, clause);
+	}
+
+	return rest;
+}
+
 TupleTableSlot *
 vec_ctablescan_access_seqnext(ScanState *node)
 {
@@ -78,6 +340,11 @@ vec_ctablescan_access_seqnext(ScanState *node)
 	}
 
 	vscandesc = (CTableScanDesc) scandesc;
+	if (vscandesc->cvscan != NULL && vscandesc->cvscan->keys == NULL &&
+		vstate->nscankeys > 0)
+		cvtable_set_keys(vscandesc->cvscan, vstate->nscankeys,
+						 vstate->scankeys);
+
 	if (vscandesc->cvscan != NULL && vscandesc->cvscan->bms_proj == NULL)
 	{
 		plan = node->ps.plan;
@@ -89,6 +356,12 @@ vec_ctablescan_access_seqnext(ScanState *node)
 
 	}
 
+	if (vstate->tablesample != NULL && !vstate->sample_inited)
+		vec_ctablescan_init_sample(vstate, vscandesc->cvscan);
+
+	if (vstate->tidrange_opnos != NIL && !vstate->tidrange_inited)
+		vec_ctablescan_init_tidrange(vstate, scandesc);
+
 	/* return the last batch. */
 	if (vstate->scan_over)
 	{
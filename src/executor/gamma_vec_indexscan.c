@@ -0,0 +1,644 @@
+/*
+ * Copyright (c) 2024 Gamma Data, Inc. <jackey@gammadb.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Vectorized index scan of gamma tables.
+ *
+ * The tids returned by the index are buffered and sorted, so the rows of a
+ * row group are fetched together (see ctable_index_fetch_columnar). The
+ * fetched rows are copied into a VectorTupleSlot batch of up to VECTOR_SIZE
+ * rows, the quals and the projection are done by the vectorized
+ * expressions. The results are unsorted, so the index scans with ORDER BY
+ * operators are not vectorized.
+ */
+
+#include "postgres.h"
+
+#include "access/genam.h"
+#include "access/relscan.h"
+#include "access/tableam.h"
+#include "catalog/pg_type.h"
+#include "executor/executor.h"
+#include "executor/nodeIndexscan.h"
+#include "miscadmin.h"
+#include "nodes/extensible.h"
+#include "nodes/makefuncs.h"
+#include "executor/nodeCustom.h"
+#include "optimizer/optimizer.h"
+#include "optimizer/plancat.h"
+#include "pgstat.h"
+#include "utils/datum.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+#include "executor/gamma_expr.h"
+#include "executor/gamma_indexscan.h"
+#include "executor/gamma_vec_indexscan.h"
+#include "executor/vec_exec_scan.h"
+#include "executor/vector_tuple_slot.h"
+#include "utils/gamma_cache.h"
+#include "utils/utils.h"
+#include "utils/vdatum/vdatum.h"
+
+/* CustomScanMethods */
+static Node *create_vec_indexscan_state(CustomScan *custom_plan);
+
+/* CustomScanExecMethods */
+static void vec_indexscan_begin(CustomScanState *node,
+								EState *estate, int eflags);
+static void vec_indexscan_rescan(CustomScanState *node);
+static TupleTableSlot* vec_indexscan_exec(CustomScanState *node);
+static void vec_indexscan_end(CustomScanState *node);
+
+static VecIndexScanState* vec_indexscan_execinit(IndexScan *node,
+												EState *estate, int eflags);
+static TupleTableSlot* vec_indexscan_access_next(ScanState *node);
+static bool vec_indexscan_access_recheck(ScanState *node,
+										 TupleTableSlot *slot);
+static Plan * vec_plan_indexscan(PlannerInfo *root, RelOptInfo *rel,
+								 CustomPath *best_path, List *tlist,
+								 List *clauses, List *custom_plans);
+
+/*
+ * VecIndexScanCustomState - state object of vectorized index scan on executor.
+ */
+typedef struct VecIndexScanCustomState
+{
+	CustomScanState	css;
+	VecIndexScanState *indexstate;
+	TupleTableSlot *backup_css_result_slot;
+} VecIndexScanCustomState;
+
+static CustomPathMethods vec_indexscan_path_methods = {
+	"gamma_vec_indexscan",			/* CustomName */
+	vec_plan_indexscan,
+};
+
+static CustomScanMethods vec_indexscan_scan_methods = {
+	"gamma_vec_indexscan",			/* CustomName */
+	create_vec_indexscan_state,		/* CreateCustomScanState */
+};
+
+static CustomExecMethods vec_indexscan_exec_methods = {
+	"gamma_vec_indexscan",		/* CustomName */
+	vec_indexscan_begin,		/* BeginCustomScan */
+	vec_indexscan_exec,			/* ExecCustomScan */
+	vec_indexscan_end,			/* EndCustomScan */
+	vec_indexscan_rescan,		/* ReScanCustomScan */
+	NULL,						/* MarkPosCustomScan */
+	NULL,						/* RestrPosCustomScan */
+	NULL,						/* EstimateDSMCustomScan */
+	NULL,						/* InitializeDSMCustomScan */
+	NULL,						/* InitializeWorkerCustomScan */
+	NULL,						/* ExplainCustomScan */
+};
+
+void
+gamma_vec_indexscan_init(void)
+{
+	RegisterCustomScanMethods(&vec_indexscan_scan_methods);
+}
+
+const CustomPathMethods*
+gamma_vec_indexscan_path_methods(void)
+{
+	return &vec_indexscan_path_methods;
+}
+
+static Plan *
+vec_plan_indexscan(PlannerInfo *root,
+		RelOptInfo *rel,
+		CustomPath *best_path,
+		List *tlist,
+		List *clauses,
+		List *custom_plans)
+{
+	CustomScan *cscan = makeNode(CustomScan);
+	Plan *subplan;
+	List *scan_tlist;
+
+	Assert(list_length(custom_plans) == 1);
+
+	subplan = (Plan *) linitial(custom_plans);
+	scan_tlist = subplan->targetlist;
+	if (scan_tlist == NULL)
+		scan_tlist = subplan->targetlist = build_physical_tlist(root, rel);
+
+	if (tlist == NULL)
+		tlist = scan_tlist;
+
+	cscan->scan.plan.parallel_aware = false;
+	cscan->scan.plan.targetlist = (List *) copyObject(tlist);
+	cscan->scan.plan.qual = NIL;
+	cscan->scan.plan.lefttree = NULL;
+	cscan->scan.scanrelid = 0;
+	cscan->custom_scan_tlist = (List *) copyObject(scan_tlist);
+	cscan->custom_plans = custom_plans;
+	cscan->methods = &vec_indexscan_scan_methods;
+
+	return &cscan->scan.plan;
+}
+
+static Node *
+create_vec_indexscan_state(CustomScan *custom_plan)
+{
+	VecIndexScanCustomState *vstate =
+		MemoryContextAllocZero(CurTransactionContext,
+								sizeof(VecIndexScanCustomState));
+
+	/* Set tag and executor callbacks */
+	NodeSetTag(vstate, T_CustomScanState);
+	vstate->css.methods = &vec_indexscan_exec_methods;
+
+	return (Node *) vstate;
+}
+
+static void
+vec_indexscan_begin(CustomScanState *node, EState *estate, int eflags)
+{
+	VecIndexScanCustomState *vstate = (VecIndexScanCustomState *) node;
+	CustomScan *cscan = (CustomScan *) node->ss.ps.plan;
+	IndexScan *plan = (IndexScan *) linitial(cscan->custom_plans);
+	ScanState *scanstate;
+
+	vstate->indexstate = vec_indexscan_execinit(plan, estate, eflags);
+	scanstate = &vstate->indexstate->iss.ss;
+
+	/* ExecEndCustomScan need it */
+	vstate->backup_css_result_slot = vstate->css.ss.ps.ps_ResultTupleSlot;
+
+	/* the same as vec_tablescan_begin */
+	if (scanstate->ps.ps_ResultTupleSlot != NULL)
+	{
+		TupleDesc result_desc =
+			vstate->css.ss.ps.ps_ResultTupleSlot->tts_tupleDescriptor;
+		en_vec_tupledesc(result_desc);
+		vstate->css.ss.ps.ps_ResultTupleSlot = NULL;
+		VecExecConditionalAssignProjectionInfo(&vstate->css.ss.ps,
+				scanstate->ps.ps_ResultTupleSlot->tts_tupleDescriptor,
+				((Scan *) plan)->scanrelid);
+
+		if (vstate->css.ss.ps.ps_ProjInfo == NULL)
+			vstate->css.ss.ps.ps_ResultTupleSlot =
+						  scanstate->ps.ps_ResultTupleSlot;
+	}
+	else
+	{
+		scanstate->ps.ps_ResultTupleSlot = scanstate->ss_ScanTupleSlot;
+
+		if (vstate->css.ss.ps.ps_ProjInfo != NULL)
+		{
+			TupleDesc result_desc =
+				vstate->css.ss.ps.ps_ResultTupleSlot->tts_tupleDescriptor;
+			en_vec_tupledesc(result_desc);
+			vstate->css.ss.ps.ps_ResultTupleSlot = NULL;
+
+			VecExecConditionalAssignProjectionInfo(&vstate->css.ss.ps,
+					scanstate->ps.ps_ResultTupleSlot->tts_tupleDescriptor,
+					((Scan *) plan)->scanrelid);
+		}
+		else
+		{
+			node->ss.ps.scanops = scanstate->ps.scanops;
+			node->ss.ps.resultops = scanstate->ps.resultops;
+			vstate->css.ss.ps.ps_ResultTupleSlot =
+							scanstate->ps.ps_ResultTupleSlot;
+		}
+	}
+
+	/* set child planstate */
+	node->custom_ps = lappend(node->custom_ps, vstate->indexstate);
+}
+
+/*
+ * The quals are evaluated as one vectorized AND expression.
+ */
+static ExprState *
+vec_indexscan_init_qual(List *qual, PlanState *parent)
+{
+	FuncExpr *newexpr;
+
+	if (qual == NULL)
+		return NULL;
+
+	newexpr = makeNode(FuncExpr);
+	newexpr->funcid = gamma_get_boolexpr_and_oid();
+	newexpr->funcresulttype = en_vec_type(BOOLOID);
+	newexpr->funcretset = false;
+	newexpr->funcvariadic = true;
+	newexpr->funcformat = COERCE_EXPLICIT_CALL;
+	newexpr->funccollid = InvalidOid;
+	newexpr->inputcollid = InvalidOid;
+	newexpr->args = qual;
+	newexpr->location = -1;
+
+	return gamma_exec_init_expr((Expr *) newexpr, parent);
+}
+
+/*
+ * The same as ExecInitIndexScan, but the scan tuple slot is a vector slot
+ * and the quals are vectorized. The index quals (scan keys) keep scalar.
+ */
+static VecIndexScanState *
+vec_indexscan_execinit(IndexScan *node, EState *estate, int eflags)
+{
+	VecIndexScanState *vstate;
+	IndexScanState *indexstate;
+	Relation rel;
+	TupleDesc vdesc;
+	Bitmapset *bms_proj = NULL;
+	LOCKMODE lockmode;
+	int attnum;
+	int i;
+
+	vstate = (VecIndexScanState *) palloc0(sizeof(VecIndexScanState));
+	indexstate = &vstate->iss;
+
+	/* EXPLAIN shows it as the index scan */
+	NodeSetTag(indexstate, T_IndexScanState);
+
+	indexstate->ss.ps.plan = (Plan *) node;
+	indexstate->ss.ps.state = estate;
+	indexstate->ss.ps.ExecProcNode = (ExecProcNodeMtd) vec_indexscan_exec;
+
+	ExecAssignExprContext(estate, &indexstate->ss.ps);
+
+	rel = ExecOpenScanRelation(estate, node->scan.scanrelid, eflags);
+	indexstate->ss.ss_currentRelation = rel;
+	indexstate->ss.ss_currentScanDesc = NULL;
+
+	vdesc = CreateTupleDescCopyConstr(RelationGetDescr(rel));
+	for (i = 0; i < vdesc->natts; i++)
+	{
+		Form_pg_attribute	attr = &(vdesc->attrs[i]);
+		Oid					vtypid = en_vec_type(attr->atttypid);
+		if (vtypid != InvalidOid)
+			attr->atttypid = vtypid;
+		else
+			elog(ERROR, "cannot find vectorized type for type %d",
+					attr->atttypid);
+	}
+
+	ExecInitScanTupleSlot(estate, &indexstate->ss, vdesc, &TTSOpsVector);
+
+	ExecInitResultTypeTL(&indexstate->ss.ps);
+	VecExecAssignScanProjectionInfo(&indexstate->ss);
+
+	indexstate->ss.ps.qual =
+		vec_indexscan_init_qual(node->scan.plan.qual, (PlanState *) indexstate);
+	indexstate->indexqualorig =
+		vec_indexscan_init_qual(node->indexqualorig, (PlanState *) indexstate);
+
+	/* the columns fetched for the batch */
+	pull_varattnos((Node *) node->scan.plan.targetlist,
+				   node->scan.scanrelid, &bms_proj);
+	pull_varattnos((Node *) node->scan.plan.qual,
+				   node->scan.scanrelid, &bms_proj);
+	pull_varattnos((Node *) node->indexqualorig,
+				   node->scan.scanrelid, &bms_proj);
+
+	vstate->proj_attnos = (int *) palloc(sizeof(int) * vdesc->natts);
+	attnum = -1;
+	while ((attnum = bms_next_member(bms_proj, attnum)) >= 0)
+	{
+		int attno = attnum + FirstLowInvalidHeapAttributeNumber;
+
+		/* the whole-row var needs all columns */
+		if (attno == 0)
+		{
+			vstate->nproj = 0;
+			for (i = 0; i < vdesc->natts; i++)
+				vstate->proj_attnos[vstate->nproj++] = i;
+			break;
+		}
+
+		if (attno > 0)
+			vstate->proj_attnos[vstate->nproj++] = attno - 1;
+	}
+
+	/* only the user columns are fetched from the row group */
+	for (i = 0; i < vstate->nproj; i++)
+		vstate->bms_proj = bms_add_member(vstate->bms_proj,
+			vstate->proj_attnos[i] + 1 - FirstLowInvalidHeapAttributeNumber);
+
+	vstate->row_slot = MakeSingleTupleTableSlot(RelationGetDescr(rel),
+												&TTSOpsVirtual);
+	vstate->batch_context = AllocSetContextCreate(CurrentMemoryContext,
+												  "Gamma Index Scan Batch",
+												  ALLOCSET_DEFAULT_SIZES);
+
+	vstate->maxitems = Max(gammadb_index_fetch_sort_tids, VECTOR_SIZE);
+	vstate->items = (CIndexFetchSortItem *)
+		palloc(sizeof(CIndexFetchSortItem) * vstate->maxitems);
+
+	if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
+		return vstate;
+
+	lockmode = exec_rt_fetch(node->scan.scanrelid, estate)->rellockmode;
+	indexstate->iss_RelationDesc = index_open(node->indexid, lockmode);
+
+	indexstate->iss_RuntimeKeysReady = false;
+	indexstate->iss_RuntimeKeys = NULL;
+	indexstate->iss_NumRuntimeKeys = 0;
+
+	ExecIndexBuildScanKeys((PlanState *) indexstate,
+						   indexstate->iss_RelationDesc,
+						   node->indexqual,
+						   false,
+						   &indexstate->iss_ScanKeys,
+						   &indexstate->iss_NumScanKeys,
+						   &indexstate->iss_RuntimeKeys,
+						   &indexstate->iss_NumRuntimeKeys,
+						   NULL,	/* no ArrayKeys */
+						   NULL);
+
+	/* the runtime keys are evaluated in a separate context */
+	if (indexstate->iss_NumRuntimeKeys != 0)
+	{
+		ExprContext *stdecontext = indexstate->ss.ps.ps_ExprContext;
+
+		ExecAssignExprContext(estate, &indexstate->ss.ps);
+		indexstate->iss_RuntimeContext = indexstate->ss.ps.ps_ExprContext;
+		indexstate->ss.ps.ps_ExprContext = stdecontext;
+	}
+	else
+	{
+		indexstate->iss_RuntimeContext = NULL;
+	}
+
+	return vstate;
+}
+
+static IndexScanDesc
+vec_indexscan_get_scandesc(VecIndexScanState *vstate)
+{
+	IndexScanState *node = &vstate->iss;
+	EState *estate = node->ss.ps.state;
+	IndexScanDesc scandesc = node->iss_ScanDesc;
+
+	if (scandesc == NULL)
+	{
+		scandesc = index_beginscan(node->ss.ss_currentRelation,
+								   node->iss_RelationDesc,
+								   estate->es_snapshot,
+								   node->iss_NumScanKeys,
+								   node->iss_NumOrderByKeys);
+
+		node->iss_ScanDesc = scandesc;
+
+		((CIndexFetchCTableData *) scandesc->xs_heapfetch)->bms_proj =
+															vstate->bms_proj;
+
+		if (node->iss_NumRuntimeKeys == 0 || node->iss_RuntimeKeysReady)
+			index_rescan(scandesc,
+						 node->iss_ScanKeys, node->iss_NumScanKeys,
+						 node->iss_OrderByKeys, node->iss_NumOrderByKeys);
+	}
+
+	return scandesc;
+}
+
+/*
+ * Read the next tids from index, they are sorted by row group unless
+ * gammadb_index_fetch_sort_tids is 0.
+ */
+static bool
+vec_indexscan_fill_tids(VecIndexScanState *vstate, IndexScanDesc scandesc)
+{
+	IndexScanState *node = &vstate->iss;
+
+	vstate->nitems = 0;
+	vstate->pos = 0;
+
+	/* the index must not be called again once it is exhausted */
+	if (node->iss_ReachedEnd)
+		return false;
+
+	while (vstate->nitems < vstate->maxitems)
+	{
+		CIndexFetchSortItem *item;
+		ItemPointer tid;
+
+		tid = index_getnext_tid(scandesc, ForwardScanDirection);
+		if (tid == NULL)
+		{
+			node->iss_ReachedEnd = true;
+			break;
+		}
+
+		item = &vstate->items[vstate->nitems++];
+		item->tid = *tid;
+		item->recheck = scandesc->xs_recheck;
+	}
+
+	if (gammadb_index_fetch_sort_tids > 0 && vstate->nitems > 1)
+		qsort(vstate->items, vstate->nitems, sizeof(CIndexFetchSortItem),
+			  (int (*) (const void *, const void *)) ItemPointerCompare);
+
+	return vstate->nitems > 0;
+}
+
+/*
+ * Copy the fetched row into the batch, the by-reference values are copied
+ * since the row group or the heap page of the row is not kept.
+ */
+static void
+vec_indexscan_store_row(VecIndexScanState *vstate, TupleTableSlot *slot,
+						int row)
+{
+	TupleTableSlot *row_slot = vstate->row_slot;
+	TupleDesc tupdesc = row_slot->tts_tupleDescriptor;
+	MemoryContext oldcontext;
+	int i;
+
+	oldcontext = MemoryContextSwitchTo(vstate->batch_context);
+
+	for (i = 0; i < vstate->nproj; i++)
+	{
+		int attno = vstate->proj_attnos[i];
+		Form_pg_attribute attr = TupleDescAttr(tupdesc, attno);
+		vdatum *column = (vdatum *) slot->tts_values[attno];
+		Datum value = row_slot->tts_values[attno];
+		bool isnull = row_slot->tts_isnull[attno];
+
+		if (!isnull && !attr->attbyval)
+			value = datumCopy(value, false, attr->attlen);
+
+		column->ref = false;
+		column->values[row] = value;
+		column->isnull[row] = isnull;
+		column->dim = row + 1;
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+static bool
+vec_indexscan_next_batch(VecIndexScanState *vstate, IndexScanDesc scandesc,
+						 TupleTableSlot *slot, bool *recheck)
+{
+	VectorTupleSlot *vslot = (VectorTupleSlot *) slot;
+	int row = 0;
+
+	MemoryContextReset(vstate->batch_context);
+
+	*recheck = false;
+
+	while (row < VECTOR_SIZE)
+	{
+		CIndexFetchSortItem *item;
+		bool call_again = false;
+
+		if (vstate->pos >= vstate->nitems &&
+			!vec_indexscan_fill_tids(vstate, scandesc))
+			break;
+
+		CHECK_FOR_INTERRUPTS();
+
+		item = &vstate->items[vstate->pos++];
+
+		/* see gamma_indexscan_access_sortnext */
+		if (!table_index_fetch_tuple(scandesc->xs_heapfetch, &item->tid,
+									 scandesc->xs_snapshot, vstate->row_slot,
+									 &call_again, NULL))
+			continue;
+
+		pgstat_count_heap_fetch(scandesc->indexRelation);
+
+		if (item->recheck)
+			*recheck = true;
+
+		vec_indexscan_store_row(vstate, slot, row);
+		row++;
+	}
+
+	if (row == 0)
+		return false;
+
+	vslot->dim = row;
+	memset(vslot->skip, false, sizeof(bool) * row);
+	slot->tts_nvalid = slot->tts_tupleDescriptor->natts;
+	ExecStoreVirtualTuple(slot);
+
+	return true;
+}
+
+static TupleTableSlot *
+vec_indexscan_access_next(ScanState *node)
+{
+	VecIndexScanState *vstate = (VecIndexScanState *) node;
+	TupleTableSlot *slot = node->ss_ScanTupleSlot;
+	ExprContext *econtext = node->ps.ps_ExprContext;
+	IndexScanDesc scandesc = vec_indexscan_get_scandesc(vstate);
+
+	for (;;)
+	{
+		bool recheck;
+
+		ExecClearTuple(slot);
+
+		if (!vec_indexscan_next_batch(vstate, scandesc, slot, &recheck))
+			return slot;
+
+		/* the index quals are checked again if the index is lossy */
+		if (recheck && vstate->iss.indexqualorig != NULL)
+		{
+			econtext->ecxt_scantuple = slot;
+			if (!vec_exec_qual(vstate->iss.indexqualorig, econtext))
+			{
+				InstrCountFiltered2(node, tts_vector_get_dim(slot));
+				continue;
+			}
+		}
+
+		return slot;
+	}
+}
+
+static bool
+vec_indexscan_access_recheck(ScanState *node, TupleTableSlot *slot)
+{
+	return true;
+}
+
+static TupleTableSlot *
+vec_indexscan_exec(CustomScanState *node)
+{
+	VecIndexScanCustomState *vstate = (VecIndexScanCustomState *) node;
+	IndexScanState *indexstate = &vstate->indexstate->iss;
+	ProjectionInfo *projInfo = node->ss.ps.ps_ProjInfo;
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+	TupleTableSlot *slot;
+
+	ResetExprContext(econtext);
+
+	if (indexstate->iss_NumRuntimeKeys != 0 && !indexstate->iss_RuntimeKeysReady)
+		ExecReScan((PlanState *) indexstate);
+
+	slot = vec_tablescan_execscan((ScanState *) indexstate,
+								  vec_indexscan_access_next,
+								  vec_indexscan_access_recheck);
+
+	if (TupIsNull(slot))
+	{
+		if (projInfo)
+			return ExecClearTuple(projInfo->pi_state.resultslot);
+		else
+			return slot;
+	}
+
+	if (projInfo)
+	{
+		TupleTableSlot *resultSlot;
+		econtext->ecxt_scantuple = slot;
+
+		resultSlot = ExecProject(projInfo);
+		memcpy(((VectorTupleSlot*)resultSlot)->skip,
+				((VectorTupleSlot*)slot)->skip, sizeof(bool) * VECTOR_SIZE);
+
+		((VectorTupleSlot *)resultSlot)->dim = ((VectorTupleSlot *)slot)->dim;
+
+		return resultSlot;
+	}
+
+	return slot;
+}
+
+static void
+vec_indexscan_rescan(CustomScanState *node)
+{
+	VecIndexScanCustomState *vstate = (VecIndexScanCustomState *) node;
+	VecIndexScanState *indexstate = vstate->indexstate;
+
+	indexstate->nitems = 0;
+	indexstate->pos = 0;
+
+	ExecReScanIndexScan(&indexstate->iss);
+}
+
+static void
+vec_indexscan_end(CustomScanState *node)
+{
+	VecIndexScanCustomState *vstate = (VecIndexScanCustomState *) node;
+	VecIndexScanState *indexstate = vstate->indexstate;
+
+	ExecEndIndexScan(&indexstate->iss);
+
+	ExecDropSingleTupleTableSlot(indexstate->row_slot);
+	MemoryContextDelete(indexstate->batch_context);
+
+	if (vstate->backup_css_result_slot != NULL)
+		vstate->css.ss.ps.ps_ResultTupleSlot = vstate->backup_css_result_slot;
+}
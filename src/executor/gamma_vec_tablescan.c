@@ -17,6 +17,8 @@
 
 #include "access/relscan.h"
 #include "access/heapam.h"
+#include "access/sysattr.h"
+#include "commands/explain.h"
 #include "executor/execdebug.h"
 #include "executor/nodeSeqscan.h"
 #include "storage/bufmgr.h"
@@ -26,6 +28,7 @@
 #include "nodes/makefuncs.h"
 #include "executor/nodeCustom.h"
 #include "optimizer/plancat.h"
+#include "utils/lsyscache.h"
 #include "utils/memutils.h"
 
 #include "executor/gamma_vec_ctablescan.h"
@@ -35,6 +38,7 @@
 #include "executor/vector_tuple_slot.h"
 #include "optimizer/gamma_converter.h"
 #include "storage/ctable_am.h"
+#include "storage/ctable_vec_am.h"
 #include "utils/gamma_cache.h"
 #include "utils/utils.h"
 #include "utils/vdatum/vdatum.h"
@@ -48,6 +52,8 @@ static void vec_tablescan_begin(CustomScanState *node,
 static void vec_tablescan_rescan(CustomScanState *node);
 static TupleTableSlot* vec_tablescan_exec(CustomScanState *node);
 static void vec_tablescan_end(CustomScanState *node);
+static void vec_tablescan_explain(CustomScanState *node, List *ancestors,
+								  ExplainState *es);
 
 /* hook functions */
 static SeqScanState* vec_tablescan_execinit(SeqScan *node, EState *estate,
@@ -90,7 +96,7 @@ static CustomExecMethods vec_tablescan_exec_methods = {
 	NULL,						/* EstimateDSMCustomScan */
 	NULL,						/* InitializeDSMCustomScan */
 	NULL,						/* InitializeWorkerCustomScan */
-	NULL,						/* ExplainCustomScan */
+	vec_tablescan_explain,		/* ExplainCustomScan */
 };
 
 void
@@ -212,6 +218,48 @@ vec_tablescan_begin(CustomScanState *node, EState *estate, int eflags)
 	
 	vstate->seqstate->scan_over = false;
 
+	/* TABLESAMPLE arguments are evaluated when the scan begins */
+	if (IsA(plan, SampleScan))
+	{
+		TableSampleClause *tsc = ((SampleScan *) plan)->tablesample;
+		PlanState *ps = (PlanState *) vstate->seqstate;
+
+		vstate->seqstate->tablesample = tsc;
+		vstate->seqstate->sample_args = ExecInitExprList(tsc->args, ps);
+		vstate->seqstate->sample_repeatable = ExecInitExpr(tsc->repeatable, ps);
+		vstate->seqstate->sample_inited = false;
+	}
+
+	/* the bounds of TID range scan are evaluated when the scan begins */
+	if (IsA(plan, TidRangeScan))
+	{
+		PlanState *ps = (PlanState *) vstate->seqstate;
+		ListCell *lc;
+
+		foreach (lc, ((TidRangeScan *) plan)->tidrangequals)
+		{
+			OpExpr *opexpr = lfirst_node(OpExpr, lc);
+			Var *var = (Var *) linitial(opexpr->args);
+			Expr *arg = (Expr *) lsecond(opexpr->args);
+			Oid opno = opexpr->opno;
+
+			/* ctid op tid, or tid op ctid which is commuted */
+			if (!IsA(var, Var) ||
+				var->varattno != SelfItemPointerAttributeNumber)
+			{
+				arg = (Expr *) linitial(opexpr->args);
+				opno = get_commutator(opno);
+			}
+
+			vstate->seqstate->tidrange_opnos =
+				lappend_oid(vstate->seqstate->tidrange_opnos, opno);
+			vstate->seqstate->tidrange_args =
+				lappend(vstate->seqstate->tidrange_args, ExecInitExpr(arg, ps));
+		}
+
+		vstate->seqstate->tidrange_inited = false;
+	}
+
 	/* ExecEndCustomScan need it */
 	vstate->backup_css_result_slot = vstate->css.ss.ps.ps_ResultTupleSlot;
 
@@ -276,6 +324,7 @@ vec_tablescan_execinit(SeqScan *node, EState *estate, int eflags)
 	Relation rel;
 	TupleDesc vdesc;
 	Expr *qual = NULL;
+	List *quals;
 
 	/*
 	 * Once upon a time it was possible to have an outerPlan of a SeqScan, but
@@ -332,9 +381,14 @@ vec_tablescan_execinit(SeqScan *node, EState *estate, int eflags)
 	VecExecAssignScanProjectionInfo(&scanstate->ss);
 
 	/*
-	 * initialize child expressions
+	 * initialize child expressions, the simple quals of columnar tables are
+	 * done by the cv scan
 	 */
-	if (((Plan *) node)->qual != NULL && IsA(((Plan *) node)->qual, List))
+	quals = ((Plan *) node)->qual;
+	if (rel->rd_tableam == ctable_tableam_routine())
+		quals = vec_ctablescan_build_keys((ScanState *) scanstate, rel, quals);
+
+	if (quals != NULL && IsA(quals, List))
 	{
 		FuncExpr *newexpr = makeNode(FuncExpr);
 		newexpr->funcid = gamma_get_boolexpr_and_oid();
@@ -344,14 +398,14 @@ vec_tablescan_execinit(SeqScan *node, EState *estate, int eflags)
 		newexpr->funcformat = COERCE_EXPLICIT_CALL; //TODO:
 		newexpr->funccollid = InvalidOid;
 		newexpr->inputcollid = InvalidOid;
-		newexpr->args = ((Plan *) node)->qual;
+		newexpr->args = quals;
 		newexpr->location = -1;
 		qual = (Expr *)newexpr;
 		//qual = makeBoolExpr(AND_EXPR, ((Plan *) node)->qual, -1); 
 	}
 	else
 	{
-		qual = (Expr *) ((Plan *)node)->qual;
+		qual = (Expr *) quals;
 	}
 
 	scanstate->ss.ps.qual = gamma_exec_init_expr(qual, (PlanState *) scanstate);
@@ -364,6 +418,10 @@ vec_tablescan_rescan(CustomScanState *node)
 {
 	VecTableScanState *vstate = (VecTableScanState*)node;
 	ExecReScanSeqScan((SeqScanState *)vstate->seqstate);
+
+	/* the arguments of TABLESAMPLE or TID range may have been changed */
+	vstate->seqstate->sample_inited = false;
+	vstate->seqstate->tidrange_inited = false;
 	return;
 }
 
@@ -435,6 +493,29 @@ vec_tablescan_end(CustomScanState *node)
 		vstate->css.ss.ps.ps_ResultTupleSlot = vstate->backup_css_result_slot;
 }
 
+/*
+ * The row groups skipped by the min/max of the pushed down quals, counted
+ * by the scan of this process.
+ */
+static void
+vec_tablescan_explain(CustomScanState *node, List *ancestors,
+					  ExplainState *es)
+{
+	VecTableScanState *vstate = (VecTableScanState *) node;
+	VecSeqScanState *seqstate = vstate->seqstate;
+	CTableScanDesc cscan;
+
+	if (!es->analyze || seqstate->nscankeys == 0)
+		return;
+
+	cscan = (CTableScanDesc) seqstate->sss.ss.ss_currentScanDesc;
+	if (cscan == NULL || cscan->cvscan == NULL)
+		return;
+
+	ExplainPropertyUInteger("Row Groups Pruned", NULL,
+							cscan->cvscan->rg_pruned, es);
+}
+
 static TupleTableSlot *
 vec_tablescan_access_seqnext(ScanState *node)
 {
@@ -474,7 +555,8 @@ vec_tablescan_access_seqnext(ScanState *node)
 		return slot;
 	}
 
-	vstate->scan_over = tts_vector_slot_fill_tuple(scandesc, direction, slot);
+	vstate->scan_over = tts_vector_slot_fill_tuple(scandesc, direction, slot,
+													NULL);
 
 	return slot;
 }
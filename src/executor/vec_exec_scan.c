@@ -46,7 +46,6 @@ static inline TupleTableSlot* vec_tablescan_execscanfetch(ScanState *node,
 			  ExecScanAccessMtd accessMtd, ExecScanRecheckMtd recheckMtd);
 static bool tlist_matches_tupdesc(PlanState *ps, List *tlist, Index varno,
 		TupleDesc tupdesc);
-static bool vec_exec_qual(ExprState *qual, ExprContext *econtext);
 
 /*
  * ExecScanFetch -- check interrupts & fetch next potential tuple
@@ -157,7 +156,7 @@ vec_tablescan_execscanfetch(ScanState *node,
 	return (*accessMtd) (node);
 }
 
-static bool
+bool
 vec_exec_qual(ExprState *qual, ExprContext *econtext)
 {
 	int row;
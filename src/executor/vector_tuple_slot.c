@@ -18,12 +18,15 @@
 #include "access/heapam.h"
 #include "access/tableam.h"
 #include "access/sysattr.h"
+#include "pgstat.h"
 #include "executor/tuptable.h"
 #include "storage/bufmgr.h"
 #include "utils/expandeddatum.h"
 #include "utils/datum.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
 
+#include "storage/ctable_am.h"
 #include "storage/gamma_meta.h"
 #include "executor/vector_tuple_slot.h"
 #include "utils/utils.h"
@@ -45,6 +48,7 @@ tts_vector_slot_init(TupleTableSlot *slot)
 	/* vectorized initialize */
 	vslot->dim = 0;
 	vslot->row_indexarr = NULL;
+	vslot->batch_context = NULL;
 	memset(vslot->skip, true, sizeof(vslot->skip));
 	
 	/* initailize column in vector slot */
@@ -79,9 +83,13 @@ tts_vector_slot_clear(TupleTableSlot *slot)
 	ItemPointerSetInvalid(&slot->tts_tid);
 
 	vecslot->dim = 0;
+	vecslot->flags = 0;
 	vecslot->row_indexarr = NULL;
 	memset(vecslot->skip, true, sizeof(vecslot->skip));
 
+	if (vecslot->batch_context != NULL)
+		MemoryContextReset(vecslot->batch_context);
+
 	return;
 }
 
@@ -103,8 +111,7 @@ tts_vector_slot_copy(TupleTableSlot *dstslot, TupleTableSlot *srcslot)
 	vdstslot->dim = vsrcslot->dim;
 	vdstslot->row_indexarr = vsrcslot->row_indexarr;
 	memcpy(vdstslot->skip, vsrcslot->skip, sizeof(bool) * VECTOR_SIZE);
-	if (VSlotHasNonSkip(vsrcslot))
-			VSlotSetNonSkip(vdstslot);
+	vdstslot->flags = vsrcslot->flags;
 
 	/* deep copy */
 	for (int natt = 0; natt < srcdesc->natts; natt++)
@@ -146,9 +153,110 @@ ttsops_vector_slot_callbacks(Relation relation)
 	return &TTSOpsVector;
 }
 
+/*
+ * The leading fixed-width attributes have the same offsets in all tuples
+ * without nulls, they are deformed column by column.
+ */
+#define GAMMA_DEFORM_FIXED_MAX			(64)
+
+static int
+tts_vector_slot_fixed_prefix(TupleDesc tupledesc, int natts, int *offsets,
+							 int *end)
+{
+	int attnum;
+	int off = 0;
+
+	for (attnum = 0; attnum < Min(natts, GAMMA_DEFORM_FIXED_MAX); attnum++)
+	{
+		Form_pg_attribute thisatt = TupleDescAttr(tupledesc, attnum);
+
+		if (thisatt->attlen <= 0 || thisatt->attisdropped)
+			break;
+
+		off = att_align_nominal(off, thisatt->attalign);
+		offsets[attnum] = off;
+		off += thisatt->attlen;
+	}
+
+	*end = off;
+	return attnum;
+}
+
+/* fetch an attribute of all fast rows, the switch is out of the loop */
+static void
+tts_vector_slot_deform_fixed(vdatum *column, Form_pg_attribute thisatt,
+							 char **tps, bool *fast, int dim, int off)
+{
+	int row;
+
+	if (!thisatt->attbyval)
+	{
+		for (row = 0; row < dim; row++)
+		{
+			if (fast[row])
+			{
+				column->values[row] = PointerGetDatum(tps[row] + off);
+				column->isnull[row] = false;
+			}
+		}
+		return;
+	}
+
+	switch (thisatt->attlen)
+	{
+		case sizeof(int64):
+			for (row = 0; row < dim; row++)
+			{
+				if (fast[row])
+				{
+					column->values[row] = Int64GetDatum(
+											*((int64 *) (tps[row] + off)));
+					column->isnull[row] = false;
+				}
+			}
+			break;
+		case sizeof(int32):
+			for (row = 0; row < dim; row++)
+			{
+				if (fast[row])
+				{
+					column->values[row] = Int32GetDatum(
+											*((int32 *) (tps[row] + off)));
+					column->isnull[row] = false;
+				}
+			}
+			break;
+		case sizeof(int16):
+			for (row = 0; row < dim; row++)
+			{
+				if (fast[row])
+				{
+					column->values[row] = Int16GetDatum(
+											*((int16 *) (tps[row] + off)));
+					column->isnull[row] = false;
+				}
+			}
+			break;
+		default:
+			for (row = 0; row < dim; row++)
+			{
+				if (fast[row])
+				{
+					column->values[row] = CharGetDatum(*(tps[row] + off));
+					column->isnull[row] = false;
+				}
+			}
+			break;
+	}
+}
+
 /*
  * we don't want set the pin_buffers/pin_tuples in the slot, so call 
  * tts_vector_slot_deform_tuple directly, it is not a callback function.
+ *
+ * The values are written into the arrays of vdatum directly. The rows
+ * without nulls are deformed column by column for the fixed-width prefix,
+ * then each row walks the rest of its attributes.
  */
 static void
 tts_vector_slot_deform_tuple(TupleTableSlot *slot, int natts,
@@ -156,108 +264,113 @@ tts_vector_slot_deform_tuple(TupleTableSlot *slot, int natts,
 {
 	VectorTupleSlot	*vslot = (VectorTupleSlot *)slot;
 	TupleDesc	tupledesc = slot->tts_tupleDescriptor;
-	HeapTuple	tuple;
-	HeapTupleHeader tup;
-	bool		hasnulls;
-	//Form_pg_attribute *att = &(tupledesc->attrs);
+	int			offsets[GAMMA_DEFORM_FIXED_MAX];
+	char	   *tps[VECTOR_SIZE];	/* ptr to tuple data */
+	bool		fast[VECTOR_SIZE];	/* no nulls, has all the prefix */
+	int			nfixed;
+	int			fixed_end;
 	int			attnum;
-	char	   *tp;				/* ptr to tuple data */
-	long		off;			/* offset in tuple data */
-	bits8	   *bp;		/* ptr to null bitmap in tuple */
-	bool		slow;			/* can we use/set attcacheoff? */
 	int			row;
 	vdatum		*column;
 
+	for (attnum = 0; attnum < natts; attnum++)
+	{
+		column = (vdatum *)slot->tts_values[attnum];
+		column->ref = false;
+		column->dim = vslot->dim;
+	}
+
+	nfixed = tts_vector_slot_fixed_prefix(tupledesc, natts, offsets,
+										  &fixed_end);
+
 	for (row = 0; row < vslot->dim; row++)
 	{
-		tuple = &pin_tuples[row];
-		tup = tuple->t_data;
-		bp = tup->t_bits;
-		hasnulls = HeapTupleHasNulls(tuple);
-
-		attnum = slot->tts_nvalid;
-		/*
-		 * Check whether the first call for this tuple, and initialize or restore
-		 * loop state.
-		 */
-		/* vectorize engine deform once for now */
-		off = 0;
-		slow = false;
+		HeapTupleHeader tup = pin_tuples[row].t_data;
 
-		tp = (char *) tup + tup->t_hoff;
+		tps[row] = (char *) tup + tup->t_hoff;
+		fast[row] = !HeapTupleHasNulls(&pin_tuples[row]) &&
+					HeapTupleHeaderGetNatts(tup) >= nfixed;
+	}
 
-		for (; attnum < natts; attnum++)
+	for (attnum = 0; attnum < nfixed; attnum++)
+	{
+		column = (vdatum *)slot->tts_values[attnum];
+		tts_vector_slot_deform_fixed(column, TupleDescAttr(tupledesc, attnum),
+									 tps, fast, vslot->dim, offsets[attnum]);
+	}
+
+	for (row = 0; row < vslot->dim; row++)
+	{
+		HeapTuple	tuple = &pin_tuples[row];
+		HeapTupleHeader tup = tuple->t_data;
+		bits8	   *bp = tup->t_bits;	/* ptr to null bitmap in tuple */
+		bool		hasnulls = HeapTupleHasNulls(tuple);
+		int			tup_natts = Min(HeapTupleHeaderGetNatts(tup), natts);
+		char	   *tp = tps[row];
+		long		off;			/* offset in tuple data */
+		bool		slow;			/* can we use the prefix offsets? */
+
+		if (fast[row])
+		{
+			attnum = nfixed;
+			off = fixed_end;
+		}
+		else
+		{
+			attnum = 0;
+			off = 0;
+		}
+		slow = false;
+
+		for (; attnum < tup_natts; attnum++)
 		{
 			Form_pg_attribute thisatt = TupleDescAttr(tupledesc, attnum);
-			//Form_pg_attribute thisatt = att[attnum];
+
 			column = (vdatum *)slot->tts_values[attnum];
-			column->ref = false;
 
 			if (hasnulls && att_isnull(attnum, bp))
 			{
-				VDATUM_SET_DATUM(column, row, ((Datum)0));
-				VDATUM_SET_ISNULL(column, row, true);
-				slow = true;		/* can't use attcacheoff anymore */
+				column->values[row] = (Datum) 0;
+				column->isnull[row] = true;
+				slow = true;		/* can't use the prefix offsets anymore */
 				continue;
 			}
 
-			VDATUM_SET_ISNULL(column, row, false);
+			column->isnull[row] = false;
 
-			if (!slow && thisatt->attcacheoff >= 0)
-				off = thisatt->attcacheoff;
+			if (!slow && attnum < nfixed)
+				off = offsets[attnum];
 			else if (thisatt->attlen == -1)
-			{
-				/*
-				 * We can only cache the offset for a varlena attribute if the
-				 * offset is already suitably aligned, so that there would be no
-				 * pad bytes in any case: then the offset will be valid for either
-				 * an aligned or unaligned value.
-				 */
-				if (!slow &&
-						off == att_align_nominal(off, thisatt->attalign))
-					thisatt->attcacheoff = off;
-				else
-				{
-					off = att_align_pointer(off, thisatt->attalign, -1,
-							tp + off);
-					slow = true;
-				}
-			}
+				off = att_align_pointer(off, thisatt->attalign, -1, tp + off);
 			else
-			{
-				/* not varlena, so safe to use att_align_nominal */
 				off = att_align_nominal(off, thisatt->attalign);
 
-				if (!slow)
-					thisatt->attcacheoff = off;
-			}
-
-			VDATUM_SET_DATUM(column, row, fetchatt(thisatt, tp + off));
+			column->values[row] = fetchatt(thisatt, tp + off);
 
 			off = att_addlength_pointer(off, thisatt->attlen, tp + off);
-
-			if (thisatt->attlen <= 0)
-				slow = true;		/* can't use attcacheoff anymore */
 		}
-	}
 
+		/* the tuple was written before the columns were added */
+		for (; attnum < natts; attnum++)
+		{
+			bool isnull;
 
-	attnum = slot->tts_nvalid;
-	for (; attnum < natts; attnum++)
-	{
-		column = (vdatum *)slot->tts_values[attnum];
-		column->dim = vslot->dim;
+			column = (vdatum *)slot->tts_values[attnum];
+			column->values[row] = getmissingattr(tupledesc, attnum + 1,
+												 &isnull);
+			column->isnull[row] = isnull;
+		}
 	}
 
 	/*
 	 * Save state for next execution
 	 */
-	slot->tts_nvalid = attnum;
+	slot->tts_nvalid = natts;
 }
 
 
 /*
- * we don't want set the pin_buffers/pin_tuples in the slot, so call 
+ * we don't want set the pin_buffers/pin_tuples in the slot, so call
  * tts_vector_slot_getallattrs directly, it is not a callback function.
  */
 void
@@ -266,8 +379,6 @@ tts_vector_slot_getallattrs(TupleTableSlot *slot, HeapTupleData *pin_tuples,
 {
 	VectorTupleSlot	*vslot = (VectorTupleSlot *)slot;
 	int			tdesc_natts = slot->tts_tupleDescriptor->natts;
-	int			attnum;
-	HeapTuple	tuple;
 	int			i;
 
 	/* Quick out if we have 'em all already */
@@ -277,33 +388,14 @@ tts_vector_slot_getallattrs(TupleTableSlot *slot, HeapTupleData *pin_tuples,
 	if (vslot->dim == 0)
 		return;
 
-	//TODO: zsj Assert?
 	for (i = 0; i < vslot->dim; i++)
 	{
-		tuple = &pin_tuples[i];
-		if (tuple == NULL)			/* internal error */
+		if (pin_tuples[i].t_data == NULL)			/* internal error */
 			elog(ERROR, "cannot extract attribute from empty tuple slot");
 	}
 
-	/*
-	 * load up any slots available from physical tuple
-	 */
-	attnum = HeapTupleHeaderGetNatts(pin_tuples[0].t_data);
-	attnum = Min(attnum, tdesc_natts);
-
-	tts_vector_slot_deform_tuple(slot, attnum, pin_tuples, pin_buffers);
-
-	/*
-	 * If tuple doesn't have all the atts indicated by tupledesc, read the
-	 * rest as null
-	 */
-	for (; attnum < tdesc_natts; attnum++)
-	{
-		slot->tts_values[attnum] = (Datum) 0;
-		slot->tts_isnull[attnum] = true;
-	}
-
-	slot->tts_nvalid = tdesc_natts;
+	/* the rows may have less atts than tupledesc, see deform_tuple */
+	tts_vector_slot_deform_tuple(slot, tdesc_natts, pin_tuples, pin_buffers);
 }
 
 uint32
@@ -353,8 +445,11 @@ tts_vector_slot_from_rg(TupleTableSlot *slot, RowGroup *rg,
 	slot->tts_nvalid = natts;
 	vslot->dim = count;
 
-	if (RGHasDelBitmap(rg))
+	/* the batches without deleted rows are emitted as full batches */
+	if (RGHasDelBitmap(rg) &&
+		memchr(&rg->delbitmap[offset], true, sizeof(bool) * count) != NULL)
 	{
+		VSlotClearNonSkip(vslot);
 		memcpy(vslot->skip, &rg->delbitmap[offset], sizeof(bool) * count);
 	}
 	else
@@ -461,17 +556,25 @@ tts_vector_slot_copy_values(TupleTableSlot *slot, TupleTableSlot *src_slot)
 	return;
 }
 
+/*
+ * Fill a batch of delta table rows into the VectorTupleSlot. After a row is
+ * returned by the heap scan, the other visible rows of its page are taken
+ * from the page directly, the heap scan continues after them.
+ */
 bool
 tts_vector_slot_fill_tuple(TableScanDesc scandesc, ScanDirection direction,
-							TupleTableSlot *slot)
+							TupleTableSlot *slot, ItemPointer tids)
 {
 	bool scan_over = false;
 	HeapTuple tuple;
 	TupleDesc tupledesc;
+	HeapScanDesc hscandesc = (HeapScanDesc)scandesc;
+	Oid relid = RelationGetRelid(scandesc->rs_rd);
 
 	VectorTupleSlot	*vslot;
 	TupleTableSlot *scanslot;
 	int row;
+	bool page_batch;
 
 	Buffer prev_buf = InvalidBuffer;
 	HeapTupleData pin_tuples[VECTOR_SIZE];
@@ -485,37 +588,95 @@ tts_vector_slot_fill_tuple(TableScanDesc scandesc, ScanDirection direction,
 	tupledesc = RelationGetDescr(scandesc->rs_rd);
 	scanslot = MakeSingleTupleTableSlot(tupledesc, &TTSOpsBufferHeapTuple);
 
+	/*
+	 * The visible rows of the page are known in page mode. rs_vistuples and
+	 * rs_cindex are heapam internals, they are only used for the sequential
+	 * scans of heap and the delta table of gamma table.
+	 */
+	page_batch = ScanDirectionIsForward(direction) &&
+				 (scandesc->rs_flags & SO_TYPE_SEQSCAN) != 0 &&
+				 (scandesc->rs_flags & SO_ALLOW_PAGEMODE) != 0 &&
+				 scandesc->rs_nkeys == 0 &&
+				 (scandesc->rs_rd->rd_tableam == GetHeapamTableAmRoutine() ||
+				  scandesc->rs_rd->rd_tableam == ctable_tableam_routine());
+
 	/* fetch a batch of rows and fill them into VectorTupleSlot */
-	for (row = 0 ; row < VECTOR_SIZE; row++)
+	row = 0;
+	while (row < VECTOR_SIZE)
 	{
-		if (heap_getnextslot(scandesc, direction, scanslot))
+		bool shouldFree;
+		Buffer buffer;
+
+		if (!heap_getnextslot(scandesc, direction, scanslot))
 		{
-			bool shouldFree;
-			HeapScanDesc hscandesc = (HeapScanDesc)scandesc;
-			Buffer buffer = hscandesc->rs_cbuf;
+			/* scan finish, but we still need to emit current vslot */
+			scan_over = true;
+			break;
+		}
 
-			tuple = ExecFetchSlotHeapTuple(scanslot, false, &shouldFree);
+		buffer = hscandesc->rs_cbuf;
+		tuple = ExecFetchSlotHeapTuple(scanslot, false, &shouldFree);
 
-			memcpy(&pin_tuples[row], tuple, sizeof(HeapTupleData));
+		memcpy(&pin_tuples[row], tuple, sizeof(HeapTupleData));
 
-			if (BufferIsValid(buffer) &&
-				(row == 0 || prev_buf != buffer))
-			{
-				prev_buf = buffer;
-				if (BufferIsValid(pin_buffers[row]))
-					ReleaseBuffer(pin_buffers[row]);
-				pin_buffers[row] = buffer;
-				IncrBufferRefCount(buffer);
-			}
+		/* the caller wants the tids of the rows */
+		if (tids != NULL)
+			tids[row] = scanslot->tts_tid;
 
-			if (shouldFree)
-				heap_freetuple(tuple);
+		if (BufferIsValid(buffer) &&
+			(row == 0 || prev_buf != buffer))
+		{
+			prev_buf = buffer;
+			if (BufferIsValid(pin_buffers[row]))
+				ReleaseBuffer(pin_buffers[row]);
+			pin_buffers[row] = buffer;
+			IncrBufferRefCount(buffer);
 		}
-		else
+
+		if (shouldFree)
 		{
-			/* scan finish, but we still need to emit current vslot */
-			scan_over = true;
-			break;
+			/* the tuple is not in the page, the batch can't reference it */
+			if (vslot->batch_context == NULL)
+				vslot->batch_context = AllocSetContextCreate(slot->tts_mcxt,
+														"Gamma Vector Batch",
+														ALLOCSET_SMALL_SIZES);
+
+			pin_tuples[row].t_data = (HeapTupleHeader)
+						MemoryContextAlloc(vslot->batch_context, tuple->t_len);
+			memcpy(pin_tuples[row].t_data, tuple->t_data, tuple->t_len);
+			heap_freetuple(tuple);
+			page_batch = false;
+		}
+
+		row++;
+
+		if (page_batch && BufferIsValid(buffer))
+		{
+			Page page = BufferGetPage(buffer);
+			int index;
+
+			/* the page is pinned by pin_buffers */
+			for (index = hscandesc->rs_cindex + 1;
+				 index < hscandesc->rs_ntuples && row < VECTOR_SIZE;
+				 index++, row++)
+			{
+				OffsetNumber lineoff = hscandesc->rs_vistuples[index];
+				ItemId lpp = PageGetItemId(page, lineoff);
+				HeapTuple page_tuple = &pin_tuples[row];
+
+				page_tuple->t_data = (HeapTupleHeader) PageGetItem(page, lpp);
+				page_tuple->t_len = ItemIdGetLength(lpp);
+				page_tuple->t_tableOid = relid;
+				ItemPointerSet(&page_tuple->t_self, hscandesc->rs_cblock,
+							   lineoff);
+
+				if (tids != NULL)
+					tids[row] = page_tuple->t_self;
+
+				pgstat_count_heap_getnext(scandesc->rs_rd);
+			}
+
+			hscandesc->rs_cindex = index - 1;
 		}
 	}
 
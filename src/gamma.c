@@ -20,8 +20,12 @@
 #include "executor/nodeCustom.h"
 #include "utils/guc.h"
 
+#include "executor/gamma_automerge.h"
 #include "executor/gamma_copy.h"
 #include "executor/gamma_vec_agg.h"
+#include "executor/gamma_vec_bitmapscan.h"
+#include "executor/gamma_vec_indexscan.h"
+#include "executor/gamma_vec_append.h"
 #include "executor/gamma_devectorize.h"
 #include "executor/gamma_indexscan.h"
 #include "executor/gamma_indexonlyscan.h"
@@ -31,6 +35,9 @@
 #include "executor/vector_tuple_slot.h"
 #include "optimizer/gamma_paths.h"
 #include "storage/gamma_buffer.h"
+#include "storage/gamma_cvtable_am.h"
+#include "storage/gamma_local_buffer.h"
+#include "storage/gamma_prewarm.h"
 #include "storage/gamma_rg.h"
 #include "utils/gamma_cache.h"
 #include "utils/nodes/gamma_nodes.h"
@@ -54,7 +61,8 @@ extern int					gammadb_delta_table_nblocks;
 extern bool					gammadb_delta_table_merge_all;
 extern int					gammadb_buffers;
 
-extern double				gammadb_stats_analyze_tuple_factor;
+extern int					gammadb_stats_analyze_rowgroup_rows;
+extern bool					gammadb_stats_rowgroup_ndistinct;
 extern int					gammadb_cv_compress_method;
 
 void _PG_init(void);
@@ -109,21 +117,71 @@ gamma_guc_init(void)
 							PGC_USERSET,
 							GUC_NOT_IN_SAMPLE | GUC_UNIT_MB,
 							NULL, NULL, NULL);
+	DefineCustomIntVariable("gammadb_buffer_decoded_percent",
+							"percent of gamma buffer for decoded column vectors, the rest keeps compressed ones",
+							NULL,
+							&gammadb_buffer_decoded_percent,
+							50,
+							1,
+							100,
+							PGC_SIGHUP,
+							GUC_NOT_IN_SAMPLE,
+							NULL, NULL, NULL);
+	DefineCustomIntVariable("gammadb_local_buffers",
+							"backend-local buffer size for decoded column vectors",
+							NULL,
+							&gammadb_local_buffers,
+							32,
+							0,
+							INT_MAX / 2,
+							PGC_USERSET,
+							GUC_NOT_IN_SAMPLE | GUC_UNIT_MB,
+							NULL, NULL, NULL);
+	DefineCustomIntVariable("gammadb_cv_prefetch_rowgroups",
+							"#row groups to read ahead in sequential scans",
+							NULL,
+							&gammadb_cv_prefetch_rowgroups,
+							2,
+							0,
+							64,
+							PGC_USERSET,
+							GUC_NOT_IN_SAMPLE,
+							NULL, NULL, NULL);
+	DefineCustomIntVariable("gammadb_index_fetch_sort_tids",
+							"#tids sorted by row group before index fetch",
+							NULL,
+							&gammadb_index_fetch_sort_tids,
+							4096,
+							0,
+							INT_MAX / 64,
+							PGC_USERSET,
+							GUC_NOT_IN_SAMPLE,
+							NULL, NULL, NULL);
 	DefineCustomBoolVariable("gammadb_delta_table_merge_all",
-							 "Merging all rows to column store.",
+							 "Merging all rows to column store by gamma_merge_delta().",
 							 NULL,
 							 &gammadb_delta_table_merge_all,
 							 false,
 							 PGC_USERSET,
 							 GUC_NOT_IN_SAMPLE,
 							 NULL, NULL, NULL);
-	DefineCustomRealVariable("gammadb_stats_analyze_tuple_factor",
-							 "#count of sampling tuples",
-							 NULL,
-							 &gammadb_stats_analyze_tuple_factor,
-							 0.01,
-							 0.0,
-							 1.0,
+	DefineCustomIntVariable("gammadb_stats_analyze_rowgroup_rows",
+							"#rows sampled from each row group by ANALYZE",
+							"The number of row groups read by ANALYZE is the "
+							"statistics target rows divided by it.",
+							&gammadb_stats_analyze_rowgroup_rows,
+							300,
+							1,
+							INT_MAX,
+							PGC_USERSET,
+							GUC_NOT_IN_SAMPLE,
+							NULL, NULL, NULL);
+	DefineCustomBoolVariable("gammadb_stats_rowgroup_ndistinct",
+							 "Estimates ndistinct with the statistics of row groups.",
+							 "The planner uses the statistics built when the "
+							 "row groups are written instead of ANALYZE.",
+							 &gammadb_stats_rowgroup_ndistinct,
+							 true,
 							 PGC_USERSET,
 							 GUC_NOT_IN_SAMPLE,
 							 NULL, NULL, NULL);
@@ -145,6 +203,112 @@ gamma_guc_init(void)
 							 PGC_USERSET,
 							 GUC_NOT_IN_SAMPLE,
 							 NULL, NULL, NULL);
+	DefineCustomIntVariable("gammadb_copy_parallel_workers",
+							"#parallel workers to build row groups in COPY",
+							"If set to zero, the row groups are built by the COPY backend.",
+							&gammadb_copy_parallel_workers,
+							2,
+							0,
+							GAMMA_COPY_MAX_WORKERS,
+							PGC_USERSET,
+							GUC_NOT_IN_SAMPLE,
+							NULL, NULL, NULL);
+	DefineCustomIntVariable("gammadb_insert_rowgroup_threshold",
+							"#rows of an INSERT written to delta table before the rest are written to row groups",
+							"If set to -1, the rows of INSERT are always written to delta table.",
+							&gammadb_insert_rowgroup_threshold,
+							GAMMA_COLUMN_VECTOR_SIZE,
+							-1,
+							INT_MAX,
+							PGC_USERSET,
+							GUC_NOT_IN_SAMPLE,
+							NULL, NULL, NULL);
+	DefineCustomBoolVariable("gammadb_autoprewarm",
+							 "Dumps and reloads gamma buffer across restarts.",
+							 NULL,
+							 &gammadb_autoprewarm,
+							 false,
+							 PGC_POSTMASTER,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
+	DefineCustomIntVariable("gammadb_autoprewarm_interval",
+							"interval between dumps of gamma buffer",
+							"If set to zero, gamma buffer is only dumped at shutdown.",
+							&gammadb_autoprewarm_interval,
+							300,
+							0,
+							INT_MAX / 1000,
+							PGC_SIGHUP,
+							GUC_NOT_IN_SAMPLE | GUC_UNIT_S,
+							NULL, NULL, NULL);
+	DefineCustomIntVariable("gammadb_autoprewarm_workers",
+							"#workers per database to reload gamma buffer",
+							NULL,
+							&gammadb_autoprewarm_workers,
+							2,
+							1,
+							1024,
+							PGC_SIGHUP,
+							GUC_NOT_IN_SAMPLE,
+							NULL, NULL, NULL);
+	DefineCustomBoolVariable("gammadb_automerge",
+							 "Starts a background worker to merge delta tables into row groups.",
+							 NULL,
+							 &gammadb_automerge,
+							 true,
+							 PGC_POSTMASTER,
+							 GUC_NOT_IN_SAMPLE,
+							 NULL, NULL, NULL);
+	DefineCustomIntVariable("gammadb_automerge_naptime",
+							"sleep time between runs of the merge worker",
+							"The worker comes back in one second if the last run merged row groups.",
+							&gammadb_automerge_naptime,
+							10,
+							1,
+							INT_MAX / 1000,
+							PGC_SIGHUP,
+							GUC_NOT_IN_SAMPLE | GUC_UNIT_S,
+							NULL, NULL, NULL);
+	DefineCustomIntVariable("gammadb_automerge_min_rows",
+							"#rows inserted into the delta table since the last merge to merge it again",
+							"The table is merged only when the delta table has at least one row group of live rows.",
+							&gammadb_automerge_min_rows,
+							GAMMA_COLUMN_VECTOR_SIZE,
+							1,
+							INT_MAX,
+							PGC_SIGHUP,
+							GUC_NOT_IN_SAMPLE,
+							NULL, NULL, NULL);
+	DefineCustomIntVariable("gammadb_automerge_max_rowgroups",
+							"#row groups merged in one transaction of the merge worker",
+							NULL,
+							&gammadb_automerge_max_rowgroups,
+							8,
+							1,
+							1024,
+							PGC_SIGHUP,
+							GUC_NOT_IN_SAMPLE,
+							NULL, NULL, NULL);
+	DefineCustomIntVariable("gammadb_automerge_busy_backends",
+							"#backends in write transactions to throttle the merge worker",
+							"The busy worker merges one row group per transaction and sleeps gammadb_automerge_delay between them. If set to zero, the worker is never throttled.",
+							&gammadb_automerge_busy_backends,
+							8,
+							0,
+							INT_MAX,
+							PGC_SIGHUP,
+							GUC_NOT_IN_SAMPLE,
+							NULL, NULL, NULL);
+	DefineCustomIntVariable("gammadb_automerge_delay",
+							"sleep time between the merges of a throttled merge worker",
+							NULL,
+							&gammadb_automerge_delay,
+							100,
+							0,
+							10000,
+							PGC_SIGHUP,
+							GUC_NOT_IN_SAMPLE | GUC_UNIT_MS,
+							NULL, NULL, NULL);
 }
 
 void
@@ -155,6 +319,12 @@ _PG_init(void)
 	/* Init GUCs */
 	gamma_guc_init();
 
+	/* Register the autoprewarm worker of gamma buffer */
+	gamma_prewarm_register_worker();
+
+	/* Register the worker merging delta tables into row groups */
+	gamma_automerge_register_worker();
+
 	/* Init Extensible nodes*/
 	gamma_register_nodes();
 
@@ -173,6 +343,9 @@ _PG_init(void)
 	/* cache some oid for performance */
 	gamma_cache_startup();
 
+	/* Track the statements writing row groups directly */
+	gamma_copy_init();
+
 	/* Register vectorized execution nodes */
 	gamma_vec_tablescan_init();
 	gamma_vec_devector_init();
@@ -181,6 +354,9 @@ _PG_init(void)
 	gamma_vec_sort_init();
 	gamma_indexscan_init();
 	gamma_indexonlyscan_init();
+	gamma_vec_bitmapscan_init();
+	gamma_vec_indexscan_init();
+	gamma_vec_append_init();
 
 #ifdef _GAMMAX_
 	gamma_colindex_scan_init();
@@ -16,22 +16,42 @@
 #include "postgres.h"
 
 #include "fmgr.h"
+#include "access/htup_details.h"
+#include "access/table.h"
+#include "catalog/pg_statistic.h"
+#include "catalog/pg_type.h"
 #include "optimizer/planner.h"
 #include "executor/nodeCustom.h"
+#include "miscadmin.h"
+#include "parser/parsetree.h"
+#include "utils/acl.h"
+#include "utils/array.h"
 #include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/selfuncs.h"
+#include "utils/syscache.h"
 
 #include "executor/gamma_devectorize.h"
 #include "executor/gamma_vec_tablescan.h"
 #include "executor/vector_tuple_slot.h"
 #include "optimizer/gamma_converter.h"
 #include "optimizer/gamma_paths.h"
+#include "storage/ctable_am.h"
+#include "storage/gamma_stats.h"
 
 
 bool enable_gammadb = false;
 bool enable_gammadb_notice = false;
+bool gammadb_stats_rowgroup_ndistinct = true;
 
 
 static planner_hook_type planner_hook_prev = NULL;
+static get_relation_stats_hook_type get_relation_stats_hook_prev = NULL;
+
+static bool gamma_get_relation_stats(PlannerInfo *root, RangeTblEntry *rte,
+									 AttrNumber attnum,
+									 VariableStatData *vardata);
 
 static PlannedStmt* gamma_vec_planner(Query	*parse,
 		const char* query_string,
@@ -48,6 +68,9 @@ gamma_path_planner_methods(void)
 		planner_hook_prev = planner_hook;
 		planner_hook = gamma_vec_planner;
 
+		get_relation_stats_hook_prev = get_relation_stats_hook;
+		get_relation_stats_hook = gamma_get_relation_stats;
+
 		gamma_path_planner_initialized = true;
 	}
 
@@ -84,3 +107,203 @@ gamma_vec_planner(Query	*parse,
 
 	return stmt;
 }
+
+/*
+ * The same check as examine_simple_variable: the statistics may be used by
+ * leaky operators only if the user can read the column and no security
+ * barrier quals (eg. row level security) are on the relation.
+ */
+static bool
+gamma_stats_acl_ok(PlannerInfo *root, RangeTblEntry *rte, AttrNumber attnum)
+{
+	Oid userid = InvalidOid;
+#if PG_VERSION_NUM >= 160000
+	int i;
+
+	for (i = 1; i < root->simple_rel_array_size; i++)
+	{
+		if (root->simple_rte_array[i] == rte &&
+			root->simple_rel_array[i] != NULL)
+		{
+			userid = root->simple_rel_array[i]->userid;
+			break;
+		}
+	}
+#else
+	userid = rte->checkAsUser;
+#endif
+
+	if (!OidIsValid(userid))
+		userid = GetUserId();
+
+	return rte->securityQuals == NIL &&
+		(pg_class_aclcheck(rte->relid, userid, ACL_SELECT) == ACLCHECK_OK ||
+		 pg_attribute_aclcheck(rte->relid, attnum, userid,
+							   ACL_SELECT) == ACLCHECK_OK);
+}
+
+/*
+ * The MCV frequencies of ANALYZE are fractions of all rows, scale them with
+ * the non-null fraction so that they are consistent with the new stanullfrac.
+ */
+static HeapTuple
+gamma_stats_rescale_mcv(HeapTuple tuple, TupleDesc desc, double nullfrac)
+{
+	Form_pg_statistic form = (Form_pg_statistic) GETSTRUCT(tuple);
+	double old_nullfrac = form->stanullfrac;
+	int i;
+
+	if (old_nullfrac >= 1.0 || old_nullfrac == nullfrac)
+		return tuple;
+
+	for (i = 0; i < STATISTIC_NUM_SLOTS; i++)
+	{
+		Datum values[Natts_pg_statistic];
+		bool nulls[Natts_pg_statistic];
+		bool replaces[Natts_pg_statistic];
+		ArrayType *numbers;
+		float4 *freqs;
+		Datum datum;
+		bool isnull;
+		HeapTuple new_tuple;
+		int nfreqs;
+		int j;
+
+		if ((&form->stakind1)[i] != STATISTIC_KIND_MCV)
+			continue;
+
+		datum = heap_getattr(tuple, Anum_pg_statistic_stanumbers1 + i,
+							 desc, &isnull);
+		if (isnull)
+			break;
+
+		numbers = DatumGetArrayTypePCopy(datum);
+		if (ARR_NDIM(numbers) != 1 || ARR_HASNULL(numbers) ||
+			ARR_ELEMTYPE(numbers) != FLOAT4OID)
+			break;
+
+		freqs = (float4 *) ARR_DATA_PTR(numbers);
+		nfreqs = ARR_DIMS(numbers)[0];
+		for (j = 0; j < nfreqs; j++)
+		{
+			double freq = freqs[j] * (1.0 - nullfrac) / (1.0 - old_nullfrac);
+			freqs[j] = (float4) Min(Max(freq, 0.0), 1.0);
+		}
+
+		memset(replaces, false, sizeof(replaces));
+		memset(nulls, false, sizeof(nulls));
+		values[Anum_pg_statistic_stanumbers1 - 1 + i] = PointerGetDatum(numbers);
+		replaces[Anum_pg_statistic_stanumbers1 - 1 + i] = true;
+
+		new_tuple = heap_modify_tuple(tuple, desc, values, nulls, replaces);
+		heap_freetuple(tuple);
+		return new_tuple;
+	}
+
+	return tuple;
+}
+
+/*
+ * The ndistinct and null fraction of a gamma table column are merged from
+ * the statistics of its row groups, they are fresh even if ANALYZE is not
+ * run after the rows are merged. The other statistics come from ANALYZE,
+ * the MCV frequencies are rescaled to the null fraction.
+ */
+static bool
+gamma_get_relation_stats(PlannerInfo *root, RangeTblEntry *rte,
+						 AttrNumber attnum, VariableStatData *vardata)
+{
+	Relation rel;
+	HeapTuple stats_tuple;
+	double stadistinct = 0;
+	double nullfrac = 0;
+	bool found = false;
+
+	if (get_relation_stats_hook_prev &&
+		get_relation_stats_hook_prev(root, rte, attnum, vardata))
+		return true;
+
+	if (!gammadb_stats_rowgroup_ndistinct || rte->rtekind != RTE_RELATION ||
+		rte->inh || attnum <= 0)
+		return false;
+
+	/* the planner checks the privileges (and parents) by itself then */
+	if (!gamma_stats_acl_ok(root, rte, attnum))
+		return false;
+
+	rel = RelationIdGetRelation(rte->relid);
+	if (!RelationIsValid(rel))
+		return false;
+
+	if (rel->rd_tableam == ctable_tableam_routine())
+		found = gamma_stats_rel_column(rel, attnum, &stadistinct, &nullfrac);
+
+	RelationClose(rel);
+
+	if (!found)
+		return false;
+
+	stats_tuple = SearchSysCache3(STATRELATTINH,
+								  ObjectIdGetDatum(rte->relid),
+								  Int16GetDatum(attnum),
+								  BoolGetDatum(false));
+	if (HeapTupleIsValid(stats_tuple))
+	{
+		HeapTuple tuple = heap_copytuple(stats_tuple);
+		Relation stat_rel;
+
+		ReleaseSysCache(stats_tuple);
+
+		stat_rel = table_open(StatisticRelationId, AccessShareLock);
+		tuple = gamma_stats_rescale_mcv(tuple, RelationGetDescr(stat_rel),
+										nullfrac);
+		table_close(stat_rel, AccessShareLock);
+
+		((Form_pg_statistic) GETSTRUCT(tuple))->stadistinct = stadistinct;
+		((Form_pg_statistic) GETSTRUCT(tuple))->stanullfrac = nullfrac;
+		vardata->statsTuple = tuple;
+	}
+	else
+	{
+		Relation stat_rel;
+		Datum values[Natts_pg_statistic];
+		bool nulls[Natts_pg_statistic];
+		Oid typid;
+		int32 typmod;
+		Oid collid;
+		int i;
+
+		get_atttypetypmodcoll(rte->relid, attnum, &typid, &typmod, &collid);
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, false, sizeof(nulls));
+
+		values[Anum_pg_statistic_starelid - 1] = ObjectIdGetDatum(rte->relid);
+		values[Anum_pg_statistic_staattnum - 1] = Int16GetDatum(attnum);
+		values[Anum_pg_statistic_stainherit - 1] = BoolGetDatum(false);
+		values[Anum_pg_statistic_stanullfrac - 1] = Float4GetDatum(nullfrac);
+		values[Anum_pg_statistic_stawidth - 1] = Int32GetDatum(
+											get_typavgwidth(typid, typmod));
+		values[Anum_pg_statistic_stadistinct - 1] = Float4GetDatum(stadistinct);
+
+		/* no slots */
+		for (i = 0; i < STATISTIC_NUM_SLOTS; i++)
+		{
+			values[Anum_pg_statistic_stakind1 - 1 + i] = Int16GetDatum(0);
+			values[Anum_pg_statistic_staop1 - 1 + i] = ObjectIdGetDatum(InvalidOid);
+			values[Anum_pg_statistic_stacoll1 - 1 + i] = ObjectIdGetDatum(InvalidOid);
+			nulls[Anum_pg_statistic_stanumbers1 - 1 + i] = true;
+			nulls[Anum_pg_statistic_stavalues1 - 1 + i] = true;
+		}
+
+		stat_rel = table_open(StatisticRelationId, AccessShareLock);
+		vardata->statsTuple = heap_form_tuple(RelationGetDescr(stat_rel),
+											  values, nulls);
+		table_close(stat_rel, AccessShareLock);
+	}
+
+	vardata->freefunc = heap_freetuple;
+	vardata->acl_ok = true;
+
+	return true;
+}
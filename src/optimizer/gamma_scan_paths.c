@@ -15,11 +15,19 @@
 
 #include "postgres.h"
 
+#include <math.h>
+
 #include "access/table.h"
 #include "catalog/pg_class.h"
 #include "nodes/makefuncs.h"
+#include "optimizer/cost.h"
 #include "optimizer/optimizer.h"
+#include "utils/fmgroids.h"
+#include "utils/spccache.h"
 
+#include "executor/gamma_vec_append.h"
+#include "executor/gamma_vec_bitmapscan.h"
+#include "executor/gamma_vec_indexscan.h"
 #include "executor/gamma_vec_tablescan.h"
 #include "executor/gamma_indexscan.h"
 #include "executor/gamma_indexonlyscan.h"
@@ -27,6 +35,7 @@
 #include "optimizer/gamma_paths.h"
 #include "optimizer/paths.h"
 #include "storage/ctable_am.h"
+#include "storage/gamma_cv.h"
 #include "utils/utils.h"
 #include "utils/vdatum/vdatum.h"
 
@@ -54,8 +63,22 @@ static void gamma_indexscan_paths(PlannerInfo *root,
 			   RelOptInfo *baserel,
 			   Index rtindex,
 			   RangeTblEntry *rte);
+static void gamma_append_paths(PlannerInfo *root,
+			   RelOptInfo *baserel,
+			   Index rtindex,
+			   RangeTblEntry *rte);
+static bool gamma_is_vec_scan_path(Path *path);
+static bool gamma_check_samplescan_path(RangeTblEntry *rte);
+static bool gamma_check_tidrangescan_path(Path *path, RangeTblEntry *rte);
+static bool gamma_check_bitmapqual(Path *bitmapqual);
+static Path *gamma_bitmapscan_path(PlannerInfo *root, RelOptInfo *baserel,
+								   Path *bitmappath);
+static Path *gamma_vec_indexscan_path(PlannerInfo *root, RelOptInfo *baserel,
+									  Path *indexpath);
 static void gamma_cost_seqscan(CustomPath *cpath, Path *scanpath,
 							   PlannerInfo *root, RelOptInfo *baserel);
+static Cost gamma_cost_rowgroup_fetch(RelOptInfo *baserel,
+									  double tuples_fetched);
 
 static set_rel_pathlist_hook_type set_rel_pathlist_prev = NULL;
 
@@ -123,7 +146,11 @@ gamma_plain_tablescan_paths(PlannerInfo *root,
 		/* all paths need to reserve (when process seqscan paths) */
 		new_pathlist = lappend(new_pathlist, scanpath);
 
-		if (scanpath->pathtype != T_SeqScan)
+		if (scanpath->pathtype != T_SeqScan &&
+			!(scanpath->pathtype == T_SampleScan &&
+			  gamma_check_samplescan_path(rte)) &&
+			!(scanpath->pathtype == T_TidRangeScan &&
+			  gamma_check_tidrangescan_path(scanpath, rte)))
 		{
 			continue;
 		}
@@ -134,9 +161,18 @@ gamma_plain_tablescan_paths(PlannerInfo *root,
 			continue;
 		}
 
-		newpath = makeNode(Path);
-		memcpy(newpath, scanpath, sizeof(Path));
-		
+		if (IsA(scanpath, TidRangePath))
+		{
+			/* the tid range quals are needed to create the plan */
+			newpath = (Path *) makeNode(TidRangePath);
+			memcpy(newpath, scanpath, sizeof(TidRangePath));
+		}
+		else
+		{
+			newpath = makeNode(Path);
+			memcpy(newpath, scanpath, sizeof(Path));
+		}
+
 
 		cpath = makeNode(CustomPath);
 
@@ -253,6 +289,8 @@ gamma_scan_paths(PlannerInfo *root,
 	}
 	else if (rte->inh)
 	{
+		/* the children have been planned, see gamma_append_paths */
+		gamma_append_paths(root, baserel, rtindex, rte);
 		return;
 	}
 	else
@@ -264,10 +302,6 @@ gamma_scan_paths(PlannerInfo *root,
 				{
 					return;
 				}
-				else if (rte->tablesample != NULL)
-				{
-					return;
-				}
 				else
 				{
 					relid = rte->relid;
@@ -297,6 +331,140 @@ gamma_scan_paths(PlannerInfo *root,
 #endif
 }
 
+static bool
+gamma_is_vec_scan_path(Path *path)
+{
+	const CustomPathMethods *methods;
+
+	if (!IsA(path, CustomPath))
+		return false;
+
+	methods = ((CustomPath *) path)->methods;
+
+	return (methods == gamma_vec_tablescan_path_methods() ||
+			methods == gamma_vec_bitmapscan_path_methods() ||
+			methods == gamma_vec_indexscan_path_methods());
+}
+
+/*
+ * The children of a partitioned (or inherited) table have got the
+ * vectorized paths when they are planned. If all the subpaths of an Append
+ * are vectorized scans, the Append passes their batches through, it is
+ * wrapped by the vectorized Append so the upper nodes are vectorized too.
+ * The Append is kept, so is the partition pruning.
+ */
+static void
+gamma_append_paths(PlannerInfo *root,
+			   RelOptInfo *baserel,
+			   Index rtindex,
+			   RangeTblEntry *rte)
+{
+	List *new_pathlist = NULL;
+	ListCell *lc;
+
+	foreach (lc, baserel->pathlist)
+	{
+		AppendPath *appendpath = (AppendPath *) lfirst(lc);
+		CustomPath *cpath = NULL;
+		ListCell *lc2;
+		bool vectorized = true;
+
+		new_pathlist = lappend(new_pathlist, appendpath);
+
+		/* the ordered Append may sort its subpaths by rows */
+		if (!IsA(appendpath, AppendPath) ||
+			appendpath->subpaths == NIL ||
+			appendpath->path.pathkeys != NIL ||
+			appendpath->path.param_info != NULL ||
+			appendpath->path.parallel_aware)
+			continue;
+
+		foreach (lc2, appendpath->subpaths)
+		{
+			if (!gamma_is_vec_scan_path((Path *) lfirst(lc2)))
+			{
+				vectorized = false;
+				break;
+			}
+		}
+
+		if (!vectorized ||
+			!gamma_vec_check_path(root, baserel, (Path *) appendpath))
+			continue;
+
+		cpath = makeNode(CustomPath);
+
+		cpath->path.pathtype			= T_CustomScan;
+		cpath->path.parent				= baserel;
+		cpath->path.pathtarget			= appendpath->path.pathtarget;
+		cpath->path.param_info			= NULL;
+		cpath->path.parallel_aware		= false;
+		cpath->path.parallel_safe		= appendpath->path.parallel_safe;
+		cpath->path.parallel_workers	= appendpath->path.parallel_workers;
+		cpath->path.rows				= appendpath->path.rows;
+		cpath->path.pathkeys			= NIL;  /* unsorted results */
+		cpath->flags					= 0;
+		cpath->custom_paths				= list_make1(appendpath);
+		cpath->custom_private			= NULL;
+		cpath->methods = (CustomPathMethods *)gamma_vec_append_path_methods();
+
+		/* the rows are passed by batches, not one by one */
+		cpath->path.startup_cost = appendpath->path.startup_cost;
+		cpath->path.total_cost = appendpath->path.total_cost -
+			cpu_tuple_cost * 0.5 * appendpath->path.rows *
+			(1.0 - 1.0 / VECTOR_SIZE);
+
+		new_pathlist = lcons(cpath, new_pathlist);
+	}
+
+	baserel->pathlist = new_pathlist;
+}
+
+/*
+ * TABLESAMPLE SYSTEM and BERNOULLI of columnar tables are done by the
+ * vectorized scan, SYSTEM samples whole row groups.
+ */
+static bool
+gamma_check_samplescan_path(RangeTblEntry *rte)
+{
+	TableSampleClause *tsc = rte->tablesample;
+	Relation rel;
+	bool result;
+
+	if (tsc == NULL)
+		return false;
+
+	if (tsc->tsmhandler != F_SYSTEM && tsc->tsmhandler != F_BERNOULLI)
+		return false;
+
+	rel = table_open(rte->relid, AccessShareLock);
+	result = (rel->rd_tableam == ctable_tableam_routine());
+	table_close(rel, AccessShareLock);
+
+	return result;
+}
+
+/*
+ * TID range scans of columnar tables are done by the vectorized scan, only
+ * the row groups covered by the range are loaded. The bounds are evaluated
+ * once when the scan begins, so the parameterized ones are not taken.
+ */
+static bool
+gamma_check_tidrangescan_path(Path *path, RangeTblEntry *rte)
+{
+	Relation rel;
+	bool result;
+
+	if (path->param_info != NULL)
+		return false;
+
+	rel = table_open(rte->relid, AccessShareLock);
+	result = (rel->rd_tableam == ctable_tableam_routine());
+	table_close(rel, AccessShareLock);
+
+	return result;
+}
+
 static void
 gamma_cost_seqscan(CustomPath *cpath, Path *scanpath,
 				   PlannerInfo *root, RelOptInfo *baserel)
@@ -323,6 +491,50 @@ gamma_cost_seqscan(CustomPath *cpath, Path *scanpath,
 	return;
 }
 
+/*
+ * The run cost of fetching tuples_fetched rows by tids. Each row group with
+ * a fetched row is loaded once (a random access, then its pages), and each
+ * vector batch with a fetched row is processed once, costed per batch as
+ * gamma_cost_seqscan does.
+ */
+static Cost
+gamma_cost_rowgroup_fetch(RelOptInfo *baserel, double tuples_fetched)
+{
+	double spc_random_page_cost;
+	double spc_seq_page_cost;
+	double nrowgroups;
+	double nbatches;
+	double rowgroups_fetched;
+	double batches_fetched;
+	double pages_per_rowgroup;
+	Cost run_cost;
+
+	if (baserel->tuples <= 0 || tuples_fetched <= 0)
+		return 0;
+
+	get_tablespace_page_costs(baserel->reltablespace,
+							  &spc_random_page_cost,
+							  &spc_seq_page_cost);
+
+	nrowgroups = ceil(baserel->tuples / GAMMA_COLUMN_VECTOR_SIZE);
+	nbatches = ceil(baserel->tuples / VECTOR_SIZE);
+
+	/* the expected number of row groups/batches having a fetched row */
+	rowgroups_fetched = clamp_row_est(nrowgroups *
+							(1.0 - exp(-tuples_fetched / nrowgroups)));
+	batches_fetched = clamp_row_est(nbatches *
+							(1.0 - exp(-tuples_fetched / nbatches)));
+
+	pages_per_rowgroup = (double) baserel->pages / nrowgroups;
+
+	run_cost = rowgroups_fetched *
+		(spc_random_page_cost + pages_per_rowgroup * spc_seq_page_cost);
+	run_cost += batches_fetched *
+		(cpu_tuple_cost + baserel->baserestrictcost.per_tuple);
+
+	return run_cost;
+}
+
 static void
 gamma_indexscan_paths(PlannerInfo *root,
 			   RelOptInfo *baserel,
@@ -351,6 +563,23 @@ gamma_indexscan_paths(PlannerInfo *root,
 	{
 		indexpath = (Path *) lfirst(lc);
 
+		/*
+		 * TIDBitmap can't hold the columnar tids, the bitmap heap scan is
+		 * replaced by the vectorized bitmap scan or removed.
+		 */
+		if (indexpath->pathtype == T_BitmapHeapScan)
+		{
+			if (indexpath->param_info == NULL &&
+				gamma_check_bitmapqual(((BitmapHeapPath *) indexpath)->bitmapqual) &&
+				gamma_vec_check_path(root, baserel, indexpath))
+			{
+				new_pathlist = lappend(new_pathlist,
+						gamma_bitmapscan_path(root, baserel, indexpath));
+			}
+
+			continue;
+		}
+
 		if (indexpath->pathtype != T_IndexScan &&
 			indexpath->pathtype != T_IndexOnlyScan)
 		{
@@ -382,9 +611,125 @@ gamma_indexscan_paths(PlannerInfo *root,
 		cpath->path.total_cost = indexpath->total_cost;
 
 		new_pathlist = lappend(new_pathlist, cpath);
+
+		/* the vectorized index scan is unsorted and not parameterized */
+		if (indexpath->pathtype == T_IndexScan &&
+			indexpath->param_info == NULL &&
+			((IndexPath *) indexpath)->indexorderbys == NIL &&
+			gamma_vec_check_path(root, baserel, indexpath))
+		{
+			new_pathlist = lappend(new_pathlist,
+					gamma_vec_indexscan_path(root, baserel, indexpath));
+		}
 	}
 
 	baserel->pathlist = new_pathlist;
 
+	/* parallel bitmap heap scan is not supported */
+	new_pathlist = NULL;
+	foreach (lc, baserel->partial_pathlist)
+	{
+		Path *path = (Path *) lfirst(lc);
+
+		if (path->pathtype != T_BitmapHeapScan)
+			new_pathlist = lappend(new_pathlist, path);
+	}
+
+	baserel->partial_pathlist = new_pathlist;
+
 	return;
 }
+
+/*
+ * The vectorized bitmap scan fetches the tids with amgettuple.
+ */
+static bool
+gamma_check_bitmapqual(Path *bitmapqual)
+{
+	List *quals;
+	ListCell *lc;
+
+	if (IsA(bitmapqual, IndexPath))
+		return ((IndexPath *) bitmapqual)->indexinfo->amhasgettuple;
+	else if (IsA(bitmapqual, BitmapAndPath))
+		quals = ((BitmapAndPath *) bitmapqual)->bitmapquals;
+	else if (IsA(bitmapqual, BitmapOrPath))
+		quals = ((BitmapOrPath *) bitmapqual)->bitmapquals;
+	else
+		return false;
+
+	foreach (lc, quals)
+	{
+		if (!gamma_check_bitmapqual((Path *) lfirst(lc)))
+			return false;
+	}
+
+	return true;
+}
+
+static Path *
+gamma_bitmapscan_path(PlannerInfo *root, RelOptInfo *baserel,
+					  Path *bitmappath)
+{
+	CustomPath *cpath = makeNode(CustomPath);
+	Cost index_cost;
+	Selectivity selectivity;
+	double tuples_fetched;
+
+	cpath->path.pathtype			= T_CustomScan;
+	cpath->path.parent				= baserel;
+	cpath->path.pathtarget			= baserel->reltarget;
+	cpath->path.param_info			= NULL;
+	cpath->path.parallel_aware		= false;
+	cpath->path.parallel_safe		= bitmappath->parallel_safe;
+	cpath->path.parallel_workers	= 0;
+	cpath->path.rows				= bitmappath->rows;
+	cpath->path.pathkeys			= NIL;  /* unsorted results */
+	cpath->flags					= 0;
+	cpath->custom_paths				= list_make1(bitmappath);
+	cpath->custom_private			= NULL;
+	cpath->methods = (CustomPathMethods *)gamma_vec_bitmapscan_path_methods();
+
+	/* the bitmap quals are executed before the first row is fetched */
+	cost_bitmap_tree_node(((BitmapHeapPath *) bitmappath)->bitmapqual,
+						  &index_cost, &selectivity);
+	tuples_fetched = clamp_row_est(selectivity * baserel->tuples);
+
+	cpath->path.startup_cost = bitmappath->startup_cost;
+	cpath->path.total_cost = bitmappath->startup_cost +
+		gamma_cost_rowgroup_fetch(baserel, tuples_fetched);
+
+	return (Path *) cpath;
+}
+
+static Path *
+gamma_vec_indexscan_path(PlannerInfo *root, RelOptInfo *baserel,
+						 Path *indexpath)
+{
+	CustomPath *cpath = makeNode(CustomPath);
+	double tuples_fetched;
+
+	cpath->path.pathtype			= T_CustomScan;
+	cpath->path.parent				= baserel;
+	cpath->path.pathtarget			= baserel->reltarget;
+	cpath->path.param_info			= NULL;
+	cpath->path.parallel_aware		= false;
+	cpath->path.parallel_safe		= indexpath->parallel_safe;
+	cpath->path.parallel_workers	= 0;
+	cpath->path.rows				= indexpath->rows;
+	cpath->path.pathkeys			= NIL;  /* unsorted results */
+	cpath->flags					= 0;
+	cpath->custom_paths				= list_make1(indexpath);
+	cpath->custom_private			= NULL;
+	cpath->methods = (CustomPathMethods *)gamma_vec_indexscan_path_methods();
+
+	/* the tids are fetched by row group, the rows are processed in batch */
+	tuples_fetched = clamp_row_est(((IndexPath *) indexpath)->indexselectivity *
+								   baserel->tuples);
+
+	cpath->path.startup_cost = indexpath->startup_cost;
+	cpath->path.total_cost = ((IndexPath *) indexpath)->indextotalcost +
+		gamma_cost_rowgroup_fetch(baserel, tuples_fetched);
+
+	return (Path *) cpath;
+}
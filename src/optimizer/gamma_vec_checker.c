@@ -296,8 +296,13 @@ gamma_vec_check_path(PlannerInfo *root, RelOptInfo *rel, Path *path)
 	if (!result)
 		return false;
 
-	/* check clauses */
-	result = gamma_vec_check_expr((Node *) rel->baserestrictinfo);
+	/* check clauses, the tid range quals keep scalar */
+	if (path->pathtype == T_TidRangeScan)
+		result = gamma_vec_check_expr((Node *) list_difference_ptr(
+										rel->baserestrictinfo,
+										((TidRangePath *) path)->tidrangequals));
+	else
+		result = gamma_vec_check_expr((Node *) rel->baserestrictinfo);
 	if (!result)
 		return false;
 
@@ -313,6 +318,9 @@ gamma_vec_check_path(PlannerInfo *root, RelOptInfo *rel, Path *path)
 			}
 			/* fall through */
 		case T_SeqScan:
+		case T_SampleScan:
+		case T_BitmapHeapScan:
+		case T_TidRangeScan:
 			{
 				//TODO: Optimize performance by checking only once
 				if (!gamma_vec_check_relation(root, rel, path))
@@ -412,6 +412,63 @@ plan_tree_mutator(Node *node,
 				SCANMUTATE(vscan, node);
 				return (Node *)vscan;
 			}
+		case T_SampleScan:
+			{
+				SampleScan	*vscan;
+
+				FLATCOPY(vscan, node, SampleScan);
+
+				SCANMUTATE(vscan, node);
+				return (Node *)vscan;
+			}
+		case T_Append:
+			{
+				Append *vappend;
+
+				FLATCOPY(vappend, node, Append);
+
+				PLANMUTATE(vappend, node);
+
+				/* the subplans are vectorized scans, they are converted */
+				return (Node *)vappend;
+			}
+		case T_TidRangeScan:
+			{
+				TidRangeScan *vscan;
+
+				FLATCOPY(vscan, node, TidRangeScan);
+
+				SCANMUTATE(vscan, node);
+
+				/* the tid range quals are the bounds, they keep scalar */
+				return (Node *)vscan;
+			}
+		case T_BitmapHeapScan:
+			{
+				BitmapHeapScan *vscan;
+
+				FLATCOPY(vscan, node, BitmapHeapScan);
+
+				SCANMUTATE(vscan, node);
+				MUTATE(vscan->bitmapqualorig,
+					   ((BitmapHeapScan *) node)->bitmapqualorig, List *);
+
+				/* the bitmap quals (lefttree) are not vectorized */
+				return (Node *)vscan;
+			}
+		case T_IndexScan:
+			{
+				IndexScan *vscan;
+
+				FLATCOPY(vscan, node, IndexScan);
+
+				SCANMUTATE(vscan, node);
+				MUTATE(vscan->indexqualorig,
+					   ((IndexScan *) node)->indexqualorig, List *);
+
+				/* the index quals are the scan keys, they keep scalar */
+				return (Node *)vscan;
+			}
 		case T_Agg:
 			{
 				Agg			*vagg;
@@ -597,6 +654,22 @@ gamma_convert_plantree(Plan *plan, bool devec)
 	plan->lefttree = gamma_convert_plantree(plan->lefttree, sub_devec);
 	plan->righttree = gamma_convert_plantree(plan->righttree, sub_devec);
 
+	/* the subplans of Append are not in lefttree */
+	if (IsA(plan, Append))
+	{
+		ListCell *lc;
+
+		foreach (lc, ((Append *) plan)->appendplans)
+			lfirst(lc) = gamma_convert_plantree((Plan *) lfirst(lc), sub_devec);
+	}
+	else if (IsA(plan, MergeAppend))
+	{
+		ListCell *lc;
+
+		foreach (lc, ((MergeAppend *) plan)->mergeplans)
+			lfirst(lc) = gamma_convert_plantree((Plan *) lfirst(lc), sub_devec);
+	}
+
 	if (IsA(plan, CustomScan))
 	{
 		Plan *subplan = NULL;
@@ -15,75 +15,458 @@
 
 #include "postgres.h"
 
+#include "access/xact.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "utils/memutils.h"
+#include "utils/tuplestore.h"
+
 #include "storage/gamma_buffer.h"
 #include "storage/gamma_dsm.h"
+#include "storage/gamma_local_buffer.h"
+#include "storage/gamma_meta.h"
 #include "storage/gamma_toc.h"
 
+#define GAMMA_BUFFER_CONTENTS_COLS	9
+#define GAMMA_BUFFER_STATS_COLS		9
+
+PG_FUNCTION_INFO_V1(gamma_buffer_contents);
+PG_FUNCTION_INFO_V1(gamma_buffer_stats);
+PG_FUNCTION_INFO_V1(gamma_buffer_stats_reset);
+
+/* percent of gamma buffer for decoded ColumnVectors, the rest is cold tier */
+int gammadb_buffer_decoded_percent = 50;
+
+/* the entry reserved by this backend and not published yet */
+static gamma_toc_entry *filling_entry = NULL;
+static bool filling_callback_registered = false;
+
+/* the delete bitmaps written by the current transaction */
+typedef struct DelBitmapKey
+{
+	Oid relid;
+	Oid rgid;
+} DelBitmapKey;
+
+static List *delbitmap_written = NIL;
+static bool delbitmap_callback_registered = false;
+
+/* the transaction is counted in toc_delbitmap_committing */
+static bool delbitmap_committing = false;
+
+/*
+ * The decoded entries pinned by this backend, one element per pin. They
+ * are all unpinned at the end of transaction (also on error), the
+ * generation number tells the stale references of ColumnVectors.
+ */
+static gamma_toc_entry **buffer_pins = NULL;
+static int nbuffer_pins = 0;
+static int maxbuffer_pins = 0;
+static uint32 buffer_pin_gen = 0;
+static bool pin_callback_registered = false;
+
+static void gamma_buffer_unpin_all(void);
+
 void
 gamma_buffer_startup(void)
 {
 	gamma_buffer_dsm_startup();
 }
 
-bool
-gamma_buffer_add_cv(Oid relid, Oid rgid, int attno,
-		uint32 dim, char *data, Size values_nbytes, bool *nulls, Size isnull_nbytes)
+static void
+gamma_buffer_shmem_exit(int code, Datum arg)
+{
+	/* don't leave the reserved entry in filling state forever */
+	if (filling_entry != NULL)
+	{
+		/* GAMMA NOTE: the process may exit with LWLocks held (eg. FATAL) */
+		LWLockReleaseAll();
+		gamma_buffer_cancel_cv(filling_entry);
+	}
+
+	/* nor the pinned entries unevictable */
+	gamma_buffer_unpin_all();
+}
+
+static void
+gamma_buffer_pin_xact_callback(XactEvent event, void *arg)
 {
-	volatile gamma_toc *toc = gamma_buffer_dsm_toc();
+	switch (event)
+	{
+		case XACT_EVENT_COMMIT:
+		case XACT_EVENT_PARALLEL_COMMIT:
+		case XACT_EVENT_ABORT:
+		case XACT_EVENT_PARALLEL_ABORT:
+			gamma_buffer_unpin_all();
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * Make room for one more pin of this backend, it is called before the pin
+ * is taken, so remembering the pin does not fail with the pin leaked.
+ */
+static void
+gamma_buffer_prepare_pin(void)
+{
+	if (!pin_callback_registered)
+	{
+		RegisterXactCallback(gamma_buffer_pin_xact_callback, NULL);
+		if (!filling_callback_registered)
+		{
+			before_shmem_exit(gamma_buffer_shmem_exit, (Datum) 0);
+			filling_callback_registered = true;
+		}
+		pin_callback_registered = true;
+	}
+
+	if (nbuffer_pins >= maxbuffer_pins)
+	{
+		int newmax = Max(maxbuffer_pins * 2, 64);
+
+		if (buffer_pins == NULL)
+			buffer_pins = (gamma_toc_entry **)
+				MemoryContextAlloc(TopMemoryContext,
+								   newmax * sizeof(gamma_toc_entry *));
+		else
+			buffer_pins = (gamma_toc_entry **)
+				repalloc(buffer_pins, newmax * sizeof(gamma_toc_entry *));
+		maxbuffer_pins = newmax;
+	}
+}
+
+static void
+gamma_buffer_unpin_all(void)
+{
+	int i;
+
+	for (i = 0; i < nbuffer_pins; i++)
+		gamma_toc_unpin(buffer_pins[i]);
+
+	nbuffer_pins = 0;
+	buffer_pin_gen++;
+}
+
+/*
+ * Drop a pin taken by gamma_buffer_get_cv or gamma_buffer_publish_cv, the
+ * entry can be evicted once no scan pins it.
+ */
+void
+gamma_buffer_unpin_cv(gamma_toc_entry *entry)
+{
+	int i;
+
+	/* the recent pins are dropped first */
+	for (i = nbuffer_pins - 1; i >= 0; i--)
+	{
+		if (buffer_pins[i] != entry)
+			continue;
+
+		gamma_toc_unpin(entry);
+		buffer_pins[i] = buffer_pins[--nbuffer_pins];
+		return;
+	}
+
+	elog(ERROR, "gamma buffer entry is not pinned");
+}
+
+/* let cv hold the pin of entry until gamma_buffer_release_cv */
+void
+gamma_buffer_pin_ref(ColumnVector *cv, gamma_toc_entry *entry)
+{
+	Assert(cv->shared_entry == NULL);
+
+	cv->shared_entry = entry;
+	cv->shared_gen = buffer_pin_gen;
+}
+
+/* drop the pin held by cv, if any */
+void
+gamma_buffer_release_cv(ColumnVector *cv)
+{
+	gamma_toc_entry *entry = (gamma_toc_entry *) cv->shared_entry;
+
+	if (entry == NULL)
+		return;
+
+	cv->shared_entry = NULL;
+
+	/* the pins of the previous transactions have been dropped */
+	if (cv->shared_gen != buffer_pin_gen)
+		return;
+
+	gamma_buffer_unpin_cv(entry);
+}
+
+/*
+ * Reserve the memory of a decoded ColumnVector in gamma buffer, the caller
+ * fills *data and *nulls directly (eg. decompress into them) and then calls
+ * gamma_buffer_publish_cv, or gamma_buffer_cancel_cv on error.
+ *
+ * If evict is true, the unpinned decoded entries are evicted by clock
+ * sweep to make room, it is for the ColumnVectors hit in the cold tier, so
+ * the hot ones are promoted while those read once do not flush the tier.
+ *
+ * Return NULL if the decoded tier is full, or the other session has
+ * inserted (or is inserting) the ColumnVector, the caller should decode it
+ * by itself.
+ */
+gamma_toc_entry *
+gamma_buffer_reserve_cv(Oid relid, Oid rgid, int16 attno, uint32 dim,
+			Size values_nbytes, Size isnull_nbytes, char **data, bool **nulls,
+			bool evict)
+{
+	gamma_toc *toc = gamma_buffer_dsm_toc();
 	gamma_toc_entry *entry;
-	char *entry_addr = NULL;
+	char *entry_addr;
+	Size nbytes;
+	Size limit;
+
+	Assert(filling_entry == NULL);
+
+	if (!filling_callback_registered)
+	{
+		before_shmem_exit(gamma_buffer_shmem_exit, (Datum) 0);
+		filling_callback_registered = true;
+	}
+
+	nbytes = BUFFERALIGN(values_nbytes) + BUFFERALIGN(isnull_nbytes);
+
+	gamma_toc_lock_acquire_x(toc);
+
+	/* the decoded tier is limited, the rest of buffer is for cold tier */
+	limit = gamma_toc_total_bytes(toc) / 100 * gammadb_buffer_decoded_percent;
+	if (gamma_toc_decoded_bytes(toc) + nbytes > limit &&
+		(!evict || !gamma_toc_reclaim_decoded(toc, nbytes, limit)))
+	{
+		gamma_toc_lock_release(toc);
+		return NULL;
+	}
+
+	entry = gamma_toc_reserve(toc, relid, rgid, attno, dim,
+							values_nbytes, isnull_nbytes, false);
+	if (entry == NULL)
+	{
+		gamma_toc_lock_release(toc);
+		return NULL;
+	}
+
+	entry_addr = gamma_toc_addr(toc, entry);
+	*data = entry_addr;
+	*nulls = isnull_nbytes > 0 ?
+				(bool *) (entry_addr + BUFFERALIGN(values_nbytes)) : NULL;
+
+	filling_entry = entry;
+
+	gamma_toc_lock_release(toc);
+
+	return entry;
+}
+
+/*
+ * Publish the filled ColumnVector, the caller keeps a pin of it, see
+ * gamma_buffer_unpin_cv.
+ */
+void
+gamma_buffer_publish_cv(gamma_toc_entry *entry)
+{
+	gamma_toc *toc = gamma_buffer_dsm_toc();
+
+	Assert(entry == filling_entry);
 
+	gamma_buffer_prepare_pin();
+
+	gamma_toc_lock_acquire_x(toc);
+	gamma_toc_publish(toc, entry, true);
+	gamma_toc_pin(entry);
+	buffer_pins[nbuffer_pins++] = entry;
+
+	/* it is promoted if it was in the cold tier, one copy is enough */
+	gamma_toc_drop_compressed(toc, entry->relid, entry->rgid, entry->attno);
+
+	gamma_toc_count(toc, entry->dbid, entry->relid, entry->attno,
+					GAMMA_TOC_INSERTS, 1);
+	gamma_toc_count(toc, entry->dbid, entry->relid, entry->attno,
+					GAMMA_TOC_INSERT_BYTES,
+					entry->values_nbytes + entry->isnull_nbytes);
+	gamma_toc_lock_release(toc);
+
+	filling_entry = NULL;
+}
+
+void
+gamma_buffer_cancel_cv(gamma_toc_entry *entry)
+{
+	gamma_toc *toc = gamma_buffer_dsm_toc();
+
+	Assert(entry == filling_entry);
+
+	gamma_toc_lock_acquire_x(toc);
+	gamma_toc_publish(toc, entry, false);
+	gamma_toc_lock_release(toc);
+
+	filling_entry = NULL;
+}
+
+/*
+ * Copy the compressed payload of a ColumnVector (the varlena of values and
+ * nulls as they are stored in cv table) into the cold tier. It saves the
+ * TOAST/heap reads of the ColumnVector which is not hot enough to be kept
+ * decoded. The cold tier is limited to the rest of gamma buffer, the least
+ * used entries are evicted to make room. Return false if the buffer is full.
+ */
+bool
+gamma_buffer_add_compressed_cv(Oid relid, Oid rgid, int16 attno, uint32 dim,
+			char *data, Size values_nbytes, char *nulls, Size isnull_nbytes)
+{
+	gamma_toc *toc = gamma_buffer_dsm_toc();
+	gamma_toc_entry *entry;
+	char *entry_addr;
 	Size nbytes;
-	char *lookup_values;
-	bool *lookup_isnull;
-	Size lookup_v_nbytes;
-	Size lookup_n_nbytes;
-	uint32 lookup_dim;
+	Size limit;
 
-	Size align_v_nbytes;
-	Size align_n_nbytes;
+	if (gammadb_buffer_decoded_percent >= 100)
+		return false;
 
-	gamma_toc_lock_acquire_x((gamma_toc *)toc);
+	nbytes = BUFFERALIGN(values_nbytes) + BUFFERALIGN(isnull_nbytes);
 
-	align_v_nbytes = BUFFERALIGN(values_nbytes);
-	align_n_nbytes = BUFFERALIGN(isnull_nbytes);
-	nbytes = align_v_nbytes + align_n_nbytes;
+	gamma_toc_lock_acquire_x(toc);
 
-	/* check if the other session have been insert the ColumnVector */
-	if (gamma_toc_lookup((gamma_toc *)toc, relid, rgid, attno, &lookup_dim,
-				&lookup_values, &lookup_v_nbytes,
-				&lookup_isnull, &lookup_n_nbytes))
+	limit = gamma_toc_total_bytes(toc) -
+			gamma_toc_total_bytes(toc) / 100 * gammadb_buffer_decoded_percent;
+	if (!gamma_toc_reclaim_compressed(toc, nbytes, limit))
 	{
-		Assert(values_nbytes == lookup_v_nbytes);
-		Assert(isnull_nbytes == lookup_n_nbytes);
-		gamma_toc_lock_release((gamma_toc *)toc);
-		return true;
+		gamma_toc_lock_release(toc);
+		return false;
 	}
 
-	/* initialize the toc entry */
-	entry = gamma_toc_alloc((gamma_toc *)toc, nbytes);
-	Assert(entry != NULL);
+	entry = gamma_toc_reserve(toc, relid, rgid, attno, dim,
+							values_nbytes, isnull_nbytes, true);
+	if (entry == NULL)
+	{
+		gamma_toc_lock_release(toc);
+		return false;
+	}
 
-	entry_addr = gamma_toc_addr((gamma_toc *)toc, entry);
+	/* the payload is small, copy it with the lock held */
+	entry_addr = gamma_toc_addr(toc, entry);
 	memcpy(entry_addr, data, values_nbytes);
 	if (nulls != NULL)
-		memcpy(entry_addr + align_v_nbytes, nulls, isnull_nbytes);
+		memcpy(entry_addr + BUFFERALIGN(values_nbytes), nulls, isnull_nbytes);
 
-	entry->relid = relid;
-	entry->rgid = rgid;
-	entry->attno = attno;
-	entry->dim = dim;
-	entry->values_nbytes = values_nbytes;
-	entry->isnull_nbytes = isnull_nbytes;
+	gamma_toc_publish(toc, entry, true);
+	gamma_toc_count(toc, MyDatabaseId, relid, attno, GAMMA_TOC_INSERTS, 1);
+	gamma_toc_count(toc, MyDatabaseId, relid, attno,
+					GAMMA_TOC_INSERT_BYTES, values_nbytes + isnull_nbytes);
 
-	gamma_toc_lock_release((gamma_toc *)toc);
+	gamma_toc_lock_release(toc);
 
 	return true;
 }
 
+/*
+ * Lookup the compressed payload of a ColumnVector in the cold tier, it is
+ * called after gamma_buffer_get_cv misses, so a hit or a miss is counted.
+ *
+ * The payload is copied out into palloc'd memory with the lock held, the
+ * entry may be moved or reused while the caller decompresses it.
+ */
+bool
+gamma_buffer_get_compressed_cv(Oid relid, Oid rgid, int16 attno, uint32 *dim,
+			char **data, Size *values_nbytes, char **nulls, Size *isnull_nbytes)
+{
+	bool result = false;
+	gamma_toc *toc = gamma_buffer_dsm_toc();
+	char *entry_values;
+	bool *entry_nulls;
+
+	gamma_toc_lock_acquire_s(toc);
+	result = gamma_toc_lookup_compressed(toc, relid, rgid, attno, dim,
+							&entry_values, values_nbytes,
+							&entry_nulls, isnull_nbytes);
+	gamma_toc_count(toc, MyDatabaseId, relid, attno,
+					result ? GAMMA_TOC_HITS : GAMMA_TOC_MISSES, 1);
+
+	if (result)
+	{
+		*data = (char *) palloc(*values_nbytes);
+		memcpy(*data, entry_values, *values_nbytes);
+
+		if (entry_nulls != NULL)
+		{
+			*nulls = (char *) palloc(*isnull_nbytes);
+			memcpy(*nulls, entry_nulls, *isnull_nbytes);
+		}
+		else
+		{
+			*nulls = NULL;
+		}
+	}
+
+	gamma_toc_lock_release(toc);
+	return result;
+}
+
+/* check if the ColumnVector is in either tier of gamma buffer */
 bool
+gamma_buffer_contains_cv(Oid relid, Oid rgid, int16 attno)
+{
+	bool result = false;
+	gamma_toc *toc = gamma_buffer_dsm_toc();
+	uint32 dim;
+	char *data;
+	bool *nulls;
+	Size values_nbytes;
+	Size isnull_nbytes;
+
+	gamma_toc_lock_acquire_s(toc);
+	result = gamma_toc_lookup(toc, relid, rgid, attno, &dim, &data,
+							&values_nbytes, &nulls, &isnull_nbytes) ||
+			gamma_toc_lookup_compressed(toc, relid, rgid, attno, &dim, &data,
+							&values_nbytes, &nulls, &isnull_nbytes);
+	gamma_toc_lock_release(toc);
+	return result;
+}
+
+/*
+ * Lookup a decoded ColumnVector in gamma buffer, count a hit if it is found.
+ * A miss is counted by gamma_buffer_get_compressed_cv.
+ *
+ * The entry found is pinned, *data and *nulls are valid until the caller
+ * drops the pin by gamma_buffer_unpin_cv or at the end of transaction.
+ */
+gamma_toc_entry *
 gamma_buffer_get_cv(Oid relid, Oid rgid, int16 attno, uint32 *dim,
 			char **data, Size *values_nbytes, bool **nulls, Size *isnull_nbytes)
+{
+	gamma_toc_entry *entry;
+	gamma_toc *toc = gamma_buffer_dsm_toc();
+
+	gamma_buffer_prepare_pin();
+
+	gamma_toc_lock_acquire_s(toc);
+	entry = gamma_toc_lookup_pin(toc, relid, rgid, attno, dim, data,
+								values_nbytes, nulls, isnull_nbytes);
+	if (entry != NULL)
+	{
+		buffer_pins[nbuffer_pins++] = entry;
+		gamma_toc_count(toc, MyDatabaseId, relid, attno, GAMMA_TOC_HITS, 1);
+	}
+	gamma_toc_lock_release(toc);
+	return entry;
+}
+
+/*
+ * Same as gamma_buffer_get_cv, but not counted in the statistics.
+ */
+bool
+gamma_buffer_find_cv(Oid relid, Oid rgid, int16 attno, uint32 *dim,
+			char **data, Size *values_nbytes, bool **nulls, Size *isnull_nbytes)
 {
 	bool result = false;
 	gamma_toc *toc = gamma_buffer_dsm_toc();
@@ -95,10 +478,353 @@ gamma_buffer_get_cv(Oid relid, Oid rgid, int16 attno, uint32 *dim,
 }
 
 void
-gamma_buffer_invalid_rel(Oid relid)
+gamma_buffer_invalid_rel(Oid dbid, Oid relid)
+{
+	gamma_toc *toc = gamma_buffer_dsm_toc();
+	gamma_toc_lock_acquire_x(toc);
+	gamma_toc_invalid_rel(toc, dbid, relid);
+	gamma_toc_bump_delbitmap_gen(toc);
+	gamma_toc_lock_release(toc);
+
+	/* the other backends drop it by relcache invalidation */
+	gamma_local_buffer_invalid_rel(relid);
+}
+
+/*
+ * The delete bitmap of a row group is cached as an entry of attno
+ * GammaDelBitmapAttributeNumber, the values part keeps the version
+ * (opaque here) of the cv table tuple and the nulls part keeps the bitmap.
+ * A row group without delete bitmap is cached with an empty bitmap.
+ *
+ * The generation number is bumped whenever a delete bitmap is written or
+ * the writer commits, a bitmap read under an older generation is not added.
+ * The cache is not used at all while a writer is committing: from its
+ * pre-commit until the end of commit, the new version may be visible to a
+ * snapshot before the cached old version is dropped.
+ */
+uint64
+gamma_buffer_delbitmap_gen(void)
+{
+	return gamma_toc_delbitmap_gen(gamma_buffer_dsm_toc());
+}
+
+/*
+ * Copy the cached version and delete bitmap out, *count is 0 if the row
+ * group has no delete bitmap.
+ */
+bool
+gamma_buffer_get_delbitmap(Oid relid, Oid rgid, char *version,
+						Size version_nbytes, bool *delbitmap, Size *count)
+{
+	bool result = false;
+	gamma_toc *toc = gamma_buffer_dsm_toc();
+	uint32 dim;
+	char *entry_version;
+	bool *entry_bitmap;
+	Size entry_v_nbytes;
+	Size entry_n_nbytes;
+
+	gamma_toc_lock_acquire_s(toc);
+	result = gamma_toc_delbitmap_committing(toc) == 0 &&
+			gamma_toc_lookup(toc, relid, rgid, GammaDelBitmapAttributeNumber,
+							&dim, &entry_version, &entry_v_nbytes,
+							&entry_bitmap, &entry_n_nbytes);
+	gamma_toc_count(toc, MyDatabaseId, relid, GammaDelBitmapAttributeNumber,
+					result ? GAMMA_TOC_HITS : GAMMA_TOC_MISSES, 1);
+
+	if (result)
+	{
+		Assert(entry_v_nbytes == version_nbytes);
+		memcpy(version, entry_version, version_nbytes);
+
+		*count = entry_n_nbytes;
+		if (entry_bitmap != NULL)
+			memcpy(delbitmap, entry_bitmap, entry_n_nbytes);
+	}
+
+	gamma_toc_lock_release(toc);
+	return result;
+}
+
+/*
+ * Add the delete bitmap read by the caller under generation gen, it is
+ * skipped if any delete bitmap has been changed since then.
+ */
+void
+gamma_buffer_add_delbitmap(Oid relid, Oid rgid, uint64 gen, char *version,
+						Size version_nbytes, bool *delbitmap, Size count)
+{
+	gamma_toc *toc = gamma_buffer_dsm_toc();
+	gamma_toc_entry *entry;
+	char *entry_addr;
+
+	gamma_toc_lock_acquire_x(toc);
+
+	if (gamma_toc_delbitmap_gen(toc) != gen ||
+		gamma_toc_delbitmap_committing(toc) > 0)
+	{
+		gamma_toc_lock_release(toc);
+		return;
+	}
+
+	/* GAMMA NOTE: it is small, not limited by the decoded tier */
+	entry = gamma_toc_reserve(toc, relid, rgid, GammaDelBitmapAttributeNumber,
+							count, version_nbytes, count, false);
+	if (entry == NULL)
+	{
+		gamma_toc_lock_release(toc);
+		return;
+	}
+
+	entry_addr = gamma_toc_addr(toc, entry);
+	memcpy(entry_addr, version, version_nbytes);
+	if (count > 0)
+		memcpy(entry_addr + BUFFERALIGN(version_nbytes), delbitmap, count);
+
+	gamma_toc_publish(toc, entry, true);
+	gamma_toc_count(toc, MyDatabaseId, relid, GammaDelBitmapAttributeNumber,
+					GAMMA_TOC_INSERTS, 1);
+	gamma_toc_count(toc, MyDatabaseId, relid, GammaDelBitmapAttributeNumber,
+					GAMMA_TOC_INSERT_BYTES, version_nbytes + count);
+
+	gamma_toc_lock_release(toc);
+}
+
+static void
+gamma_buffer_drop_delbitmap(Oid relid, Oid rgid)
+{
+	gamma_toc *toc = gamma_buffer_dsm_toc();
+
+	gamma_toc_lock_acquire_x(toc);
+	gamma_toc_bump_delbitmap_gen(toc);
+	gamma_toc_invalid_cv(toc, MyDatabaseId, relid, rgid,
+						GammaDelBitmapAttributeNumber);
+	gamma_toc_lock_release(toc);
+}
+
+static void
+gamma_buffer_delbitmap_xact_callback(XactEvent event, void *arg)
+{
+	ListCell *lc;
+
+	switch (event)
+	{
+		case XACT_EVENT_PRE_COMMIT:
+		case XACT_EVENT_PARALLEL_PRE_COMMIT:
+			/*
+			 * The new versions become visible before XACT_EVENT_COMMIT,
+			 * keep the other sessions off the cache until then.
+			 */
+			if (delbitmap_written != NIL && !delbitmap_committing)
+			{
+				gamma_toc *toc = gamma_buffer_dsm_toc();
+
+				gamma_toc_lock_acquire_x(toc);
+				gamma_toc_begin_delbitmap_commit(toc);
+				gamma_toc_bump_delbitmap_gen(toc);
+				gamma_toc_lock_release(toc);
+				delbitmap_committing = true;
+			}
+			return;
+		case XACT_EVENT_COMMIT:
+		case XACT_EVENT_PARALLEL_COMMIT:
+			/*
+			 * The other sessions may have cached the old version while the
+			 * transaction was in progress, drop them once the new version
+			 * is visible.
+			 */
+			foreach (lc, delbitmap_written)
+			{
+				DelBitmapKey *key = (DelBitmapKey *) lfirst(lc);
+				gamma_buffer_drop_delbitmap(key->relid, key->rgid);
+			}
+			break;
+		case XACT_EVENT_ABORT:
+		case XACT_EVENT_PARALLEL_ABORT:
+			break;
+		default:
+			return;
+	}
+
+	if (delbitmap_committing)
+	{
+		gamma_toc *toc = gamma_buffer_dsm_toc();
+
+		gamma_toc_lock_acquire_x(toc);
+		gamma_toc_end_delbitmap_commit(toc);
+		gamma_toc_lock_release(toc);
+		delbitmap_committing = false;
+	}
+
+	/* the list is in TopTransactionContext */
+	delbitmap_written = NIL;
+}
+
+/*
+ * Called before the delete bitmap of a row group is written. The writer
+ * transaction reads the delete bitmaps from cv table since then, see
+ * gamma_buffer_delbitmap_bypass.
+ */
+void
+gamma_buffer_invalid_delbitmap(Oid relid, Oid rgid)
+{
+	MemoryContext old_context;
+	DelBitmapKey *key;
+	ListCell *lc;
+
+	if (!delbitmap_callback_registered)
+	{
+		RegisterXactCallback(gamma_buffer_delbitmap_xact_callback, NULL);
+		delbitmap_callback_registered = true;
+	}
+
+	gamma_buffer_drop_delbitmap(relid, rgid);
+
+	foreach (lc, delbitmap_written)
+	{
+		key = (DelBitmapKey *) lfirst(lc);
+		if (key->relid == relid && key->rgid == rgid)
+			return;
+	}
+
+	old_context = MemoryContextSwitchTo(TopTransactionContext);
+	key = (DelBitmapKey *) palloc(sizeof(DelBitmapKey));
+	key->relid = relid;
+	key->rgid = rgid;
+	delbitmap_written = lappend(delbitmap_written, key);
+	MemoryContextSwitchTo(old_context);
+}
+
+/* the current transaction has written delete bitmaps, don't use the cache */
+bool
+gamma_buffer_delbitmap_bypass(void)
+{
+	return delbitmap_written != NIL;
+}
+
+/*
+ * Return the keys of all valid column vectors in the buffer, palloc'd in
+ * the current memory context.
+ */
+gamma_toc_key *
+gamma_buffer_cv_keys(uint32 *nkeys)
+{
+	gamma_toc *toc = gamma_buffer_dsm_toc();
+	gamma_toc_key *keys;
+	uint32 maxkeys;
+
+	gamma_toc_lock_acquire_s(toc);
+	maxkeys = gamma_toc_nentry(toc);
+	keys = (gamma_toc_key *) palloc(sizeof(gamma_toc_key) * (maxkeys + 1));
+	*nkeys = gamma_toc_collect_keys(toc, keys, maxkeys);
+	gamma_toc_lock_release(toc);
+
+	return keys;
+}
+
+/*
+ * gamma_buffer_contents()
+ *
+ * Return one row for each ColumnVector in gamma buffer.
+ */
+Datum
+gamma_buffer_contents(PG_FUNCTION_ARGS)
 {
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
 	gamma_toc *toc = gamma_buffer_dsm_toc();
+	gamma_toc_entry *entries;
+	uint32 maxentries;
+	uint32 nentries;
+	uint32 i;
+
+	InitMaterializedSRF(fcinfo, 0);
+
+	/* copy the entries out, don't hold the lock while building tuples */
+	gamma_toc_lock_acquire_s(toc);
+	maxentries = gamma_toc_nentry(toc);
+	entries = (gamma_toc_entry *) palloc(sizeof(gamma_toc_entry) * (maxentries + 1));
+	nentries = gamma_toc_collect_entries(toc, entries, maxentries);
+	gamma_toc_lock_release(toc);
+
+	for (i = 0; i < nentries; i++)
+	{
+		Datum values[GAMMA_BUFFER_CONTENTS_COLS];
+		bool nulls[GAMMA_BUFFER_CONTENTS_COLS];
+
+		memset(nulls, false, sizeof(nulls));
+
+		values[0] = ObjectIdGetDatum(entries[i].dbid);
+		values[1] = ObjectIdGetDatum(entries[i].relid);
+		values[2] = ObjectIdGetDatum(entries[i].rgid);
+		values[3] = Int16GetDatum(entries[i].attno);
+		values[4] = Int64GetDatum((int64) entries[i].dim);
+		values[5] = Int64GetDatum((int64) entries[i].values_nbytes);
+		values[6] = Int64GetDatum((int64) entries[i].isnull_nbytes);
+		values[7] = Int64GetDatum((int64) entries[i].nbytes);
+		values[8] = BoolGetDatum(gamma_toc_entry_compressed(&entries[i]));
+
+		tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+	}
+
+	pfree(entries);
+
+	return (Datum) 0;
+}
+
+/*
+ * gamma_buffer_stats()
+ *
+ * Return the hit/miss/insert/eviction counters of each column.
+ */
+Datum
+gamma_buffer_stats(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	gamma_toc *toc = gamma_buffer_dsm_toc();
+	gamma_toc_stat *stats;
+	uint32 nstats;
+	uint32 i;
+
+	InitMaterializedSRF(fcinfo, 0);
+
+	stats = (gamma_toc_stat *) palloc(sizeof(gamma_toc_stat) *
+									  (GAMMA_TOC_NSTATS + 1));
+
+	gamma_toc_lock_acquire_s(toc);
+	nstats = gamma_toc_collect_stats(toc, stats, GAMMA_TOC_NSTATS + 1);
+	gamma_toc_lock_release(toc);
+
+	for (i = 0; i < nstats; i++)
+	{
+		Datum values[GAMMA_BUFFER_STATS_COLS];
+		bool nulls[GAMMA_BUFFER_STATS_COLS];
+		int j;
+
+		memset(nulls, false, sizeof(nulls));
+
+		values[0] = ObjectIdGetDatum(stats[i].dbid);
+		values[1] = ObjectIdGetDatum(stats[i].relid);
+		values[2] = Int16GetDatum(stats[i].attno);
+		for (j = 0; j < GAMMA_TOC_NCOUNTERS; j++)
+			values[3 + j] = Int64GetDatum((int64)
+								pg_atomic_read_u64(&stats[i].counters[j]));
+
+		tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+	}
+
+	pfree(stats);
+
+	return (Datum) 0;
+}
+
+Datum
+gamma_buffer_stats_reset(PG_FUNCTION_ARGS)
+{
+	gamma_toc *toc = gamma_buffer_dsm_toc();
+
 	gamma_toc_lock_acquire_x(toc);
-	gamma_toc_invalid_rel(toc, relid);
+	gamma_toc_reset_stats(toc);
 	gamma_toc_lock_release(toc);
+
+	PG_RETURN_VOID();
 }
@@ -390,5 +390,12 @@ gamma_buffer_dsm_attach(void)
 gamma_toc *
 gamma_buffer_dsm_toc(void)
 {
+	/*
+	 * When gammadb is loaded by shared_preload_libraries, _PG_init runs in
+	 * the postmaster and the children have not attached the buffer yet.
+	 */
+	if (unlikely(dsm_toc == NULL) && IsUnderPostmaster)
+		gamma_buffer_dsm_startup();
+
 	return dsm_toc;
 }
@@ -0,0 +1,450 @@
+/*
+ * Copyright (c) 2024 Gamma Data, Inc. <jackey@gammadb.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "lib/ilist.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+
+#include "storage/gamma_local_buffer.h"
+
+/*
+ * Backend-local buffer of decoded ColumnVectors, it is checked before the
+ * gamma buffer in shared memory. It keeps a private copy of the data, so
+ * the decoded values never reference the shared memory.
+ *
+ * The ColumnVector of a RowGroup pins the entry it references, pinned
+ * entries are not evicted. All pins are dropped at the end of transaction,
+ * the generation number tells the stale pins.
+ */
+
+#define GAMMA_MB (1024 * 1024)
+
+typedef struct LocalCVKey
+{
+	Oid relid;
+	Oid rgid;
+	int32 attno;
+} LocalCVKey;
+
+typedef struct LocalCV
+{
+	LocalCVKey key;
+	dlist_node node;		/* in LRU list, or dead list if removed */
+	int refcount;
+	bool dead;				/* removed from hash table */
+	Size nbytes;			/* memory used by this entry */
+	ColumnVector cv;		/* decoded ColumnVector, reference data/nulls */
+	char *data;
+	bool *nulls;
+} LocalCV;
+
+typedef struct LocalCVHashEntry
+{
+	LocalCVKey key;
+	LocalCV *lcv;
+} LocalCVHashEntry;
+
+/* the xmin of the column vectors of a RowGroup, see cvtable_rg_visible */
+typedef struct LocalRGKey
+{
+	Oid relid;
+	Oid rgid;
+} LocalRGKey;
+
+typedef struct LocalRGHashEntry
+{
+	LocalRGKey key;
+	TransactionId xmin;
+} LocalRGHashEntry;
+
+int gammadb_local_buffers = 32;
+
+static HTAB *local_cv_hash = NULL;
+static HTAB *local_rg_hash = NULL;
+static MemoryContext local_cv_context = NULL;
+static dlist_head local_cv_lru = DLIST_STATIC_INIT(local_cv_lru);	/* MRU first */
+static dlist_head local_cv_dead = DLIST_STATIC_INIT(local_cv_dead);
+static Size local_cv_bytes = 0;
+static uint32 local_cv_gen = 0;
+
+static void gamma_local_buffer_relcache_callback(Datum arg, Oid relid);
+static void gamma_local_buffer_xact_callback(XactEvent event, void *arg);
+
+static void
+gamma_local_buffer_init(void)
+{
+	HASHCTL ctl;
+
+	if (local_cv_hash != NULL)
+		return;
+
+	local_cv_context = AllocSetContextCreate(TopMemoryContext,
+											 "Gamma Local Buffer",
+											 ALLOCSET_DEFAULT_SIZES);
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(LocalCVKey);
+	ctl.entrysize = sizeof(LocalCVHashEntry);
+	ctl.hcxt = local_cv_context;
+	local_cv_hash = hash_create("Gamma Local Buffer", 256, &ctl,
+								HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(LocalRGKey);
+	ctl.entrysize = sizeof(LocalRGHashEntry);
+	ctl.hcxt = local_cv_context;
+	local_rg_hash = hash_create("Gamma Local RowGroups", 256, &ctl,
+								HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	CacheRegisterRelcacheCallback(gamma_local_buffer_relcache_callback,
+								  (Datum) 0);
+	RegisterXactCallback(gamma_local_buffer_xact_callback, NULL);
+}
+
+static inline void
+gamma_local_buffer_make_key(LocalCVKey *key, Oid relid, Oid rgid, int16 attno)
+{
+	memset(key, 0, sizeof(LocalCVKey));
+	key->relid = relid;
+	key->rgid = rgid;
+	key->attno = attno;
+}
+
+static void
+gamma_local_buffer_free(LocalCV *lcv)
+{
+	Assert(lcv->refcount == 0);
+
+	local_cv_bytes -= lcv->nbytes;
+
+	if (!CVIsRef((&lcv->cv)))
+	{
+		pfree(lcv->cv.values);
+		pfree(lcv->cv.isnull);
+	}
+
+	pfree(lcv->data);
+	if (lcv->nulls != NULL)
+		pfree(lcv->nulls);
+	pfree(lcv);
+}
+
+/* remove the entry from hash table, free it when it is not pinned */
+static void
+gamma_local_buffer_remove(LocalCV *lcv)
+{
+	hash_search(local_cv_hash, &lcv->key, HASH_REMOVE, NULL);
+	dlist_delete(&lcv->node);
+	lcv->dead = true;
+
+	if (lcv->refcount == 0)
+		gamma_local_buffer_free(lcv);
+	else
+		dlist_push_tail(&local_cv_dead, &lcv->node);
+}
+
+/* evict unpinned entries from the LRU tail until nbytes can be added */
+static bool
+gamma_local_buffer_reserve(Size nbytes)
+{
+	Size limit = ((Size) gammadb_local_buffers) * GAMMA_MB;
+	dlist_node *node;
+
+	if (nbytes > limit)
+		return false;
+
+	if (dlist_is_empty(&local_cv_lru))
+		return local_cv_bytes + nbytes <= limit;
+
+	node = dlist_tail_node(&local_cv_lru);
+	while (local_cv_bytes + nbytes > limit)
+	{
+		LocalCV *lcv = dlist_container(LocalCV, node, node);
+		dlist_node *prev = dlist_has_prev(&local_cv_lru, node) ?
+										dlist_prev_node(&local_cv_lru, node) : NULL;
+
+		if (lcv->refcount == 0)
+			gamma_local_buffer_remove(lcv);
+
+		if (prev == NULL)
+			break;
+
+		node = prev;
+	}
+
+	return local_cv_bytes + nbytes <= limit;
+}
+
+static void
+gamma_local_buffer_pin(LocalCV *lcv, ColumnVector *cv)
+{
+	Assert(cv->local_entry == NULL);
+
+	lcv->refcount++;
+	cv->local_entry = lcv;
+	cv->local_gen = local_cv_gen;
+
+	cv->dim = lcv->cv.dim;
+	cv->flags = lcv->cv.flags;
+	cv->values = lcv->cv.values;
+	cv->isnull = lcv->cv.isnull;
+}
+
+/*
+ * Lookup the decoded ColumnVector, if it is found, cv references it until
+ * gamma_local_buffer_release_cv.
+ */
+bool
+gamma_local_buffer_get_cv(Oid relid, Oid rgid, int16 attno, ColumnVector *cv)
+{
+	LocalCVKey key;
+	LocalCVHashEntry *hentry;
+
+	if (gammadb_local_buffers <= 0 || local_cv_hash == NULL)
+		return false;
+
+	gamma_local_buffer_make_key(&key, relid, rgid, attno);
+	hentry = (LocalCVHashEntry *) hash_search(local_cv_hash, &key,
+											  HASH_FIND, NULL);
+	if (hentry == NULL)
+		return false;
+
+	dlist_move_head(&local_cv_lru, &hentry->lcv->node);
+	gamma_local_buffer_pin(hentry->lcv, cv);
+
+	return true;
+}
+
+/*
+ * Copy and decode the data of ColumnVector into the local buffer, and let
+ * cv reference it. Return false if the local buffer has no room for it,
+ * then the caller decodes into cv by itself.
+ */
+bool
+gamma_local_buffer_add_cv(Oid relid, Oid rgid, int16 attno, ColumnVector *cv,
+						char *data, Size values_nbytes, bool *nulls, uint32 rows)
+{
+	LocalCVHashEntry *hentry;
+	LocalCV *lcv;
+	MemoryContext old_context;
+	Size nbytes;
+	bool found;
+
+	if (gammadb_local_buffers <= 0)
+		return false;
+
+	gamma_local_buffer_init();
+
+	nbytes = sizeof(LocalCV) + values_nbytes;
+	if (nulls != NULL)
+		nbytes += rows * sizeof(bool);
+	if (!(cv->elembyval && cv->elemlen > 0))
+		nbytes += rows * (sizeof(Datum) + sizeof(bool));
+
+	if (!gamma_local_buffer_reserve(nbytes))
+		return false;
+
+	old_context = MemoryContextSwitchTo(local_cv_context);
+
+	lcv = (LocalCV *) palloc0(sizeof(LocalCV));
+	gamma_local_buffer_make_key(&lcv->key, relid, rgid, attno);
+	lcv->nbytes = nbytes;
+
+	lcv->data = (char *) MemoryContextAllocHuge(local_cv_context,
+												Max(values_nbytes, 1));
+	memcpy(lcv->data, data, values_nbytes);
+	if (nulls != NULL)
+	{
+		lcv->nulls = (bool *) palloc(rows * sizeof(bool));
+		memcpy(lcv->nulls, nulls, rows * sizeof(bool));
+	}
+
+	lcv->cv.rgid = rgid;
+	lcv->cv.attno = attno;
+	lcv->cv.elemtype = cv->elemtype;
+	lcv->cv.elemlen = cv->elemlen;
+	lcv->cv.elembyval = cv->elembyval;
+	lcv->cv.elemalign = cv->elemalign;
+	lcv->cv.flags = 0;
+	if (!(cv->elembyval && cv->elemlen > 0))
+	{
+		lcv->cv.values = (Datum *) MemoryContextAllocHuge(local_cv_context,
+												Max(rows, 1) * sizeof(Datum));
+		lcv->cv.isnull = (bool *) palloc(Max(rows, 1) * sizeof(bool));
+	}
+
+	MemoryContextSwitchTo(old_context);
+
+	gamma_cv_fill_data(&lcv->cv, lcv->data, values_nbytes, lcv->nulls, rows);
+
+	hentry = (LocalCVHashEntry *) hash_search(local_cv_hash, &lcv->key,
+											  HASH_FIND, NULL);
+	if (hentry != NULL)
+		gamma_local_buffer_remove(hentry->lcv);
+
+	hentry = (LocalCVHashEntry *) hash_search(local_cv_hash, &lcv->key,
+											  HASH_ENTER, &found);
+	hentry->lcv = lcv;
+	dlist_push_head(&local_cv_lru, &lcv->node);
+	local_cv_bytes += nbytes;
+
+	gamma_local_buffer_pin(lcv, cv);
+
+	return true;
+}
+
+/* drop the reference of cv to the local buffer */
+void
+gamma_local_buffer_release_cv(ColumnVector *cv)
+{
+	LocalCV *lcv = (LocalCV *) cv->local_entry;
+
+	if (lcv == NULL)
+		return;
+
+	cv->local_entry = NULL;
+
+	/* the pins of the previous transactions have been dropped */
+	if (cv->local_gen != local_cv_gen)
+		return;
+
+	Assert(lcv->refcount > 0);
+	lcv->refcount--;
+
+	if (lcv->dead && lcv->refcount == 0)
+	{
+		dlist_delete(&lcv->node);
+		gamma_local_buffer_free(lcv);
+	}
+}
+
+/*
+ * Get the xmin of the RowGroup cached by gamma_local_buffer_set_rg_xmin.
+ */
+bool
+gamma_local_buffer_get_rg_xmin(Oid relid, Oid rgid, TransactionId *xmin)
+{
+	LocalRGKey key;
+	LocalRGHashEntry *hentry;
+
+	if (local_rg_hash == NULL)
+		return false;
+
+	memset(&key, 0, sizeof(LocalRGKey));
+	key.relid = relid;
+	key.rgid = rgid;
+
+	hentry = (LocalRGHashEntry *) hash_search(local_rg_hash, &key,
+											  HASH_FIND, NULL);
+	if (hentry == NULL)
+		return false;
+
+	*xmin = hentry->xmin;
+	return true;
+}
+
+/*
+ * Cache the xmin of a committed RowGroup, the column vectors of a RowGroup
+ * are never updated, it is dropped with the relation only.
+ */
+void
+gamma_local_buffer_set_rg_xmin(Oid relid, Oid rgid, TransactionId xmin)
+{
+	LocalRGKey key;
+	LocalRGHashEntry *hentry;
+
+	gamma_local_buffer_init();
+
+	memset(&key, 0, sizeof(LocalRGKey));
+	key.relid = relid;
+	key.rgid = rgid;
+
+	hentry = (LocalRGHashEntry *) hash_search(local_rg_hash, &key,
+											  HASH_ENTER, NULL);
+	hentry->xmin = xmin;
+}
+
+void
+gamma_local_buffer_invalid_rel(Oid relid)
+{
+	HASH_SEQ_STATUS status;
+	LocalCVHashEntry *hentry;
+	LocalRGHashEntry *rg_hentry;
+
+	if (local_cv_hash == NULL)
+		return;
+
+	hash_seq_init(&status, local_cv_hash);
+	while ((hentry = (LocalCVHashEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (relid == InvalidOid || hentry->key.relid == relid)
+			gamma_local_buffer_remove(hentry->lcv);
+	}
+
+	hash_seq_init(&status, local_rg_hash);
+	while ((rg_hentry = (LocalRGHashEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (relid == InvalidOid || rg_hentry->key.relid == relid)
+			(void) hash_search(local_rg_hash, &rg_hentry->key, HASH_REMOVE, NULL);
+	}
+}
+
+static void
+gamma_local_buffer_relcache_callback(Datum arg, Oid relid)
+{
+	gamma_local_buffer_invalid_rel(relid);
+}
+
+/*
+ * The RowGroups of the finished transaction are gone, drop all pins.
+ */
+static void
+gamma_local_buffer_xact_callback(XactEvent event, void *arg)
+{
+	dlist_iter iter;
+	dlist_mutable_iter miter;
+
+	switch (event)
+	{
+		case XACT_EVENT_COMMIT:
+		case XACT_EVENT_PARALLEL_COMMIT:
+		case XACT_EVENT_ABORT:
+		case XACT_EVENT_PARALLEL_ABORT:
+			break;
+		default:
+			return;
+	}
+
+	local_cv_gen++;
+
+	dlist_foreach(iter, &local_cv_lru)
+	{
+		LocalCV *lcv = dlist_container(LocalCV, node, iter.cur);
+		lcv->refcount = 0;
+	}
+
+	dlist_foreach_modify(miter, &local_cv_dead)
+	{
+		LocalCV *lcv = dlist_container(LocalCV, node, miter.cur);
+
+		dlist_delete(&lcv->node);
+		lcv->refcount = 0;
+		gamma_local_buffer_free(lcv);
+	}
+}
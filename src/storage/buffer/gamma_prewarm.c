@@ -0,0 +1,556 @@
+/*
+ * Copyright (c) 2024 Gamma Data, Inc. <jackey@gammadb.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "postgres.h"
+
+#include <unistd.h>
+
+#include "access/relation.h"
+#include "access/xact.h"
+#include "catalog/objectaddress.h"
+#include "catalog/pg_type.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/interrupt.h"
+#include "storage/fd.h"
+#include "storage/latch.h"
+#include "tcop/tcopprot.h"
+#include "utils/acl.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+
+#include "storage/ctable_am.h"
+#include "storage/gamma_buffer.h"
+#include "storage/gamma_cvtable_am.h"
+#include "storage/gamma_meta.h"
+#include "storage/gamma_prewarm.h"
+
+/*
+ * The dump file is in the data directory, it contains the list of
+ * (dbid, relid, rgid, attno) of the column vectors in gamma buffer.
+ */
+#define GAMMA_PREWARM_FILE "gammadb_prewarm.dump"
+
+bool gammadb_autoprewarm = false;
+int gammadb_autoprewarm_interval = 300;
+int gammadb_autoprewarm_workers = 2;
+
+/* passed to the loader workers by bgw_extra */
+typedef struct GammaPrewarmWorkerArgs
+{
+	Oid dbid;
+	int worker_id;
+	int nworkers;
+} GammaPrewarmWorkerArgs;
+
+PG_FUNCTION_INFO_V1(gamma_prewarm);
+PG_FUNCTION_INFO_V1(gamma_prewarm_dump_now);
+
+static int
+gamma_prewarm_key_cmp(const void *a, const void *b)
+{
+	const gamma_toc_key *k1 = (const gamma_toc_key *) a;
+	const gamma_toc_key *k2 = (const gamma_toc_key *) b;
+
+	if (k1->dbid != k2->dbid)
+		return k1->dbid < k2->dbid ? -1 : 1;
+	if (k1->relid != k2->relid)
+		return k1->relid < k2->relid ? -1 : 1;
+	if (k1->rgid != k2->rgid)
+		return k1->rgid < k2->rgid ? -1 : 1;
+	if (k1->attno != k2->attno)
+		return k1->attno < k2->attno ? -1 : 1;
+
+	return 0;
+}
+
+/*
+ * Write the keys of gamma buffer to the dump file, return the number of
+ * column vectors written.
+ */
+static int64
+gamma_prewarm_dump(void)
+{
+	gamma_toc_key *keys;
+	uint32 nkeys;
+	uint32 i;
+	char tmpfile[MAXPGPATH];
+	FILE *file;
+
+	keys = gamma_buffer_cv_keys(&nkeys);
+	qsort(keys, nkeys, sizeof(gamma_toc_key), gamma_prewarm_key_cmp);
+
+	snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", GAMMA_PREWARM_FILE);
+	file = AllocateFile(tmpfile, "w");
+	if (file == NULL)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\": %m", tmpfile)));
+
+	if (fprintf(file, "<<%u>>\n", nkeys) < 0)
+		goto write_error;
+
+	for (i = 0; i < nkeys; i++)
+	{
+		if (fprintf(file, "%u,%u,%u,%d\n", keys[i].dbid, keys[i].relid,
+					keys[i].rgid, keys[i].attno) < 0)
+			goto write_error;
+	}
+
+	if (FreeFile(file) != 0)
+	{
+		file = NULL;
+		goto write_error;
+	}
+
+	(void) durable_rename(tmpfile, GAMMA_PREWARM_FILE, ERROR);
+
+	pfree(keys);
+	return nkeys;
+
+write_error:
+	{
+		int save_errno = errno;
+
+		if (file != NULL)
+			FreeFile(file);
+		unlink(tmpfile);
+		errno = save_errno;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to file \"%s\": %m", tmpfile)));
+	}
+
+	return 0;
+}
+
+/*
+ * Read the keys from the dump file, sorted by (dbid, relid, rgid, attno).
+ */
+static gamma_toc_key *
+gamma_prewarm_read_dump(uint32 *nkeys)
+{
+	FILE *file;
+	gamma_toc_key *keys;
+	uint32 num;
+	uint32 i;
+
+	*nkeys = 0;
+
+	file = AllocateFile(GAMMA_PREWARM_FILE, "r");
+	if (file == NULL)
+	{
+		if (errno != ENOENT)
+			ereport(LOG,
+					(errcode_for_file_access(),
+					 errmsg("could not read file \"%s\": %m",
+						 GAMMA_PREWARM_FILE)));
+		return NULL;
+	}
+
+	if (fscanf(file, "<<%u>>\n", &num) != 1)
+	{
+		FreeFile(file);
+		ereport(LOG,
+				(errmsg("gammadb prewarm file \"%s\" is corrupted",
+						GAMMA_PREWARM_FILE)));
+		return NULL;
+	}
+
+	keys = (gamma_toc_key *) palloc(sizeof(gamma_toc_key) * (num + 1));
+
+	for (i = 0; i < num; i++)
+	{
+		int attno;
+
+		if (fscanf(file, "%u,%u,%u,%d\n", &keys[i].dbid, &keys[i].relid,
+					&keys[i].rgid, &attno) != 4)
+			break;
+
+		keys[i].attno = (int16) attno;
+	}
+
+	FreeFile(file);
+
+	*nkeys = i;
+	qsort(keys, *nkeys, sizeof(gamma_toc_key), gamma_prewarm_key_cmp);
+
+	return keys;
+}
+
+/*
+ * Start the loader workers of each database in the dump file, the column
+ * vectors of one database are split by rgid among the workers. Wait until
+ * all loaders are done.
+ */
+static void
+gamma_prewarm_launch_loaders(void)
+{
+	gamma_toc_key *keys;
+	uint32 nkeys;
+	uint32 i;
+	int w;
+	int nworkers = Max(gammadb_autoprewarm_workers, 1);
+	List *handles = NIL;
+	ListCell *lc;
+
+	keys = gamma_prewarm_read_dump(&nkeys);
+	if (nkeys == 0)
+		return;
+
+	for (i = 0; i < nkeys; i++)
+	{
+		if (i > 0 && keys[i].dbid == keys[i - 1].dbid)
+			continue;
+
+		for (w = 0; w < nworkers; w++)
+		{
+			BackgroundWorker worker;
+			BackgroundWorkerHandle *handle;
+			GammaPrewarmWorkerArgs args;
+
+			memset(&worker, 0, sizeof(worker));
+			worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+							   BGWORKER_BACKEND_DATABASE_CONNECTION;
+			worker.bgw_start_time = BgWorkerStart_ConsistentState;
+			worker.bgw_restart_time = BGW_NEVER_RESTART;
+			strcpy(worker.bgw_library_name, "gammadb");
+			strcpy(worker.bgw_function_name, "gamma_prewarm_worker_main");
+			snprintf(worker.bgw_name, BGW_MAXLEN, "gammadb prewarm worker %d", w);
+			strcpy(worker.bgw_type, "gammadb prewarm worker");
+			worker.bgw_notify_pid = MyProcPid;
+
+			args.dbid = keys[i].dbid;
+			args.worker_id = w;
+			args.nworkers = nworkers;
+			memcpy(worker.bgw_extra, &args, sizeof(args));
+
+			if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+			{
+				ereport(LOG,
+						(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+						 errmsg("registering gammadb prewarm worker failed"),
+						 errhint("Consider increasing configuration parameter \"max_worker_processes\".")));
+				break;
+			}
+
+			handles = lappend(handles, handle);
+		}
+	}
+
+	foreach (lc, handles)
+	{
+		BackgroundWorkerHandle *handle = (BackgroundWorkerHandle *) lfirst(lc);
+		(void) WaitForBackgroundWorkerShutdown(handle);
+	}
+
+	list_free_deep(handles);
+	pfree(keys);
+}
+
+/*
+ * Main entry of the autoprewarm leader: reload the dump file at startup,
+ * then dump gamma buffer every gammadb_autoprewarm_interval seconds and at
+ * shutdown.
+ */
+void
+gamma_prewarm_main(Datum main_arg)
+{
+	TimestampTz last_dump_time;
+
+	pqsignal(SIGTERM, SignalHandlerForShutdownRequest);
+	pqsignal(SIGHUP, SignalHandlerForConfigReload);
+	BackgroundWorkerUnblockSignals();
+
+	gamma_prewarm_launch_loaders();
+	last_dump_time = GetCurrentTimestamp();
+
+	while (!ShutdownRequestPending)
+	{
+		long delay_ms = -1L;
+		int events = WL_LATCH_SET | WL_EXIT_ON_PM_DEATH;
+
+		if (ConfigReloadPending)
+		{
+			ConfigReloadPending = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		/* 0 means only dump at shutdown */
+		if (gammadb_autoprewarm_interval > 0)
+		{
+			TimestampTz next_dump_time;
+
+			next_dump_time = TimestampTzPlusMilliseconds(last_dump_time,
+									gammadb_autoprewarm_interval * 1000);
+			delay_ms = TimestampDifferenceMilliseconds(GetCurrentTimestamp(),
+													   next_dump_time);
+			if (delay_ms <= 0)
+			{
+				gamma_prewarm_dump();
+				last_dump_time = GetCurrentTimestamp();
+				continue;
+			}
+
+			events |= WL_TIMEOUT;
+		}
+
+		(void) WaitLatch(MyLatch, events, delay_ms, PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+	}
+
+	gamma_prewarm_dump();
+}
+
+static void
+gamma_prewarm_end_rel(Relation rel, CVScanDesc cvscan)
+{
+	if (cvscan != NULL)
+		cvtable_endscan(cvscan);
+
+	if (rel != NULL)
+		relation_close(rel, AccessShareLock);
+
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+}
+
+/*
+ * Main entry of the loader worker, load its share of column vectors of
+ * one database into gamma buffer.
+ */
+void
+gamma_prewarm_worker_main(Datum main_arg)
+{
+	GammaPrewarmWorkerArgs args;
+	gamma_toc_key *keys;
+	uint32 nkeys;
+	uint32 i;
+	Oid cur_relid = InvalidOid;
+	Relation rel = NULL;
+	CVScanDesc cvscan = NULL;
+	bool in_xact = false;
+	bool full = false;
+
+	memcpy(&args, MyBgworkerEntry->bgw_extra, sizeof(args));
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	BackgroundWorkerInitializeConnectionByOid(args.dbid, InvalidOid, 0);
+
+	keys = gamma_prewarm_read_dump(&nkeys);
+
+	for (i = 0; i < nkeys && !full; i++)
+	{
+		if (keys[i].dbid != args.dbid ||
+			keys[i].rgid % args.nworkers != args.worker_id)
+			continue;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (keys[i].relid != cur_relid)
+		{
+			if (in_xact)
+				gamma_prewarm_end_rel(rel, cvscan);
+
+			cur_relid = keys[i].relid;
+			rel = NULL;
+			cvscan = NULL;
+
+			StartTransactionCommand();
+			PushActiveSnapshot(GetTransactionSnapshot());
+			in_xact = true;
+
+			/* the relation may be dropped since the dump */
+			rel = try_relation_open(cur_relid, AccessShareLock);
+			if (rel != NULL && rel->rd_tableam != ctable_tableam_routine())
+			{
+				relation_close(rel, AccessShareLock);
+				rel = NULL;
+			}
+
+			if (rel != NULL)
+				cvscan = cvtable_beginscan(rel, GetActiveSnapshot(), 0, NULL,
+										   NULL, 0);
+		}
+
+		if (cvscan == NULL)
+			continue;
+
+		(void) cvtable_prewarm_cv(cvscan, keys[i].rgid, keys[i].attno, &full);
+	}
+
+	if (in_xact)
+		gamma_prewarm_end_rel(rel, cvscan);
+
+	if (keys != NULL)
+		pfree(keys);
+}
+
+/*
+ * Register the autoprewarm leader, only when gammadb is loaded by
+ * shared_preload_libraries.
+ */
+void
+gamma_prewarm_register_worker(void)
+{
+	BackgroundWorker worker;
+
+	if (!process_shared_preload_libraries_in_progress || !gammadb_autoprewarm)
+		return;
+
+	memset(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	strcpy(worker.bgw_library_name, "gammadb");
+	strcpy(worker.bgw_function_name, "gamma_prewarm_main");
+	strcpy(worker.bgw_name, "gammadb autoprewarm leader");
+	strcpy(worker.bgw_type, "gammadb autoprewarm leader");
+
+	RegisterBackgroundWorker(&worker);
+}
+
+/*
+ * gamma_prewarm(rel regclass, columns text[])
+ *
+ * Load the column vectors of all row groups of the given columns (all
+ * columns if NULL) into gamma buffer. Return the number of column vectors
+ * loaded.
+ */
+Datum
+gamma_prewarm(PG_FUNCTION_ARGS)
+{
+	Oid relid;
+	Relation rel;
+	AclResult aclresult;
+	TupleDesc desc;
+	CVScanDesc cvscan;
+	AttrNumber *attnos;
+	int natts = 0;
+	uint32 max_rgid;
+	uint32 rgid;
+	int64 count = 0;
+	bool full = false;
+	int i;
+
+	if (PG_ARGISNULL(0))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("relation cannot be null")));
+
+	relid = PG_GETARG_OID(0);
+	rel = relation_open(relid, AccessShareLock);
+
+	aclresult = pg_class_aclcheck(relid, GetUserId(), ACL_SELECT);
+	if (aclresult != ACLCHECK_OK)
+		aclcheck_error(aclresult, get_relkind_objtype(rel->rd_rel->relkind),
+					   get_rel_name(relid));
+
+	if (rel->rd_tableam != ctable_tableam_routine())
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a gamma table",
+						RelationGetRelationName(rel))));
+
+	desc = RelationGetDescr(rel);
+
+	if (PG_ARGISNULL(1))
+	{
+		attnos = (AttrNumber *) palloc(sizeof(AttrNumber) * desc->natts);
+		for (i = 0; i < desc->natts; i++)
+		{
+			if (!TupleDescAttr(desc, i)->attisdropped)
+				attnos[natts++] = i + 1;
+		}
+	}
+	else
+	{
+		ArrayType *columns = PG_GETARG_ARRAYTYPE_P(1);
+		Datum *elems;
+		bool *elem_nulls;
+		int nelems;
+
+		deconstruct_array(columns, TEXTOID, -1, false, TYPALIGN_INT,
+						  &elems, &elem_nulls, &nelems);
+
+		attnos = (AttrNumber *) palloc(sizeof(AttrNumber) * (nelems + 1));
+		for (i = 0; i < nelems; i++)
+		{
+			char *colname;
+			AttrNumber attno;
+
+			if (elem_nulls[i])
+				continue;
+
+			colname = TextDatumGetCString(elems[i]);
+			attno = get_attnum(relid, colname);
+			if (attno <= 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_UNDEFINED_COLUMN),
+						 errmsg("column \"%s\" of relation \"%s\" does not exist",
+								colname, RelationGetRelationName(rel))));
+
+			attnos[natts++] = attno;
+		}
+	}
+
+	cvscan = cvtable_beginscan(rel, GetActiveSnapshot(), 0, NULL, NULL, 0);
+	max_rgid = gamma_meta_max_rgid(rel);
+
+	for (rgid = 1; rgid <= max_rgid && !full; rgid++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		for (i = 0; i < natts; i++)
+		{
+			if (cvtable_prewarm_cv(cvscan, rgid, attnos[i], &full))
+				count++;
+			else
+				break;		/* the row group is not exists, or buffer is full */
+		}
+	}
+
+	if (full)
+		ereport(NOTICE,
+				(errmsg("gamma buffer is full, prewarm of \"%s\" stopped at row group %u",
+						RelationGetRelationName(rel), rgid - 1),
+				 errhint("Consider increasing configuration parameter \"gammadb_buffers\".")));
+
+	cvtable_endscan(cvscan);
+	relation_close(rel, AccessShareLock);
+
+	pfree(attnos);
+
+	PG_RETURN_INT64(count);
+}
+
+/*
+ * gamma_prewarm_dump_now()
+ *
+ * Write the dump file immediately, return the number of column vectors.
+ */
+Datum
+gamma_prewarm_dump_now(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_INT64(gamma_prewarm_dump());
+}
@@ -15,12 +15,38 @@
 
 #include "postgres.h"
 
+#include "common/hashfn.h"
+#include "miscadmin.h"
 #include "port/atomics.h"
 #include "storage/lwlock.h"
+#include "storage/s_lock.h"
 
 #include "storage/gamma_toc.h"
 
 #define TOC_ENTRY_INVALID		0x1
+#define TOC_ENTRY_FILLING		0x2		/* reserved, the owner is filling data */
+#define TOC_ENTRY_COMPRESSED	0x4		/* cold tier, holds the compressed payload */
+
+/* state of stat slot */
+#define TOC_STAT_EMPTY			0
+#define TOC_STAT_INIT			1
+#define TOC_STAT_READY			2
+#define TOC_STAT_FREE			3		/* freed, the probes go on past it */
+
+/* max slots probed for a column, the others are counted in toc_stats_other */
+#define TOC_STAT_MAX_PROBES		32
+
+/* max usage count of an entry, the clock sweep decrements it */
+#define TOC_ENTRY_MAX_USAGE		5
+
+/* the tiers swept by gamma_toc_clock_victim */
+#define TOC_SWEEP_ALL			0
+#define TOC_SWEEP_COMPRESSED	1
+#define TOC_SWEEP_DECODED		2
+
+static void gamma_toc_drop(gamma_toc *toc, gamma_toc_entry *entry);
+static void gamma_toc_evict(gamma_toc *toc, gamma_toc_entry *entry);
+static void gamma_toc_free_stats(gamma_toc *toc, Oid dbid, Oid relid);
 
 struct gamma_toc
 {
@@ -29,6 +55,13 @@ struct gamma_toc
 	Size		toc_total_bytes;	/* Bytes managed by this TOC */
 	Size		toc_allocated_bytes;	/* Bytes allocated of those managed */
 	uint32		toc_nentry;		/* Number of entries in TOC */
+	Size		toc_decoded_bytes;	/* Bytes of valid decoded entries */
+	Size		toc_compressed_bytes;	/* Bytes of valid cold tier entries */
+	uint32		toc_clock_hand;	/* next entry checked by clock sweep */
+	pg_atomic_uint64 toc_delbitmap_gen;	/* bumped when a delete bitmap changes */
+	pg_atomic_uint32 toc_delbitmap_committing;	/* writers in commit */
+	gamma_toc_stat toc_stats[GAMMA_TOC_NSTATS];
+	gamma_toc_stat toc_stats_other;	/* columns without a slot */
 	gamma_toc_entry toc_entry[FLEXIBLE_ARRAY_MEMBER];
 };
 
@@ -39,6 +72,7 @@ gamma_toc *
 gamma_toc_create(uint64 magic, void *address, Size nbytes)
 {
 	gamma_toc    *toc = (gamma_toc *) address;
+	int i;
 
 	Assert(nbytes > offsetof(gamma_toc, toc_entry));
 	toc->toc_magic = magic;
@@ -52,6 +86,27 @@ gamma_toc_create(uint64 magic, void *address, Size nbytes)
 	toc->toc_total_bytes = BUFFERALIGN_DOWN(nbytes);
 	toc->toc_allocated_bytes = 0;
 	toc->toc_nentry = 0;
+	toc->toc_decoded_bytes = 0;
+	toc->toc_compressed_bytes = 0;
+	toc->toc_clock_hand = 0;
+	pg_atomic_init_u64(&toc->toc_delbitmap_gen, 0);
+	pg_atomic_init_u32(&toc->toc_delbitmap_committing, 0);
+
+	for (i = 0; i < GAMMA_TOC_NSTATS; i++)
+	{
+		int j;
+
+		pg_atomic_init_u32(&toc->toc_stats[i].state, TOC_STAT_EMPTY);
+		for (j = 0; j < GAMMA_TOC_NCOUNTERS; j++)
+			pg_atomic_init_u64(&toc->toc_stats[i].counters[j], 0);
+	}
+
+	pg_atomic_init_u32(&toc->toc_stats_other.state, TOC_STAT_READY);
+	toc->toc_stats_other.dbid = InvalidOid;
+	toc->toc_stats_other.relid = InvalidOid;
+	toc->toc_stats_other.attno = 0;
+	for (i = 0; i < GAMMA_TOC_NCOUNTERS; i++)
+		pg_atomic_init_u64(&toc->toc_stats_other.counters[i], 0);
 
 	return toc;
 }
@@ -99,11 +154,13 @@ gamma_toc_enough(gamma_toc *toc, Size nbytes)
 
 /* 
  * Check if it is possible to take an entry that is already
- * invalid (all tuples have been removed)
+ * invalid (all tuples have been removed), the smallest one which is
+ * large enough is taken.
  */
 static gamma_toc_entry *
 gamma_toc_invalid(gamma_toc *toc, Size nbytes)
 {
+	gamma_toc_entry *result = NULL;
 	uint32 nentry;
 	uint32 i;
 
@@ -112,8 +169,86 @@ gamma_toc_invalid(gamma_toc *toc, Size nbytes)
 	for (i = 0; i < nentry; ++i)
 	{
 		if (toc->toc_entry[i].flags & TOC_ENTRY_INVALID &&
-			toc->toc_entry[i].nbytes > nbytes)
-			return &(toc->toc_entry[i]);
+			!(toc->toc_entry[i].flags & TOC_ENTRY_FILLING) &&
+			pg_atomic_read_u32(&toc->toc_entry[i].refcount) == 0 &&
+			toc->toc_entry[i].nbytes >= nbytes &&
+			(result == NULL || toc->toc_entry[i].nbytes < result->nbytes))
+			result = &(toc->toc_entry[i]);
+	}
+
+	return result;
+}
+
+/*
+ * The entries whose readers copy the data out with the toc lock held (the
+ * cold tier and the delete bitmaps) can be moved or evicted at any time.
+ * GAMMA NOTE: a decoded column vector may be referenced by a scan after the
+ * lock is released, the scan pins it (see gamma_toc_lookup_pin) and it is
+ * neither moved nor evicted until it is unpinned. The pins are taken with
+ * the toc lock held, the entries are evicted with the lock held
+ * exclusively, so the refcount read here is stable.
+ */
+static bool
+gamma_toc_entry_evictable(gamma_toc_entry *entry)
+{
+	return (entry->flags & TOC_ENTRY_COMPRESSED) != 0 || entry->attno < 0 ||
+		pg_atomic_read_u32(&entry->refcount) == 0;
+}
+
+/* bytes of the tier which the entry belongs to */
+static Size *
+gamma_toc_tier_bytes(gamma_toc *toc, gamma_toc_entry *entry)
+{
+	if (entry->flags & TOC_ENTRY_COMPRESSED)
+		return &toc->toc_compressed_bytes;
+
+	return &toc->toc_decoded_bytes;
+}
+
+/*
+ * Clock sweep over the evictable entries, the entry whose usage count
+ * drops to zero is the victim. Caller should hold the toc lock in exclusive
+ * mode.
+ */
+static gamma_toc_entry *
+gamma_toc_clock_victim(gamma_toc *toc, int tier)
+{
+	uint32 nentry = toc->toc_nentry;
+	uint64 n;
+
+	if (nentry == 0)
+		return NULL;
+
+	for (n = 0; n < (uint64) nentry * (TOC_ENTRY_MAX_USAGE + 1); n++)
+	{
+		gamma_toc_entry *entry;
+		uint32 usage;
+
+		entry = &toc->toc_entry[toc->toc_clock_hand++ % nentry];
+
+		if (entry->flags & (TOC_ENTRY_INVALID | TOC_ENTRY_FILLING))
+			continue;
+
+		if (!gamma_toc_entry_evictable(entry))
+			continue;
+
+		if (tier == TOC_SWEEP_COMPRESSED &&
+			!(entry->flags & TOC_ENTRY_COMPRESSED))
+			continue;
+
+		/* the delete bitmaps are not counted in the decoded tier */
+		if (tier == TOC_SWEEP_DECODED &&
+			((entry->flags & TOC_ENTRY_COMPRESSED) || entry->attno < 0))
+			continue;
+
+		usage = pg_atomic_read_u32(&entry->usage);
+		if (usage > 0)
+		{
+			pg_atomic_write_u32(&entry->usage, usage - 1);
+			continue;
+		}
+
+		return entry;
 	}
 
 	return NULL;
@@ -132,6 +267,15 @@ gamma_toc_merge(gamma_toc *toc, Size nbytes)
 		gamma_toc_entry *tail_entry = &(toc->toc_entry[i - 1]);
 		bool move = false;
 
+		/* the owner is writing into the entry, it can not be moved */
+		if (tail_entry->flags & TOC_ENTRY_FILLING)
+			break;
+
+		/* the invalidated entry is still referenced by a scan */
+		if ((tail_entry->flags & TOC_ENTRY_INVALID) &&
+			pg_atomic_read_u32(&tail_entry->refcount) > 0)
+			break;
+
 		/* if tail entry is invalid, remove it directly */
 		if (tail_entry->flags & TOC_ENTRY_INVALID)
 		{
@@ -145,6 +289,9 @@ gamma_toc_merge(gamma_toc *toc, Size nbytes)
 			continue;
 		}
 
+		if (!gamma_toc_entry_evictable(tail_entry))
+			break;
+
 		/*
 		 * Try to move the trailing entry forward
 		 * GAMMA NOTE: use toc->toc_nentry, don't use nentry directly
@@ -153,32 +300,46 @@ gamma_toc_merge(gamma_toc *toc, Size nbytes)
 		{
 			gamma_toc_entry *target_entry = &(toc->toc_entry[j]);
 			if (target_entry->flags & TOC_ENTRY_INVALID &&
+				!(target_entry->flags & TOC_ENTRY_FILLING) &&
+				pg_atomic_read_u32(&target_entry->refcount) == 0 &&
 				target_entry->nbytes >= tail_entry->nbytes)
 			{
 				char *target_addr;
 				char *tail_addr;
+				Size *tier_bytes;
 
 				toc->toc_allocated_bytes -= tail_entry->nbytes;
 				toc->toc_nentry--;
 
+				/* the entry takes the whole target slot from now on */
+				tier_bytes = gamma_toc_tier_bytes(toc, tail_entry);
+				*tier_bytes += target_entry->nbytes - tail_entry->nbytes;
+
 				tail_addr = gamma_toc_addr((gamma_toc *)toc, tail_entry);
 				target_addr = gamma_toc_addr((gamma_toc *)toc, target_entry);
 
 				memcpy(target_addr, tail_addr,
 						tail_entry->values_nbytes + tail_entry->isnull_nbytes);
 
+				target_entry->dbid = tail_entry->dbid;
 				target_entry->relid = tail_entry->relid;
 				target_entry->rgid = tail_entry->rgid;
 				target_entry->attno = tail_entry->attno;
 				target_entry->dim = tail_entry->dim;
 				target_entry->values_nbytes = tail_entry->values_nbytes;
 				target_entry->isnull_nbytes = tail_entry->isnull_nbytes;
+				target_entry->flags = tail_entry->flags;
+				pg_atomic_write_u32(&target_entry->usage,
+									pg_atomic_read_u32(&tail_entry->usage));
 
 				move = true;
 
 				/* check if memory is enough */
 				if (gamma_toc_enough(toc, nbytes))
 					return true;
+
+				/* the tail entry is gone, go on with the new tail */
+				break;
 			}
 		}
 
@@ -189,10 +350,24 @@ gamma_toc_merge(gamma_toc *toc, Size nbytes)
 	return false;
 }
 
+/*
+ * Evict the cold entries by clock sweep until an invalid slot is large
+ * enough or the free space is enough after merge.
+ */
 static bool
 gamma_toc_lru(gamma_toc *toc, Size nbytes)
 {
-	//TODO:
+	gamma_toc_entry *victim;
+
+	while ((victim = gamma_toc_clock_victim(toc, TOC_SWEEP_ALL)) != NULL)
+	{
+		gamma_toc_evict(toc, victim);
+
+		if (gamma_toc_invalid(toc, nbytes) != NULL ||
+			gamma_toc_merge(toc, nbytes))
+			return true;
+	}
+
 	return false;
 }
 
@@ -221,17 +396,24 @@ gamma_toc_alloc(gamma_toc *toc, Size nbytes)
 		if (remain_bytes + nbytes > total_bytes ||
 			remain_bytes + nbytes < remain_bytes)
 		{
+			/* reuse the slot of an invalid entry, it keeps its size */
 			result = gamma_toc_invalid((gamma_toc *)vtoc, nbytes);
-			if (result == NULL)
-				break;
-				
+			if (result != NULL)
+			{
+				result->flags = 0;
+				pg_atomic_write_u32(&result->usage, 0);
+				pg_atomic_write_u32(&result->refcount, 0);
+				return result;
+			}
+
 			if (gamma_toc_merge((gamma_toc *)vtoc, nbytes))
 				continue;
 
 			if (gamma_toc_lru((gamma_toc *)vtoc, nbytes))
 				continue;
 
-			elog(ERROR, "Gamma Share Memory is not enough.");
+			/* the caller goes on without gamma buffer */
+			break;
 		}
 
 		offset = total_bytes - allocated_bytes - nbytes;
@@ -243,6 +425,9 @@ gamma_toc_alloc(gamma_toc *toc, Size nbytes)
 		result = (gamma_toc_entry *) &(vtoc->toc_entry[nentry]);
 		result->values_offset = offset;
 		result->nbytes = nbytes;
+		result->flags = 0;
+		pg_atomic_init_u32(&result->usage, 0);
+		pg_atomic_init_u32(&result->refcount, 0);
 
 		return result;
 
@@ -257,9 +442,10 @@ gamma_toc_addr(gamma_toc *toc, gamma_toc_entry *entry)
 	return (((char *)toc) + entry->values_offset);
 }
 
-bool
-gamma_toc_lookup(gamma_toc *toc, Oid relid, Oid rgid, int16 attno, uint32 *dim,
-				char **data, Size *values_nbytes, bool **nulls, Size *isnull_nbytes)
+static gamma_toc_entry *
+gamma_toc_lookup_internal(gamma_toc *toc, Oid relid, Oid rgid, int16 attno,
+				bool compressed, uint32 *dim, char **data, Size *values_nbytes,
+				bool **nulls, Size *isnull_nbytes)
 {
 	uint32		nentry;
 	uint32		i;
@@ -271,12 +457,18 @@ gamma_toc_lookup(gamma_toc *toc, Oid relid, Oid rgid, int16 attno, uint32 *dim,
 
 	for (i = 0; i < nentry; ++i)
 	{
+		/* GAMMA NOTE: relid is only unique within one database */
 		if (toc->toc_entry[i].relid == relid &&
 			toc->toc_entry[i].rgid == rgid &&
-			toc->toc_entry[i].attno == attno)
+			toc->toc_entry[i].attno == attno &&
+			toc->toc_entry[i].dbid == MyDatabaseId)
 		{
-			/* the cv in toc is invalid(eg. it is truncated) */
-			if (toc->toc_entry[i].flags & TOC_ENTRY_INVALID)
+			/* the cv in toc is invalid(eg. it is truncated) or not filled */
+			if (toc->toc_entry[i].flags & (TOC_ENTRY_INVALID | TOC_ENTRY_FILLING))
+				continue;
+
+			/* the other tier */
+			if (((toc->toc_entry[i].flags & TOC_ENTRY_COMPRESSED) != 0) != compressed)
 				continue;
 
 			align_v_nbytes = BUFFERALIGN(toc->toc_entry[i].values_nbytes);
@@ -286,7 +478,7 @@ gamma_toc_lookup(gamma_toc *toc, Oid relid, Oid rgid, int16 attno, uint32 *dim,
 
 			if (toc->toc_entry[i].isnull_nbytes != 0)
 			{
-				*nulls = (bool *)(((char *)data) + align_v_nbytes);
+				*nulls = (bool *)((*data) + align_v_nbytes);
 				*isnull_nbytes = toc->toc_entry[i].isnull_nbytes;
 			}
 			else
@@ -296,16 +488,95 @@ gamma_toc_lookup(gamma_toc *toc, Oid relid, Oid rgid, int16 attno, uint32 *dim,
 			}
 
 			*dim = toc->toc_entry[i].dim;
-			return true;
+
+			/* GAMMA NOTE: the lock may be shared, the count is approximate */
+			if (pg_atomic_read_u32(&toc->toc_entry[i].usage) < TOC_ENTRY_MAX_USAGE)
+				pg_atomic_fetch_add_u32(&toc->toc_entry[i].usage, 1);
+
+			return &toc->toc_entry[i];
 		}
 	}
 
-	return false;
+	return NULL;
 }
 
+/* lookup the decoded column vector */
+bool
+gamma_toc_lookup(gamma_toc *toc, Oid relid, Oid rgid, int16 attno, uint32 *dim,
+				char **data, Size *values_nbytes, bool **nulls, Size *isnull_nbytes)
+{
+	return gamma_toc_lookup_internal(toc, relid, rgid, attno, false, dim,
+									data, values_nbytes, nulls,
+									isnull_nbytes) != NULL;
+}
+
+/*
+ * Lookup the decoded column vector and pin it, the data keeps in place
+ * until gamma_toc_unpin. Caller should hold the toc lock (shared is enough).
+ */
+gamma_toc_entry *
+gamma_toc_lookup_pin(gamma_toc *toc, Oid relid, Oid rgid, int16 attno,
+				uint32 *dim, char **data, Size *values_nbytes,
+				bool **nulls, Size *isnull_nbytes)
+{
+	gamma_toc_entry *entry;
+
+	entry = gamma_toc_lookup_internal(toc, relid, rgid, attno, false, dim,
+									data, values_nbytes, nulls, isnull_nbytes);
+	if (entry != NULL)
+		gamma_toc_pin(entry);
+
+	return entry;
+}
+
+/* Caller should hold the toc lock (shared is enough) */
 void
-gamma_toc_invalid_rel(gamma_toc *toc, Oid relid)
+gamma_toc_pin(gamma_toc_entry *entry)
+{
+	pg_atomic_fetch_add_u32(&entry->refcount, 1);
+}
+
+/* the toc lock is not needed, no one waits for the pins */
+void
+gamma_toc_unpin(gamma_toc_entry *entry)
+{
+	Assert(pg_atomic_read_u32(&entry->refcount) > 0);
+	pg_atomic_fetch_sub_u32(&entry->refcount, 1);
+}
+
+/*
+ * lookup the compressed payload of column vector, data and nulls point to
+ * the varlena as it is stored in cv table
+ */
+bool
+gamma_toc_lookup_compressed(gamma_toc *toc, Oid relid, Oid rgid, int16 attno,
+				uint32 *dim, char **data, Size *values_nbytes,
+				bool **nulls, Size *isnull_nbytes)
+{
+	return gamma_toc_lookup_internal(toc, relid, rgid, attno, true, dim,
+									data, values_nbytes, nulls,
+									isnull_nbytes) != NULL;
+}
+
+/*
+ * Reserve an entry for the column vector, the caller fills the memory of
+ * the entry without holding the toc lock, and then publishes it by
+ * gamma_toc_publish. The reserved entry is invisible to lookup, and it is
+ * not moved or reused by gamma_toc_merge until it is published.
+ *
+ * The entry is in the cold tier if compressed is true, which holds the
+ * payload as it is stored in cv table.
+ *
+ * Return NULL if the toc is full, or the column vector has been inserted
+ * (or is being filled) into the tier by the other session. Caller should
+ * hold the toc lock in exclusive mode.
+ */
+gamma_toc_entry *
+gamma_toc_reserve(gamma_toc *toc, Oid relid, Oid rgid, int16 attno,
+				uint32 dim, Size values_nbytes, Size isnull_nbytes,
+				bool compressed)
 {
+	gamma_toc_entry *entry;
 	uint32		nentry;
 	uint32		i;
 
@@ -314,15 +585,185 @@ gamma_toc_invalid_rel(gamma_toc *toc, Oid relid)
 
 	for (i = 0; i < nentry; ++i)
 	{
-		if (toc->toc_entry[i].relid == relid)
+		if (toc->toc_entry[i].relid == relid &&
+			toc->toc_entry[i].rgid == rgid &&
+			toc->toc_entry[i].attno == attno &&
+			toc->toc_entry[i].dbid == MyDatabaseId &&
+			!(toc->toc_entry[i].flags & TOC_ENTRY_INVALID) &&
+			((toc->toc_entry[i].flags & TOC_ENTRY_COMPRESSED) != 0) == compressed)
+			return NULL;
+	}
+
+	entry = gamma_toc_alloc(toc, BUFFERALIGN(values_nbytes) +
+								BUFFERALIGN(isnull_nbytes));
+	if (entry == NULL)
+		return NULL;
+
+	entry->dbid = MyDatabaseId;
+	entry->relid = relid;
+	entry->rgid = rgid;
+	entry->attno = attno;
+	entry->dim = dim;
+	entry->values_nbytes = values_nbytes;
+	entry->isnull_nbytes = isnull_nbytes;
+	entry->flags = TOC_ENTRY_FILLING;
+
+	if (compressed)
+	{
+		entry->flags |= TOC_ENTRY_COMPRESSED;
+		toc->toc_compressed_bytes += entry->nbytes;
+	}
+	else
+		toc->toc_decoded_bytes += entry->nbytes;
+
+	return entry;
+}
+
+/*
+ * Make the reserved entry visible, or give it up if valid is false (eg. an
+ * error is raised while filling it). If the entry is invalidated while it
+ * is being filled, it keeps invalid. Caller should hold the toc lock in
+ * exclusive mode.
+ */
+void
+gamma_toc_publish(gamma_toc *toc, gamma_toc_entry *entry, bool valid)
+{
+	Assert(entry->flags & TOC_ENTRY_FILLING);
+
+	if (!valid)
+		gamma_toc_drop(toc, entry);
+
+	pg_write_barrier();
+	entry->flags = entry->flags & ~TOC_ENTRY_FILLING;
+}
+
+/* mark the entry invalid, its memory can be reused by other entries */
+static void
+gamma_toc_drop(gamma_toc *toc, gamma_toc_entry *entry)
+{
+	if (entry->flags & TOC_ENTRY_INVALID)
+		return;
+
+	entry->flags = entry->flags | TOC_ENTRY_INVALID;
+
+	*gamma_toc_tier_bytes(toc, entry) -= entry->nbytes;
+}
+
+/*
+ * Drop the cold tier copy of a column vector, it is called once the column
+ * vector is promoted into the decoded tier. Caller should hold the toc lock
+ * in exclusive mode.
+ */
+void
+gamma_toc_drop_compressed(gamma_toc *toc, Oid relid, Oid rgid, int16 attno)
+{
+	uint32		nentry;
+	uint32		i;
+
+	nentry = toc->toc_nentry;
+
+	for (i = 0; i < nentry; ++i)
+	{
+		gamma_toc_entry *entry = &toc->toc_entry[i];
+
+		if (entry->relid == relid &&
+			entry->rgid == rgid &&
+			entry->attno == attno &&
+			entry->dbid == MyDatabaseId &&
+			(entry->flags & TOC_ENTRY_COMPRESSED) &&
+			!(entry->flags & TOC_ENTRY_FILLING))
+			gamma_toc_drop(toc, entry);
+	}
+}
+
+/*
+ * Evict the cold tier entries by clock sweep until nbytes more fit in
+ * limit, return false if it is impossible. Caller should hold the toc lock
+ * in exclusive mode.
+ */
+bool
+gamma_toc_reclaim_compressed(gamma_toc *toc, Size nbytes, Size limit)
+{
+	gamma_toc_entry *victim;
+
+	if (nbytes > limit)
+		return false;
+
+	while (toc->toc_compressed_bytes + nbytes > limit)
+	{
+		victim = gamma_toc_clock_victim(toc, TOC_SWEEP_COMPRESSED);
+		if (victim == NULL)
+			return false;
+
+		gamma_toc_evict(toc, victim);
+	}
+
+	return true;
+}
+
+/*
+ * Evict the unpinned decoded entries by clock sweep until nbytes more fit
+ * in limit, return false if it is impossible. Caller should hold the toc
+ * lock in exclusive mode.
+ */
+bool
+gamma_toc_reclaim_decoded(gamma_toc *toc, Size nbytes, Size limit)
+{
+	gamma_toc_entry *victim;
+
+	if (nbytes > limit)
+		return false;
+
+	while (toc->toc_decoded_bytes + nbytes > limit)
+	{
+		victim = gamma_toc_clock_victim(toc, TOC_SWEEP_DECODED);
+		if (victim == NULL)
+			return false;
+
+		gamma_toc_evict(toc, victim);
+	}
+
+	return true;
+}
+
+static void
+gamma_toc_evict(gamma_toc *toc, gamma_toc_entry *entry)
+{
+	if (entry->flags & TOC_ENTRY_INVALID)
+		return;
+
+	gamma_toc_drop(toc, entry);
+
+	gamma_toc_count(toc, entry->dbid, entry->relid, entry->attno,
+					GAMMA_TOC_EVICTIONS, 1);
+	gamma_toc_count(toc, entry->dbid, entry->relid, entry->attno,
+					GAMMA_TOC_EVICT_BYTES,
+					entry->values_nbytes + entry->isnull_nbytes);
+}
+
+void
+gamma_toc_invalid_rel(gamma_toc *toc, Oid dbid, Oid relid)
+{
+	uint32		nentry;
+	uint32		i;
+
+	nentry = toc->toc_nentry;
+	pg_read_barrier();
+
+	for (i = 0; i < nentry; ++i)
+	{
+		if (toc->toc_entry[i].dbid == dbid &&
+			toc->toc_entry[i].relid == relid)
 		{
-			toc->toc_entry[i].flags = toc->toc_entry[i].flags | TOC_ENTRY_INVALID;
+			gamma_toc_evict(toc, &toc->toc_entry[i]);
 		}
 	}
+
+	gamma_toc_free_stats(toc, dbid, relid);
 }
 
 void
-gamma_toc_invalid_rg(gamma_toc *toc, Oid relid, uint32 rgid)
+gamma_toc_invalid_rg(gamma_toc *toc, Oid dbid, Oid relid, uint32 rgid)
 {
 	uint32		nentry;
 	uint32		i;
@@ -332,16 +773,18 @@ gamma_toc_invalid_rg(gamma_toc *toc, Oid relid, uint32 rgid)
 
 	for (i = 0; i < nentry; ++i)
 	{
-		if (toc->toc_entry[i].relid == relid &&
+		if (toc->toc_entry[i].dbid == dbid &&
+			toc->toc_entry[i].relid == relid &&
 			toc->toc_entry[i].rgid == rgid)
 		{
-			toc->toc_entry[i].flags = toc->toc_entry[i].flags | TOC_ENTRY_INVALID;
+			gamma_toc_evict(toc, &toc->toc_entry[i]);
 		}
 	}
 }
 
 void
-gamma_toc_invalid_cv(gamma_toc *toc, Oid relid, uint32 rgid, int16 attno)
+gamma_toc_invalid_cv(gamma_toc *toc, Oid dbid, Oid relid, uint32 rgid,
+						int16 attno)
 {
 	uint32		nentry;
 	uint32		i;
@@ -351,15 +794,334 @@ gamma_toc_invalid_cv(gamma_toc *toc, Oid relid, uint32 rgid, int16 attno)
 
 	for (i = 0; i < nentry; ++i)
 	{
-		if (toc->toc_entry[i].relid == relid &&
+		if (toc->toc_entry[i].dbid == dbid &&
+			toc->toc_entry[i].relid == relid &&
 			toc->toc_entry[i].rgid == rgid &&
 			toc->toc_entry[i].attno == attno)
 		{
-			toc->toc_entry[i].flags = toc->toc_entry[i].flags | TOC_ENTRY_INVALID;
+			gamma_toc_evict(toc, &toc->toc_entry[i]);
+		}
+	}
+}
+
+uint32
+gamma_toc_nentry(gamma_toc *toc)
+{
+	return toc->toc_nentry;
+}
+
+Size
+gamma_toc_total_bytes(gamma_toc *toc)
+{
+	return toc->toc_total_bytes;
+}
+
+Size
+gamma_toc_decoded_bytes(gamma_toc *toc)
+{
+	return toc->toc_decoded_bytes;
+}
+
+Size
+gamma_toc_compressed_bytes(gamma_toc *toc)
+{
+	return toc->toc_compressed_bytes;
+}
+
+uint64
+gamma_toc_delbitmap_gen(gamma_toc *toc)
+{
+	return pg_atomic_read_u64(&toc->toc_delbitmap_gen);
+}
+
+void
+gamma_toc_bump_delbitmap_gen(gamma_toc *toc)
+{
+	pg_atomic_fetch_add_u64(&toc->toc_delbitmap_gen, 1);
+}
+
+/*
+ * The number of transactions which wrote delete bitmaps and are between
+ * pre-commit and the end of commit, their new versions may be visible to
+ * some snapshots while the old versions are still cached.
+ */
+uint32
+gamma_toc_delbitmap_committing(gamma_toc *toc)
+{
+	return pg_atomic_read_u32(&toc->toc_delbitmap_committing);
+}
+
+void
+gamma_toc_begin_delbitmap_commit(gamma_toc *toc)
+{
+	pg_atomic_fetch_add_u32(&toc->toc_delbitmap_committing, 1);
+}
+
+void
+gamma_toc_end_delbitmap_commit(gamma_toc *toc)
+{
+	pg_atomic_fetch_sub_u32(&toc->toc_delbitmap_committing, 1);
+}
+
+bool
+gamma_toc_entry_compressed(gamma_toc_entry *entry)
+{
+	return (entry->flags & TOC_ENTRY_COMPRESSED) != 0;
+}
+
+/*
+ * Copy the keys of valid entries into keys[], return the number copied.
+ * Caller should hold the toc lock.
+ */
+uint32
+gamma_toc_collect_keys(gamma_toc *toc, gamma_toc_key *keys, uint32 maxkeys)
+{
+	uint32		nentry;
+	uint32		i;
+	uint32		nkeys = 0;
+
+	nentry = toc->toc_nentry;
+	pg_read_barrier();
+
+	for (i = 0; i < nentry && nkeys < maxkeys; ++i)
+	{
+		if (toc->toc_entry[i].flags & (TOC_ENTRY_INVALID | TOC_ENTRY_FILLING))
+			continue;
+
+		/* GAMMA NOTE: delete bitmaps (attno < 0) are versioned, not reloaded */
+		if (toc->toc_entry[i].attno <= 0)
+			continue;
+
+		keys[nkeys].dbid = toc->toc_entry[i].dbid;
+		keys[nkeys].relid = toc->toc_entry[i].relid;
+		keys[nkeys].rgid = toc->toc_entry[i].rgid;
+		keys[nkeys].attno = toc->toc_entry[i].attno;
+		nkeys++;
+	}
+
+	return nkeys;
+}
+
+/*
+ * Copy the valid entries into entries[], return the number copied.
+ * Caller should hold the toc lock.
+ */
+uint32
+gamma_toc_collect_entries(gamma_toc *toc, gamma_toc_entry *entries,
+						uint32 maxentries)
+{
+	uint32		nentry;
+	uint32		i;
+	uint32		n = 0;
+
+	nentry = toc->toc_nentry;
+	pg_read_barrier();
+
+	for (i = 0; i < nentry && n < maxentries; ++i)
+	{
+		if (toc->toc_entry[i].flags & (TOC_ENTRY_INVALID | TOC_ENTRY_FILLING))
+			continue;
+
+		memcpy(&entries[n++], &toc->toc_entry[i], sizeof(gamma_toc_entry));
+	}
+
+	return n;
+}
+
+/*
+ * Find the stat slot of (dbid, relid, attno), create it if not exists.
+ * Slots are claimed without the toc lock by CAS on the state, they are
+ * only freed with the toc lock held exclusively. At most
+ * TOC_STAT_MAX_PROBES slots are probed, the columns which find no slot
+ * are counted together in toc_stats_other.
+ */
+static gamma_toc_stat *
+gamma_toc_stat_slot(gamma_toc *toc, Oid dbid, Oid relid, int16 attno)
+{
+	uint32 hash;
+
+	hash = hash_combine(hash_uint32(dbid), hash_uint32(relid));
+	hash = hash_combine(hash, hash_uint32((uint32) attno));
+
+	for (;;)
+	{
+		gamma_toc_stat *free_slot = NULL;
+		uint32 free_state = TOC_STAT_EMPTY;
+		uint32 n;
+
+		for (n = 0; n < TOC_STAT_MAX_PROBES; n++)
+		{
+			gamma_toc_stat *slot;
+			uint32 state;
+
+			slot = &toc->toc_stats[(hash + n) % GAMMA_TOC_NSTATS];
+			state = pg_atomic_read_u32(&slot->state);
+
+			if (state == TOC_STAT_EMPTY || state == TOC_STAT_FREE)
+			{
+				if (free_slot == NULL)
+				{
+					free_slot = slot;
+					free_state = state;
+				}
+
+				/* the column is not after an empty slot */
+				if (state == TOC_STAT_EMPTY)
+					break;
+
+				continue;
+			}
+
+			/* the other backend is filling the slot, it is very short */
+			while (state == TOC_STAT_INIT)
+			{
+				pg_spin_delay();
+				state = pg_atomic_read_u32(&slot->state);
+			}
+
+			pg_read_barrier();
+			if (slot->dbid == dbid && slot->relid == relid &&
+				slot->attno == attno)
+				return slot;
+		}
+
+		if (free_slot == NULL)
+			return &toc->toc_stats_other;
+
+		if (pg_atomic_compare_exchange_u32(&free_slot->state, &free_state,
+										   TOC_STAT_INIT))
+		{
+			free_slot->dbid = dbid;
+			free_slot->relid = relid;
+			free_slot->attno = attno;
+			pg_write_barrier();
+			pg_atomic_write_u32(&free_slot->state, TOC_STAT_READY);
+			return free_slot;
 		}
+
+		/* the slot was claimed by the other backend, probe again */
 	}
 }
 
+/*
+ * Free the stat slots of a dropped or truncated relation. Caller should
+ * hold the toc lock exclusively.
+ */
+static void
+gamma_toc_free_stats(gamma_toc *toc, Oid dbid, Oid relid)
+{
+	int i;
+
+	for (i = 0; i < GAMMA_TOC_NSTATS; i++)
+	{
+		gamma_toc_stat *slot = &toc->toc_stats[i];
+		int j;
+
+		if (pg_atomic_read_u32(&slot->state) != TOC_STAT_READY ||
+			slot->dbid != dbid || slot->relid != relid)
+			continue;
+
+		for (j = 0; j < GAMMA_TOC_NCOUNTERS; j++)
+			pg_atomic_write_u64(&slot->counters[j], 0);
+
+		pg_atomic_write_u32(&slot->state, TOC_STAT_FREE);
+	}
+}
+
+/*
+ * Add n to a counter. Caller should hold the toc lock (shared is enough),
+ * so that gamma_toc_reset_stats can not run concurrently.
+ */
+void
+gamma_toc_count(gamma_toc *toc, Oid dbid, Oid relid, int16 attno,
+				gamma_toc_counter counter, uint64 n)
+{
+	gamma_toc_stat *slot = gamma_toc_stat_slot(toc, dbid, relid, attno);
+
+	if (slot == NULL)
+		return;
+
+	pg_atomic_fetch_add_u64(&slot->counters[counter], n);
+}
+
+/*
+ * Copy the used stat slots into stats[], return the number copied.
+ */
+uint32
+gamma_toc_collect_stats(gamma_toc *toc, gamma_toc_stat *stats, uint32 maxstats)
+{
+	uint32 i;
+	uint32 n = 0;
+
+	for (i = 0; i < GAMMA_TOC_NSTATS && n < maxstats; i++)
+	{
+		gamma_toc_stat *slot = &toc->toc_stats[i];
+		int j;
+
+		if (pg_atomic_read_u32(&slot->state) != TOC_STAT_READY)
+			continue;
+
+		pg_read_barrier();
+		pg_atomic_init_u32(&stats[n].state, TOC_STAT_READY);
+		stats[n].dbid = slot->dbid;
+		stats[n].relid = slot->relid;
+		stats[n].attno = slot->attno;
+		for (j = 0; j < GAMMA_TOC_NCOUNTERS; j++)
+			pg_atomic_init_u64(&stats[n].counters[j],
+							   pg_atomic_read_u64(&slot->counters[j]));
+		n++;
+	}
+
+	/* the columns without a slot, if any */
+	if (n < maxstats)
+	{
+		gamma_toc_stat *slot = &toc->toc_stats_other;
+		bool used = false;
+		int j;
+
+		for (j = 0; j < GAMMA_TOC_NCOUNTERS; j++)
+		{
+			pg_atomic_init_u64(&stats[n].counters[j],
+							   pg_atomic_read_u64(&slot->counters[j]));
+			if (pg_atomic_read_u64(&stats[n].counters[j]) > 0)
+				used = true;
+		}
+
+		if (used)
+		{
+			pg_atomic_init_u32(&stats[n].state, TOC_STAT_READY);
+			stats[n].dbid = InvalidOid;
+			stats[n].relid = InvalidOid;
+			stats[n].attno = 0;
+			n++;
+		}
+	}
+
+	return n;
+}
+
+/*
+ * Clear all stat slots. Caller should hold the toc lock exclusively.
+ */
+void
+gamma_toc_reset_stats(gamma_toc *toc)
+{
+	int i;
+
+	for (i = 0; i < GAMMA_TOC_NSTATS; i++)
+	{
+		int j;
+
+		for (j = 0; j < GAMMA_TOC_NCOUNTERS; j++)
+			pg_atomic_write_u64(&toc->toc_stats[i].counters[j], 0);
+
+		pg_atomic_write_u32(&toc->toc_stats[i].state, TOC_STAT_EMPTY);
+	}
+
+	for (i = 0; i < GAMMA_TOC_NCOUNTERS; i++)
+		pg_atomic_write_u64(&toc->toc_stats_other.counters[i], 0);
+}
+
 void
 gamma_toc_lock_acquire_x(gamma_toc *toc)
 {
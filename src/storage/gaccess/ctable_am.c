@@ -15,10 +15,13 @@
 
 #include "postgres.h"
 
+#include <math.h>
+
 #include "access/genam.h"
 #include "access/heapam.h"
 #include "access/multixact.h"
 #include "access/rewriteheap.h"
+#include "access/sysattr.h"
 #include "access/tableam.h"
 #include "access/tsmapi.h"
 #include "storage/lockdefs.h"
@@ -30,6 +33,7 @@
 #include "catalog/index.h"
 #include "catalog/objectaccess.h"
 #include "catalog/pg_am.h"
+#include "catalog/pg_attribute.h"
 #include "catalog/pg_publication.h"
 #include "catalog/pg_trigger.h"
 #include "catalog/pg_extension.h"
@@ -39,10 +43,13 @@
 #include "commands/vacuum.h"
 #include "commands/extension.h"
 #include "commands/trigger.h"
+#include "common/pg_prng.h"
 #include "executor/executor.h"
 #include "funcapi.h"
+#include "miscadmin.h"
 #include "nodes/makefuncs.h"
 #include "nodes/pg_list.h"
+#include "optimizer/optimizer.h"
 #include "optimizer/plancat.h"
 #include "pgstat.h"
 #include "storage/bufmgr.h"
@@ -73,8 +80,9 @@
 #include "storage/gamma_cvtable_am.h"
 #include "storage/gamma_meta.h"
 #include "storage/gamma_rg.h"
+#include "storage/gamma_stats.h"
 
-double gammadb_stats_analyze_tuple_factor = 0.01;
+int gammadb_stats_analyze_rowgroup_rows = 300;
 
 static const TupleTableSlotOps* ctable_slot_callbacks(Relation relation);
 static TableScanDesc ctable_beginscan(Relation rel, Snapshot snapshot,
@@ -86,6 +94,10 @@ static void ctable_rescan(TableScanDesc scan, struct ScanKeyData * key,
 		bool allow_pagemode);
 static bool ctable_getnextslot(TableScanDesc scan, ScanDirection direction,
 		TupleTableSlot * slot);
+static void ctable_scan_set_tidrange(TableScanDesc sscan, ItemPointer mintid,
+		ItemPointer maxtid);
+static bool ctable_scan_getnextslot_tidrange(TableScanDesc sscan,
+		ScanDirection direction, TupleTableSlot * slot);
 static Size ctable_parallelscan_estimate(Relation rel);
 static Size ctable_parallelscan_initialize(Relation rel,
 		ParallelTableScanDesc pscan);
@@ -97,6 +109,8 @@ static void ctable_index_fetch_end(IndexFetchTableData * sscan);
 static bool ctable_index_fetch_tuple(struct IndexFetchTableData * sscan,
 		ItemPointer tid, Snapshot snapshot, TupleTableSlot * slot,
 		bool * call_again, bool * all_dead);
+static bool ctable_index_fetch_columnar(CIndexFetchCTableData * scan,
+		Snapshot snapshot, ItemPointer tid, TupleTableSlot * slot);
 static bool ctable_fetch_row_version(Relation relation, ItemPointer tid,
 		Snapshot snapshot, TupleTableSlot *slot);
 static void ctable_get_latest_tid(TableScanDesc sscan, ItemPointer tid);
@@ -182,6 +196,10 @@ static bool ctable_relation_needs_toast_table(Relation rel);
 static uint64 ctable_relation_size(Relation rel, ForkNumber forkNumber);
 static void ctable_estimate_rel_size(Relation rel, int32 * attr_widths,
 		BlockNumber * pages, double *tuples, double * allvisfrac);
+static bool ctable_scan_bitmap_next_block(TableScanDesc scan,
+		TBMIterateResult * tbmres);
+static bool ctable_scan_bitmap_next_tuple(TableScanDesc scan,
+		TBMIterateResult * tbmres, TupleTableSlot * slot);
 static bool ctable_scan_sample_next_block(TableScanDesc scan,
 		SampleScanState * scanstate);
 static bool ctable_scan_sample_next_tuple(TableScanDesc scan,
@@ -199,8 +217,8 @@ static const TableAmRoutine ctable_am_methods = {
 	.scan_rescan = ctable_rescan,
 	.scan_getnextslot = ctable_getnextslot,
 
-	.scan_set_tidrange = NULL,
-	.scan_getnextslot_tidrange = NULL,
+	.scan_set_tidrange = ctable_scan_set_tidrange,
+	.scan_getnextslot_tidrange = ctable_scan_getnextslot_tidrange,
 
 	.parallelscan_estimate = ctable_parallelscan_estimate,
 	.parallelscan_initialize = ctable_parallelscan_initialize,
@@ -249,8 +267,8 @@ static const TableAmRoutine ctable_am_methods = {
 
 	.relation_estimate_size = ctable_estimate_rel_size,
 
-	.scan_bitmap_next_block = NULL,
-	.scan_bitmap_next_tuple = NULL,
+	.scan_bitmap_next_block = ctable_scan_bitmap_next_block,
+	.scan_bitmap_next_tuple = ctable_scan_bitmap_next_tuple,
 	.scan_sample_next_block = ctable_scan_sample_next_block,
 	.scan_sample_next_tuple = ctable_scan_sample_next_tuple
 };
@@ -374,6 +392,68 @@ refetch:
 	return false;
 }
 
+/*
+ * TID range scan: only the row groups covered by the range are loaded (see
+ * vec_ctable_set_tidrange), then the rows of delta table in the range.
+ */
+static void
+ctable_scan_set_tidrange(TableScanDesc sscan, ItemPointer mintid,
+						 ItemPointer maxtid)
+{
+	vec_ctable_set_tidrange(sscan, mintid, maxtid);
+}
+
+static bool
+ctable_scan_getnextslot_tidrange(TableScanDesc sscan, ScanDirection direction,
+								 TupleTableSlot * slot)
+{
+	CTableScanDesc cscan = (CTableScanDesc) sscan;
+	CVScanDesc cvscan = cscan->cvscan;
+
+	while (!cscan->heap)
+	{
+		RowGroup *rg = cvscan->rg;
+		bool skip = false;
+
+		if (cvscan->offset >= rg->dim)
+		{
+			cvscan->offset = 0;
+			if (!cvtable_loadnext_rg(cvscan, direction))
+				cscan->heap = true;
+
+			continue;
+		}
+
+		if (RGHasDelBitmap(rg))
+			skip = rg->delbitmap[cvscan->offset];
+
+		if (!skip)
+			vec_ctable_tidrange_rows(cscan, rg, cvscan->offset, &skip, 1);
+
+		if (skip)
+		{
+			cvscan->offset++;
+			continue;
+		}
+
+		cvscan->offset += tts_slot_from_rg(slot, rg, cvscan->bms_proj,
+										   cvscan->offset);
+		return true;
+	}
+
+	if (heap_getnextslot_tidrange((TableScanDesc) cscan->hscan, direction,
+								  cscan->buf_slot))
+	{
+		slot_getallattrs(cscan->buf_slot);
+		tts_slot_copy_values(slot, cscan->buf_slot);
+		slot->tts_tid = cscan->buf_slot->tts_tid; /* keep the tid */
+		return true;
+	}
+
+	ExecClearTuple(slot);
+	return false;
+}
+
 
 static Size
 ctable_parallelscan_estimate(Relation rel)
@@ -384,11 +464,10 @@ ctable_parallelscan_estimate(Relation rel)
 static Size
 ctable_rowgroup_parallelscan_initialize(Relation rel, ParallelTableScanDesc pscan)
 {
-	RowGroupCtableScanDesc pdata = (RowGroupCtableScanDesc)((char *)pscan) +
-										sizeof(ParallelBlockTableScanDescData);
+	RowGroupCtableScanDesc pdata = &((VecParallelTableScanDesc) pscan)->rgdata;
 
 	pg_atomic_init_u32(&pdata->cur_rg_id, 0);;
-	pg_atomic_init_u32(&pdata->max_rg_id, gamma_meta_max_rgid(rel));
+	pg_atomic_init_u32(&pdata->max_rg_id, gamma_meta_max_rgid(rel) + 1);
 
 	return sizeof(VecParallelTableScanDescData);
 }
@@ -406,8 +485,7 @@ ctable_parallelscan_initialize(Relation rel, ParallelTableScanDesc pscan)
 static void
 ctable_parallelscan_reinitialize(Relation rel, ParallelTableScanDesc pscan)
 {
-	RowGroupCtableScanDesc pdata = (RowGroupCtableScanDesc)((char *)pscan) +
-										sizeof(ParallelBlockTableScanDescData);
+	RowGroupCtableScanDesc pdata = &((VecParallelTableScanDesc) pscan)->rgdata;
 
 	table_block_parallelscan_reinitialize(rel, pscan);
 	pg_atomic_init_u32(&pdata->cur_rg_id, 0);;
@@ -430,6 +508,13 @@ ctable_index_fetch_begin(Relation rel)
 static void
 ctable_index_fetch_reset(IndexFetchTableData * sscan)
 {
+	CIndexFetchCTableData *scan = (CIndexFetchCTableData *)sscan;
+
+	/* the row group is kept, the delete bitmap is checked again */
+	scan->delbitmap_loaded = false;
+
+	scan->sort_nitems = 0;
+	scan->sort_pos = 0;
 }
 
 
@@ -447,6 +532,14 @@ ctable_index_fetch_end(IndexFetchTableData * sscan)
 
 	ExecDropSingleTupleTableSlot(scan->heapslot);
 
+	if (scan->cvscan != NULL)
+		cvtable_endscan(scan->cvscan);
+
+	if (scan->sort_items != NULL)
+		pfree(scan->sort_items);
+
+	bms_free(scan->rg_clean);
+
 	pfree(sscan);
 }
 
@@ -459,7 +552,6 @@ ctable_index_fetch_tuple(struct IndexFetchTableData * sscan,
 		bool * call_again, bool * all_dead)
 {
 	CIndexFetchCTableData *scan = (CIndexFetchCTableData *) sscan;
-	Relation rel = scan->base.xs_base.rel;
 	//uint32 rgid = gamma_meta_ptid_get_rgid(tid);
 	const TableAmRoutine *heapam_routine = GetHeapamTableAmRoutine();
 	bool found = false;
@@ -493,13 +585,137 @@ ctable_index_fetch_tuple(struct IndexFetchTableData * sscan,
 		*all_dead = false;
 	}
 
+	return ctable_index_fetch_columnar(scan, snapshot, tid, slot);
+}
+
+/* the row group has no deleted row in the snapshot of fetch */
+static inline bool
+ctable_index_fetch_rg_clean(CIndexFetchCTableData * scan, uint32 rgid)
+{
+	return rgid <= PG_INT32_MAX && bms_is_member((int) rgid, scan->rg_clean);
+}
+
+/*
+ * The cv scan and the loaded row group are kept by the index fetch, the
+ * tids of the same row group are fetched without loading it again.
+ */
+static bool
+ctable_index_fetch_columnar(CIndexFetchCTableData * scan, Snapshot snapshot,
+		ItemPointer tid, TupleTableSlot * slot)
+{
+	Relation rel = scan->base.xs_base.rel;
+	uint32 rgid = gamma_meta_ptid_get_rgid(tid);
+	uint16 rowid = gamma_meta_ptid_get_rowid(tid);
+	CVScanDesc cvscan;
+	RowGroup *rg;
+
+	/* rowid start with 1, 0 is written by the old builds */
+	if (rowid == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INDEX_CORRUPTED),
+				 errmsg("index of gamma table \"%s\" has tids of an old format",
+						RelationGetRelationName(rel)),
+				 errhint("REINDEX the indexes of the table.")));
+
+	if (snapshot == NULL)
+		snapshot = GetTransactionSnapshot();
+
+	if (scan->cvscan == NULL || scan->cvscan->snapshot != snapshot)
+	{
+		if (scan->cvscan != NULL)
+			cvtable_endscan(scan->cvscan);
+
+		scan->cvscan = cvtable_beginscan(rel, snapshot, 0, NULL, NULL, 0);
+		scan->rg_loaded = false;
+		scan->rg_missing = false;
+		scan->delbitmap_loaded = false;
+
+		bms_free(scan->rg_clean);
+		scan->rg_clean = NULL;
+	}
+
+	/*
+	 * The row groups without deleted rows work as the visibility map, the
+	 * index-only scan returns for them without touching the row group.
+	 */
+	if (scan->indexonlyscan && ctable_index_fetch_rg_clean(scan, rgid))
+		return true;
+
+	cvscan = scan->cvscan;
+	rg = cvscan->rg;
+
+	if (scan->rgid != rgid)
+	{
+		scan->rgid = rgid;
+		scan->rg_loaded = false;
+		scan->rg_missing = false;
+		scan->delbitmap_loaded = false;
+	}
+
+	if (scan->rg_missing)
+		return false;
+
+	if (!scan->delbitmap_loaded)
+	{
+		if (ctable_index_fetch_rg_clean(scan, rgid))
+		{
+			RGClearDelBitmap(rg);
+		}
+		else if (!cvtable_rg_visible(cvscan, rgid))
+		{
+			/* the row group is merged after the snapshot */
+			scan->rg_missing = true;
+			return false;
+		}
+		else
+		{
+			cvtable_load_delbitmap(cvscan, rgid);
+
+			if (!RGHasDelBitmap(rg) && rgid <= PG_INT32_MAX)
+			{
+				MemoryContext old_context;
+
+				old_context = MemoryContextSwitchTo(GetMemoryChunkContext(scan));
+				scan->rg_clean = bms_add_member(scan->rg_clean, (int) rgid);
+				MemoryContextSwitchTo(old_context);
+			}
+		}
+
+		scan->delbitmap_loaded = true;
+	}
+
+	if (RGHasDelBitmap(rg) && rg->delbitmap[rowid - 1])
+		return false;
+
 	if (scan->indexonlyscan)
+		return true;
+
+	if (scan->rg_missing)
+		return false;
+
+	/* other scans have filled the cache arrays of the values */
+	if (scan->rg_loaded && scan->rg_generation != gamma_rg_cache_generation())
+		scan->rg_loaded = false;
+
+	if (!scan->rg_loaded)
 	{
-		return gamma_rg_check_visible(rel, snapshot, tid);
+		cvscan->bms_proj = scan->bms_proj;
+		if (!cvtable_load_rg(cvscan, rgid))
+		{
+			scan->rg_missing = true;
+			return false;
+		}
+
+		scan->rg_loaded = true;
+		scan->rg_generation = gamma_rg_cache_generation();
 	}
 
-	return gamma_rg_fetch_slot(rel, snapshot, tid, slot, scan->bms_proj);
+	if (rowid > rg->dim)
+		return false;
+
+	tts_slot_from_rg(slot, rg, cvscan->bms_proj, rowid - 1);
 
+	return true;
 }
 
 static bool
@@ -575,6 +791,20 @@ ctable_tuple_insert(Relation rel, TupleTableSlot * slot, CommandId cid,
 		int options, struct BulkInsertStateData * bistate)
 {
 	const TableAmRoutine *heapam_routine = GetHeapamTableAmRoutine();
+
+	/*
+	 * Bulk inserts with a BulkInsertState end with finish_bulk_insert, the
+	 * ones of COPY and CREATE TABLE AS are collected into row groups, see
+	 * gamma_copy_bulk_enabled. So are the INSERT statements with enough
+	 * rows, see gamma_copy_insert_collect.
+	 */
+	if (gammadb_copy_to_cvtable && bistate != NULL &&
+		gamma_copy_collect_and_merge(rel, &slot, 1, cid, options, bistate))
+		return;
+
+	if (gamma_copy_insert_collect(rel, slot, cid, options))
+		return;
+
 	heapam_routine->tuple_insert(rel, slot, cid, options, bistate);
 	return;
 }
@@ -606,14 +836,11 @@ ctable_multi_insert(Relation rel, TupleTableSlot ** slots, int ntuples,
 		struct BulkInsertStateData * bistate)
 {
 	const TableAmRoutine *heapam_routine = GetHeapamTableAmRoutine();
-	if (gammadb_copy_to_cvtable)
-	{
-		gamma_copy_collect_and_merge(rel, slots, ntuples, cid, options, bistate);
-	}
-	else
-	{
-		heapam_routine->multi_insert(rel, slots, ntuples, cid, options, bistate);
-	}
+	if (gammadb_copy_to_cvtable &&
+		gamma_copy_collect_and_merge(rel, slots, ntuples, cid, options, bistate))
+		return;
+
+	heapam_routine->multi_insert(rel, slots, ntuples, cid, options, bistate);
 	return;
 }
 
@@ -714,10 +941,13 @@ ctable_set_new_filenode(Relation rel,
 	if (OidIsValid(cvrelid))
 	{
 		gamma_meta_truncate_cvtable(cvrelid);
-		gamma_buffer_invalid_rel(RelationGetRelid(rel)); /* Oid of base rel*/
+		gamma_buffer_invalid_rel(MyDatabaseId, RelationGetRelid(rel)); /* Oid of base rel*/
 	}
 	else
+	{
 		gamma_meta_cv_table(rel, (Datum)0);
+		gamma_copy_note_rewrite(rel);
+	}
 }
 
 static void
@@ -766,10 +996,13 @@ ctable_set_new_filelocator(Relation rel,
 	if (OidIsValid(cvrelid))
 	{
 		gamma_meta_truncate_cvtable(cvrelid);
-		gamma_buffer_invalid_rel(RelationGetRelid(rel)); /* Oid of base rel */
+		gamma_buffer_invalid_rel(MyDatabaseId, RelationGetRelid(rel)); /* Oid of base rel */
 	}
 	else
+	{
 		gamma_meta_cv_table(rel, (Datum)0);
+		gamma_copy_note_rewrite(rel);
+	}
 }
 
 static void
@@ -857,7 +1090,7 @@ ctable_nontransactional_truncate(Relation rel)
 	if (OidIsValid(cvrelid))
 	{
 		gamma_meta_truncate_cvtable(cvrelid);
-		gamma_buffer_invalid_rel(RelationGetRelid(rel)); /* Oid of base rel */
+		gamma_buffer_invalid_rel(MyDatabaseId, RelationGetRelid(rel)); /* Oid of base rel */
 	}
 }
 
@@ -883,26 +1116,276 @@ ctable_vacuum_relation(Relation rel, VacuumParams * params,
 	ctable_vacuum_rel(rel, params, bstrategy);
 }
 
+/*
+ * The rows sampled by ANALYZE are 300 * the largest statistics target of
+ * the columns, the same as std_typanalyze.
+ */
+static int
+ctable_analyze_targrows(Relation rel)
+{
+	TupleDesc desc = RelationGetDescr(rel);
+	int target = 0;
+	int i;
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		Form_pg_attribute attr = TupleDescAttr(desc, i);
+		int attstattarget;
+
+		if (attr->attisdropped)
+			continue;
+
+#if PG_VERSION_NUM >= 170000
+		{
+			HeapTuple atttuple;
+			Datum datum;
+			bool isnull;
+
+			atttuple = SearchSysCache2(ATTNUM,
+									   ObjectIdGetDatum(RelationGetRelid(rel)),
+									   Int16GetDatum(attr->attnum));
+			if (!HeapTupleIsValid(atttuple))
+				continue;
+
+			datum = SysCacheGetAttr(ATTNUM, atttuple,
+									Anum_pg_attribute_attstattarget, &isnull);
+			attstattarget = isnull ? -1 : DatumGetInt16(datum);
+			ReleaseSysCache(atttuple);
+		}
+#else
+		attstattarget = attr->attstattarget;
+#endif
+
+		if (attstattarget < 0)
+			attstattarget = default_statistics_target;
+
+		target = Max(target, attstattarget);
+	}
+
+	if (target <= 0)
+		target = default_statistics_target;
+
+	return 300 * target;
+}
+
+/*
+ * ANALYZE samples the blocks of delta table only, the row groups are not
+ * blocks. So a random subset of row groups is chosen here, sized to the
+ * statistics target, and their rows are returned before the first block.
+ *
+ * The rows of row groups and delta table are kept with the same probability,
+ * then the sample is uniform. The rows of the row groups are reported as
+ * live rows scaled to the sampled blocks, so that ANALYZE extrapolates the
+ * total rows correctly.
+ *
+ * At most gammadb_stats_analyze_rowgroup_rows rows of a loaded row group
+ * are read, so the fraction is lowered to that rate of a full row group.
+ * Before PG 17, the delta table has a block for ANALYZE once there are row
+ * groups, see ctable_relation_size.
+ *
+ * If there are enough row groups, the row samples kept by the writer (see
+ * gamma_stats_build) are read instead of the column vectors. They are taken
+ * at a fixed rate, so the fraction is lowered to that rate.
+ */
+static void
+ctable_analyze_init(CTableScanDesc cscan)
+{
+	Relation rel = cscan->base.rs_rd;
+	CVScanDesc cvscan = cscan->cvscan;
+	uint32 max_rg_id = pg_atomic_read_u32(&cvscan->p_rg->max_rg_id);
+	BlockNumber nrgs = max_rg_id > 1 ? max_rg_id - 1 : 0;
+	BlockNumber totalblocks = RelationGetNumberOfBlocks(rel);
+	BlockNumber nblocks;
+	BlockNumber sample_rgs;
+	int targrows = ctable_analyze_targrows(rel);
+	double rows_rate;
+	double rg_fraction = 1.0;
+	double heap_fraction = 1.0;
+	double fraction;
+
+	cscan->analyze_inited = true;
+
+	/* the cv table is read with index, it needs a snapshot */
+	cvscan->snapshot = GetTransactionSnapshot();
+
+	sample_rgs = BlockSampler_Init(&cscan->analyze_bs, nrgs,
+							(targrows + gammadb_stats_analyze_rowgroup_rows - 1) /
+								gammadb_stats_analyze_rowgroup_rows,
+							pg_prng_uint32(&pg_global_prng_state));
+	cscan->analyze_rg = (sample_rgs > 0);
+
+	if (nrgs > 0)
+		rg_fraction = (double) sample_rgs / nrgs;
+
+	/* the same as BlockSampler_Init of acquire_sample_rows */
+	nblocks = Min((BlockNumber) targrows, totalblocks);
+	if (totalblocks > 0)
+		heap_fraction = (double) nblocks / totalblocks;
+
+	cscan->analyze_use_samples = cscan->analyze_rg &&
+				(double) sample_rgs * GAMMA_STATS_SAMPLE_ROWS >= targrows;
+
+	if (cscan->analyze_use_samples)
+	{
+		fraction = Min(rg_fraction * GAMMA_STATS_SAMPLE_RATE, heap_fraction);
+		cscan->analyze_sample_keep =
+					fraction / (rg_fraction * GAMMA_STATS_SAMPLE_RATE);
+		cscan->analyze_context = AllocSetContextCreate(CurrentMemoryContext,
+												"Gamma Analyze Samples",
+												ALLOCSET_DEFAULT_SIZES);
+		cscan->analyze_samples = (GammaColumnStats **) palloc0(
+						sizeof(GammaColumnStats *) * RelationGetNumberOfAttributes(rel));
+	}
+	else
+	{
+		rows_rate = Min(1.0, (double) gammadb_stats_analyze_rowgroup_rows /
+							GAMMA_COLUMN_VECTOR_SIZE);
+		fraction = Min(rg_fraction * rows_rate, heap_fraction);
+	}
+
+	cscan->analyze_rg_keep = fraction / rg_fraction;
+	cscan->analyze_heap_keep = fraction / heap_fraction;
+
+	cscan->analyze_rg_liverows = 0;
+	if (cscan->analyze_rg)
+	{
+		Relation cv_rel = cvscan->cv_rel;
+		double rows = (double) cvtable_get_rows(cv_rel);
+
+		if (totalblocks > 0)
+			rows = rows * nblocks / totalblocks;
+
+		cscan->analyze_rg_liverows = rows;
+	}
+}
+
+/*
+ * Read the row samples of all columns of a row group, return false if some
+ * columns have no sample, then the column vectors are loaded.
+ */
+static bool
+ctable_analyze_load_samples(CTableScanDesc cscan, uint32 rgid)
+{
+	Relation rel = cscan->base.rs_rd;
+	CVScanDesc cvscan = cscan->cvscan;
+	TupleDesc desc = RelationGetDescr(rel);
+	Oid indexoid = RelationGetRelid(cvscan->cv_index_rel);
+	MemoryContext old_context;
+	bool found = true;
+	int i;
+
+	MemoryContextReset(cscan->analyze_context);
+	cscan->analyze_sample_rowids = NULL;
+	cscan->analyze_nsample = 0;
+	cscan->analyze_pos = 0;
+
+	old_context = MemoryContextSwitchTo(cscan->analyze_context);
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		Form_pg_attribute attr = TupleDescAttr(desc, i);
+		GammaColumnStats *stats;
+
+		cscan->analyze_samples[i] = NULL;
+
+		if (attr->attisdropped)
+			continue;
+
+		stats = gamma_stats_fetch(cvscan->cv_rel, indexoid, cvscan->snapshot,
+								  rgid, attr);
+
+		/* the sample is dropped if the values are too wide */
+		if (stats == NULL ||
+			(stats->nsample == 0 && stats->nrows > 0) ||
+			(cscan->analyze_sample_rowids != NULL &&
+			 stats->nsample != cscan->analyze_nsample))
+		{
+			found = false;
+			break;
+		}
+
+		cscan->analyze_samples[i] = stats;
+		cscan->analyze_sample_rowids = stats->sample_rowids;
+		cscan->analyze_nsample = stats->nsample;
+	}
+
+	MemoryContextSwitchTo(old_context);
+
+	if (!found || cscan->analyze_sample_rowids == NULL)
+	{
+		cscan->analyze_nsample = 0;
+		return false;
+	}
+
+	cscan->analyze_sample_rgid = rgid;
+	return true;
+}
+
+/*
+ * The number of rows to skip before the next one kept at the rate keep, so
+ * that the rows out of the sample are not read at all.
+ */
+static uint32
+ctable_analyze_skip(double keep)
+{
+	double skip;
+
+	if (keep >= 1.0)
+		return 0;
+
+	if (keep <= 0.0)
+		return GAMMA_COLUMN_VECTOR_SIZE;
+
+	skip = floor(log(1.0 - pg_prng_double(&pg_global_prng_state)) /
+				 log(1.0 - keep));
+
+	return (uint32) Min(skip, (double) GAMMA_COLUMN_VECTOR_SIZE);
+}
+
 #if PG_VERSION_NUM < 170000
 static bool
 ctable_scan_analyze_next_block(TableScanDesc scan, BlockNumber blockno,
 		BufferAccessStrategy bstrategy)
 {
-	/* The rowgroup part is not block-based, so there is nothing to do here. */
-	return true;
+	CTableScanDesc cscan = (CTableScanDesc) scan;
+
+	if (!cscan->analyze_inited)
+		ctable_analyze_init(cscan);
+
+	/*
+	 * The row groups are sampled before the first block is read, the block
+	 * keeps a buffer locked until its rows are returned.
+	 */
+	if (cscan->analyze_rg)
+	{
+		cscan->analyze_blockno = blockno;
+		cscan->analyze_bstrategy = bstrategy;
+		return true;
+	}
+
+	cscan->analyze_heap = GetHeapamTableAmRoutine()->scan_analyze_next_block(
+							(TableScanDesc) cscan->hscan, blockno, bstrategy);
+
+	return cscan->analyze_heap;
 }
 #else
 
-static bool gamma_block_end = false;
 static bool
 ctable_scan_analyze_next_block(TableScanDesc scan, ReadStream *stream)
 {
-	if (gamma_block_end)
-	{
-		gamma_block_end = false;
-		return false;
-	}
-	return true;
+	CTableScanDesc cscan = (CTableScanDesc) scan;
+
+	if (!cscan->analyze_inited)
+		ctable_analyze_init(cscan);
+
+	/* the row groups are sampled as an extra block before the stream */
+	if (cscan->analyze_rg)
+		return true;
+
+	cscan->analyze_heap = GetHeapamTableAmRoutine()->scan_analyze_next_block(
+							(TableScanDesc) cscan->hscan, stream);
+
+	return cscan->analyze_heap;
 }
 #endif
 
@@ -911,39 +1394,182 @@ ctable_scan_analyze_next_tuple(TableScanDesc scan, TransactionId OldestXmin,
 		double * liverows, double * deadrows,
 		TupleTableSlot * slot)
 {
-	/* sampler 5% */
-	Snapshot snapshot = GetTransactionSnapshot();
 	CTableScanDesc cscan = (CTableScanDesc) scan;
 	CVScanDesc cvscan = cscan->cvscan;
-	HeapScanDesc hscan = cscan->hscan;
 
-	cscan->base.rs_snapshot = snapshot;
-	cvscan->snapshot = snapshot;
-	hscan->rs_base.rs_snapshot = snapshot;
+	/* the sampled row groups go with the first block */
+	if (cscan->analyze_rg_liverows > 0)
+	{
+		*liverows += cscan->analyze_rg_liverows;
+		cscan->analyze_rg_liverows = 0;
+	}
 
-	while (ctable_getnextslot(scan, ForwardScanDirection, slot))
+	while (cscan->analyze_rg)
 	{
-		double factor = 0.0;
-		(*liverows)++;
+		RowGroup *rg = cvscan->rg;
+		uint32 rowid;
+
+		if (cscan->analyze_pos < cscan->analyze_nsample)
+		{
+			TupleDesc desc = slot->tts_tupleDescriptor;
+			int32 pos = cscan->analyze_pos++;
+			int i;
+
+			rowid = cscan->analyze_sample_rowids[pos];
+
+			if (RGHasDelBitmap(rg) && rg->delbitmap[rowid])
+				continue;
+
+			if (cscan->analyze_sample_keep < 1.0 &&
+				pg_prng_double(&pg_global_prng_state) >= cscan->analyze_sample_keep)
+				continue;
+
+			ExecClearTuple(slot);
+			for (i = 0; i < desc->natts; i++)
+			{
+				GammaColumnStats *stats = cscan->analyze_samples[i];
+
+				if (stats == NULL)
+				{
+					slot->tts_values[i] = (Datum) 0;
+					slot->tts_isnull[i] = true;
+					continue;
+				}
+
+				slot->tts_values[i] = stats->sample_values[pos];
+				slot->tts_isnull[i] = stats->sample_isnull[pos];
+			}
+			ExecStoreVirtualTuple(slot);
+			/* rowid of tid start with 1 */
+			slot->tts_tid = gamma_meta_cv_convert_tid(
+										cscan->analyze_sample_rgid, rowid + 1);
+			return true;
+		}
 
-		factor = ((double)(random() % 100000)) / (double) 100000;
-		if (factor > gammadb_stats_analyze_tuple_factor)
+		if (cvscan->offset >= rg->dim)
 		{
-			slot = ExecClearTuple(slot);
+			uint32 rgid;
+
+			if (!BlockSampler_HasMore(&cscan->analyze_bs))
+			{
+				cscan->analyze_rg = false;
+#if PG_VERSION_NUM < 170000
+				/* now the first block of delta table */
+				cscan->analyze_heap =
+					GetHeapamTableAmRoutine()->scan_analyze_next_block(
+										(TableScanDesc) cscan->hscan,
+										cscan->analyze_blockno,
+										cscan->analyze_bstrategy);
+				break;
+#else
+				ExecClearTuple(slot);
+				return false;
+#endif
+			}
+
+			rgid = BlockSampler_Next(&cscan->analyze_bs) + 1;
+			cvscan->offset = 0;
+			rg->dim = 0;
+
+			if (cscan->analyze_use_samples &&
+				ctable_analyze_load_samples(cscan, rgid))
+			{
+				cvtable_load_delbitmap(cvscan, rgid);
+				continue;
+			}
+
+			/* the row group may have been merged */
+			if (!cvtable_load_rg(cvscan, rgid))
+			{
+				rg->dim = 0;
+				continue;
+			}
+
+			cvtable_load_delbitmap(cvscan, rgid);
+			cvscan->offset = ctable_analyze_skip(cscan->analyze_rg_keep);
 			continue;
 		}
 
+		/* a loaded row group is kept at the same rate as the samples */
+		rowid = cvscan->offset;
+		cvscan->offset += 1 + ctable_analyze_skip(cscan->analyze_rg_keep);
+
+		if (RGHasDelBitmap(rg) && rg->delbitmap[rowid])
+			continue;
+
+		tts_slot_from_rg(slot, rg, NULL, rowid);
 		return true;
 	}
 
-#if PG_VERSION_NUM >= 170000
-	gamma_block_end = true;
-#endif
+	if (!cscan->analyze_heap)
+	{
+		ExecClearTuple(slot);
+		return false;
+	}
 
+	while (GetHeapamTableAmRoutine()->scan_analyze_next_tuple(
+				(TableScanDesc) cscan->hscan, OldestXmin, liverows, deadrows,
+				cscan->buf_slot))
+	{
+		if (cscan->analyze_heap_keep < 1.0 &&
+			pg_prng_double(&pg_global_prng_state) >= cscan->analyze_heap_keep)
+			continue;
+
+		slot_getallattrs(cscan->buf_slot);
+		tts_slot_copy_values(slot, cscan->buf_slot);
+		slot->tts_tid = cscan->buf_slot->tts_tid; /* keep the tid */
+		return true;
+	}
+
+	ExecClearTuple(slot);
 	return false;
 }
 
 
+/*
+ * The columns needed by the index build: the key columns, and the columns
+ * of index expressions and predicate. Only these are loaded from the row
+ * groups. NULL means all of the columns (whole-row reference).
+ */
+static Bitmapset *
+ctable_index_build_proj(IndexInfo *indexInfo)
+{
+	Bitmapset *attrs = NULL;
+	Bitmapset *bms_proj = NULL;
+	int i;
+
+	for (i = 0; i < indexInfo->ii_NumIndexAttrs; i++)
+	{
+		AttrNumber attno = indexInfo->ii_IndexAttrNumbers[i];
+
+		if (attno > 0)
+			bms_proj = bms_add_member(bms_proj,
+							attno - FirstLowInvalidHeapAttributeNumber);
+	}
+
+	pull_varattnos((Node *) indexInfo->ii_Expressions, 1, &attrs);
+	pull_varattnos((Node *) indexInfo->ii_Predicate, 1, &attrs);
+
+	i = -1;
+	while ((i = bms_next_member(attrs, i)) >= 0)
+	{
+		AttrNumber attno = i + FirstLowInvalidHeapAttributeNumber;
+
+		if (attno == InvalidAttrNumber)
+		{
+			bms_free(bms_proj);
+			bms_free(attrs);
+			return NULL;
+		}
+
+		if (attno > 0)
+			bms_proj = bms_add_member(bms_proj, i);
+	}
+
+	bms_free(attrs);
+	return bms_proj;
+}
+
 static double
 ctable_index_build_range_scan(Relation rel,
 		Relation indexRelation,
@@ -961,6 +1587,7 @@ ctable_index_build_range_scan(Relation rel,
 	TupleTableSlot *slot;
 	EState	   *estate;
 	ExprContext *econtext;
+	CTableScanDesc cscan;
 	TransactionId oldest_xmin = InvalidTransactionId;
 	Snapshot snapshot;
 	BlockNumber previous_blkno = InvalidBlockNumber;
@@ -974,13 +1601,6 @@ ctable_index_build_range_scan(Relation rel,
 				 errmsg("Only btree index is supported")));
 	}
 
-	if (scan != NULL)
-	{
-		ereport(ERROR,
-				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-				 errmsg("parallel scans are not supported for columnar index")));
-	}
-
 	/*
 	 * Need an EState for evaluation of index expressions and partial-index
 	 * predicates.  Also a slot to hold the current tuple.
@@ -1002,18 +1622,36 @@ ctable_index_build_range_scan(Relation rel,
 		oldest_xmin = GetOldestNonRemovableTransactionId(rel);
 	}
 
-	if (!TransactionIdIsValid(oldest_xmin))
+	/*
+	 * Parallel index build: the scan is begun by the caller on the shared
+	 * parallel scan, the row groups are handed out to the workers by the
+	 * rgid counter of it, and the blocks of delta table by heap.
+	 */
+	if (scan != NULL)
 	{
-
-		snapshot = RegisterSnapshot(GetTransactionSnapshot());
-		need_unregister_snapshot = true;
+		Assert(!IsBootstrapProcessingMode());
+		Assert(allow_sync);
+		snapshot = scan->rs_snapshot;
 	}
 	else
 	{
-		snapshot = SnapshotAny;
+		if (!TransactionIdIsValid(oldest_xmin))
+		{
+			snapshot = RegisterSnapshot(GetTransactionSnapshot());
+			need_unregister_snapshot = true;
+		}
+		else
+		{
+			snapshot = SnapshotAny;
+		}
+
+		scan = table_beginscan_strat(rel, snapshot, 0, NULL, true, allow_sync);
 	}
 
-	scan = table_beginscan_strat(rel, snapshot, 0, NULL, true, allow_sync);
+	/* only the columns of the index are loaded from the row groups */
+	cscan = (CTableScanDesc) scan;
+	if (cscan->cvscan != NULL && cscan->cvscan->bms_proj == NULL)
+		cscan->cvscan->bms_proj = ctable_index_build_proj(indexInfo);
 
 	if (progress)
 	{
@@ -1091,6 +1729,23 @@ static uint64
 ctable_relation_size(Relation rel, ForkNumber forkNumber)
 {
 	uint64 size = table_block_relation_size(rel, forkNumber);
+
+#if PG_VERSION_NUM < 170000
+	/*
+	 * GAMMA NOTE: acquire_sample_rows of PG < 17 calls
+	 * ctable_scan_analyze_next_block only for the blocks of delta table, the
+	 * row groups of a table with an empty delta table would not be sampled.
+	 * Give it an empty block when ANALYZE asks for the size.
+	 */
+	if (size == 0 && forkNumber == MAIN_FORKNUM && MyBEEntry != NULL &&
+		MyBEEntry->st_progress_command == PROGRESS_COMMAND_ANALYZE &&
+		gamma_meta_max_rgid(rel) > 1)
+	{
+		gamma_meta_keep_delta_block(rel);
+		size = table_block_relation_size(rel, forkNumber);
+	}
+#endif
+
 	return size;
 }
 
@@ -1120,10 +1775,104 @@ ctable_estimate_rel_size(Relation rel, int32 * attr_widths,
 	table_close(cv_rel, AccessShareLock);
 }
 
+/*
+ * GAMMA NOTE: TIDBitmap can't hold the columnar tids (the offset is the rowid
+ * of row group), the bitmap heap scan paths of gamma tables are replaced by
+ * the vectorized bitmap scan in gamma_scan_paths.c, it groups the tids by
+ * row group. Only the blocks of delta table are expected here.
+ */
+static bool
+ctable_scan_bitmap_next_block(TableScanDesc scan, TBMIterateResult * tbmres)
+{
+	CTableScanDesc cscan = (CTableScanDesc) scan;
+	const TableAmRoutine *heapam_routine = GetHeapamTableAmRoutine();
+
+	if (tbmres->blockno > GAMMA_DELTA_TABLE_NBLOCKS)
+		elog(ERROR, "bitmap heap scan of row groups is not supported");
+
+	return heapam_routine->scan_bitmap_next_block(
+								(TableScanDesc) cscan->hscan, tbmres);
+}
+
+static bool
+ctable_scan_bitmap_next_tuple(TableScanDesc scan, TBMIterateResult * tbmres,
+		TupleTableSlot * slot)
+{
+	CTableScanDesc cscan = (CTableScanDesc) scan;
+	const TableAmRoutine *heapam_routine = GetHeapamTableAmRoutine();
+
+	if (!heapam_routine->scan_bitmap_next_tuple((TableScanDesc) cscan->hscan,
+												tbmres, cscan->buf_slot))
+		return false;
+
+	slot_getallattrs(cscan->buf_slot);
+	tts_slot_copy_values(slot, cscan->buf_slot);
+	slot->tts_tid = cscan->buf_slot->tts_tid; /* keep the tid */
+
+	return true;
+}
+
+/*
+ * TABLESAMPLE: the row groups are sampled first, each row group is treated
+ * as a block, so SYSTEM takes or skips a whole row group and the skipped
+ * ones are never loaded. Then the blocks of delta table are sampled by heap.
+ *
+ * GAMMA NOTE: the sampling methods hash the block number, the row groups
+ * are numbered after the blocks of delta table (rgid = blockno + 1 -
+ * rs_nblocks), otherwise a row group and the delta table block of the same
+ * number would be taken or skipped together.
+ */
 static bool
 ctable_scan_sample_next_block(TableScanDesc scan, SampleScanState * scanstate)
 {
-	elog(ERROR, "ctable_scan_sample_next_block not implemented");
+	CTableScanDesc cscan = (CTableScanDesc) scan;
+	CVScanDesc cvscan = cscan->cvscan;
+	TsmRoutine *tsm = scanstate->tsmroutine;
+	uint32 max_rg_id = pg_atomic_read_u32(&cvscan->p_rg->max_rg_id);
+	BlockNumber base = cscan->hscan->rs_nblocks;
+	BlockNumber nblocks = max_rg_id > 1 ? max_rg_id - 1 : 0;
+
+	while (!cscan->heap)
+	{
+		BlockNumber blockno;
+		uint32 rgid;
+
+		if (tsm->NextSampleBlock)
+		{
+			/* the blocks of delta table come later, skip them here */
+			do
+			{
+				blockno = tsm->NextSampleBlock(scanstate, base + nblocks);
+			} while (BlockNumberIsValid(blockno) && blockno < base);
+		}
+		else
+		{
+			/* scanning all row groups */
+			blockno = base + cscan->sample_block;
+			if (cscan->sample_block < nblocks)
+				cscan->sample_block++;
+			else
+				blockno = InvalidBlockNumber;
+		}
+
+		if (!BlockNumberIsValid(blockno))
+		{
+			cscan->heap = true;
+			cscan->sample_block = 0;
+			break;
+		}
+
+		/* the row group may have been merged */
+		rgid = blockno - base + 1;
+		if (!cvtable_load_rg(cvscan, rgid))
+			continue;
+
+		cvtable_load_delbitmap(cvscan, rgid);
+		return true;
+	}
+
+	return GetHeapamTableAmRoutine()->scan_sample_next_block(
+										(TableScanDesc) cscan->hscan, scanstate);
 }
 
 
@@ -1131,7 +1880,48 @@ static bool
 ctable_scan_sample_next_tuple(TableScanDesc scan, SampleScanState * scanstate,
 		TupleTableSlot * slot)
 {
-	elog(ERROR, "ctable_scan_sample_next_tuple not implemented");
+	CTableScanDesc cscan = (CTableScanDesc) scan;
+	CVScanDesc cvscan = cscan->cvscan;
+	TsmRoutine *tsm = scanstate->tsmroutine;
+
+	if (!cscan->heap)
+	{
+		RowGroup *rg = cvscan->rg;
+		BlockNumber blockno = cscan->hscan->rs_nblocks + rg->rgid - 1;
+
+		for (;;)
+		{
+			OffsetNumber offset = tsm->NextSampleTuple(scanstate, blockno,
+													   (OffsetNumber) rg->dim);
+			uint32 rowid;
+
+			/* GAMMA NOTE: a row group has more rows than MaxOffsetNumber */
+			if (offset == InvalidOffsetNumber || offset > rg->dim)
+			{
+				ExecClearTuple(slot);
+				return false;
+			}
+
+			rowid = offset - 1;
+			if (RGHasDelBitmap(rg) && rg->delbitmap[rowid])
+				continue;
+
+			tts_slot_from_rg(slot, rg, cvscan->bms_proj, rowid);
+			return true;
+		}
+	}
+
+	if (GetHeapamTableAmRoutine()->scan_sample_next_tuple(
+				(TableScanDesc) cscan->hscan, scanstate, cscan->buf_slot))
+	{
+		slot_getallattrs(cscan->buf_slot);
+		tts_slot_copy_values(slot, cscan->buf_slot);
+		slot->tts_tid = cscan->buf_slot->tts_tid; /* keep the tid */
+		return true;
+	}
+
+	ExecClearTuple(slot);
+	return false;
 }
 
 static Oid
@@ -56,6 +56,7 @@
 #include "utils/snapmgr.h"
 #include "utils/spccache.h"
 
+#include "executor/gamma_automerge.h"
 #include "executor/gamma_merge.h"
 #include "storage/ctable_dml.h"
 #include "storage/gamma_cvtable_am.h"
@@ -87,6 +88,23 @@ ctable_delete(Relation relation, ItemPointer tid,
 	{
 		result = heap_delete(relation, tid, cid, crosscheck,
 											wait, tmfd, changingPart);
+
+		/*
+		 * GAMMA NOTE: the merge deletes the tuples moved into row groups like
+		 * a cross-partition UPDATE, see gamma_merge_delete_tuple. The row can
+		 * not be followed to the row group, fail as a serialization error
+		 * instead of the error of the moved partitions.
+		 */
+		if (result == TM_Updated &&
+			ItemPointerIndicatesMovedPartitions(&tmfd->ctid))
+			ereport(ERROR,
+					(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
+					 errmsg("could not serialize access due to concurrent merge of gamma table \"%s\"",
+							RelationGetRelationName(relation)),
+					 relation->rd_rel->relispartition ?
+					 errdetail("The row was moved into a row group by the merge or to another partition by a concurrent update.") :
+					 errdetail("The row was moved into a row group by the merge."),
+					 errhint("Retry the transaction.")));
 	}
 	
 	return result;
@@ -114,6 +132,10 @@ ctable_vacuum_rel(Relation rel, VacuumParams * params,
 
 	heap_vacuum_rel(rel, params, bstrategy);
 
+	/* the automerge workers merge it in their own transactions */
+	if (gamma_automerge_running())
+		return;
+
 	/* the delta table need to truncate or clean */
 	nblocks = RelationGetNumberOfBlocks(rel);
 	if (nblocks < (GAMMA_DELTA_TABLE_NBLOCKS * gammadb_delta_table_factor))
@@ -121,21 +143,24 @@ ctable_vacuum_rel(Relation rel, VacuumParams * params,
 		return;
 	}
 
-	/* 
-	 * Merge the data in the Delta table into the column vector part.
-	 * The order of merge is from back to front in the delta table, so that
-	 * the pages at the end of the delta table can be cleared and the number
-	 * of pages in the tail of delta table can be truncated as early as
+	/*
+	 * Merge the data in the Delta table into the column vector part, at most
+	 * gammadb_automerge_max_rowgroups row groups by one VACUUM. The order of
+	 * merge is from back to front in the delta table, so that the pages at
+	 * the end of the delta table can be cleared and truncated as early as
 	 * possible.
+	 *
+	 * GAMMA NOTE: lazy VACUUM is left out of the snapshots of other backends,
+	 * they would take the rows written by the merge for aborted ones. So the
+	 * merge is skipped if the table is busy, and AccessExclusiveLock is held
+	 * until VACUUM commits.
 	 */
 	if (!ConditionalLockRelation(rel, AccessExclusiveLock))
 	{
 		return;
 	}
 
-	gamma_merge(rel);
-
-	UnlockRelation(rel, AccessExclusiveLock);
+	(void) gamma_merge(rel, gammadb_automerge_max_rowgroups, false);
 
 	return;
 }
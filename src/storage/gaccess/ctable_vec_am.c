@@ -15,10 +15,61 @@
 
 #include "postgres.h"
 
-
+#include "access/heapam.h"
 
 #include "storage/ctable_vec_am.h"
+#include "storage/gamma_meta.h"
+
+/*
+ * TABLESAMPLE of the rows of delta table: the blocks are sampled for SYSTEM
+ * and the rows for BERNOULLI, the rows out of the sample are skipped.
+ */
+static void
+vec_ctable_sample_tids(CVScanDesc cvscan, VectorTupleSlot *vslot,
+					   ItemPointer tids)
+{
+	int i;
+
+	if (TTS_EMPTY(&vslot->base.base))
+		return;
+
+	for (i = 0; i < vslot->dim; i++)
+	{
+		BlockNumber blkno = ItemPointerGetBlockNumber(&tids[i]);
+		OffsetNumber offnum = ItemPointerGetOffsetNumber(&tids[i]);
 
+		if (cvscan->sample_method == GAMMA_SAMPLE_SYSTEM)
+			offnum = 0;
+
+		if (!cvtable_sample_keep(cvscan, blkno, offnum, true))
+			vslot->skip[i] = true;
+	}
+
+	VSlotClearNonSkip(vslot);
+}
+
+/*
+ * TID range scan of the rows of delta table: heap_set_tidrange limits the
+ * blocks, the rows out of the range in the first and last block are skipped.
+ */
+static void
+vec_ctable_tidrange_tids(CTableScanDesc cscan, VectorTupleSlot *vslot,
+						 ItemPointer tids)
+{
+	int i;
+
+	if (TTS_EMPTY(&vslot->base.base))
+		return;
+
+	for (i = 0; i < vslot->dim; i++)
+	{
+		if (ItemPointerCompare(&tids[i], &cscan->tidrange_min) < 0 ||
+			ItemPointerCompare(&tids[i], &cscan->tidrange_max) > 0)
+			vslot->skip[i] = true;
+	}
+
+	VSlotClearNonSkip(vslot);
+}
 
 bool
 vec_ctable_getnextslot(TableScanDesc scan, ScanDirection direction,
@@ -27,6 +78,7 @@ vec_ctable_getnextslot(TableScanDesc scan, ScanDirection direction,
 	CTableScanDesc cscan = (CTableScanDesc) scan;
 	CVScanDesc cvscan = cscan->cvscan;
 	TableScanDesc hscan = (TableScanDesc) cscan->hscan;
+	VectorTupleSlot *vslot = (VectorTupleSlot *) slot;
 
 	if (cscan->scan_over)
 	{
@@ -49,9 +101,25 @@ vec_ctable_getnextslot(TableScanDesc scan, ScanDirection direction,
 		}
 		else
 		{
-			
+			uint32 offset = cvscan->offset;
+
 			cvscan->offset += tts_vector_slot_from_rg(slot, cvscan->rg,
 										cvscan->bms_proj, cvscan->offset);
+
+			if (cvscan->sample_method == GAMMA_SAMPLE_BERNOULLI)
+			{
+				cvtable_sample_rows(cvscan, offset, vslot->skip, vslot->dim);
+				VSlotClearNonSkip(vslot);
+			}
+			else if (cscan->tidrange)
+			{
+				vec_ctable_tidrange_rows(cscan, cvscan->rg, offset,
+										 vslot->skip, vslot->dim);
+				VSlotClearNonSkip(vslot);
+			}
+
+			cvtable_keys_filter(cvscan, slot);
+
 			return true;
 		}
 	}
@@ -61,7 +129,29 @@ vec_ctable_getnextslot(TableScanDesc scan, ScanDirection direction,
 
 	if (cscan->heap)
 	{
-		cscan->scan_over = tts_vector_slot_fill_tuple(hscan, direction, slot);
+		if (cvscan->sample_method != GAMMA_SAMPLE_NONE)
+		{
+			ItemPointerData tids[VECTOR_SIZE];
+
+			cscan->scan_over = tts_vector_slot_fill_tuple(hscan, direction,
+														  slot, tids);
+			vec_ctable_sample_tids(cvscan, vslot, tids);
+		}
+		else if (cscan->tidrange)
+		{
+			ItemPointerData tids[VECTOR_SIZE];
+
+			cscan->scan_over = tts_vector_slot_fill_tuple(hscan, direction,
+														  slot, tids);
+			vec_ctable_tidrange_tids(cscan, vslot, tids);
+		}
+		else
+		{
+			cscan->scan_over = tts_vector_slot_fill_tuple(hscan, direction,
+														  slot, NULL);
+		}
+
+		cvtable_keys_filter(cvscan, slot);
 	}
 
 	return true;
@@ -115,6 +205,9 @@ vec_ctable_end_scan(TableScanDesc scan)
 	heap_endscan((TableScanDesc) cscan->hscan);
 	cvtable_endscan(cscan->cvscan);
 
+	if (cscan->analyze_context != NULL)
+		MemoryContextDelete(cscan->analyze_context);
+
 	pfree(cscan);
 	
 	return;
@@ -136,3 +229,70 @@ vec_ctable_rescan(TableScanDesc scan, struct ScanKeyData * key,
 	return;
 }
 
+/*
+ * Set the range of TID range scan. The block of a row group is
+ * MaxBlockNumber - rgid, so the range covers the row groups from the one of
+ * maxtid to the one of mintid, and only these are loaded. The blocks of
+ * delta table are below them, heap limits its scan to the range itself.
+ * The scan restarts, it is called after rescan.
+ */
+void
+vec_ctable_set_tidrange(TableScanDesc scan, ItemPointer mintid,
+						ItemPointer maxtid)
+{
+	CTableScanDesc cscan = (CTableScanDesc) scan;
+	BlockNumber minblk = ItemPointerGetBlockNumberNoCheck(mintid);
+	BlockNumber maxblk = ItemPointerGetBlockNumberNoCheck(maxtid);
+	uint32 min_rgid = 1;
+	uint32 max_rgid = 0;		/* no row group */
+
+	cscan->tidrange = true;
+	ItemPointerCopy(mintid, &cscan->tidrange_min);
+	ItemPointerCopy(maxtid, &cscan->tidrange_max);
+
+	if (ItemPointerCompare(mintid, maxtid) <= 0 &&
+		maxblk > GAMMA_DELTA_TABLE_NBLOCKS)
+	{
+		/* the higher the block is, the lower the rgid is */
+		if (maxblk < MaxBlockNumber)
+			min_rgid = MaxBlockNumber - maxblk;
+
+		if (minblk <= GAMMA_DELTA_TABLE_NBLOCKS)
+			max_rgid = PG_UINT32_MAX;
+		else if (minblk < MaxBlockNumber)
+			max_rgid = MaxBlockNumber - minblk;
+	}
+
+	cvtable_set_rgid_range(cscan->cvscan, min_rgid, max_rgid);
+	heap_set_tidrange((TableScanDesc) cscan->hscan, mintid, maxtid);
+
+	cscan->heap = false;
+	cscan->scan_over = false;
+}
+
+/*
+ * Mark the rows [offset, offset + count) of the row group which are out of
+ * the TID range in skip. Only the row groups in the blocks of the bounds
+ * have to be checked row by row.
+ */
+void
+vec_ctable_tidrange_rows(CTableScanDesc cscan, RowGroup *rg, uint32 offset,
+						 bool *skip, uint32 count)
+{
+	BlockNumber blkno = MaxBlockNumber - rg->rgid;
+	uint32 i;
+
+	if (blkno > ItemPointerGetBlockNumberNoCheck(&cscan->tidrange_min) &&
+		blkno < ItemPointerGetBlockNumberNoCheck(&cscan->tidrange_max))
+		return;
+
+	for (i = 0; i < count; i++)
+	{
+		ItemPointerData tid = gamma_meta_cv_convert_tid(rg->rgid,
+														offset + i + 1);
+
+		if (ItemPointerCompare(&tid, &cscan->tidrange_min) < 0 ||
+			ItemPointerCompare(&tid, &cscan->tidrange_max) > 0)
+			skip[i] = true;
+	}
+}
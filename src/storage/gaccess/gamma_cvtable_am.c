@@ -15,23 +15,51 @@
 
 #include "postgres.h"
 
+#include <math.h>
+
+#if PG_VERSION_NUM >= 160000
+#include "varatt.h"
+#endif
+
+#include "access/detoast.h"
 #include "access/genam.h"
 #include "access/relscan.h"
 #include "access/heapam.h"
+#include "access/htup_details.h"
 #include "access/tableam.h"
+#include "access/toast_compression.h"
+#include "access/stratnum.h"
+#include "access/toast_internals.h"
+#include "access/xact.h"
 #include "catalog/indexing.h"
+#include "common/hashfn.h"
+#include "common/pg_lzcompress.h"
 #include "executor/execdebug.h"
 #include "executor/nodeSeqscan.h"
 #include "storage/bufmgr.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
+#include "utils/snapmgr.h"
+
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
 
 #include "storage/gamma_buffer.h"
 #include "storage/gamma_cvtable_am.h"
+#include "storage/gamma_local_buffer.h"
 #include "storage/gamma_meta.h"
 #include "storage/gamma_rg.h"
+#include "storage/gamma_stats.h"
+
+/* #row groups to prefetch ahead of the current one in sequential scans */
+int gammadb_cv_prefetch_rowgroups = 2;
 
+static HeapTuple cvtable_probe_delbitmap(Relation cvrel, Oid indexoid,
+										 Snapshot snapshot, Oid rgid);
+static bool cvtable_keys_match_rg(CVScanDesc cvscan, uint32 rgid);
 
 CVScanDesc
 cvtable_beginscan(Relation rel, Snapshot snapshot, int nkeys,
@@ -66,126 +94,433 @@ cvtable_beginscan(Relation rel, Snapshot snapshot, int nkeys,
 	if (parallel_scan)
 	{
 		cvscan->p_b = (ParallelBlockTableScanDesc)parallel_scan;
-		cvscan->p_rg = (RowGroupCtableScanDesc)((char *)parallel_scan) +
-										sizeof(ParallelBlockTableScanDescData);
+		cvscan->p_rg = &((VecParallelTableScanDesc) parallel_scan)->rgdata;
 	}
 	else
 	{
 		cvscan->p_b = NULL;
 		cvscan->p_rg = palloc0(sizeof(RowGroupCtableScanDescData));
 		pg_atomic_init_u32(&cvscan->p_rg->cur_rg_id, 0);
-		pg_atomic_init_u32(&cvscan->p_rg->max_rg_id, gamma_meta_max_rgid(rel));
+		pg_atomic_init_u32(&cvscan->p_rg->max_rg_id,
+						   gamma_meta_max_rgid(rel) + 1);
 	}
 
 	return cvscan;
 }
 
+/*
+ * Decompress (or copy) the data of a varlena into dest, which has room for
+ * nbytes. The inline compressed data is decompressed into dest directly,
+ * so the caller can pass the memory of gamma buffer without a temporary
+ * copy of the decompressed data.
+ */
+static void
+cvtable_decompress_into(struct varlena *attr, char *dest, Size nbytes)
+{
+	struct varlena *tmp = NULL;
+	int32 rawsize = -1;
+
+	if (VARATT_IS_EXTERNAL_ONDISK(attr))
+	{
+		/* fetch the chunks, it keeps compressed if it is */
+		tmp = detoast_external_attr(attr);
+		attr = tmp;
+	}
+	else if (VARATT_IS_EXTERNAL(attr))
+	{
+		/* indirect or expanded, it is not used by cv table */
+		tmp = detoast_attr(attr);
+		attr = tmp;
+	}
+
+	if (!VARATT_IS_COMPRESSED(attr))
+	{
+		memcpy(dest, VARDATA_ANY(attr), Min(nbytes, VARSIZE_ANY_EXHDR(attr)));
+		if (tmp != NULL)
+			pfree(tmp);
+		return;
+	}
+
+	switch (VARDATA_COMPRESSED_GET_COMPRESS_METHOD(attr))
+	{
+		case TOAST_PGLZ_COMPRESSION_ID:
+			rawsize = pglz_decompress((char *) attr + VARHDRSZ_COMPRESSED,
+									VARSIZE(attr) - VARHDRSZ_COMPRESSED,
+									dest, nbytes, true);
+			break;
+		case TOAST_LZ4_COMPRESSION_ID:
+#ifdef USE_LZ4
+			rawsize = LZ4_decompress_safe((char *) attr + VARHDRSZ_COMPRESSED,
+									dest, VARSIZE(attr) - VARHDRSZ_COMPRESSED,
+									nbytes);
+#else
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("compression method lz4 not supported"),
+					 errdetail("This functionality requires the server to be built with lz4 support.")));
+#endif
+			break;
+		default:
+			{
+				/* unknown method, let toast report it */
+				struct varlena *raw = detoast_attr(attr);
+				memcpy(dest, VARDATA_ANY(raw), Min(nbytes, VARSIZE_ANY_EXHDR(raw)));
+				rawsize = nbytes;
+				pfree(raw);
+			}
+			break;
+	}
+
+	if (rawsize < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg_internal("compressed column vector is corrupt")));
+
+	if (tmp != NULL)
+		pfree(tmp);
+}
+
+/*
+ * Decompress the column vector into the decoded tier of gamma buffer if it
+ * has room, otherwise into palloc'd memory (*local is set). values and nulls
+ * are the varlena as they are stored in cv table, nulls is NULL if the
+ * column vector has no null. If evict is true, the unpinned decoded entries
+ * may be evicted to make room. The published entry is pinned, *pinned is
+ * set to it.
+ */
+static void
+cvtable_decode_cv(Oid relid, uint32 rgid, int16 attno, uint32 rows,
+				struct varlena *values, struct varlena *nulls, bool evict,
+				char **buffer_values, Size *buffer_v_len,
+				bool **buffer_isnull, Size *buffer_n_len, bool *local,
+				gamma_toc_entry **pinned)
+{
+	gamma_toc_entry *entry;
+
+	/* the raw size is known from the header, no need to decompress */
+	*buffer_v_len = toast_raw_datum_size(PointerGetDatum(values)) - VARHDRSZ;
+	*buffer_n_len = (nulls != NULL) ? rows : 0;
+
+	entry = gamma_buffer_reserve_cv(relid, rgid, attno, rows,
+								*buffer_v_len, *buffer_n_len,
+								buffer_values, buffer_isnull, evict);
+	if (entry != NULL)
+	{
+		PG_TRY();
+		{
+			cvtable_decompress_into(values, *buffer_values, *buffer_v_len);
+			if (nulls != NULL)
+				cvtable_decompress_into(nulls, (char *) *buffer_isnull,
+										*buffer_n_len);
+		}
+		PG_CATCH();
+		{
+			gamma_buffer_cancel_cv(entry);
+			PG_RE_THROW();
+		}
+		PG_END_TRY();
+
+		gamma_buffer_publish_cv(entry);
+		*pinned = entry;
+		*local = false;
+		return;
+	}
+
+	*buffer_values = (char *) palloc(Max(*buffer_v_len, 1));
+	cvtable_decompress_into(values, *buffer_values, *buffer_v_len);
+
+	if (nulls != NULL)
+	{
+		*buffer_isnull = (bool *) palloc(*buffer_n_len);
+		cvtable_decompress_into(nulls, (char *) *buffer_isnull, *buffer_n_len);
+	}
+	else
+	{
+		*buffer_isnull = NULL;
+	}
+
+	*local = true;
+}
+
+/*
+ * Get the raw data of a column vector. gamma buffer has two tiers, the
+ * decoded tier is checked first, then the cold tier which keeps the
+ * compressed payload, at last the column vector is read from the cv table.
+ *
+ * The column vector is decompressed directly into the decoded tier if it
+ * has room. A cold hit is promoted in this way, it may evict the unpinned
+ * decoded entries, while a column vector read from cv table only takes the
+ * free room, so a large scan does not flush the hot ones. Otherwise it is
+ * decompressed into palloc'd memory and *local is set, the payload read
+ * from cv table is kept in the cold tier to save the TOAST/heap reads.
+ *
+ * If the data is in the decoded tier, *pinned is set to the entry pinned,
+ * the caller should drop it by gamma_buffer_unpin_cv after use.
+ */
 static bool
-cvtable_load_cv(CVScanDesc cvscan, uint32 rgid, int16 attno)
+cvtable_fetch_cv(CVScanDesc cvscan, uint32 rgid, int16 attno, uint32 *rows,
+				char **buffer_values, Size *buffer_v_len,
+				bool **buffer_isnull, Size *buffer_n_len, bool *local,
+				gamma_toc_entry **pinned)
 {
-	static SysScanDesc sscan;
-	static ScanKeyData key[2];
+	SysScanDesc sscan;
+	ScanKeyData key[2];
 	HeapTuple	tuple;
 	TupleDesc cv_desc = RelationGetDescr(cvscan->cv_rel);
-	//TupleDesc base_desc = RelationGetDescr(cvscan->base_rel);
-	//bool exists = false;
-	uint32 rows;
+	Oid relid = RelationGetRelid(cvscan->base_rel);
 	bool non_nulls = false;
 	
 	bool isnull = false;
 	Datum datum_rows;
 	Datum datum_data;
 	Datum datum_nulls;
-	//Datum datum_rgid;
-	//Datum datum_attno;
 
-	text *text_data;
-	//uint32 data_len = 0;
-	text *text_nulls = NULL;
-	//int32 attno;
+	char *cold_values;
+	char *cold_nulls;
+	Size cold_v_len;
+	Size cold_n_len;
+
+	struct varlena *attr_data;
+	struct varlena *attr_nulls = NULL;
+
+	*local = false;
+
+	*pinned = gamma_buffer_get_cv(relid, rgid, attno, rows, buffer_values,
+							buffer_v_len, buffer_isnull, buffer_n_len);
+	if (*pinned != NULL)
+		return true;
+
+	if (gamma_buffer_get_compressed_cv(relid, rgid, attno, rows,
+								&cold_values, &cold_v_len,
+								&cold_nulls, &cold_n_len))
+	{
+		cvtable_decode_cv(relid, rgid, attno, *rows,
+						(struct varlena *) cold_values,
+						(struct varlena *) cold_nulls, true,
+						buffer_values, buffer_v_len,
+						buffer_isnull, buffer_n_len, local, pinned);
+
+		pfree(cold_values);
+		if (cold_nulls != NULL)
+			pfree(cold_nulls);
+
+		return true;
+	}
+
+	ScanKeyInit(&key[0],
+			Anum_gamma_rowgroup_rgid,
+			BTEqualStrategyNumber, F_OIDEQ,
+			ObjectIdGetDatum(rgid));
+
+	ScanKeyInit(&key[1],
+			Anum_gamma_rowgroup_attno,
+			BTGreaterEqualStrategyNumber, F_INT4EQ,
+			Int32GetDatum(attno));
+
+	sscan = systable_beginscan(cvscan->cv_rel,
+							RelationGetRelid(cvscan->cv_index_rel), true,
+							cvscan->snapshot, 2, key);
+
+	tuple = systable_getnext(sscan);
+	if (tuple == NULL)
+	{
+		systable_endscan(sscan);
+		return false;
+	}
+
+	/* Extract values, they are not detoasted here */
+	datum_rows = heap_getattr(tuple, Anum_gamma_rowgroup_count, cv_desc, &isnull);
+	datum_data = heap_getattr(tuple, Anum_gamma_rowgroup_values, cv_desc, &isnull);
+	datum_nulls = heap_getattr(tuple, Anum_gamma_rowgroup_nulls, cv_desc, &non_nulls);
+
+	*rows = DatumGetInt32(datum_rows);
+
+	/* fetch the TOAST chunks, the payload keeps compressed */
+	attr_data = (struct varlena *) DatumGetPointer(datum_data);
+	if (VARATT_IS_EXTERNAL(attr_data))
+		attr_data = detoast_external_attr(attr_data);
+
+	if (!non_nulls)
+	{
+		attr_nulls = (struct varlena *) DatumGetPointer(datum_nulls);
+		if (VARATT_IS_EXTERNAL(attr_nulls))
+			attr_nulls = detoast_external_attr(attr_nulls);
+	}
 
+	cvtable_decode_cv(relid, rgid, attno, *rows, attr_data, attr_nulls, false,
+					buffer_values, buffer_v_len,
+					buffer_isnull, buffer_n_len, local, pinned);
+
+	/* it is not kept decoded, keep the payload in the cold tier */
+	if (*local)
+		gamma_buffer_add_compressed_cv(relid, rgid, attno, *rows,
+									(char *) attr_data, VARSIZE_ANY(attr_data),
+									(char *) attr_nulls,
+									attr_nulls ? VARSIZE_ANY(attr_nulls) : 0);
+
+	if ((void *) attr_data != DatumGetPointer(datum_data))
+		pfree(attr_data);
+
+	if (attr_nulls != NULL && (void *) attr_nulls != DatumGetPointer(datum_nulls))
+		pfree(attr_nulls);
+
+	systable_endscan(sscan);
+
+	return true;
+}
+
+static bool
+cvtable_load_cv(CVScanDesc cvscan, uint32 rgid, int16 attno)
+{
+	uint32 rows;
 	char *buffer_values = NULL;
 	bool *buffer_isnull = NULL;
 	Size buffer_v_len = 0;
 	Size buffer_n_len = 0;
+	bool local = false;
+	gamma_toc_entry *pinned = NULL;
+	Oid relid = RelationGetRelid(cvscan->base_rel);
+	ColumnVector *cv = &cvscan->rg->cvs[attno - 1];
 
-	if (!gamma_buffer_get_cv(RelationGetRelid(cvscan->base_rel),
-							rgid, attno, &rows, &buffer_values, &buffer_v_len,
-							&buffer_isnull, &buffer_n_len))
-	{
-		ScanKeyInit(&key[0],
-				Anum_gamma_rowgroup_rgid,
-				BTEqualStrategyNumber, F_OIDEQ,
-				ObjectIdGetDatum(rgid));
+	gamma_rg_reset_cv(cvscan->rg, attno - 1);
 
-		ScanKeyInit(&key[1],
-				Anum_gamma_rowgroup_attno,
-				BTGreaterEqualStrategyNumber, F_INT4EQ,
-				Int32GetDatum(attno));
+	/* the decoded ColumnVector in backend-local buffer */
+	if (gamma_local_buffer_get_cv(relid, rgid, attno, cv))
+		return true;
 
-		sscan = systable_beginscan(cvscan->cv_rel,
-								RelationGetRelid(cvscan->cv_index_rel), true,
-								cvscan->snapshot, 2, key);
+	if (!cvtable_fetch_cv(cvscan, rgid, attno, &rows,
+						&buffer_values, &buffer_v_len,
+						&buffer_isnull, &buffer_n_len, &local, &pinned))
+		return false;
 
-		tuple = systable_getnext(sscan);
-		if (tuple == NULL)
+	if (gamma_local_buffer_add_cv(relid, rgid, attno, cv, buffer_values,
+								buffer_v_len, buffer_isnull, rows))
+	{
+		/* the local buffer has its own copy */
+		if (local)
 		{
-			systable_endscan(sscan);
-			return false;
+			pfree(buffer_values);
+			if (buffer_isnull != NULL)
+				pfree(buffer_isnull);
 		}
 
-		/* Extract values */
-		//datum_rgid = heap_getattr(tuple, Anum_gamma_rowgroup_rgid, cv_desc, &isnull);
-		//datum_attno = heap_getattr(tuple, Anum_gamma_rowgroup_attno, cv_desc, &isnull);
-		datum_rows = heap_getattr(tuple, Anum_gamma_rowgroup_count, cv_desc, &isnull);
-		datum_data = heap_getattr(tuple, Anum_gamma_rowgroup_values, cv_desc, &isnull);
-		datum_nulls = heap_getattr(tuple, Anum_gamma_rowgroup_nulls, cv_desc, &non_nulls);
+		if (pinned != NULL)
+			gamma_buffer_unpin_cv(pinned);
 
-		//rgid = DatumGetObjectId(datum_rgid);
-		//attno = DatumGetInt32(datum_attno);
-		rows = DatumGetInt32(datum_rows);
-		text_data = DatumGetTextPP(datum_data);  
-		buffer_values = text_to_cstring(text_data);
-		buffer_v_len = VARSIZE_ANY_EXHDR(text_data);
+		return true;
+	}
 
-		if (!non_nulls)
-		{
-			text_nulls = DatumGetTextPP(datum_nulls);
-			buffer_isnull = (bool *)text_to_cstring(text_nulls);
-			buffer_n_len = rows;
-		}
-		else
-		{
-			buffer_isnull = NULL;
-			buffer_n_len = 0;
-		}	
+	gamma_cv_fill_data(cv, buffer_values, buffer_v_len, buffer_isnull, rows);
 
-		systable_endscan(sscan);
+	/* the ColumnVector references gamma buffer, keep it pinned */
+	if (pinned != NULL)
+		gamma_buffer_pin_ref(cv, pinned);
 
-		if (gamma_buffer_add_cv(RelationGetRelid(cvscan->base_rel),
-					rgid, attno, rows,
-					buffer_values, buffer_v_len, buffer_isnull, buffer_n_len))
-		{
-			if (buffer_values != NULL)
-				pfree(buffer_values);
+	return true;
+}
 
-			if (!non_nulls && buffer_isnull != NULL)
-				pfree(buffer_isnull);
+/*
+ * Load a column vector into gamma buffer without filling the row group.
+ * Return false if the column vector does not exist or gamma buffer is full,
+ * *full tells which one.
+ */
+bool
+cvtable_prewarm_cv(CVScanDesc cvscan, uint32 rgid, int16 attno, bool *full)
+{
+	uint32 rows;
+	char *buffer_values = NULL;
+	bool *buffer_isnull = NULL;
+	Size buffer_v_len = 0;
+	Size buffer_n_len = 0;
+	bool local = false;
+	gamma_toc_entry *pinned = NULL;
 
-			gamma_buffer_get_cv(RelationGetRelid(cvscan->base_rel),
-					rgid, attno, &rows,
-					&buffer_values, &buffer_v_len, &buffer_isnull, &buffer_n_len);
-		}
+	*full = false;
 
-		if ((void *)text_data != DatumGetPointer(datum_data))
-			pfree(text_data);
+	if (!cvtable_fetch_cv(cvscan, rgid, attno, &rows,
+						&buffer_values, &buffer_v_len,
+						&buffer_isnull, &buffer_n_len, &local, &pinned))
+		return false;
 
-		if (!non_nulls && (void *)text_nulls != DatumGetPointer(datum_nulls))
-			pfree(text_nulls);
+	if (!local)
+	{
+		if (pinned != NULL)
+			gamma_buffer_unpin_cv(pinned);
+		return true;
 	}
 
-	gamma_cv_fill_data(&cvscan->rg->cvs[attno - 1], buffer_values,
-			buffer_v_len, buffer_isnull, rows);
+	pfree(buffer_values);
+	if (buffer_isnull != NULL)
+		pfree(buffer_isnull);
+
+	/* not decoded in gamma buffer, check if the cold tier keeps it */
+	if (gamma_buffer_contains_cv(RelationGetRelid(cvscan->base_rel),
+								rgid, attno))
+		return true;
+
+	/* still not in gamma buffer, it is out of space */
+	*full = true;
+	return false;
+}
+
+/*
+ * Check if the row group is visible to the snapshot of the scan.
+ *
+ * GAMMA NOTE: gamma buffer and the local buffer return the column vectors
+ * without checking the snapshot. The merge of delta table runs with
+ * readers, a snapshot taken before the merge commits still sees the rows
+ * in delta table, so the row groups of that merge must be skipped. The
+ * column vectors of a row group are inserted together and never updated,
+ * the xmin of any of them tells the visibility. It is cached in the local
+ * buffer once it is committed.
+ */
+bool
+cvtable_rg_visible(CVScanDesc cvscan, uint32 rgid)
+{
+	Oid relid = RelationGetRelid(cvscan->base_rel);
+	Snapshot snapshot = cvscan->snapshot;
+	SysScanDesc sscan;
+	ScanKeyData key[2];
+	HeapTuple tuple;
+	TransactionId xmin;
+
+	if (snapshot == NULL || !IsMVCCSnapshot(snapshot))
+		return true;
+
+	if (gamma_local_buffer_get_rg_xmin(relid, rgid, &xmin))
+		return !XidInMVCCSnapshot(xmin, snapshot);
+
+	ScanKeyInit(&key[0],
+			Anum_gamma_rowgroup_rgid,
+			BTEqualStrategyNumber, F_OIDEQ,
+			ObjectIdGetDatum(rgid));
+
+	/* skip the delete bitmap, it is updated by deletes */
+	ScanKeyInit(&key[1],
+			Anum_gamma_rowgroup_attno,
+			BTGreaterEqualStrategyNumber, F_INT4GE,
+			Int32GetDatum(1));
+
+	sscan = systable_beginscan(cvscan->cv_rel,
+							RelationGetRelid(cvscan->cv_index_rel), true,
+							snapshot, 2, key);
+
+	tuple = systable_getnext(sscan);
+	if (tuple == NULL)
+	{
+		systable_endscan(sscan);
+		return false;
+	}
+
+	if (HeapTupleHeaderXminFrozen(tuple->t_data))
+		xmin = FrozenTransactionId;
+	else
+		xmin = HeapTupleHeaderGetXmin(tuple->t_data);
+
+	if (!TransactionIdIsCurrentTransactionId(xmin))
+		gamma_local_buffer_set_rg_xmin(relid, rgid, xmin);
+
+	systable_endscan(sscan);
 
 	return true;
 }
@@ -198,6 +533,9 @@ cvtable_load_rg(CVScanDesc cvscan, uint32 rgid)
 	int dim_attno = 0;
 	TupleDesc base_desc = RelationGetDescr(cvscan->base_rel);
 
+	if (!cvtable_rg_visible(cvscan, rgid))
+		return false;
+
 	if (cvscan->bms_proj)
 	{
 		i = -1;
@@ -248,6 +586,9 @@ cvtable_load_rowslot(CVScanDesc cvscan, uint32 rgid,
 	//if (del[rowid])
 	//	return false;
 
+	if (!cvtable_rg_visible(cvscan, rgid))
+		return false;
+
 	if (cvscan->bms_proj)
 	{
 		i = -1;
@@ -295,12 +636,21 @@ cvtable_load_rowslot(CVScanDesc cvscan, uint32 rgid,
 	return true;
 }
 
-void
-cvtable_load_delbitmap(CVScanDesc cvscan, uint32 rgid)
+/*
+ * The version of delete bitmap cached in gamma buffer, xmin is invalid if
+ * the row group has no delete bitmap.
+ */
+typedef struct CVDelBitmapVersion
+{
+	TransactionId xmin;
+	ItemPointerData ctid;
+} CVDelBitmapVersion;
+
+/* copy the delete bitmap into the row group and free the tuple */
+static Size
+cvtable_set_delbitmap(CVScanDesc cvscan, HeapTuple delbitmap_tuple)
 {
-	HeapTuple delbitmap_tuple = cvtable_get_delbitmap_tuple(cvscan->cv_rel,
-			cvscan->cv_index_rel->rd_id,
-			cvscan->snapshot, rgid);
+	Size count = 0;
 
 	if (delbitmap_tuple != NULL)
 	{
@@ -314,13 +664,251 @@ cvtable_load_delbitmap(CVScanDesc cvscan, uint32 rgid)
 				RelationGetDescr(cvscan->cv_rel), &isnull);
 		text_data = DatumGetTextPP(datum);  
 		data_len = VARSIZE_ANY_EXHDR(text_data);
-		delbitmap = (bool *)VARDATA(text_data);
+		delbitmap = (bool *)VARDATA_ANY(text_data);
 
 		memcpy(cvscan->rg->delbitmap, delbitmap, data_len);
-		RGSetDelBitmap(cvscan->rg);
+		if (memchr(delbitmap, true, data_len) != NULL)
+			RGSetDelBitmap(cvscan->rg);
+		count = data_len;
+
+		if ((void *) text_data != DatumGetPointer(datum))
+			pfree(text_data);
+
+		heap_freetuple(delbitmap_tuple);
 	}
 
-	return;
+	return count;
+}
+
+/*
+ * Load the delete bitmap of the row group, from gamma buffer if the cached
+ * version is visible to the transaction snapshot.
+ *
+ * Only the latest committed version is cached: on a miss the bitmap is
+ * read with the latest snapshot, and it is added if no delete bitmap has
+ * been written since then. The writers drop the cached version when they
+ * write and when they commit, and read from cv table themselves.
+ */
+void
+cvtable_load_delbitmap(CVScanDesc cvscan, uint32 rgid)
+{
+	Oid relid = RelationGetRelid(cvscan->base_rel);
+	Oid indexoid = RelationGetRelid(cvscan->cv_index_rel);
+	Snapshot snapshot = GetTransactionSnapshot();
+	HeapTuple delbitmap_tuple;
+	CVDelBitmapVersion version;
+	Size count;
+	uint64 gen;
+
+	RGClearDelBitmap(cvscan->rg);
+
+	if (gamma_buffer_delbitmap_bypass())
+	{
+		delbitmap_tuple = cvtable_probe_delbitmap(cvscan->cv_rel, indexoid,
+												  snapshot, rgid);
+		cvtable_set_delbitmap(cvscan, delbitmap_tuple);
+		return;
+	}
+
+	if (gamma_buffer_get_delbitmap(relid, rgid, (char *) &version,
+								sizeof(CVDelBitmapVersion),
+								cvscan->rg->delbitmap, &count))
+	{
+		if (!TransactionIdIsNormal(version.xmin) ||
+			!XidInMVCCSnapshot(version.xmin, snapshot))
+		{
+			if (count > 0 &&
+				memchr(cvscan->rg->delbitmap, true, count) != NULL)
+				RGSetDelBitmap(cvscan->rg);
+			return;
+		}
+
+		/* the snapshot is older than the cached version */
+		delbitmap_tuple = cvtable_probe_delbitmap(cvscan->cv_rel, indexoid,
+												  snapshot, rgid);
+		cvtable_set_delbitmap(cvscan, delbitmap_tuple);
+		return;
+	}
+
+	gen = gamma_buffer_delbitmap_gen();
+	delbitmap_tuple = cvtable_probe_delbitmap(cvscan->cv_rel, indexoid,
+											  GetLatestSnapshot(), rgid);
+
+	memset(&version, 0, sizeof(CVDelBitmapVersion));
+	version.xmin = InvalidTransactionId;
+	ItemPointerSetInvalid(&version.ctid);
+
+	if (delbitmap_tuple != NULL)
+	{
+		version.xmin = HeapTupleHeaderGetXmin(delbitmap_tuple->t_data);
+		version.ctid = delbitmap_tuple->t_self;
+	}
+
+	if (TransactionIdIsNormal(version.xmin) &&
+		XidInMVCCSnapshot(version.xmin, snapshot))
+	{
+		/* the snapshot does not see the latest version */
+		heap_freetuple(delbitmap_tuple);
+
+		delbitmap_tuple = cvtable_probe_delbitmap(cvscan->cv_rel, indexoid,
+												  snapshot, rgid);
+		cvtable_set_delbitmap(cvscan, delbitmap_tuple);
+		return;
+	}
+
+	count = cvtable_set_delbitmap(cvscan, delbitmap_tuple);
+
+	gamma_buffer_add_delbitmap(relid, rgid, gen, (char *) &version,
+							sizeof(CVDelBitmapVersion),
+							cvscan->rg->delbitmap, count);
+}
+
+#ifdef USE_PREFETCH
+/*
+ * Prefetch the TOAST chunks of an out-of-line value. Only the toast index
+ * is read here, the heap blocks of chunks are requested asynchronously.
+ */
+static void
+cvtable_prefetch_toast(struct varlena *attr)
+{
+	struct varatt_external toast_pointer;
+	Relation toastrel;
+	Relation *toastidxs;
+	int num_indexes;
+	int valid_index;
+	ScanKeyData key;
+	IndexScanDesc scan;
+	ItemPointer tid;
+	BlockNumber last_blkno = InvalidBlockNumber;
+
+	if (!VARATT_IS_EXTERNAL_ONDISK(attr))
+		return;
+
+	VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
+
+	toastrel = table_open(toast_pointer.va_toastrelid, AccessShareLock);
+	valid_index = toast_open_indexes(toastrel, AccessShareLock,
+									 &toastidxs, &num_indexes);
+
+	ScanKeyInit(&key,
+				(AttrNumber) 1,
+				BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(toast_pointer.va_valueid));
+
+	/* only tids are needed, visibility is checked when it is detoasted */
+	scan = index_beginscan(toastrel, toastidxs[valid_index], SnapshotAny, 1, 0);
+	index_rescan(scan, &key, 1, NULL, 0);
+
+	while ((tid = index_getnext_tid(scan, ForwardScanDirection)) != NULL)
+	{
+		BlockNumber blkno = ItemPointerGetBlockNumber(tid);
+
+		if (blkno != last_blkno)
+		{
+			PrefetchBuffer(toastrel, MAIN_FORKNUM, blkno);
+			last_blkno = blkno;
+		}
+	}
+
+	index_endscan(scan);
+	toast_close_indexes(toastidxs, num_indexes, AccessShareLock);
+	table_close(toastrel, AccessShareLock);
+}
+
+static void
+cvtable_prefetch_cv(CVScanDesc cvscan, uint32 rgid, int16 attno)
+{
+	SysScanDesc sscan;
+	ScanKeyData key[2];
+	HeapTuple	tuple;
+	TupleDesc cv_desc = RelationGetDescr(cvscan->cv_rel);
+	Datum datum;
+	bool isnull;
+
+	/* it is in gamma buffer already */
+	if (gamma_buffer_contains_cv(RelationGetRelid(cvscan->base_rel),
+								rgid, attno))
+		return;
+
+	ScanKeyInit(&key[0],
+			Anum_gamma_rowgroup_rgid,
+			BTEqualStrategyNumber, F_OIDEQ,
+			ObjectIdGetDatum(rgid));
+
+	ScanKeyInit(&key[1],
+			Anum_gamma_rowgroup_attno,
+			BTEqualStrategyNumber, F_INT4EQ,
+			Int32GetDatum(attno));
+
+	sscan = systable_beginscan(cvscan->cv_rel,
+							RelationGetRelid(cvscan->cv_index_rel), true,
+							cvscan->snapshot, 2, key);
+
+	tuple = systable_getnext(sscan);
+	if (tuple != NULL)
+	{
+		datum = heap_getattr(tuple, Anum_gamma_rowgroup_values, cv_desc, &isnull);
+		if (!isnull)
+			cvtable_prefetch_toast((struct varlena *) DatumGetPointer(datum));
+
+		datum = heap_getattr(tuple, Anum_gamma_rowgroup_nulls, cv_desc, &isnull);
+		if (!isnull)
+			cvtable_prefetch_toast((struct varlena *) DatumGetPointer(datum));
+	}
+
+	systable_endscan(sscan);
+}
+#endif
+
+/*
+ * Read-ahead of the projected column vectors of the next row groups, up to
+ * gammadb_cv_prefetch_rowgroups after rgid.
+ */
+static void
+cvtable_prefetch(CVScanDesc cvscan, uint32 rgid)
+{
+#ifdef USE_PREFETCH
+	uint32 max_rg_id = pg_atomic_read_u32(&cvscan->p_rg->max_rg_id);
+	uint32 target;
+	uint32 next;
+	int i;
+
+	if (gammadb_cv_prefetch_rowgroups <= 0 || max_rg_id <= 1)
+		return;
+
+	/* max_rg_id is the exclusive bound of the scan */
+	target = Min(rgid + gammadb_cv_prefetch_rowgroups, max_rg_id - 1);
+	next = Max(cvscan->prefetch_rgid, rgid) + 1;
+
+	for (; next <= target; next++)
+	{
+		/* the row groups out of the sample are not read */
+		if (cvscan->sample_method == GAMMA_SAMPLE_SYSTEM &&
+			!cvtable_sample_keep(cvscan, next, 0, false))
+		{
+			cvscan->prefetch_rgid = next;
+			continue;
+		}
+
+		if (cvscan->bms_proj)
+		{
+			i = -1;
+			while ((i = bms_next_member(cvscan->bms_proj, i)) >= 0)
+			{
+				int attno = i + FirstLowInvalidHeapAttributeNumber;
+				if (attno > 0)
+					cvtable_prefetch_cv(cvscan, next, attno);
+			}
+		}
+		else
+		{
+			for (i = 0; i < RelationGetDescr(cvscan->base_rel)->natts; i++)
+				cvtable_prefetch_cv(cvscan, next, i + 1);
+		}
+
+		cvscan->prefetch_rgid = next;
+	}
+#endif
 }
 
 bool
@@ -375,7 +963,23 @@ cvtable_loadnext_rg(CVScanDesc cvscan, ScanDirection direction)
 		rgid = pg_atomic_add_fetch_u32(&cvscan->p_rg->cur_rg_id, 1);
 	}
 
-	while (!(result = cvtable_load_rg(cvscan, rgid)))
+	/*
+	 * The first row group must be checked as the next ones, max_rg_id may
+	 * be limited by a TID range and the other workers move cur_rg_id.
+	 */
+	max_rg_id = pg_atomic_read_u32(&cvscan->p_rg->max_rg_id);
+	if (rgid < 1 || rgid >= max_rg_id)
+		return false;
+
+	/*
+	 * GAMMA NOTE: with TABLESAMPLE SYSTEM, the row groups out of the sample
+	 * are skipped here, none of their column vectors is read. So are the
+	 * row groups whose min/max can't satisfy the scan keys.
+	 */
+	while (!(result = ((cvscan->sample_method != GAMMA_SAMPLE_SYSTEM ||
+						cvtable_sample_keep(cvscan, rgid, 0, false)) &&
+					   cvtable_keys_match_rg(cvscan, rgid) &&
+					   cvtable_load_rg(cvscan, rgid))))
 	{
 		if (ScanDirectionIsForward(direction))
 		{
@@ -431,8 +1035,14 @@ cvtable_loadnext_rg(CVScanDesc cvscan, ScanDirection direction)
 	}
 
 	if (result)
+	{
 		cvtable_load_delbitmap(cvscan, rgid);
 
+		/* the next row groups are read while this one is processed */
+		if (!backward)
+			cvtable_prefetch(cvscan, rgid);
+	}
+
 	return result;
 }
 
@@ -530,6 +1140,307 @@ cvtable_endscan(CVScanDesc cvscan)
 
 	if (cvscan->cv_rel)
 		table_close(cvscan->cv_rel, NoLock);
+
+	if (cvscan->keys_context)
+		MemoryContextDelete(cvscan->keys_context);
+
+	if (cvscan->key_attnos)
+		pfree(cvscan->key_attnos);
+}
+
+/*
+ * Set the TABLESAMPLE method of the scan. Like the builtin SYSTEM and
+ * BERNOULLI methods, a unit (row group, block or row) is kept when the
+ * hash of its keys and the seed is below the cutoff, so REPEATABLE gives
+ * the same sample while the table is unchanged.
+ */
+void
+cvtable_set_sample(CVScanDesc cvscan, int method, double percent, uint32 seed)
+{
+	double dcutoff = rint(((double) PG_UINT32_MAX + 1) * percent / 100);
+
+	cvscan->sample_method = method;
+	cvscan->sample_cutoff = (uint64) dcutoff;
+	cvscan->sample_seed = seed;
+}
+
+/*
+ * Restrict the scan to the row groups [min_rgid, max_rgid] (TID range scan),
+ * the others are never loaded. The scan restarts from min_rgid.
+ */
+void
+cvtable_set_rgid_range(CVScanDesc cvscan, uint32 min_rgid, uint32 max_rgid)
+{
+	uint32 max_rg_id = gamma_meta_max_rgid(cvscan->base_rel) + 1;
+
+	/* the range is set by each scan, it can't be shared by workers */
+	Assert(cvscan->p_b == NULL);
+	Assert(min_rgid >= 1);
+
+	if (min_rgid > max_rgid)
+		max_rg_id = 1;		/* no row group */
+	else if (max_rgid + 1 < max_rg_id)
+		max_rg_id = max_rgid + 1;
+
+	pg_atomic_write_u32(&cvscan->p_rg->max_rg_id, max_rg_id);
+	pg_atomic_write_u32(&cvscan->p_rg->cur_rg_id, min_rgid - 1);
+	cvscan->offset = cvscan->rg->dim;
+}
+
+/*
+ * Set the scan keys of the quals "column op const". The row groups are
+ * skipped by their min/max before they are loaded, then the rows (of row
+ * groups and delta table) which don't satisfy the keys are skipped in the
+ * vector slot. The keys are owned by the caller.
+ */
+void
+cvtable_set_keys(CVScanDesc cvscan, int nkeys, ScanKey keys)
+{
+	int i;
+
+	cvscan->nkeys = nkeys;
+	cvscan->keys = keys;
+	cvscan->key_natts = 0;
+
+	if (nkeys == 0)
+		return;
+
+	if (cvscan->keys_context == NULL)
+		cvscan->keys_context = AllocSetContextCreate(CurrentMemoryContext,
+													 "Gamma CV Scan Keys",
+													 ALLOCSET_SMALL_SIZES);
+
+	/* the columns of the keys, fetched by one probe for each row group */
+	if (cvscan->key_attnos != NULL)
+		pfree(cvscan->key_attnos);
+	cvscan->key_attnos = (AttrNumber *)
+		MemoryContextAlloc(GetMemoryChunkContext(cvscan),
+						   sizeof(AttrNumber) * nkeys);
+
+	for (i = 0; i < nkeys; i++)
+	{
+		AttrNumber attno = keys[i].sk_attno;
+		int j = cvscan->key_natts;
+
+		/* insertion sort, the keys are few */
+		while (j > 0 && cvscan->key_attnos[j - 1] > attno)
+			j--;
+
+		if (j > 0 && cvscan->key_attnos[j - 1] == attno)
+			continue;
+
+		memmove(&cvscan->key_attnos[j + 1], &cvscan->key_attnos[j],
+				sizeof(AttrNumber) * (cvscan->key_natts - j));
+		cvscan->key_attnos[j] = attno;
+		cvscan->key_natts++;
+	}
+}
+
+/*
+ * Check the min/max of the columns of a row group with the scan keys, it
+ * returns false if no row of the row group can satisfy them. A row group
+ * without statistics (or which is missing) is matched. The min/max of all
+ * the key columns are fetched by one probe of the cv index.
+ */
+static bool
+cvtable_keys_match_rg(CVScanDesc cvscan, uint32 rgid)
+{
+	MemoryContext old_context;
+	GammaColumnStats **key_stats;
+	bool match = true;
+	int i;
+
+	if (cvscan->nkeys == 0)
+		return true;
+
+	old_context = MemoryContextSwitchTo(cvscan->keys_context);
+
+	key_stats = (GammaColumnStats **)
+		palloc(sizeof(GammaColumnStats *) * cvscan->key_natts);
+	gamma_stats_fetch_minmax(cvscan->cv_rel,
+							 RelationGetRelid(cvscan->cv_index_rel),
+							 cvscan->snapshot, rgid, cvscan->key_attnos,
+							 cvscan->key_natts, key_stats);
+
+	for (i = 0; i < cvscan->nkeys && match; i++)
+	{
+		ScanKey key = &cvscan->keys[i];
+		GammaColumnStats *stats = NULL;
+		int32 cmp_min;
+		int32 cmp_max;
+		int j;
+
+		for (j = 0; j < cvscan->key_natts; j++)
+		{
+			if (cvscan->key_attnos[j] == key->sk_attno)
+			{
+				stats = key_stats[j];
+				break;
+			}
+		}
+
+		if (stats == NULL)
+			continue;
+
+		/* the operators are strict, the nulls never match */
+		if (stats->nnulls == stats->nrows)
+		{
+			match = false;
+			break;
+		}
+
+		if (!stats->has_minmax)
+			continue;
+
+		cmp_min = DatumGetInt32(FunctionCall2Coll(&key->sk_func,
+												  key->sk_collation,
+												  stats->min,
+												  key->sk_argument));
+		cmp_max = DatumGetInt32(FunctionCall2Coll(&key->sk_func,
+												  key->sk_collation,
+												  stats->max,
+												  key->sk_argument));
+
+		switch (key->sk_strategy)
+		{
+			case BTLessStrategyNumber:
+				match = (cmp_min < 0);
+				break;
+			case BTLessEqualStrategyNumber:
+				match = (cmp_min <= 0);
+				break;
+			case BTEqualStrategyNumber:
+				match = (cmp_min <= 0 && cmp_max >= 0);
+				break;
+			case BTGreaterEqualStrategyNumber:
+				match = (cmp_max >= 0);
+				break;
+			case BTGreaterStrategyNumber:
+				match = (cmp_max > 0);
+				break;
+			default:
+				break;
+		}
+	}
+
+	MemoryContextSwitchTo(old_context);
+	MemoryContextReset(cvscan->keys_context);
+
+	if (!match)
+		cvscan->rg_pruned++;
+
+	return match;
+}
+
+/*
+ * Skip the rows of the vector slot which don't satisfy the scan keys, the
+ * rows skipped already (deleted or out of sample) are not compared.
+ */
+void
+cvtable_keys_filter(CVScanDesc cvscan, TupleTableSlot *slot)
+{
+	VectorTupleSlot *vslot = (VectorTupleSlot *) slot;
+	int i;
+	int j;
+
+	if (cvscan->nkeys == 0 || TTS_EMPTY(slot))
+		return;
+
+	for (i = 0; i < cvscan->nkeys; i++)
+	{
+		ScanKey key = &cvscan->keys[i];
+		vdatum *column = (vdatum *) slot->tts_values[key->sk_attno - 1];
+
+		for (j = 0; j < vslot->dim; j++)
+		{
+			int32 cmp;
+			bool keep;
+
+			if (vslot->skip[j])
+				continue;
+
+			if (VDATUM_ISNULL(column, j))
+			{
+				vslot->skip[j] = true;
+				continue;
+			}
+
+			cmp = DatumGetInt32(FunctionCall2Coll(&key->sk_func,
+												  key->sk_collation,
+												  VDATUM_DATUM(column, j),
+												  key->sk_argument));
+			switch (key->sk_strategy)
+			{
+				case BTLessStrategyNumber:
+					keep = (cmp < 0);
+					break;
+				case BTLessEqualStrategyNumber:
+					keep = (cmp <= 0);
+					break;
+				case BTEqualStrategyNumber:
+					keep = (cmp == 0);
+					break;
+				case BTGreaterEqualStrategyNumber:
+					keep = (cmp >= 0);
+					break;
+				default:
+					keep = (cmp > 0);
+					break;
+			}
+
+			if (!keep)
+				vslot->skip[j] = true;
+		}
+	}
+
+	VSlotClearNonSkip(vslot);
+}
+
+/*
+ * Check if (key1, key2) is in the sample, they are (rgid, rowid) of a row
+ * group or (blkno, offnum) of delta table if delta is true. The two are
+ * hashed with different salts, so a row group and the delta table block of
+ * the same number are sampled independently.
+ */
+bool
+cvtable_sample_keep(CVScanDesc cvscan, uint32 key1, uint32 key2, bool delta)
+{
+	uint32 hashinput[4];
+	uint32 hash;
+
+	if (cvscan->sample_method == GAMMA_SAMPLE_NONE)
+		return true;
+
+	hashinput[0] = key1;
+	hashinput[1] = key2;
+	hashinput[2] = cvscan->sample_seed;
+	hashinput[3] = delta ? GAMMA_SAMPLE_SALT_DELTA : GAMMA_SAMPLE_SALT_RG;
+
+	hash = DatumGetUInt32(hash_any((const unsigned char *) hashinput,
+								   (int) sizeof(hashinput)));
+
+	return hash < cvscan->sample_cutoff;
+}
+
+/*
+ * TABLESAMPLE BERNOULLI of the rows [offset, offset + count) of the current
+ * row group, the rows out of the sample are set in the skip array.
+ */
+void
+cvtable_sample_rows(CVScanDesc cvscan, uint32 offset, bool *skip, uint32 count)
+{
+	uint32 rgid = cvscan->rg->rgid;
+	uint32 i;
+
+	if (cvscan->sample_method != GAMMA_SAMPLE_BERNOULLI)
+		return;
+
+	for (i = 0; i < count; i++)
+	{
+		if (!skip[i] &&
+			!cvtable_sample_keep(cvscan, rgid, offset + i + 1, false))
+			skip[i] = true;
+	}
 }
 
 TM_Result
@@ -566,6 +1477,9 @@ cvtable_delete_tuple(Relation relation, ItemPointer tid,
 	Assert (list_lenght(index_oid_list) == 1);
 	cv_index_oid = list_nth_oid(index_oid_list, 0);
 
+	/* drop the cached delete bitmap before it is changed */
+	gamma_buffer_invalid_delbitmap(RelationGetRelid(relation), rgid);
+
 	delbitmap_tuple = cvtable_get_delbitmap_tuple(cv_rel, cv_index_oid,
 												  snapshot, rgid);
 
@@ -645,6 +1559,22 @@ cvtable_delete_tuple(Relation relation, ItemPointer tid,
 HeapTuple
 cvtable_get_delbitmap_tuple(Relation cvrel, Oid indexoid,
 											Snapshot snapshot, Oid rgid)
+{
+	/*
+	 * Here, "transaction MVCC snapshot" is used, which combines "command++"
+	 * to ensure the visibility of new tuples when updated multiple times
+	 * in same transaction.
+	 *
+	 * GAMMA_NOTE: The delete snapshot is different from the transaction snapshot?
+	 */
+	return cvtable_probe_delbitmap(cvrel, indexoid, GetTransactionSnapshot(),
+								   rgid);
+}
+
+/* fetch a copy of the delete bitmap tuple visible to the snapshot */
+static HeapTuple
+cvtable_probe_delbitmap(Relation cvrel, Oid indexoid, Snapshot snapshot,
+						Oid rgid)
 {
 	HeapTuple tuple ;
 	ScanKeyData scankey[2];
@@ -661,16 +1591,8 @@ cvtable_get_delbitmap_tuple(Relation cvrel, Oid indexoid,
 			BTEqualStrategyNumber, F_INT4EQ,
 			Int32GetDatum(GammaDelBitmapAttributeNumber));
 
-	/*
-	 * Here, "transaction MVCC snapshot" is used, which combines "command++"
-	 * to ensure the visibility of new tuples when updated multiple times
-	 * in same transaction.
-	 *
-	 * GAMMA_NOTE: The delete snapshot is different from the transaction snapshot?
-	 */
 	delbitmapscan = systable_beginscan(cvrel, indexoid, true,
-										   GetTransactionSnapshot(),
-										   2, scankey);
+										   snapshot, 2, scankey);
 
 	tuple = systable_getnext(delbitmapscan);
 	if (tuple != NULL)
@@ -712,7 +1634,8 @@ cvtable_get_rows(Relation cvrel)
 }
 
 void
-cvtable_update_delete_bitmap(Relation relation, Snapshot snapshot, uint32 rgid,
+cvtable_update_delete_bitmap(Relation relation, Oid base_relid,
+								Snapshot snapshot, uint32 rgid,
 								bool *vacuum_delbitmap, int count)
 {
 	HeapTuple delbitmap_tuple;
@@ -724,6 +1647,9 @@ cvtable_update_delete_bitmap(Relation relation, Snapshot snapshot, uint32 rgid,
 	Assert (list_lenght(index_oid_list) == 1);
 	rg_index_oid = list_nth_oid(index_oid_list, 0);
 
+	/* relation is the cv table, the cache is keyed by the base relation */
+	gamma_buffer_invalid_delbitmap(base_relid, rgid);
+
 	delbitmap_tuple = cvtable_get_delbitmap_tuple(relation, rg_index_oid,
 												  snapshot, rgid);
 
@@ -16,7 +16,9 @@
 #include "postgres.h"
 
 #include "access/heapam.h"
+#include "access/heaptoast.h"
 #include "access/toast_compression.h"
+#include "access/toast_internals.h"
 #include "access/xact.h"
 #include "access/xloginsert.h"
 #include "catalog/catalog.h"
@@ -37,14 +39,18 @@
 #include "pgstat.h"
 #include "nodes/makefuncs.h"
 #include "storage/bufmgr.h"
+#include "storage/lmgr.h"
 #include "storage/lock.h"
 #include "storage/predicate.h"
 #include "utils/builtins.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
 
 
+#include "storage/gamma_buffer.h"
 #include "storage/gamma_meta.h"
+#include "storage/gamma_stats.h"
 
 
 #define GAMMA_META_CV_TABLE_NAME "gammadb_cv_table_%u"
@@ -557,6 +563,48 @@ gamma_meta_next_rgid(Relation rel)
 	return nextval_internal(seq_oid, false);
 }
 
+#if PG_VERSION_NUM < 170000
+/*
+ * ANALYZE reads the row groups along with the blocks of delta table, and
+ * it reads no block at all if the delta table is empty. Keep an empty page
+ * in the delta table of a table which has row groups, see
+ * ctable_relation_size.
+ */
+void
+gamma_meta_keep_delta_block(Relation rel)
+{
+	Buffer buffer;
+
+	/* GAMMA NOTE: not RelationGetNumberOfBlocks, it is called by it */
+	if (table_block_relation_size(rel, MAIN_FORKNUM) > 0)
+		return;
+
+#if PG_VERSION_NUM >= 160000
+	buffer = ExtendBufferedRel(BMR_REL(rel), MAIN_FORKNUM, NULL, EB_LOCK_FIRST);
+#else
+	LockRelationForExtension(rel, ExclusiveLock);
+	buffer = ReadBufferExtended(rel, MAIN_FORKNUM, P_NEW, RBM_NORMAL, NULL);
+	UnlockRelationForExtension(rel, ExclusiveLock);
+	LockBuffer(buffer, BUFFER_LOCK_EXCLUSIVE);
+#endif
+
+	START_CRIT_SECTION();
+
+	PageInit(BufferGetPage(buffer), BufferGetPageSize(buffer), 0);
+	MarkBufferDirty(buffer);
+	if (RelationNeedsWAL(rel))
+		log_newpage_buffer(buffer, true);
+
+	END_CRIT_SECTION();
+
+	UnlockReleaseBuffer(buffer);
+}
+#endif
+
+/*
+ * The last value of the rgid sequence. The backends cache the rgids, so
+ * it may have been assigned to a row group, the scans read up to it.
+ */
 uint32
 gamma_meta_max_rgid(Relation rel)
 {
@@ -589,32 +637,114 @@ gamma_meta_rgid_sequence_oid(Relation rel)
 /*************************************************************************/
 /********************* Some operations for Gamma Tables ******************/
 
+/*
+ * Form the tuple of cv table for a column of the row group, the statistics
+ * are built in stats_context.
+ */
+static HeapTuple
+gamma_meta_form_rowgroup_cv(Relation rel, Relation cv_rel, RowGroup *rg,
+							int attno, uint16 *rowids, int32 nsample,
+							MemoryContext stats_context, bool compress)
+{
+	Form_pg_attribute attr = TupleDescAttr(RelationGetDescr(rel), attno);
+	bool *delbitmap = RGHasDelBitmap(rg) ? rg->delbitmap : NULL;
+	ColumnVector *cv = gamma_rg_get_cv(rg, attno);
+	GammaColumnStats *stats = NULL;
+	MemoryContext old_context;
+	HeapTuple tuple;
+
+	old_context = MemoryContextSwitchTo(stats_context);
+	if (!attr->attisdropped)
+		stats = gamma_stats_build(attr, cv, delbitmap, rowids, nsample);
+	MemoryContextSwitchTo(old_context);
+
+	tuple = gamma_meta_form_cv(cv_rel, rg->rgid, attno + 1, cv, attr, stats,
+							   compress);
+
+	MemoryContextReset(stats_context);
+
+	return tuple;
+}
+
 void
 gamma_meta_insert_rowgroup(Relation rel, RowGroup *rg)
 {
 	Relation cv_rel;
 	TupleDesc tupdesc = rel->rd_att;
-	ColumnVector *cv;
 	int attno;
 	Oid cv_rel_oid = gamma_meta_get_cv_table_rel(rel);
 	uint32 rgid = rg->rgid;
+	MemoryContext stats_context;
+	uint16 *rowids;
+	int32 nsample;
 
 	cv_rel = relation_open(cv_rel_oid, RowExclusiveLock);
 
+	/* all columns of the row group sample the same rows */
+	rowids = gamma_stats_sample_rowids(rg->dim, &nsample);
+	stats_context = AllocSetContextCreate(CurrentMemoryContext,
+										  "Gamma Meta Stats",
+										  ALLOCSET_DEFAULT_SIZES);
+
 	if (RGHasDelBitmap(rg))
+	{
+		gamma_buffer_invalid_delbitmap(RelationGetRelid(rel), rgid);
 		gamma_meta_insert_delbitmap(cv_rel, rgid, rg->delbitmap, rg->dim);
+	}
 
 	for (attno = 0; attno < tupdesc->natts; attno++)
 	{
-		cv = gamma_rg_get_cv(rg, attno);
-		gamma_meta_insert_cv(cv_rel, rgid, attno + 1, cv);
+		HeapTuple tuple;
+
+		tuple = gamma_meta_form_rowgroup_cv(rel, cv_rel, rg, attno, rowids,
+											nsample, stats_context, false);
+		CatalogTupleInsert(cv_rel, tuple);
+		heap_freetuple(tuple);
 	}
 
+	MemoryContextDelete(stats_context);
+	pfree(rowids);
+
 	relation_close(cv_rel, RowExclusiveLock);
 
 	return;
 }
 
+/*
+ * Form the tuples of cv table for the row group without inserting them, for
+ * the parallel COPY workers, which can not insert (see gamma_copy.c). The
+ * values are compressed here, the leader only moves them out of line.
+ * The row group has no delete bitmap.
+ */
+List *
+gamma_meta_form_rowgroup(Relation rel, Relation cv_rel, RowGroup *rg)
+{
+	TupleDesc tupdesc = rel->rd_att;
+	List *tuples = NIL;
+	int attno;
+	MemoryContext stats_context;
+	uint16 *rowids;
+	int32 nsample;
+
+	Assert(!RGHasDelBitmap(rg));
+
+	rowids = gamma_stats_sample_rowids(rg->dim, &nsample);
+	stats_context = AllocSetContextCreate(CurrentMemoryContext,
+										  "Gamma Meta Stats",
+										  ALLOCSET_DEFAULT_SIZES);
+
+	for (attno = 0; attno < tupdesc->natts; attno++)
+		tuples = lappend(tuples,
+						 gamma_meta_form_rowgroup_cv(rel, cv_rel, rg, attno,
+													 rowids, nsample,
+													 stats_context, true));
+
+	MemoryContextDelete(stats_context);
+	pfree(rowids);
+
+	return tuples;
+}
+
 void
 gamma_meta_insert_delbitmap(Relation cvrel, uint32 rgid, 
 											bool *delbitmap, int32 count)
@@ -650,9 +780,50 @@ gamma_meta_insert_delbitmap(Relation cvrel, uint32 rgid,
 
 }
 
+/*
+ * Compress the value the way TOAST does for the column of cv table, so
+ * that TOAST only has to move it out of line.
+ */
+static Datum
+gamma_meta_compress_datum(Relation cvrel, int attno, Datum value)
+{
+	Form_pg_attribute attr = TupleDescAttr(RelationGetDescr(cvrel), attno - 1);
+	Datum cvalue;
+
+	if (attr->attstorage != TYPSTORAGE_EXTENDED &&
+		attr->attstorage != TYPSTORAGE_MAIN)
+		return value;
+
+	if (VARSIZE_ANY(DatumGetPointer(value)) <= TOAST_TUPLE_TARGET)
+		return value;
+
+	cvalue = toast_compress_datum(value, attr->attcompression);
+	if (DatumGetPointer(cvalue) == NULL)
+		return value;
+
+	return cvalue;
+}
+
 void
-gamma_meta_insert_cv(Relation cvrel,
-					 uint32 rgid, int32 attno, ColumnVector *cv)
+gamma_meta_insert_cv(Relation cvrel, uint32 rgid, int32 attno,
+					 ColumnVector *cv, Form_pg_attribute attr,
+					 GammaColumnStats *stats)
+{
+	HeapTuple tuple;
+
+	tuple = gamma_meta_form_cv(cvrel, rgid, attno, cv, attr, stats, false);
+	CatalogTupleInsert(cvrel, tuple);
+	heap_freetuple(tuple);
+}
+
+/*
+ * Form the tuple of cv table for the column vector, the values and nulls
+ * are compressed if compress is true, otherwise by TOAST on insert.
+ */
+HeapTuple
+gamma_meta_form_cv(Relation cvrel, uint32 rgid, int32 attno,
+				   ColumnVector *cv, Form_pg_attribute attr,
+				   GammaColumnStats *stats, bool compress)
 {
 	HeapTuple tuple;
 	Datum values[Natts_gamma_rowgroup];
@@ -662,11 +833,21 @@ gamma_meta_insert_cv(Relation cvrel,
 	Datum datum_data;
 	text *text_nulls;
 	Datum datum_nulls;
+	StringInfoData option;
+	StringInfoData min;
+	StringInfoData max;
 	int i;
 	bool has_null = false;
 
 	gamma_cv_serialize(cv, data);
 
+	/* the statistics are kept in min/max and option columns */
+	initStringInfo(&option);
+	initStringInfo(&min);
+	initStringInfo(&max);
+	if (stats != NULL)
+		gamma_stats_serialize(attr, stats, &option, &min, &max);
+
 	text_data = cstring_to_text_with_len(data->data, data->len);
 	datum_data = PointerGetDatum(text_data);
 
@@ -691,8 +872,18 @@ gamma_meta_insert_cv(Relation cvrel,
 
 	values[Anum_gamma_rowgroup_rgid - 1] = ObjectIdGetDatum(rgid);
 	values[Anum_gamma_rowgroup_attno - 1] = Int32GetDatum(attno);
-	nulls[Anum_gamma_rowgroup_min - 1] = true;
-	nulls[Anum_gamma_rowgroup_max - 1] = true;
+	if (stats != NULL && stats->has_minmax)
+	{
+		values[Anum_gamma_rowgroup_min - 1] = PointerGetDatum(
+								cstring_to_text_with_len(min.data, min.len));
+		values[Anum_gamma_rowgroup_max - 1] = PointerGetDatum(
+								cstring_to_text_with_len(max.data, max.len));
+	}
+	else
+	{
+		nulls[Anum_gamma_rowgroup_min - 1] = true;
+		nulls[Anum_gamma_rowgroup_max - 1] = true;
+	}
 	values[Anum_gamma_rowgroup_count - 1] = Int32GetDatum(cv->dim);;
 	nulls[Anum_gamma_rowgroup_mode - 1] = true;
 	values[Anum_gamma_rowgroup_values - 1] = datum_data;
@@ -700,17 +891,30 @@ gamma_meta_insert_cv(Relation cvrel,
 		values[Anum_gamma_rowgroup_nulls - 1] = datum_nulls;
 	else
 		nulls[Anum_gamma_rowgroup_nulls - 1] = true;
-	nulls[Anum_gamma_rowgroup_option - 1] = true;
+	if (stats != NULL)
+		values[Anum_gamma_rowgroup_option - 1] = PointerGetDatum(
+								cstring_to_text_with_len(option.data, option.len));
+	else
+		nulls[Anum_gamma_rowgroup_option - 1] = true;
 
-	tuple = heap_form_tuple(RelationGetDescr(cvrel), values, nulls);
-	CatalogTupleInsert(cvrel, tuple);
+	if (compress)
+	{
+		values[Anum_gamma_rowgroup_values - 1] = gamma_meta_compress_datum(
+				cvrel, Anum_gamma_rowgroup_values, datum_data);
+		if (has_null)
+			values[Anum_gamma_rowgroup_nulls - 1] = gamma_meta_compress_datum(
+				cvrel, Anum_gamma_rowgroup_nulls, datum_nulls);
+	}
 
-	heap_freetuple(tuple);
+	tuple = heap_form_tuple(RelationGetDescr(cvrel), values, nulls);
 
 	pfree(data->data);
 	pfree(data);
+	pfree(option.data);
+	pfree(min.data);
+	pfree(max.data);
 
-	return;
+	return tuple;
 }
 
 /*
@@ -24,7 +24,9 @@
 #include "utils/snapmgr.h"
 #include "utils/memutils.h"
 
+#include "storage/gamma_buffer.h"
 #include "storage/gamma_cvtable_am.h"
+#include "storage/gamma_local_buffer.h"
 #include "storage/gamma_meta.h"
 #include "storage/gamma_rg.h"
 
@@ -33,6 +35,9 @@
 static Datum cache_values[GAMMA_COLUMN_VECTOR_CACHE][GAMMA_COLUMN_VECTOR_SIZE ];
 static bool cache_isnull[GAMMA_COLUMN_VECTOR_CACHE][GAMMA_COLUMN_VECTOR_SIZE];
 
+/* bumped when the cache arrays are filled for a row group */
+static uint64 cache_generation = 0;
+
 RowGroup*
 gamma_rg_build(Relation rel)
 {
@@ -48,7 +53,10 @@ gamma_rg_build_desc(TupleDesc tupdesc)
 
 	RowGroup *rg = (RowGroup *)palloc0(SizeOfRowGroup(attcount));
 
-	rg->delbitmap = (bool *) &cache_isnull[attcount][0];
+	rg->natts = attcount;
+
+	/* the delete bitmap is owned by the RowGroup, it is kept across loads */
+	rg->delbitmap = (bool *) palloc0(sizeof(bool) * GAMMA_COLUMN_VECTOR_SIZE);
 
 	for (i = 0; i < attcount; i++)
 	{
@@ -72,15 +80,54 @@ gamma_rg_build_desc(TupleDesc tupdesc)
 void
 gamma_rg_free(RowGroup *rg)
 {
+	int i;
+
+	for (i = 0; i < rg->natts; i++)
+	{
+		gamma_local_buffer_release_cv(&(rg->cvs[i]));
+		gamma_buffer_release_cv(&(rg->cvs[i]));
+	}
+
+	pfree(rg->delbitmap);
 	pfree(rg);
 }
 
+/*
+ * The values of a loaded RowGroup may be in the cache arrays, which are
+ * shared by all RowGroups. They are still there if the generation is not
+ * changed since the RowGroup was loaded.
+ */
+uint64
+gamma_rg_cache_generation(void)
+{
+	return cache_generation;
+}
+
 ColumnVector *
 gamma_rg_get_cv(RowGroup *rg, int idx)
 {
 	return &(rg->cvs[idx]);
 }
 
+/*
+ * Let the ColumnVector use its own cache arrays again, before it is filled
+ * with the data of the next row group.
+ */
+void
+gamma_rg_reset_cv(RowGroup *rg, int idx)
+{
+	ColumnVector *cv = &(rg->cvs[idx]);
+
+	gamma_local_buffer_release_cv(cv);
+	gamma_buffer_release_cv(cv);
+
+	cv->flags = 0;
+	cv->isnull = &cache_isnull[idx][0];
+	cv->values = &cache_values[idx][0];
+
+	cache_generation++;
+}
+
 void
 gamma_fill_rowgroup(Relation rel, HeapTupleData *pin_tuples, bool *delbitmap,
 					RowGroup *rg, int32 rowcount)
@@ -97,6 +144,8 @@ gamma_fill_rowgroup(Relation rel, HeapTupleData *pin_tuples, bool *delbitmap,
 	bool		slow;			/* can we use/set attcacheoff? */
 	ColumnVector *cv;
 
+	cache_generation++;
+
 	/* set delete bitmap */
 	if (delbitmap != NULL)
 	{
@@ -217,12 +266,20 @@ gamma_rg_check_visible(Relation rel, Snapshot snapshot, ItemPointer tid)
 		snapshot = GetTransactionSnapshot();
 	cvscan = cvtable_beginscan(rel, snapshot, 0, NULL, NULL, 0);
 
+	/* the row group is merged after the snapshot */
+	if (!cvtable_rg_visible(cvscan, rgid))
+	{
+		cvtable_endscan(cvscan);
+		return false;
+	}
+
 	cvtable_load_delbitmap(cvscan, rgid);
 
-	if (cvscan->rg->delbitmap == NULL)
+	/* rowid start with 1 */
+	if (!RGHasDelBitmap(cvscan->rg))
 		result = true;
 	else
-		result = !cvscan->rg->delbitmap[rowid];
+		result = !cvscan->rg->delbitmap[rowid - 1];
 
 	cvtable_endscan(cvscan);
 
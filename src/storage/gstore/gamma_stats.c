@@ -0,0 +1,907 @@
+/*
+ * Copyright (c) 2024 Gamma Data, Inc. <jackey@gammadb.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "postgres.h"
+
+#if PG_VERSION_NUM >= 160000
+#include "varatt.h"
+#endif
+
+#include "access/detoast.h"
+#include "access/genam.h"
+#include "access/htup_details.h"
+#include "access/stratnum.h"
+#include "access/table.h"
+#include "common/pg_prng.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/fmgroids.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/rls.h"
+#include "utils/snapmgr.h"
+#include "utils/typcache.h"
+
+#include "storage/ctable_am.h"
+#include "storage/gamma_buffer.h"
+#include "storage/gamma_meta.h"
+#include "storage/gamma_stats.h"
+
+PG_FUNCTION_INFO_V1(gamma_column_stats);
+
+/*
+ * The statistics of a column vector are stored in the row of cv table:
+ * min/max in the min/max columns, the others in the option column.
+ */
+#define GAMMA_STATS_VERSION		(1)
+
+typedef struct GammaStatsHeader
+{
+	uint32 version;
+	int32 nrows;
+	int32 nnulls;
+	int32 nsample;
+	uint8 hll_bwidth;			/* 0 if there is no HyperLogLog */
+} GammaStatsHeader;
+
+/* backend-local cache of the merged statistics for planner */
+typedef struct GammaStatsCacheKey
+{
+	Oid relid;
+	AttrNumber attnum;
+} GammaStatsCacheKey;
+
+typedef struct GammaStatsCacheEntry
+{
+	GammaStatsCacheKey key;
+	uint32 max_rgid;			/* the row groups are changed if it changes */
+	uint64 delbitmap_gen;		/* the rows are deleted if it changes */
+	bool valid;
+	double stadistinct;
+	double nullfrac;
+} GammaStatsCacheEntry;
+
+static HTAB *gamma_stats_cache = NULL;
+
+static void gamma_stats_relcache_callback(Datum arg, Oid relid);
+
+static inline Datum
+gamma_stats_detoast(Form_pg_attribute attr, Datum value)
+{
+	if (attr->attlen == -1 && VARATT_IS_EXTENDED(DatumGetPointer(value)))
+		return PointerGetDatum(detoast_attr(
+								(struct varlena *) DatumGetPointer(value)));
+
+	return value;
+}
+
+static inline int32
+gamma_stats_compare(TypeCacheEntry *typentry, Oid collation,
+					Datum value1, Datum value2)
+{
+	return DatumGetInt32(FunctionCall2Coll(&typentry->cmp_proc_finfo,
+										   collation, value1, value2));
+}
+
+/*
+ * Choose the sample rows of a row group. Each row is kept with the same
+ * probability, then the samples of all row groups are a uniform sample of
+ * the table, and a row group of rowcount rows has about
+ * GAMMA_STATS_SAMPLE_ROWS * rowcount / GAMMA_COLUMN_VECTOR_SIZE samples.
+ */
+uint16 *
+gamma_stats_sample_rowids(int32 rowcount, int32 *nsample)
+{
+	uint16 *rowids = (uint16 *) palloc(sizeof(uint16) * Max(rowcount, 1));
+	int32 count = 0;
+	int32 row;
+
+	for (row = 0; row < rowcount; row++)
+	{
+		if (pg_prng_double(&pg_global_prng_state) < GAMMA_STATS_SAMPLE_RATE)
+			rowids[count++] = (uint16) row;
+	}
+
+	*nsample = count;
+	return rowids;
+}
+
+/*
+ * Build the statistics of a column vector, the deleted rows are not counted.
+ * The ndistinct sketch needs the hash function of the type and min/max need
+ * the btree comparison function, they are skipped if the type has none.
+ */
+GammaColumnStats *
+gamma_stats_build(Form_pg_attribute attr, ColumnVector *cv, bool *delbitmap,
+				  uint16 *rowids, int32 nsample)
+{
+	GammaColumnStats *stats;
+	TypeCacheEntry *typentry;
+	MemoryContext row_context;
+	MemoryContext old_context;
+	Oid collation = attr->attcollation;
+	bool has_cmp;
+	bool has_hash;
+	bool nonnull = CVIsNonNull(cv);
+	Datum min = (Datum) 0;
+	Datum max = (Datum) 0;
+	int32 row;
+	int32 i;
+
+	stats = (GammaColumnStats *) palloc0(sizeof(GammaColumnStats));
+
+	typentry = lookup_type_cache(attr->atttypid,
+								 TYPECACHE_CMP_PROC_FINFO |
+								 TYPECACHE_HASH_PROC_FINFO);
+	has_cmp = OidIsValid(typentry->cmp_proc_finfo.fn_oid);
+	has_hash = OidIsValid(typentry->hash_proc_finfo.fn_oid);
+
+	if (has_hash)
+	{
+		initHyperLogLog(&stats->hll, GAMMA_STATS_HLL_BWIDTH);
+		stats->has_hll = true;
+	}
+
+	/* the functions may detoast the values, free them row by row */
+	row_context = AllocSetContextCreate(CurrentMemoryContext,
+										"Gamma Stats Row",
+										ALLOCSET_SMALL_SIZES);
+
+	for (row = 0; row < cv->dim; row++)
+	{
+		Datum value;
+
+		if (delbitmap != NULL && delbitmap[row])
+			continue;
+
+		stats->nrows++;
+
+		if (!nonnull && cv->isnull[row])
+		{
+			stats->nnulls++;
+			continue;
+		}
+
+		value = cv->values[row];
+
+		old_context = MemoryContextSwitchTo(row_context);
+
+		if (has_hash)
+		{
+			uint32 hash = DatumGetUInt32(FunctionCall1Coll(
+											&typentry->hash_proc_finfo,
+											collation, value));
+			addHyperLogLog(&stats->hll, hash);
+		}
+
+		if (has_cmp)
+		{
+			if (!stats->has_minmax)
+			{
+				min = max = value;
+				stats->has_minmax = true;
+			}
+			else if (gamma_stats_compare(typentry, collation, value, min) < 0)
+				min = value;
+			else if (gamma_stats_compare(typentry, collation, value, max) > 0)
+				max = value;
+		}
+
+		MemoryContextSwitchTo(old_context);
+		MemoryContextReset(row_context);
+	}
+
+	MemoryContextDelete(row_context);
+
+	if (stats->has_minmax)
+	{
+		stats->min = datumCopy(gamma_stats_detoast(attr, min),
+							   attr->attbyval, attr->attlen);
+		stats->max = datumCopy(gamma_stats_detoast(attr, max),
+							   attr->attbyval, attr->attlen);
+	}
+
+	if (nsample <= 0)
+		return stats;
+
+	stats->sample_rowids = (uint16 *) palloc(sizeof(uint16) * nsample);
+	stats->sample_values = (Datum *) palloc(sizeof(Datum) * nsample);
+	stats->sample_isnull = (bool *) palloc(sizeof(bool) * nsample);
+
+	for (i = 0; i < nsample; i++)
+	{
+		uint16 rowid = rowids[i];
+		bool isnull = (!nonnull && cv->isnull[rowid]);
+		Datum value = (Datum) 0;
+
+		if (!isnull)
+		{
+			value = gamma_stats_detoast(attr, cv->values[rowid]);
+
+			/* GAMMA NOTE: the same as ANALYZE, too wide values are ignored */
+			if (attr->attlen == -1 &&
+				VARSIZE_ANY(DatumGetPointer(value)) > GAMMA_STATS_SAMPLE_WIDTH)
+			{
+				stats->nsample = 0;
+				return stats;
+			}
+
+			value = datumCopy(value, attr->attbyval, attr->attlen);
+		}
+
+		stats->sample_rowids[i] = rowid;
+		stats->sample_values[i] = value;
+		stats->sample_isnull[i] = isnull;
+	}
+
+	stats->nsample = nsample;
+
+	return stats;
+}
+
+static void
+gamma_stats_serialize_datum(Form_pg_attribute attr, Datum value, bool isnull,
+							StringInfo buf)
+{
+	Size size = datumEstimateSpace(value, isnull, attr->attbyval, attr->attlen);
+	char *start;
+
+	enlargeStringInfo(buf, size);
+	start = buf->data + buf->len;
+	datumSerialize(value, isnull, attr->attbyval, attr->attlen, &start);
+	buf->len += size;
+	buf->data[buf->len] = '\0';
+}
+
+void
+gamma_stats_serialize(Form_pg_attribute attr, GammaColumnStats *stats,
+					  StringInfo option, StringInfo min, StringInfo max)
+{
+	GammaStatsHeader header;
+	int32 i;
+
+	memset(&header, 0, sizeof(header));
+	header.version = GAMMA_STATS_VERSION;
+	header.nrows = (int32) stats->nrows;
+	header.nnulls = (int32) stats->nnulls;
+	header.nsample = stats->nsample;
+	header.hll_bwidth = stats->has_hll ? stats->hll.registerWidth : 0;
+
+	appendBinaryStringInfo(option, (char *) &header, sizeof(header));
+
+	if (stats->has_hll)
+		appendBinaryStringInfo(option, (char *) stats->hll.hashesArr,
+							   stats->hll.nRegisters);
+
+	if (stats->nsample > 0)
+	{
+		appendBinaryStringInfo(option, (char *) stats->sample_rowids,
+							   sizeof(uint16) * stats->nsample);
+
+		for (i = 0; i < stats->nsample; i++)
+			gamma_stats_serialize_datum(attr, stats->sample_values[i],
+										stats->sample_isnull[i], option);
+	}
+
+	if (stats->has_minmax)
+	{
+		gamma_stats_serialize_datum(attr, stats->min, false, min);
+		gamma_stats_serialize_datum(attr, stats->max, false, max);
+	}
+}
+
+/*
+ * Restore the statistics from the cv table, return NULL if the row group
+ * was written without statistics. The sample is restored if it is wanted.
+ */
+GammaColumnStats *
+gamma_stats_deserialize(Form_pg_attribute attr, char *option, Size option_len,
+						char *min, char *max, bool sample)
+{
+	GammaColumnStats *stats;
+	GammaStatsHeader header;
+	char *ptr = option;
+	char *end = option + option_len;
+	int32 i;
+
+	if (option == NULL || option_len < sizeof(header))
+		return NULL;
+
+	memcpy(&header, ptr, sizeof(header));
+	ptr += sizeof(header);
+
+	if (header.version != GAMMA_STATS_VERSION)
+		return NULL;
+
+	stats = (GammaColumnStats *) palloc0(sizeof(GammaColumnStats));
+	stats->nrows = header.nrows;
+	stats->nnulls = header.nnulls;
+
+	if (header.hll_bwidth > 0)
+	{
+		initHyperLogLog(&stats->hll, header.hll_bwidth);
+		if (ptr + stats->hll.nRegisters > end)
+			elog(ERROR, "corrupted statistics of column vector");
+
+		memcpy(stats->hll.hashesArr, ptr, stats->hll.nRegisters);
+		ptr += stats->hll.nRegisters;
+		stats->has_hll = true;
+	}
+
+	if (sample && header.nsample > 0)
+	{
+		Size rowids_len = sizeof(uint16) * header.nsample;
+
+		if (ptr + rowids_len > end)
+			elog(ERROR, "corrupted statistics of column vector");
+
+		stats->sample_rowids = (uint16 *) palloc(rowids_len);
+		stats->sample_values = (Datum *) palloc(sizeof(Datum) * header.nsample);
+		stats->sample_isnull = (bool *) palloc(sizeof(bool) * header.nsample);
+
+		memcpy(stats->sample_rowids, ptr, rowids_len);
+		ptr += rowids_len;
+
+		for (i = 0; i < header.nsample; i++)
+			stats->sample_values[i] = datumRestore(&ptr,
+												   &stats->sample_isnull[i]);
+
+		if (ptr > end)
+			elog(ERROR, "corrupted statistics of column vector");
+
+		stats->nsample = header.nsample;
+	}
+
+	if (min != NULL && max != NULL)
+	{
+		bool isnull;
+
+		stats->min = datumRestore(&min, &isnull);
+		stats->max = datumRestore(&max, &isnull);
+		stats->has_minmax = true;
+	}
+
+	return stats;
+}
+
+/*
+ * Merge the statistics of src into dst, the samples are not merged, they
+ * are read by row group.
+ */
+void
+gamma_stats_merge(Form_pg_attribute attr, GammaColumnStats *dst,
+				  GammaColumnStats *src)
+{
+	dst->nrows += src->nrows;
+	dst->nnulls += src->nnulls;
+
+	if (src->has_hll)
+	{
+		Size i;
+
+		if (!dst->has_hll)
+		{
+			initHyperLogLog(&dst->hll, src->hll.registerWidth);
+			dst->has_hll = true;
+		}
+
+		/* the register keeps the max rank of the hashes */
+		if (dst->hll.nRegisters == src->hll.nRegisters)
+		{
+			for (i = 0; i < dst->hll.nRegisters; i++)
+				dst->hll.hashesArr[i] = Max(dst->hll.hashesArr[i],
+											src->hll.hashesArr[i]);
+		}
+	}
+
+	if (src->has_minmax)
+	{
+		TypeCacheEntry *typentry = lookup_type_cache(attr->atttypid,
+												TYPECACHE_CMP_PROC_FINFO);
+		Oid collation = attr->attcollation;
+
+		if (!dst->has_minmax)
+		{
+			dst->min = datumCopy(src->min, attr->attbyval, attr->attlen);
+			dst->max = datumCopy(src->max, attr->attbyval, attr->attlen);
+			dst->has_minmax = true;
+		}
+		else if (OidIsValid(typentry->cmp_proc_finfo.fn_oid))
+		{
+			if (gamma_stats_compare(typentry, collation, src->min, dst->min) < 0)
+				dst->min = datumCopy(src->min, attr->attbyval, attr->attlen);
+			if (gamma_stats_compare(typentry, collation, src->max, dst->max) > 0)
+				dst->max = datumCopy(src->max, attr->attbyval, attr->attlen);
+		}
+	}
+}
+
+double
+gamma_stats_ndistinct(GammaColumnStats *stats)
+{
+	double ndistinct;
+
+	if (!stats->has_hll)
+		return 0;
+
+	ndistinct = estimateHyperLogLog(&stats->hll);
+
+	/* never more than the non-null rows */
+	return Min(ndistinct, (double) (stats->nrows - stats->nnulls));
+}
+
+static GammaColumnStats *
+gamma_stats_from_tuple(Relation cvrel, HeapTuple tuple, Form_pg_attribute attr,
+					   bool sample)
+{
+	TupleDesc cv_desc = RelationGetDescr(cvrel);
+	Datum datum;
+	bool isnull;
+	text *option;
+	text *min = NULL;
+	text *max = NULL;
+
+	datum = heap_getattr(tuple, Anum_gamma_rowgroup_option, cv_desc, &isnull);
+	if (isnull)
+		return NULL;
+
+	option = DatumGetTextPP(datum);
+
+	datum = heap_getattr(tuple, Anum_gamma_rowgroup_min, cv_desc, &isnull);
+	if (!isnull)
+		min = DatumGetTextPP(datum);
+
+	datum = heap_getattr(tuple, Anum_gamma_rowgroup_max, cv_desc, &isnull);
+	if (!isnull)
+		max = DatumGetTextPP(datum);
+
+	return gamma_stats_deserialize(attr, VARDATA_ANY(option),
+								   VARSIZE_ANY_EXHDR(option),
+								   min != NULL ? VARDATA_ANY(min) : NULL,
+								   max != NULL ? VARDATA_ANY(max) : NULL,
+								   sample);
+}
+
+/* fetch the statistics (with sample) of a column vector */
+GammaColumnStats *
+gamma_stats_fetch(Relation cvrel, Oid indexoid, Snapshot snapshot,
+				  uint32 rgid, Form_pg_attribute attr)
+{
+	GammaColumnStats *stats = NULL;
+	ScanKeyData scankey[2];
+	SysScanDesc scan;
+	HeapTuple tuple;
+
+	ScanKeyInit(&scankey[0],
+				(AttrNumber) 1,
+				BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(rgid));
+
+	ScanKeyInit(&scankey[1],
+				(AttrNumber) 2,
+				BTEqualStrategyNumber, F_INT4EQ,
+				Int32GetDatum(attr->attnum));
+
+	scan = systable_beginscan(cvrel, indexoid, true, snapshot, 2, scankey);
+
+	tuple = systable_getnext(scan);
+	if (tuple != NULL)
+		stats = gamma_stats_from_tuple(cvrel, tuple, attr, true);
+
+	systable_endscan(scan);
+
+	return stats;
+}
+
+/*
+ * Only the row counts and min/max, the HyperLogLog and the sample are not
+ * restored. The header is the first bytes of the option, only its slice
+ * is detoasted.
+ */
+static GammaColumnStats *
+gamma_stats_minmax_from_tuple(Relation cvrel, HeapTuple tuple)
+{
+	TupleDesc cv_desc = RelationGetDescr(cvrel);
+	GammaColumnStats *stats;
+	GammaStatsHeader header;
+	Datum datum;
+	bool isnull;
+	text *option;
+	text *min;
+	text *max;
+
+	datum = heap_getattr(tuple, Anum_gamma_rowgroup_option, cv_desc, &isnull);
+	if (isnull)
+		return NULL;
+
+	option = DatumGetTextPSlice(datum, 0, sizeof(GammaStatsHeader));
+	if (VARSIZE_ANY_EXHDR(option) < sizeof(GammaStatsHeader))
+		return NULL;
+
+	memcpy(&header, VARDATA_ANY(option), sizeof(GammaStatsHeader));
+	if (header.version != GAMMA_STATS_VERSION)
+		return NULL;
+
+	stats = (GammaColumnStats *) palloc0(sizeof(GammaColumnStats));
+	stats->nrows = header.nrows;
+	stats->nnulls = header.nnulls;
+
+	datum = heap_getattr(tuple, Anum_gamma_rowgroup_min, cv_desc, &isnull);
+	if (isnull)
+		return stats;
+	min = DatumGetTextPP(datum);
+
+	datum = heap_getattr(tuple, Anum_gamma_rowgroup_max, cv_desc, &isnull);
+	if (isnull)
+		return stats;
+	max = DatumGetTextPP(datum);
+
+	{
+		char *min_ptr = VARDATA_ANY(min);
+		char *max_ptr = VARDATA_ANY(max);
+
+		stats->min = datumRestore(&min_ptr, &isnull);
+		stats->max = datumRestore(&max_ptr, &isnull);
+		stats->has_minmax = true;
+	}
+
+	return stats;
+}
+
+/*
+ * Fetch the row counts and min/max of the columns attnos (sorted) of a row
+ * group with one probe of the cv index. stats[i] is NULL if the column
+ * vector of attnos[i] has no statistics.
+ */
+void
+gamma_stats_fetch_minmax(Relation cvrel, Oid indexoid, Snapshot snapshot,
+						 uint32 rgid, AttrNumber *attnos, int natts,
+						 GammaColumnStats **stats)
+{
+	TupleDesc cv_desc = RelationGetDescr(cvrel);
+	ScanKeyData scankey[3];
+	SysScanDesc scan;
+	HeapTuple tuple;
+
+	memset(stats, 0, sizeof(GammaColumnStats *) * natts);
+
+	if (natts == 0)
+		return;
+
+	ScanKeyInit(&scankey[0],
+				(AttrNumber) 1,
+				BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(rgid));
+
+	ScanKeyInit(&scankey[1],
+				(AttrNumber) 2,
+				BTGreaterEqualStrategyNumber, F_INT4GE,
+				Int32GetDatum(attnos[0]));
+
+	ScanKeyInit(&scankey[2],
+				(AttrNumber) 2,
+				BTLessEqualStrategyNumber, F_INT4LE,
+				Int32GetDatum(attnos[natts - 1]));
+
+	scan = systable_beginscan(cvrel, indexoid, true, snapshot, 3, scankey);
+
+	while ((tuple = systable_getnext(scan)) != NULL)
+	{
+		bool isnull;
+		int32 attno;
+		int i;
+
+		attno = DatumGetInt32(heap_getattr(tuple, Anum_gamma_rowgroup_attno,
+										   cv_desc, &isnull));
+
+		for (i = 0; i < natts; i++)
+		{
+			if (attnos[i] == attno)
+			{
+				stats[i] = gamma_stats_minmax_from_tuple(cvrel, tuple);
+				break;
+			}
+		}
+	}
+
+	systable_endscan(scan);
+}
+
+/*
+ * Merge the statistics of all row groups of a column into merged, which is
+ * allocated in the current memory context. Return false if some row groups
+ * have no statistics. The (rgid, attno) index is scanned, so only the cv
+ * table rows of the column are fetched.
+ */
+static bool
+gamma_stats_merge_column(Relation cvrel, Form_pg_attribute attr,
+						 GammaColumnStats *merged, int64 *nrowgroups)
+{
+	MemoryContext tmp_context;
+	MemoryContext old_context;
+	ScanKeyData scankey[1];
+	SysScanDesc scan;
+	HeapTuple tuple;
+	List *index_oid_list;
+	Oid cv_index_oid;
+	bool complete = true;
+
+	memset(merged, 0, sizeof(GammaColumnStats));
+	*nrowgroups = 0;
+
+	tmp_context = AllocSetContextCreate(CurrentMemoryContext,
+										"Gamma Stats Merge",
+										ALLOCSET_DEFAULT_SIZES);
+
+	ScanKeyInit(&scankey[0],
+				Anum_gamma_rowgroup_attno,
+				BTEqualStrategyNumber, F_INT4EQ,
+				Int32GetDatum(attr->attnum));
+
+	index_oid_list = RelationGetIndexList(cvrel);
+	Assert (list_length(index_oid_list) == 1);
+	cv_index_oid = list_nth_oid(index_oid_list, 0);
+
+	scan = systable_beginscan(cvrel, cv_index_oid, true,
+							  GetTransactionSnapshot(), 1, scankey);
+
+	while ((tuple = systable_getnext(scan)) != NULL)
+	{
+		GammaColumnStats *stats;
+
+		old_context = MemoryContextSwitchTo(tmp_context);
+		stats = gamma_stats_from_tuple(cvrel, tuple, attr, false);
+		MemoryContextSwitchTo(old_context);
+
+		(*nrowgroups)++;
+
+		if (stats == NULL)
+			complete = false;
+		else
+			gamma_stats_merge(attr, merged, stats);
+
+		MemoryContextReset(tmp_context);
+	}
+
+	systable_endscan(scan);
+	MemoryContextDelete(tmp_context);
+
+	return complete;
+}
+
+static void
+gamma_stats_relcache_callback(Datum arg, Oid relid)
+{
+	HASH_SEQ_STATUS status;
+	GammaStatsCacheEntry *entry;
+
+	if (gamma_stats_cache == NULL)
+		return;
+
+	hash_seq_init(&status, gamma_stats_cache);
+	while ((entry = (GammaStatsCacheEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (relid == InvalidOid || entry->key.relid == relid)
+			hash_search(gamma_stats_cache, &entry->key, HASH_REMOVE, NULL);
+	}
+}
+
+/*
+ * The ndistinct (in the form of pg_statistic.stadistinct) and null fraction
+ * of a column, merged from the statistics of all row groups. They are cached
+ * until new row groups are written or rows are deleted. Return false if they
+ * are unknown.
+ */
+bool
+gamma_stats_rel_column(Relation rel, AttrNumber attnum,
+					   double *stadistinct, double *nullfrac)
+{
+	GammaStatsCacheKey key;
+	GammaStatsCacheEntry *entry;
+	GammaColumnStats merged;
+	MemoryContext tmp_context;
+	MemoryContext old_context;
+	Form_pg_attribute attr;
+	Relation cv_rel;
+	uint32 max_rgid;
+	uint64 delbitmap_gen;
+	int64 nrowgroups;
+	bool valid = false;
+
+	if (attnum <= 0 || attnum > RelationGetNumberOfAttributes(rel))
+		return false;
+
+	attr = TupleDescAttr(RelationGetDescr(rel), attnum - 1);
+	if (attr->attisdropped)
+		return false;
+
+	if (gamma_stats_cache == NULL)
+	{
+		HASHCTL ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(GammaStatsCacheKey);
+		ctl.entrysize = sizeof(GammaStatsCacheEntry);
+		ctl.hcxt = CacheMemoryContext;
+		gamma_stats_cache = hash_create("Gamma Stats Cache", 64, &ctl,
+										HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+		CacheRegisterRelcacheCallback(gamma_stats_relcache_callback,
+									  (Datum) 0);
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.relid = RelationGetRelid(rel);
+	key.attnum = attnum;
+
+	max_rgid = gamma_meta_max_rgid(rel);
+	delbitmap_gen = gamma_buffer_delbitmap_gen();
+
+	entry = (GammaStatsCacheEntry *) hash_search(gamma_stats_cache, &key,
+												 HASH_FIND, NULL);
+	if (entry != NULL && entry->max_rgid == max_rgid &&
+		entry->delbitmap_gen == delbitmap_gen)
+	{
+		*stadistinct = entry->stadistinct;
+		*nullfrac = entry->nullfrac;
+		return entry->valid;
+	}
+
+	*stadistinct = 0;
+	*nullfrac = 0;
+
+	tmp_context = AllocSetContextCreate(CurrentMemoryContext,
+										"Gamma Stats Column",
+										ALLOCSET_DEFAULT_SIZES);
+	old_context = MemoryContextSwitchTo(tmp_context);
+
+	cv_rel = table_open(gamma_meta_get_cv_table_rel(rel), AccessShareLock);
+
+	if (gamma_stats_merge_column(cv_rel, attr, &merged, &nrowgroups) &&
+		nrowgroups > 0 && merged.nrows > 0 && merged.has_hll)
+	{
+		double ndistinct = gamma_stats_ndistinct(&merged);
+
+		/* the same as ANALYZE, scale with the table if there are many */
+		if (ndistinct > 0.1 * merged.nrows)
+			*stadistinct = -(ndistinct / merged.nrows);
+		else
+			*stadistinct = ndistinct;
+
+		*nullfrac = (double) merged.nnulls / merged.nrows;
+		valid = true;
+	}
+
+	table_close(cv_rel, AccessShareLock);
+
+	MemoryContextSwitchTo(old_context);
+	MemoryContextDelete(tmp_context);
+
+	/* the invalidation may have removed the entry, enter it at last */
+	entry = (GammaStatsCacheEntry *) hash_search(gamma_stats_cache, &key,
+												 HASH_ENTER, NULL);
+	entry->max_rgid = max_rgid;
+	entry->delbitmap_gen = delbitmap_gen;
+	entry->valid = valid;
+	entry->stadistinct = *stadistinct;
+	entry->nullfrac = *nullfrac;
+
+	return valid;
+}
+
+/*
+ * gamma_column_stats(rel regclass)
+ *
+ * Return the statistics of each column merged from its row groups. As
+ * pg_stats, only the columns the user can read are returned, and nothing if
+ * row level security is active for the table.
+ */
+#define GAMMA_COLUMN_STATS_COLS 8
+
+Datum
+gamma_column_stats(PG_FUNCTION_ARGS)
+{
+	Oid relid = PG_GETARG_OID(0);
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Relation rel;
+	Relation cv_rel;
+	TupleDesc desc;
+	bool table_acl_ok;
+	int i;
+
+	InitMaterializedSRF(fcinfo, 0);
+
+	rel = table_open(relid, AccessShareLock);
+	if (rel->rd_tableam != ctable_tableam_routine())
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a gamma table",
+						RelationGetRelationName(rel))));
+
+	if (check_enable_rls(relid, InvalidOid, true) == RLS_ENABLED)
+	{
+		table_close(rel, AccessShareLock);
+		return (Datum) 0;
+	}
+
+	table_acl_ok = (pg_class_aclcheck(relid, GetUserId(),
+									  ACL_SELECT) == ACLCHECK_OK);
+
+	cv_rel = table_open(gamma_meta_get_cv_table_rel(rel), AccessShareLock);
+	desc = RelationGetDescr(rel);
+
+	for (i = 0; i < desc->natts; i++)
+	{
+		Form_pg_attribute attr = TupleDescAttr(desc, i);
+		Datum values[GAMMA_COLUMN_STATS_COLS];
+		bool nulls[GAMMA_COLUMN_STATS_COLS];
+		GammaColumnStats merged;
+		int64 nrowgroups;
+		bool complete;
+
+		if (attr->attisdropped)
+			continue;
+
+		if (!table_acl_ok &&
+			pg_attribute_aclcheck(relid, attr->attnum, GetUserId(),
+								  ACL_SELECT) != ACLCHECK_OK)
+			continue;
+
+		complete = gamma_stats_merge_column(cv_rel, attr, &merged, &nrowgroups);
+
+		memset(nulls, false, sizeof(nulls));
+
+		values[0] = Int16GetDatum(attr->attnum);
+		values[1] = Int64GetDatum(nrowgroups);
+		values[2] = BoolGetDatum(complete);
+		values[3] = Int64GetDatum(merged.nrows);
+		values[4] = Int64GetDatum(merged.nnulls);
+
+		if (merged.has_hll)
+			values[5] = Float8GetDatum(gamma_stats_ndistinct(&merged));
+		else
+			nulls[5] = true;
+
+		if (merged.has_minmax)
+		{
+			Oid typoutput;
+			bool typisvarlena;
+
+			getTypeOutputInfo(attr->atttypid, &typoutput, &typisvarlena);
+			values[6] = CStringGetTextDatum(OidOutputFunctionCall(typoutput,
+																  merged.min));
+			values[7] = CStringGetTextDatum(OidOutputFunctionCall(typoutput,
+																  merged.max));
+		}
+		else
+		{
+			nulls[6] = true;
+			nulls[7] = true;
+		}
+
+		tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+	}
+
+	table_close(cv_rel, AccessShareLock);
+	table_close(rel, AccessShareLock);
+
+	return (Datum) 0;
+}
@@ -0,0 +1,31 @@
+# ALTER TABLE waiting for a parallel COPY
+#
+# The ALTER TABLE queued for the table waits for the leader of COPY, the
+# workers of COPY take their locks of the table in the lock group of the
+# leader, not behind the ALTER TABLE.
+
+setup
+{
+	CREATE EXTENSION IF NOT EXISTS gammadb;
+	CREATE TABLE copy_t (a int, b text) USING gamma;
+	COPY (SELECT i, 'r' || i FROM generate_series(1, 122880) i)
+		TO '/tmp/gammadb_copy_parallel_lock.data';
+}
+
+teardown
+{
+	DROP TABLE copy_t;
+}
+
+session s1
+setup			{ SET gammadb_copy_parallel_workers = 2; }
+step s1_begin	{ BEGIN; }
+step s1_lock	{ LOCK TABLE copy_t IN ROW EXCLUSIVE MODE; }
+step s1_copy	{ COPY copy_t FROM '/tmp/gammadb_copy_parallel_lock.data'; }
+step s1_commit	{ COMMIT; }
+
+session s2
+step s2_alter	{ ALTER TABLE copy_t ADD COLUMN c int; }
+step s2_select	{ SELECT count(*) AS total_rows, sum(a) AS sum_of_column_a FROM copy_t WHERE c IS NULL; }
+
+permutation s1_begin s1_lock s2_alter s1_copy s1_commit s2_select
@@ -0,0 +1,35 @@
+# UPDATE and DELETE racing with the merge of the delta table
+#
+# The merge deletes the rows moved into row groups like a cross-partition
+# UPDATE, the writers waiting for them fail with a serialization error.
+
+setup
+{
+	CREATE EXTENSION IF NOT EXISTS gammadb;
+	CREATE TABLE merge_t (a int, b int) USING gamma;
+	SET gammadb_insert_rowgroup_threshold = -1;
+	INSERT INTO merge_t SELECT i, 0 FROM generate_series(1, 122880) i;
+}
+
+teardown
+{
+	DROP TABLE merge_t;
+}
+
+session s1
+step s1_begin	{ BEGIN; }
+step s1_merge	{ SELECT gamma_merge_delta('merge_t') AS rowgroups; }
+step s1_commit	{ COMMIT; }
+
+session s2
+setup			{ SET enable_gammadb = on; }
+step s2_update	{ UPDATE merge_t SET b = 1 WHERE a = 1; }
+step s2_delete	{ DELETE FROM merge_t WHERE a = 1; }
+step s2_select	{ SELECT count(*) AS total_rows, sum(b) AS updated_rows FROM merge_t; }
+
+# the writers waiting for the merge fail
+permutation s1_begin s1_merge s2_update s1_commit s2_select
+permutation s1_begin s1_merge s2_delete s1_commit s2_select
+
+# the rows in row groups are updated after the merge
+permutation s1_begin s1_merge s1_commit s2_update s2_select
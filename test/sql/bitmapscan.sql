@@ -0,0 +1,34 @@
+create extension gammadb;
+
+--
+-- vectorized bitmap scan of row groups
+--
+create table bm_t (a int, b int) using gamma;
+set gammadb_insert_rowgroup_threshold = 0;
+insert into bm_t select i, i % 1000 from generate_series(1, 100000) i;
+reset gammadb_insert_rowgroup_threshold;
+create index bm_t_a on bm_t (a);
+create index bm_t_b on bm_t (b);
+analyze bm_t;
+set enable_gammadb = on;
+set enable_seqscan = off;
+set enable_indexscan = off;
+set enable_indexonlyscan = off;
+select count(*), sum(a) from bm_t where a <= 50000;
+select count(*) from bm_t where a <= 20000 or b = 7;
+select count(*) from bm_t where a <= 50000 and b < 10;
+
+-- the row groups become lossy out of work_mem
+set work_mem = 64;
+select count(*), sum(a) from bm_t where a <= 50000;
+select count(*) from bm_t where a <= 20000 or b = 7;
+select count(*) from bm_t where a <= 50000 and b < 10;
+reset work_mem;
+
+reset enable_indexonlyscan;
+reset enable_indexscan;
+reset enable_seqscan;
+reset enable_gammadb;
+drop table bm_t;
+
+drop extension gammadb;
@@ -0,0 +1,36 @@
+create extension gammadb;
+
+--
+-- a hot column vector in the cold tier is promoted after the decoded tier
+-- of gamma buffer has been filled
+--
+alter system set gammadb_buffer_decoded_percent = 1;
+select pg_reload_conf();
+select pg_sleep(0.5);
+
+set gammadb_local_buffers = 0;
+set gammadb_insert_rowgroup_threshold = 0;
+set enable_gammadb = on;
+
+create table bp_big (a int, b text) using gamma;
+insert into bp_big select i, repeat('x', 20) from generate_series(1, 614400) i;
+create table bp_hot (a int, b text) using gamma;
+insert into bp_hot select i, repeat('x', 20) from generate_series(1, 61440) i;
+
+-- fill the decoded tier, the column vectors left are kept compressed
+select count(*), sum(length(b)) from bp_big;
+
+-- the first read does not evict the decoded entries
+select count(*), sum(length(b)) from bp_hot;
+select compressed from gamma_buffer_contents()
+  where relid = 'bp_hot'::regclass and attno = 2;
+
+-- the second read hits the cold tier and promotes it
+select count(*), sum(length(b)) from bp_hot;
+select compressed from gamma_buffer_contents()
+  where relid = 'bp_hot'::regclass and attno = 2;
+
+drop table bp_big;
+drop table bp_hot;
+alter system reset gammadb_buffer_decoded_percent;
+select pg_reload_conf();
@@ -0,0 +1,71 @@
+create extension gammadb;
+
+--
+-- CREATE TABLE AS writes row groups
+--
+create table bi_src (a int, b text);
+insert into bi_src select i, 'r' || i from generate_series(1, 1000) i;
+create table bi_ctas using gamma as select * from bi_src;
+select attnum, rowgroups, rows from gamma_column_stats('bi_ctas');
+select count(*), sum(a) from bi_ctas;
+
+--
+-- REFRESH MATERIALIZED VIEW swaps in a transient table, the rows are in
+-- the delta table and the old row groups are gone
+--
+create materialized view bi_mv using gamma as select * from bi_src;
+create index bi_mv_a on bi_mv (a);
+select attnum, rowgroups, rows from gamma_column_stats('bi_mv');
+insert into bi_src select i, 'r' || i from generate_series(1001, 1500) i;
+refresh materialized view bi_mv;
+select attnum, rowgroups, rows from gamma_column_stats('bi_mv');
+select count(*), sum(a) from bi_mv;
+select a, b from bi_mv where a in (1, 1000, 1500) order by a;
+
+--
+-- so does the table rewrite of ALTER TABLE
+--
+create table bi_t (a int, b text) using gamma;
+create index bi_t_a on bi_t (a);
+set gammadb_insert_rowgroup_threshold = 0;
+insert into bi_t select i, 'r' || i from generate_series(1, 1000) i;
+reset gammadb_insert_rowgroup_threshold;
+select attnum, rowgroups, rows from gamma_column_stats('bi_t');
+alter table bi_t alter column a type bigint;
+select attnum, rowgroups, rows from gamma_column_stats('bi_t');
+select count(*), sum(a), pg_typeof(max(a)) from bi_t;
+select a, b from bi_t where a in (1, 500, 1000) order by a;
+
+--
+-- the AFTER STATEMENT triggers see the rows of the statement, they are not
+-- collected into row groups
+--
+create table bi_trg (a int) using gamma;
+create function bi_trg_count() returns trigger language plpgsql as
+$$
+begin
+    raise notice 'bi_trg rows: %', (select count(*) from bi_trg);
+    return null;
+end;
+$$;
+create trigger bi_trg_after after insert on bi_trg
+    for each statement execute function bi_trg_count();
+set gammadb_insert_rowgroup_threshold = 0;
+insert into bi_trg select i from generate_series(1, 100) i;
+insert into bi_trg select i from generate_series(101, 200) i;
+reset gammadb_insert_rowgroup_threshold;
+copy bi_trg from stdin;
+201
+202
+203
+\.
+select attnum, rowgroups, rows from gamma_column_stats('bi_trg');
+
+drop table bi_src;
+drop table bi_ctas;
+drop materialized view bi_mv;
+drop table bi_t;
+drop table bi_trg;
+drop function bi_trg_count();
+
+drop extension gammadb;
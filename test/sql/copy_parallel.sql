@@ -0,0 +1,43 @@
+create extension gammadb;
+
+--
+-- the full row groups of COPY are built by the worker pool
+--
+create table cp_src (a int, b text, c numeric);
+insert into cp_src select i, case when i % 7 = 0 then null else 'r' || i end, i * 0.5
+    from generate_series(1, 200000) i;
+copy cp_src to '/tmp/gammadb_copy_parallel.data';
+
+create table cp_t (a int, b text, c numeric) using gamma;
+set gammadb_copy_parallel_workers = 2;
+copy cp_t from '/tmp/gammadb_copy_parallel.data';
+
+create table cp_s (a int, b text, c numeric) using gamma;
+set gammadb_copy_parallel_workers = 0;
+copy cp_s from '/tmp/gammadb_copy_parallel.data';
+reset gammadb_copy_parallel_workers;
+
+set enable_gammadb = on;
+select count(*), sum(a), count(b), sum(c) from cp_t;
+select count(*) from (select * from cp_src except all select * from cp_t) s;
+select count(*) from (select * from cp_t except all select * from cp_s) s;
+select a, b, c from cp_t where a in (1, 7, 61440, 61441, 200000) order by a;
+
+--
+-- the workers do not see the table created by the transaction, the leader
+-- builds the row groups
+--
+begin;
+create table cp_x (a int, b text, c numeric) using gamma;
+set local gammadb_copy_parallel_workers = 2;
+copy cp_x from '/tmp/gammadb_copy_parallel.data';
+select count(*), sum(a) from cp_x;
+commit;
+
+reset enable_gammadb;
+drop table cp_src;
+drop table cp_t;
+drop table cp_s;
+drop table cp_x;
+
+drop extension gammadb;
@@ -0,0 +1,40 @@
+create extension gammadb;
+
+--
+-- the row groups are skipped by the min/max of the pushed down quals
+--
+create table rp_t (a int, b text) using gamma;
+set gammadb_insert_rowgroup_threshold = 0;
+insert into rp_t select i, 'r' || i from generate_series(1, 100) i;
+insert into rp_t select i, 'r' || i from generate_series(101, 200) i;
+insert into rp_t select i, 'r' || i from generate_series(201, 300) i;
+reset gammadb_insert_rowgroup_threshold;
+set enable_gammadb = on;
+
+create function rp_pruned(query text) returns setof text
+language plpgsql as
+$$
+declare
+    ln text;
+begin
+    for ln in execute 'explain (analyze, costs off, timing off, summary off) ' || query
+    loop
+        if ln like '%Row Groups Pruned%' then
+            return next trim(ln);
+        end if;
+    end loop;
+end;
+$$;
+
+select count(*), min(a) from rp_t where a > 250;
+select rp_pruned('select count(*) from rp_t where a > 250');
+select count(*) from rp_t where a >= 150 and a <= 160;
+select rp_pruned('select count(*) from rp_t where a >= 150 and a <= 160');
+select count(*) from rp_t where a = 301;
+select rp_pruned('select count(*) from rp_t where a = 301');
+
+drop function rp_pruned(text);
+reset enable_gammadb;
+drop table rp_t;
+
+drop extension gammadb;
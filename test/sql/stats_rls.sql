@@ -0,0 +1,33 @@
+create extension gammadb;
+
+--
+-- the row group statistics are only visible as pg_stats
+--
+create table st_t (a int, b text, c int) using gamma;
+set gammadb_insert_rowgroup_threshold = 0;
+insert into st_t select i, 's' || i, case when i % 10 = 0 then null else i % 3 end
+  from generate_series(1, 100) i;
+reset gammadb_insert_rowgroup_threshold;
+select attnum, rowgroups, rows, nulls, min, max from gamma_column_stats('st_t');
+create role regress_gamma_stats;
+grant select (a, c) on st_t to regress_gamma_stats;
+
+-- only the columns which the user can read
+set role regress_gamma_stats;
+select attnum, rowgroups, rows, nulls, min, max from gamma_column_stats('st_t');
+reset role;
+
+-- nothing under row level security
+grant select on st_t to regress_gamma_stats;
+alter table st_t enable row level security;
+create policy st_p on st_t for select using (a <= 10);
+set role regress_gamma_stats;
+select attnum, rowgroups, rows, nulls, min, max from gamma_column_stats('st_t');
+select count(*) from st_t;
+select count(*) from st_t where b = 's50';
+reset role;
+
+drop table st_t;
+drop role regress_gamma_stats;
+
+drop extension gammadb;
@@ -0,0 +1,39 @@
+create extension gammadb;
+
+--
+-- TABLESAMPLE of a row group which has more rows than a heap block
+--
+create table ts_t (a int, b text) using gamma;
+set gammadb_insert_rowgroup_threshold = 0;
+insert into ts_t select i, 'r' || i from generate_series(1, 5000) i;
+reset gammadb_insert_rowgroup_threshold;
+insert into ts_t select i, 'd' || i from generate_series(5001, 5100) i;
+
+-- vectorized scan
+set enable_gammadb = on;
+select count(*) from ts_t tablesample system (100);
+select count(*) from ts_t tablesample bernoulli (100);
+select count(*), max(a) from ts_t tablesample bernoulli (100) where a <= 5000;
+select count(*) from ts_t tablesample bernoulli (0);
+select count(*) between 2000 and 3100 as sampled
+  from ts_t tablesample bernoulli (50) repeatable (1);
+select count(*) filter (where a <= 5000) between 2000 and 3100 as rowgroup,
+       count(*) filter (where a > 5000) between 20 and 80 as delta
+  from ts_t tablesample bernoulli (50) repeatable (7);
+
+-- row scan by the sampling method
+set enable_gammadb = off;
+select count(*) from ts_t tablesample system (100);
+select count(*) from ts_t tablesample bernoulli (100);
+select count(*), max(a) from ts_t tablesample bernoulli (100) where a <= 5000;
+select count(*) from ts_t tablesample bernoulli (0);
+select count(*) between 2000 and 3100 as sampled
+  from ts_t tablesample bernoulli (50) repeatable (1);
+select count(*) filter (where a <= 5000) between 2000 and 3100 as rowgroup,
+       count(*) filter (where a > 5000) between 20 and 80 as delta
+  from ts_t tablesample bernoulli (50) repeatable (7);
+reset enable_gammadb;
+
+drop table ts_t;
+
+drop extension gammadb;
@@ -0,0 +1,30 @@
+create extension gammadb;
+
+--
+-- TID range scans over row groups, the later row group has the lower block
+--
+create table tr_t (a int, b text) using gamma;
+set gammadb_insert_rowgroup_threshold = 0;
+insert into tr_t select i, 'r' || i from generate_series(1, 100) i;
+insert into tr_t select i, 'r' || i from generate_series(101, 200) i;
+reset gammadb_insert_rowgroup_threshold;
+insert into tr_t select i, 'd' || i from generate_series(201, 210) i;
+
+set enable_gammadb = on;
+select count(*) from tr_t where ctid >= (select ctid from tr_t where a = 151)
+  and ctid <= (select ctid from tr_t where a = 10);
+select count(*) from tr_t where ctid >= (select ctid from tr_t where a = 200);
+select count(*) from tr_t where ctid < (select ctid from tr_t where a = 101);
+select count(*) from tr_t where ctid > (select ctid from tr_t where a = 100);
+
+set enable_gammadb = off;
+select count(*) from tr_t where ctid >= (select ctid from tr_t where a = 151)
+  and ctid <= (select ctid from tr_t where a = 10);
+select count(*) from tr_t where ctid >= (select ctid from tr_t where a = 200);
+select count(*) from tr_t where ctid < (select ctid from tr_t where a = 101);
+select count(*) from tr_t where ctid > (select ctid from tr_t where a = 100);
+reset enable_gammadb;
+
+drop table tr_t;
+
+drop extension gammadb;